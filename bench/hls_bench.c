@@ -0,0 +1,381 @@
+/*
+ * Headless benchmark of the hls_player model: no GUI and no SDL, with a null
+ * frame sink (the colour conversion still runs, into a scratch buffer) and
+ * the null audio device of null_audio.c.
+ *
+ * usage: hls_bench [--realtime] [--seconds n] [--size WxH] [--converter name]
+ *                  [--format name] [--decode-threads n] [--convert-threads n]
+ *                  [--no-keep-alive] [--no-degrade] input
+ *
+ * input is a local HLS playlist, TS or MP4 file (or any URL FFmpeg opens).
+ * By default frames are presented as soon as they are decoded; --realtime
+ * paces them by their timestamps. --no-keep-alive opens a new connection
+ * for every playlist and segment request. --no-degrade keeps decoding in
+ * full when a --realtime run falls behind, for sizing hardware against the
+ * time the default run spends at each decoding level. A human-readable summary goes to
+ * stderr and one JSON object to stdout, for comparing builds.
+ */
+#include "model/decode_ladder.h"
+#include "model/hls_player.h"
+#include "model/http_pool.h"
+#include "null_audio.h"
+#include <libavutil/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+/* How often the run is polled for the end of the input */
+#define BENCH_POLL_MS 10
+
+/*
+ * Count every allocation in the process, FFmpeg's included, by interposing
+ * the allocator entry points over glibc's.
+ */
+#ifdef __GLIBC__
+#include <errno.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static uint64_t s_allocs;
+
+static void bench_count_alloc(void) {
+  __atomic_fetch_add(&s_allocs, 1, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size) {
+  bench_count_alloc();
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+  bench_count_alloc();
+  return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  bench_count_alloc();
+  return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+  bench_count_alloc();
+  return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  bench_count_alloc();
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+  bench_count_alloc();
+  void *ptr = __libc_memalign(alignment, size);
+  if (ptr == NULL) {
+    return ENOMEM;
+  }
+  *memptr = ptr;
+  return 0;
+}
+
+static int64_t bench_allocs(void) {
+  return (int64_t)__atomic_load_n(&s_allocs, __ATOMIC_RELAXED);
+}
+#else
+static int64_t bench_allocs(void) {
+  return -1;
+}
+#endif
+
+typedef struct _bench_options_t {
+  const char *input;
+  bool_t realtime;
+  double seconds;
+  int width;
+  int height;
+  hls_player_converter_t converter;
+  hls_player_pixel_format_t format;
+  uint32_t decode_threads;
+  uint32_t convert_threads;
+  bool_t no_keep_alive;
+  bool_t no_degrade;
+} bench_options_t;
+
+/* Null frame sink: one scratch buffer, grown to the largest frame seen */
+typedef struct _bench_sink_t {
+  uint8_t *data;
+  size_t size;
+  uint64_t frames;
+  uint64_t pixels;
+} bench_sink_t;
+
+static ret_t bench_acquire_frame(void *ctx, int width, int height, int format,
+                                 hls_player_frame_t *frame) {
+  bench_sink_t *sink = (bench_sink_t *)ctx;
+  uint32_t bpp =
+      format == HLS_PLAYER_PIXEL_RGB565 || format == HLS_PLAYER_PIXEL_BGR565 ? 2 : 4;
+  uint32_t chroma_w = (uint32_t)(width + 1) / 2;
+  uint32_t chroma_h = (uint32_t)(height + 1) / 2;
+  size_t luma = (size_t)width * height;
+  size_t size = format == HLS_PLAYER_PIXEL_YUV420P ? luma + 2 * chroma_w * chroma_h
+                                                   : luma * bpp;
+
+  if (size > sink->size) {
+    uint8_t *data = (uint8_t *)realloc(sink->data, size);
+    return_value_if_fail(data != NULL, RET_OOM);
+    sink->data = data;
+    sink->size = size;
+  }
+
+  frame->data = sink->data;
+  frame->line_length = (uint32_t)width * bpp;
+  if (format == HLS_PLAYER_PIXEL_YUV420P) {
+    frame->line_length = (uint32_t)width;
+    frame->chroma[0] = sink->data + luma;
+    frame->chroma[1] = frame->chroma[0] + chroma_w * chroma_h;
+    frame->chroma_line_length[0] = chroma_w;
+    frame->chroma_line_length[1] = chroma_w;
+  }
+  frame->width = width;
+  frame->height = height;
+  frame->format = format;
+  frame->handle = NULL;
+
+  return RET_OK;
+}
+
+static ret_t bench_release_frame(void *ctx, hls_player_frame_t *frame,
+                                 bool_t publish) {
+  bench_sink_t *sink = (bench_sink_t *)ctx;
+
+  if (publish) {
+    sink->frames++;
+    sink->pixels += (uint64_t)frame->width * frame->height;
+  }
+
+  return RET_OK;
+}
+
+static const char *const s_converters[] = {"auto",   "swscale", "scalar",
+                                           "sse2",   "avx2",    "neon"};
+
+/* In hls_player_pixel_format_t order */
+static const char *const s_formats[] = {"rgba", "bgra", "rgb565", "bgr565",
+                                        "yuv420p"};
+
+static int bench_parse_name(const char *name, const char *const *names,
+                            int nr) {
+  for (int i = 0; i < nr; i++) {
+    if (strcmp(name, names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static int bench_usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--realtime] [--seconds n] [--size WxH] [--converter "
+          "auto|swscale|scalar|sse2|avx2|neon]\n"
+          "       [--format rgba|bgra|rgb565|bgr565|yuv420p] [--decode-threads n]\n"
+          "       [--convert-threads n] [--no-keep-alive] [--no-degrade] input\n",
+          argv0);
+  return 1;
+}
+
+static int bench_parse(int argc, char *argv[], bench_options_t *opts) {
+  memset(opts, 0x00, sizeof(*opts));
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+    if (strcmp(arg, "--realtime") == 0) {
+      opts->realtime = TRUE;
+      continue;
+    } else if (strcmp(arg, "--no-keep-alive") == 0) {
+      opts->no_keep_alive = TRUE;
+      continue;
+    } else if (strcmp(arg, "--no-degrade") == 0) {
+      opts->no_degrade = TRUE;
+      continue;
+    } else if (arg[0] != '-') {
+      opts->input = arg;
+      continue;
+    } else if (value == NULL) {
+      return -1;
+    }
+
+    if (strcmp(arg, "--seconds") == 0) {
+      opts->seconds = atof(value);
+    } else if (strcmp(arg, "--size") == 0) {
+      if (sscanf(value, "%dx%d", &opts->width, &opts->height) != 2) {
+        return -1;
+      }
+    } else if (strcmp(arg, "--converter") == 0) {
+      int converter = bench_parse_name(value, s_converters, ARRAY_SIZE(s_converters));
+      if (converter < 0) {
+        return -1;
+      }
+      opts->converter = (hls_player_converter_t)converter;
+    } else if (strcmp(arg, "--format") == 0) {
+      int format = bench_parse_name(value, s_formats, ARRAY_SIZE(s_formats));
+      if (format < 0) {
+        return -1;
+      }
+      opts->format = (hls_player_pixel_format_t)format;
+    } else if (strcmp(arg, "--decode-threads") == 0) {
+      opts->decode_threads = (uint32_t)atoi(value);
+    } else if (strcmp(arg, "--convert-threads") == 0) {
+      opts->convert_threads = (uint32_t)atoi(value);
+    } else {
+      return -1;
+    }
+    i++;
+  }
+
+  return opts->input != NULL ? 0 : -1;
+}
+
+static double bench_seconds(struct timeval tv) {
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+  bench_options_t opts;
+  bench_sink_t sink;
+  hls_player_metrics_t m;
+  hls_player_stop_stats_t stop;
+  http_pool_stats_t http;
+  decode_ladder_stats_t decode;
+  struct rusage usage;
+  str_t json;
+
+  if (bench_parse(argc, argv, &opts) != 0) {
+    return bench_usage(argv[0]);
+  }
+
+  hls_player_t *player = hls_player_create();
+  if (player == NULL) {
+    fprintf(stderr, "could not create player\n");
+    return 1;
+  }
+
+  memset(&sink, 0x00, sizeof(sink));
+  null_audio_set_realtime(opts.realtime);
+  hls_player_set_free_run(player, !opts.realtime);
+  hls_player_set_frame_sink(player, bench_acquire_frame, bench_release_frame, &sink);
+  hls_player_set_output_size(player, opts.width, opts.height);
+  hls_player_set_output_format(player, opts.format);
+  if (hls_player_set_converter(player, opts.converter) != RET_OK) {
+    fprintf(stderr, "converter %s is not available\n", s_converters[opts.converter]);
+    hls_player_destroy(player);
+    return 1;
+  }
+  hls_player_set_decode_threads(player, opts.decode_threads,
+                                HLS_PLAYER_THREAD_FRAME | HLS_PLAYER_THREAD_SLICE);
+  hls_player_set_convert_threads(player, opts.convert_threads);
+  hls_player_set_keep_alive(player, !opts.no_keep_alive);
+  hls_player_set_auto_degrade(player, !opts.no_degrade);
+  hls_player_set_url(player, opts.input);
+
+  // Allocations per frame are counted from the first frame on, past start-up.
+  int64_t start = av_gettime_relative();
+  int64_t first_frame = 0;
+  int64_t allocs_start = 0;
+  uint64_t frames_start = 0;
+  hls_player_play(player);
+  while (hls_player_get_state(player) != PLAYER_STATE_STOPPED) {
+    int64_t now = av_gettime_relative();
+    if (opts.seconds > 0 && now - start >= opts.seconds * 1000000) {
+      break;
+    }
+    if (first_frame == 0) {
+      hls_player_get_metrics(player, &m);
+      if (m.frames_decoded > 0) {
+        first_frame = now;
+        frames_start = m.frames_decoded;
+        allocs_start = bench_allocs();
+      }
+    }
+    sleep_ms(BENCH_POLL_MS);
+  }
+  int64_t allocs_end = bench_allocs();
+  hls_player_get_metrics(player, &m);
+  double wall = (av_gettime_relative() - start) / 1e6;
+
+  str_init(&json, 2048);
+  hls_player_dump_metrics(player, &json);
+  hls_player_stop(player);
+  hls_player_get_stop_stats(player, &stop);
+  hls_player_get_http_stats(player, &http);
+  hls_player_get_decode_stats(player, &decode);
+  getrusage(RUSAGE_SELF, &usage);
+
+  double cpu_user = bench_seconds(usage.ru_utime);
+  double cpu_sys = bench_seconds(usage.ru_stime);
+  double decode_wall = first_frame > 0 ? wall - (first_frame - start) / 1e6 : 0;
+  uint64_t steady_frames = m.frames_decoded - frames_start;
+  double decode_fps = decode_wall > 0 ? steady_frames / decode_wall : 0;
+  const hls_player_stage_stats_t *convert = &m.stages[HLS_PLAYER_STAGE_CONVERT];
+  double convert_time = convert->avg * convert->count / 1000;
+  double convert_fps = convert_time > 0 ? convert->count / convert_time : 0;
+  double convert_mpix = convert_time > 0 ? sink.pixels / convert_time / 1e6 : 0;
+  double allocs_per_frame =
+      allocs_start >= 0 && steady_frames > 0
+          ? (double)(allocs_end - allocs_start) / steady_frames
+          : -1;
+
+  fprintf(stderr, "%s (%s, %s)\n", opts.input, opts.realtime ? "realtime" : "fast",
+          s_formats[opts.format]);
+  fprintf(stderr, "  wall %.2f s, cpu %.2f s user + %.2f s sys (%.0f%%)\n", wall,
+          cpu_user, cpu_sys, wall > 0 ? (cpu_user + cpu_sys) / wall * 100 : 0);
+  fprintf(stderr, "  frames %llu decoded, %llu shown, %llu dropped\n",
+          (unsigned long long)m.frames_decoded,
+          (unsigned long long)m.frames_displayed,
+          (unsigned long long)m.frames_dropped);
+  fprintf(stderr, "  decode %.1f fps, convert %.1f fps (%.1f MPix/s)\n", decode_fps,
+          convert_fps, convert_mpix);
+  fprintf(stderr, "  peak rss %ld KiB, %.1f allocations per frame\n",
+          usage.ru_maxrss, allocs_per_frame);
+  fprintf(stderr, "  stop %.1f ms, %u i/o timeouts\n", stop.last_latency,
+          stop.io_timeouts);
+  fprintf(stderr, "  http %u requests, %u on kept connections, %u connects (%.1f ms)\n",
+          http.requests, http.reused, http.connects, http.handshake_avg);
+  fprintf(stderr, "  decode level changes %u down, %u up;", decode.steps_down,
+          decode.steps_up);
+  for (uint32_t i = 0; i < DECODE_LEVELS; i++) {
+    fprintf(stderr, " %s %.1f s", decode_level_name((decode_level_t)i),
+            decode.seconds[i]);
+  }
+  fprintf(stderr, "\n");
+
+  printf("{\"input\":\"%s\",\"mode\":\"%s\",\"format\":\"%s\",\"wall_s\":%.3f,"
+         "\"cpu_user_s\":%.3f,\"cpu_sys_s\":%.3f,",
+         opts.input, opts.realtime ? "realtime" : "fast", s_formats[opts.format], wall,
+         cpu_user, cpu_sys);
+  printf("\"frames_decoded\":%llu,\"frames_displayed\":%llu,\"frames_dropped\":%llu,",
+         (unsigned long long)m.frames_decoded, (unsigned long long)m.frames_displayed,
+         (unsigned long long)m.frames_dropped);
+  printf("\"decode_fps\":%.2f,\"convert_fps\":%.2f,\"convert_mpix_s\":%.2f,",
+         decode_fps, convert_fps, convert_mpix);
+  printf("\"peak_rss_kb\":%ld,\"allocs_per_frame\":%.2f,\"audio_bytes\":%llu,",
+         usage.ru_maxrss, allocs_per_frame,
+         (unsigned long long)null_audio_get_bytes());
+  printf("\"stop_ms\":%.2f,\"io_timeouts\":%u,", stop.last_latency,
+         stop.io_timeouts);
+  printf("\"http_requests\":%u,\"http_reused\":%u,\"http_connects\":%u,"
+         "\"handshake_ms\":%.2f,\"dns_hits\":%u,",
+         http.requests, http.reused, http.connects, http.handshake_avg,
+         http.dns_hits);
+  printf("\"metrics\":%s}\n", json.str);
+
+  str_reset(&json);
+  hls_player_destroy(player);
+  free(sink.data);
+
+  return m.frames_decoded > 0 ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+#include "null_audio.h"
+#include <SDL.h>
+#include <libavutil/time.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+/* Outside real time the device still waits a little per buffer, not spin */
+#define NULL_AUDIO_FAST_SPEEDUP 32
+#define NULL_AUDIO_DEVICE_ID 1
+
+typedef struct _null_audio_device_t {
+  SDL_AudioSpec spec;
+  uint32_t size;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  int open;
+  int paused;
+  int quit;
+  uint64_t bytes;
+} null_audio_device_t;
+
+static null_audio_device_t s_device = {.lock = PTHREAD_MUTEX_INITIALIZER};
+static int s_realtime = 1;
+static const char *s_error = "";
+
+void null_audio_set_realtime(int realtime) {
+  __atomic_store_n(&s_realtime, realtime, __ATOMIC_RELAXED);
+}
+
+uint64_t null_audio_get_bytes(void) {
+  return __atomic_load_n(&s_device.bytes, __ATOMIC_RELAXED);
+}
+
+static void *null_audio_thread(void *arg) {
+  null_audio_device_t *dev = (null_audio_device_t *)arg;
+  int64_t period = (int64_t)dev->spec.samples * 1000000 / dev->spec.freq;
+  int64_t next = av_gettime_relative();
+  Uint8 *buf = (Uint8 *)malloc(dev->size);
+
+  while (buf != NULL && !__atomic_load_n(&dev->quit, __ATOMIC_ACQUIRE)) {
+    int realtime = __atomic_load_n(&s_realtime, __ATOMIC_RELAXED);
+    int64_t wait = realtime ? period : period / NULL_AUDIO_FAST_SPEEDUP;
+
+    if (!__atomic_load_n(&dev->paused, __ATOMIC_ACQUIRE)) {
+      pthread_mutex_lock(&dev->lock);
+      dev->spec.callback(dev->spec.userdata, buf, (int)dev->size);
+      pthread_mutex_unlock(&dev->lock);
+      __atomic_fetch_add(&dev->bytes, dev->size, __ATOMIC_RELAXED);
+    }
+
+    // Deadlines, not fixed sleeps, so the pace does not drift.
+    next += wait;
+    int64_t now = av_gettime_relative();
+    if (next > now) {
+      av_usleep((unsigned)(next - now));
+    } else {
+      next = now;
+    }
+  }
+
+  free(buf);
+  return NULL;
+}
+
+int SDL_InitSubSystem(Uint32 flags) {
+  (void)flags;
+  return 0;
+}
+
+const char *SDL_GetError(void) {
+  return s_error;
+}
+
+SDL_AudioDeviceID SDL_OpenAudioDevice(const char *device, int iscapture,
+                                      const SDL_AudioSpec *desired,
+                                      SDL_AudioSpec *obtained,
+                                      int allowed_changes) {
+  null_audio_device_t *dev = &s_device;
+  (void)device;
+  (void)allowed_changes;
+
+  if (iscapture || desired == NULL || desired->callback == NULL ||
+      desired->freq <= 0 || desired->samples == 0) {
+    s_error = "null audio: unsupported request";
+    return 0;
+  }
+  if (dev->open) {
+    s_error = "null audio: device busy";
+    return 0;
+  }
+
+  dev->spec = *desired;
+  dev->size = (uint32_t)desired->samples * desired->channels * 2;
+  dev->spec.size = dev->size;
+  dev->paused = 1;
+  dev->quit = 0;
+  dev->bytes = 0;
+  if (pthread_create(&dev->thread, NULL, null_audio_thread, dev) != 0) {
+    s_error = "null audio: no thread";
+    return 0;
+  }
+  dev->open = 1;
+  if (obtained != NULL) {
+    *obtained = dev->spec;
+  }
+
+  return NULL_AUDIO_DEVICE_ID;
+}
+
+void SDL_PauseAudioDevice(SDL_AudioDeviceID id, int pause_on) {
+  if (id == NULL_AUDIO_DEVICE_ID) {
+    __atomic_store_n(&s_device.paused, pause_on, __ATOMIC_RELEASE);
+  }
+}
+
+void SDL_LockAudioDevice(SDL_AudioDeviceID id) {
+  if (id == NULL_AUDIO_DEVICE_ID) {
+    pthread_mutex_lock(&s_device.lock);
+  }
+}
+
+void SDL_UnlockAudioDevice(SDL_AudioDeviceID id) {
+  if (id == NULL_AUDIO_DEVICE_ID) {
+    pthread_mutex_unlock(&s_device.lock);
+  }
+}
+
+void SDL_CloseAudioDevice(SDL_AudioDeviceID id) {
+  if (id != NULL_AUDIO_DEVICE_ID || !s_device.open) {
+    return;
+  }
+  __atomic_store_n(&s_device.quit, 1, __ATOMIC_RELEASE);
+  pthread_join(s_device.thread, NULL);
+  s_device.open = 0;
+}
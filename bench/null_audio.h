@@ -0,0 +1,18 @@
+#ifndef NULL_AUDIO_H
+#define NULL_AUDIO_H
+
+#include <stdint.h>
+
+/*
+ * Null SDL audio backend for the headless benchmark, linked in place of
+ * libSDL2. It implements the SDL audio calls hls_player makes: an opened
+ * device runs its callback on a thread and discards what it is given.
+ */
+
+/* Pull audio at the device rate (default), or as fast as it is produced. */
+void null_audio_set_realtime(int realtime);
+
+/* Bytes the device callback has been asked for since the device opened */
+uint64_t null_audio_get_bytes(void);
+
+#endif /* NULL_AUDIO_H */
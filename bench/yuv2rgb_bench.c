@@ -0,0 +1,184 @@
+/*
+ * Micro-benchmark of the yuv2rgb kernels against swscale on the same input.
+ *
+ * usage: yuv2rgb_bench [width height [iterations]]
+ *
+ * For each source format it reports MPix/s per kernel and for swscale,
+ * checks every SIMD kernel is bit-exact with the scalar one and reports the
+ * PSNR of the scalar output against swscale's.
+ */
+#include "model/yuv2rgb.h"
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+#include <libswscale/swscale.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct _bench_input_t {
+  const char *name;
+  enum AVPixelFormat pix_fmt;
+  yuv2rgb_format_t format;
+  yuv2rgb_matrix_t matrix;
+  bool_t full_range;
+} bench_input_t;
+
+static const bench_input_t s_inputs[] = {
+    {"yuv420p bt709", AV_PIX_FMT_YUV420P, YUV2RGB_FORMAT_YUV420P, YUV2RGB_MATRIX_BT709, FALSE},
+    {"yuv420p bt601", AV_PIX_FMT_YUV420P, YUV2RGB_FORMAT_YUV420P, YUV2RGB_MATRIX_BT601, FALSE},
+    {"nv12 bt709", AV_PIX_FMT_NV12, YUV2RGB_FORMAT_NV12, YUV2RGB_MATRIX_BT709, FALSE},
+    {"yuvj420p bt601", AV_PIX_FMT_YUVJ420P, YUV2RGB_FORMAT_YUV420P, YUV2RGB_MATRIX_BT601, TRUE},
+};
+
+static const yuv2rgb_kernel_t s_kernels[] = {YUV2RGB_KERNEL_SCALAR, YUV2RGB_KERNEL_SSE2,
+                                             YUV2RGB_KERNEL_AVX2, YUV2RGB_KERNEL_NEON};
+
+/* Smooth gradients with some noise, so neither flat nor random content */
+static void bench_fill(uint8_t *plane, int width, int height, int stride, int step,
+                       int seed) {
+  uint32_t state = seed;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      state = state * 1664525 + 1013904223;
+      int v = (x * 255 / width + y * 255 / height) / 2 + (int)(state >> 28) - 8;
+      plane[y * stride + x * step] = (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+  }
+}
+
+static double bench_psnr(const uint8_t *a, const uint8_t *b, int width, int height) {
+  double sse = 0;
+  for (int i = 0; i < width * height; i++) {
+    for (int c = 0; c < 3; c++) {
+      int d = a[i * 4 + c] - b[i * 4 + c];
+      sse += d * d;
+    }
+  }
+  if (sse == 0) {
+    return INFINITY;
+  }
+  return 10 * log10(255.0 * 255.0 / (sse / (width * height * 3.0)));
+}
+
+static double bench_mpix(int64_t elapsed_us, int width, int height, int iterations) {
+  return (double)width * height * iterations / tk_max(1, elapsed_us);
+}
+
+static int bench_run(const bench_input_t *input, int width, int height, int iterations) {
+  int cw = (width + 1) / 2;
+  int ch = (height + 1) / 2;
+  int failures = 0;
+  yuv2rgb_src_t src;
+  uint8_t *planes[3] = {NULL, NULL, NULL};
+  uint8_t *ref = (uint8_t *)av_malloc(width * height * 4);
+  uint8_t *out = (uint8_t *)av_malloc(width * height * 4);
+
+  memset(&src, 0x00, sizeof(src));
+  src.format = input->format;
+  src.width = width;
+  src.height = height;
+  src.matrix = input->matrix;
+  src.full_range = input->full_range;
+  src.stride[0] = width;
+  planes[0] = (uint8_t *)av_malloc(width * height);
+  bench_fill(planes[0], width, height, width, 1, 1);
+  if (input->format == YUV2RGB_FORMAT_NV12) {
+    src.stride[1] = cw * 2;
+    planes[1] = (uint8_t *)av_malloc(cw * 2 * ch);
+    bench_fill(planes[1], cw, ch, cw * 2, 2, 2);
+    bench_fill(planes[1] + 1, cw, ch, cw * 2, 2, 3);
+  } else {
+    src.stride[1] = src.stride[2] = cw;
+    planes[1] = (uint8_t *)av_malloc(cw * ch);
+    planes[2] = (uint8_t *)av_malloc(cw * ch);
+    bench_fill(planes[1], cw, ch, cw, 1, 2);
+    bench_fill(planes[2], cw, ch, cw, 1, 3);
+  }
+  for (int p = 0; p < 3; p++) {
+    src.data[p] = planes[p];
+  }
+
+  printf("%s %dx%d, %d iterations\n", input->name, width, height, iterations);
+  yuv2rgb_convert(YUV2RGB_KERNEL_SCALAR, &src, ref, width * 4);
+
+  for (uint32_t k = 0; k < ARRAY_SIZE(s_kernels); k++) {
+    yuv2rgb_kernel_t kernel = s_kernels[k];
+    if (!yuv2rgb_kernel_available(kernel)) {
+      continue;
+    }
+
+    memset(out, 0x00, width * height * 4);
+    int64_t start = av_gettime_relative();
+    for (int i = 0; i < iterations; i++) {
+      yuv2rgb_convert(kernel, &src, out, width * 4);
+    }
+    int64_t elapsed = av_gettime_relative() - start;
+
+    bool_t exact = memcmp(ref, out, width * height * 4) == 0;
+    if (!exact) {
+      failures++;
+    }
+    printf("  %-8s %8.1f MPix/s  %s\n", yuv2rgb_kernel_name(kernel),
+           bench_mpix(elapsed, width, height, iterations),
+           exact ? "bit-exact" : "MISMATCH");
+  }
+
+  struct SwsContext *sws =
+      sws_getContext(width, height, input->pix_fmt, width, height, AV_PIX_FMT_RGBA,
+                     SWS_BILINEAR | SWS_ACCURATE_RND, NULL, NULL, NULL);
+  if (sws != NULL) {
+    int cs = input->matrix == YUV2RGB_MATRIX_BT709 ? SWS_CS_ITU709 : SWS_CS_ITU601;
+    const uint8_t *const sws_src[4] = {planes[0], planes[1], planes[2], NULL};
+    int sws_stride[4] = {src.stride[0], src.stride[1], src.stride[2], 0};
+    uint8_t *const sws_dst[4] = {out, NULL, NULL, NULL};
+    int sws_dst_stride[4] = {width * 4, 0, 0, 0};
+
+    sws_setColorspaceDetails(sws, sws_getCoefficients(cs), input->full_range,
+                             sws_getCoefficients(SWS_CS_DEFAULT), 1, 0, 1 << 16,
+                             1 << 16);
+    int64_t start = av_gettime_relative();
+    for (int i = 0; i < iterations; i++) {
+      sws_scale(sws, sws_src, sws_stride, 0, height, sws_dst, sws_dst_stride);
+    }
+    int64_t elapsed = av_gettime_relative() - start;
+    printf("  %-8s %8.1f MPix/s  PSNR vs scalar %.2f dB\n", "swscale",
+           bench_mpix(elapsed, width, height, iterations),
+           bench_psnr(ref, out, width, height));
+    sws_freeContext(sws);
+  }
+
+  for (int p = 0; p < 3; p++) {
+    av_free(planes[p]);
+  }
+  av_free(ref);
+  av_free(out);
+
+  return failures;
+}
+
+int main(int argc, char *argv[]) {
+  int width = 1920;
+  int height = 1080;
+  int iterations = 100;
+  int failures = 0;
+
+  if (argc >= 3) {
+    width = atoi(argv[1]);
+    height = atoi(argv[2]);
+  }
+  if (argc >= 4) {
+    iterations = atoi(argv[3]);
+  }
+  if (width <= 0 || height <= 0 || iterations <= 0) {
+    fprintf(stderr, "usage: %s [width height [iterations]]\n", argv[0]);
+    return 1;
+  }
+
+  printf("best kernel: %s\n", yuv2rgb_kernel_name(yuv2rgb_best_kernel()));
+  for (uint32_t i = 0; i < ARRAY_SIZE(s_inputs); i++) {
+    failures += bench_run(s_inputs + i, width, height, iterations);
+  }
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,245 @@
+#!/bin/bash
+
+# Local HLS stand-in server for testing the playlist engine.
+#
+#   ./scripts/serve_hls.sh [--live|--ll|--test] [--delay MS] [--connect-delay MS]
+#                          [--rate KBPS] [--port PORT]
+#
+# Generates a test stream with ffmpeg (a VOD pair of variants, or a live
+# sliding-window playlist with --live) and serves it over HTTP, adding MS
+# milliseconds to every response to emulate a high-RTT link and, with
+# --rate, capping each response at KBPS kilobits per second to exercise
+# adaptive bitrate switching. Connections are kept alive (HTTP/1.1);
+# --connect-delay adds MS to the first response on each new connection, as
+# the TCP and TLS handshakes of a distant server would. Play
+#   http://localhost:PORT/master.m3u8   (or live.m3u8 with --live)
+# or file://$(pwd)/bin/hls_test/master.m3u8 without the server.
+#
+# --ll serves a low-latency live stream at ll.m3u8: ffmpeg writes 1/3 s
+# chunks that the server lists as LL-HLS parts of 2 s segments, with
+# blocking playlist reloads (_HLS_msn/_HLS_part) and a preload hint.
+#
+# --test generates nothing and serves the fixed responses under /test/ that
+# tests/http_pool_test.sh checks the keep-alive client against: a plain
+# body, a chunked one, a redirect and a connection dropped once answered.
+
+LIVE=0
+LL=0
+TEST=0
+DELAY=0
+CONNECT_DELAY=0
+RATE=0
+PORT=8000
+while [ $# -gt 0 ]; do
+  case "$1" in
+    --live) LIVE=1 ;;
+    --ll) LL=1 ;;
+    --test) TEST=1 ;;
+    --delay) DELAY="$2"; shift ;;
+    --connect-delay) CONNECT_DELAY="$2"; shift ;;
+    --rate) RATE="$2"; shift ;;
+    --port) PORT="$2"; shift ;;
+    *) echo "usage: $0 [--live|--ll|--test] [--delay MS] [--connect-delay MS] [--rate KBPS] [--port PORT]"; exit 1 ;;
+  esac
+  shift
+done
+
+DIR=$(pwd)/bin/hls_test
+mkdir -p "$DIR"
+
+SOURCE="-f lavfi -i testsrc2=size=1280x720:rate=30 -f lavfi -i sine=frequency=440:sample_rate=48000"
+ENCODE="-c:v libx264 -preset veryfast -g 60 -sc_threshold 0 -c:a aac -b:a 128k"
+
+if [ $LIVE -eq 1 ]; then
+  rm -f "$DIR"/live*.ts "$DIR"/live.m3u8
+  ffmpeg -loglevel error -re $SOURCE $ENCODE -b:v 2M -f hls -hls_time 2 \
+    -hls_list_size 6 -hls_flags delete_segments \
+    -hls_segment_filename "$DIR/live%d.ts" "$DIR/live.m3u8" &
+  FFMPEG_PID=$!
+  trap 'kill $FFMPEG_PID 2>/dev/null' EXIT
+elif [ $LL -eq 1 ]; then
+  # A keyframe every 10 frames makes each 1/3 s chunk an independent part.
+  rm -f "$DIR"/llp*.ts "$DIR"/ll_parts.m3u8
+  ffmpeg -loglevel error -re $SOURCE $ENCODE -g 10 -keyint_min 10 \
+    -tune zerolatency -b:v 2M -f hls -hls_time 0.333 -hls_list_size 60 \
+    -hls_flags delete_segments \
+    -hls_segment_filename "$DIR/llp%d.ts" "$DIR/ll_parts.m3u8" &
+  FFMPEG_PID=$!
+  trap 'kill $FFMPEG_PID 2>/dev/null' EXIT
+elif [ $TEST -eq 0 ] && [ ! -f "$DIR/master.m3u8" ]; then
+  echo "Generating test stream in $DIR..."
+  for VARIANT in "360 640x360 800k" "720 1280x720 2M"; do
+    set -- $VARIANT
+    ffmpeg -loglevel error -y $SOURCE -t 60 $ENCODE -s "$2" -b:v "$3" \
+      -f hls -hls_time 2 -hls_playlist_type vod \
+      -hls_segment_filename "$DIR/v$1_%03d.ts" "$DIR/v$1.m3u8" || exit 1
+  done
+  cat > "$DIR/master.m3u8" <<EOF
+#EXTM3U
+#EXT-X-STREAM-INF:BANDWIDTH=1000000,RESOLUTION=640x360
+v360.m3u8
+#EXT-X-STREAM-INF:BANDWIDTH=2300000,RESOLUTION=1280x720
+v720.m3u8
+EOF
+fi
+
+echo "Serving $DIR on http://localhost:$PORT/ with ${DELAY}ms delay"
+cd "$DIR" && python3 - "$PORT" "$DELAY" "$RATE" "$LL" "$CONNECT_DELAY" "$TEST" <<'EOF'
+import http.server, io, re, socketserver, sys, time, urllib.parse
+
+port, delay = int(sys.argv[1]), int(sys.argv[2]) / 1000.0
+rate = int(sys.argv[3]) * 1000 / 8
+ll = sys.argv[4] == "1"
+connect_delay = int(sys.argv[5]) / 1000.0
+selftest = sys.argv[6] == "1"
+
+# Low-latency mode: ffmpeg's chunk i is part i % PARTS of segment i // PARTS.
+PARTS = 6
+BLOCK_TIMEOUT = 3.0
+
+def ll_parts():
+    seq, durations = 0, []
+    try:
+        lines = open("ll_parts.m3u8").read().splitlines()
+    except OSError:
+        return seq, durations
+    for line in lines:
+        if line.startswith("#EXT-X-MEDIA-SEQUENCE:"):
+            seq = int(line.split(":")[1])
+        elif line.startswith("#EXTINF:"):
+            durations.append(float(line[8:].split(",")[0]))
+    return seq, durations
+
+def ll_wait(index):
+    deadline = time.time() + BLOCK_TIMEOUT
+    while True:
+        seq, durations = ll_parts()
+        if index < seq + len(durations) or time.time() >= deadline:
+            return seq, durations
+        time.sleep(0.02)
+
+def ll_playlist(seq, durations):
+    end = seq + len(durations)
+    first = -(-seq // PARTS)
+    done = end // PARTS
+    out = ["#EXTM3U", "#EXT-X-VERSION:6", "#EXT-X-TARGETDURATION:2",
+           "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=1.0",
+           "#EXT-X-PART-INF:PART-TARGET=0.334",
+           "#EXT-X-MEDIA-SEQUENCE:%d" % first]
+    for k in range(first, done + 1):
+        # Parts only for the last few segments and the one being written
+        if k >= done - 3:
+            for i in range(k * PARTS, min((k + 1) * PARTS, end)):
+                out.append('#EXT-X-PART:DURATION=%.3f,URI="llp%d.ts",INDEPENDENT=YES'
+                           % (durations[i - seq], i))
+        if k < done:
+            out.append("#EXTINF:%.3f,"
+                       % sum(durations[k * PARTS - seq:(k + 1) * PARTS - seq]))
+            out.append("ll_seg%d.ts" % k)
+    out.append('#EXT-X-PRELOAD-HINT:TYPE=PART,URI="llp%d.ts"' % end)
+    return "\n".join(out) + "\n"
+
+class Handler(http.server.SimpleHTTPRequestHandler):
+    # Keep-alive, as CDNs do; every response carries its Content-Length.
+    protocol_version = "HTTP/1.1"
+
+    def setup(self):
+        super().setup()
+        time.sleep(connect_delay)
+
+    def do_GET(self):
+        time.sleep(delay)
+        if ll and self.ll_get():
+            return
+        if selftest and self.test_get():
+            return
+        super().do_GET()
+
+    def ll_reply(self, body, content_type):
+        self.send_response(200)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(body)))
+        self.send_header("Cache-Control", "no-cache")
+        self.end_headers()
+        self.copyfile(io.BytesIO(body), self.wfile)
+
+    # Serves what the plain file handler cannot: the synthesised playlist,
+    # whole segments, and parts not written yet (blocking until they are).
+    def ll_get(self):
+        url = urllib.parse.urlsplit(self.path)
+        name = url.path.lstrip("/")
+        part = re.fullmatch(r"llp(\d+)\.ts", name)
+        segment = re.fullmatch(r"ll_seg(\d+)\.ts", name)
+        if name == "ll.m3u8":
+            query = urllib.parse.parse_qs(url.query)
+            if "_HLS_msn" in query:
+                msn = int(query["_HLS_msn"][0])
+                index = int(query.get("_HLS_part", [PARTS - 1])[0])
+                seq, durations = ll_wait(msn * PARTS + index)
+            else:
+                seq, durations = ll_parts()
+            self.ll_reply(ll_playlist(seq, durations).encode(),
+                          "application/vnd.apple.mpegurl")
+        elif part:
+            ll_wait(int(part.group(1)))
+            return False
+        elif segment:
+            k = int(segment.group(1))
+            ll_wait((k + 1) * PARTS - 1)
+            try:
+                body = b"".join(open("llp%d.ts" % i, "rb").read()
+                                for i in range(k * PARTS, (k + 1) * PARTS))
+            except OSError:
+                self.send_error(404)
+                return True
+            self.ll_reply(body, "video/mp2t")
+        else:
+            return False
+        return True
+
+    def test_reply(self, status, body, headers=()):
+        self.send_response(status)
+        for name, value in headers:
+            self.send_header(name, value)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    # The responses of --test. None of them honours Range.
+    def test_get(self):
+        name = urllib.parse.urlsplit(self.path).path
+        if name == "/test/hello":
+            self.test_reply(200, b"hello world")
+        elif name == "/test/chunked":
+            self.send_response(200)
+            self.send_header("Transfer-Encoding", "chunked")
+            self.end_headers()
+            for chunk in (b"hello ", b"chunked ", b"world"):
+                self.wfile.write(b"%x\r\n%s\r\n" % (len(chunk), chunk))
+            self.wfile.write(b"0\r\nX-Trailer: yes\r\n\r\n")
+        elif name == "/test/redirect":
+            self.test_reply(302, b"moved", [("Location", "hello")])
+        elif name == "/test/drop":
+            # Kept alive as far as the client can tell, then closed.
+            self.test_reply(200, b"dropped")
+            self.close_connection = True
+        else:
+            return False
+        return True
+
+    def copyfile(self, source, outputfile):
+        if rate <= 0:
+            return super().copyfile(source, outputfile)
+        while True:
+            chunk = source.read(16 * 1024)
+            if not chunk:
+                break
+            outputfile.write(chunk)
+            time.sleep(len(chunk) / rate)
+
+class Server(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+Server(("", port), Handler).serve_forever()
+EOF
@@ -2,8 +2,10 @@
 #include "mvvm/mvvm.h"
 
 #include "view_model/player_view_model.h"
+#include "view/video_grid.h"
 #include "view/video_image.h"
 #include "view/video_view.h"
+#include "view_model/mosaic_view_model.h"
 #include "view_model/player_view_model.h"
 
 ret_t application_init(void) {
@@ -11,7 +13,9 @@ ret_t application_init(void) {
   
   widget_factory_register(widget_factory(), WIDGET_TYPE_VIDEO_IMAGE, video_image_create);
   widget_factory_register(widget_factory(), WIDGET_TYPE_VIDEO_VIEW, video_view_create);
+  widget_factory_register(widget_factory(), WIDGET_TYPE_VIDEO_GRID, video_grid_create);
   view_model_factory_register("player", player_view_model_create);
+  view_model_factory_register("mosaic", mosaic_view_model_create);
 
   return navigator_to("main");
 }
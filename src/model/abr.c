@@ -0,0 +1,127 @@
+#include "abr.h"
+#include <math.h>
+#include <string.h>
+
+/* Half-lives in seconds of download time */
+#define ABR_FAST_HALF_LIFE 2.0
+#define ABR_SLOW_HALF_LIFE 5.0
+/* Fraction of the estimate a variant may use, by buffer health */
+#define ABR_SAFETY_LOW 0.7
+#define ABR_SAFETY_HIGH 0.85
+/* Buffer levels in seconds */
+#define ABR_PANIC_BUFFER 1.5
+#define ABR_LOW_BUFFER 4.0
+#define ABR_UP_BUFFER 8.0
+#define ABR_MIN_SAMPLES_BETWEEN_SWITCHES 2
+/* The buffer is still filling during the first downloads */
+#define ABR_STARTUP_SAMPLES 3
+
+static void abr_ewma_init(abr_ewma_t *ewma, double half_life) {
+  ewma->alpha = exp(log(0.5) / half_life);
+  ewma->estimate = 0;
+  ewma->total_weight = 0;
+}
+
+static void abr_ewma_add(abr_ewma_t *ewma, double weight, double value) {
+  double adj = pow(ewma->alpha, weight);
+  ewma->estimate = value * (1 - adj) + adj * ewma->estimate;
+  ewma->total_weight += weight;
+}
+
+/* Corrects the bias towards the zero the average starts from. */
+static double abr_ewma_get(abr_ewma_t *ewma) {
+  double zero_factor = 1 - pow(ewma->alpha, ewma->total_weight);
+  return zero_factor > 0 ? ewma->estimate / zero_factor : 0;
+}
+
+ret_t abr_init(abr_t *abr) {
+  return_value_if_fail(abr != NULL, RET_BAD_PARAMS);
+
+  memset(abr, 0x00, sizeof(*abr));
+  abr_ewma_init(&abr->fast, ABR_FAST_HALF_LIFE);
+  abr_ewma_init(&abr->slow, ABR_SLOW_HALF_LIFE);
+
+  return RET_OK;
+}
+
+ret_t abr_add_sample(abr_t *abr, uint64_t bytes, double seconds) {
+  return_value_if_fail(abr != NULL && seconds > 0, RET_BAD_PARAMS);
+
+  double bps = bytes * 8.0 / seconds;
+  abr_ewma_add(&abr->fast, seconds, bps);
+  abr_ewma_add(&abr->slow, seconds, bps);
+  abr->samples++;
+  abr->samples_since_switch++;
+
+  return RET_OK;
+}
+
+double abr_get_estimate(abr_t *abr) {
+  return_value_if_fail(abr != NULL, 0);
+
+  if (abr->samples == 0) {
+    return 0;
+  }
+  return tk_min(abr_ewma_get(&abr->fast), abr_ewma_get(&abr->slow));
+}
+
+ret_t abr_on_switch(abr_t *abr) {
+  return_value_if_fail(abr != NULL, RET_BAD_PARAMS);
+  abr->samples_since_switch = 0;
+  return RET_OK;
+}
+
+/* The next variant up from current by declared bandwidth, or current */
+static uint32_t abr_step_up(const m3u8_variant_t *variants, uint32_t nr_variants,
+                            uint32_t current) {
+  uint32_t next = current;
+  for (uint32_t i = 0; i < nr_variants; i++) {
+    if (variants[i].bandwidth > variants[current].bandwidth &&
+        (next == current || variants[i].bandwidth < variants[next].bandwidth)) {
+      next = i;
+    }
+  }
+  return next;
+}
+
+uint32_t abr_choose(abr_t *abr, const m3u8_variant_t *variants,
+                    uint32_t nr_variants, uint32_t current, double buffered) {
+  return_value_if_fail(abr != NULL && variants != NULL && current < nr_variants,
+                       current);
+
+  if (abr->samples == 0 || nr_variants < 2) {
+    return current;
+  }
+
+  // Highest variant the link sustains, else the lowest there is.
+  double budget = abr_get_estimate(abr) *
+                  (buffered < ABR_LOW_BUFFER ? ABR_SAFETY_LOW : ABR_SAFETY_HIGH);
+  uint32_t fit = nr_variants;
+  uint32_t lowest = 0;
+  for (uint32_t i = 0; i < nr_variants; i++) {
+    if (variants[i].bandwidth < variants[lowest].bandwidth) {
+      lowest = i;
+    }
+    if (variants[i].bandwidth <= budget &&
+        (fit == nr_variants || variants[i].bandwidth > variants[fit].bandwidth)) {
+      fit = i;
+    }
+  }
+  if (fit == nr_variants ||
+      (buffered < ABR_PANIC_BUFFER && abr->samples > ABR_STARTUP_SAMPLES)) {
+    fit = lowest;
+  }
+
+  if (variants[fit].bandwidth < variants[current].bandwidth) {
+    // Step down at once: a stall costs more than a softer picture.
+    return fit;
+  }
+  if (variants[fit].bandwidth > variants[current].bandwidth &&
+      buffered >= ABR_UP_BUFFER &&
+      abr->samples_since_switch >= ABR_MIN_SAMPLES_BETWEEN_SWITCHES) {
+    // Step up one rendition at a time.
+    return abr_step_up(variants, nr_variants, current);
+  }
+
+  return current;
+}
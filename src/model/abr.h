@@ -0,0 +1,49 @@
+#ifndef ABR_H
+#define ABR_H
+
+#include "tkc/types_def.h"
+#include "m3u8.h"
+
+BEGIN_C_DECLS
+
+/*
+ * Adaptive bitrate controller. Throughput is tracked with a fast and a slow
+ * exponentially weighted moving average over download time, and the lower
+ * of the two is used, so the estimate drops quickly and recovers slowly.
+ * Variant choice combines that estimate with the seconds of media buffered.
+ */
+typedef struct _abr_ewma_t {
+  double alpha;
+  double estimate;
+  double total_weight;
+} abr_ewma_t;
+
+typedef struct _abr_t {
+  abr_ewma_t fast;
+  abr_ewma_t slow;
+  uint32_t samples;
+  /* Samples since the last switch, to damp oscillation */
+  uint32_t samples_since_switch;
+} abr_t;
+
+ret_t abr_init(abr_t *abr);
+
+/* bytes downloaded over seconds of link time */
+ret_t abr_add_sample(abr_t *abr, uint64_t bytes, double seconds);
+
+/* Estimated throughput in bits per second, 0 before the first sample */
+double abr_get_estimate(abr_t *abr);
+
+/*
+ * Variant to play next given the current one and the seconds of media
+ * buffered ahead of the playhead. Returns current to stay.
+ */
+uint32_t abr_choose(abr_t *abr, const m3u8_variant_t *variants,
+                    uint32_t nr_variants, uint32_t current, double buffered);
+
+/* Call after switching variants. */
+ret_t abr_on_switch(abr_t *abr);
+
+END_C_DECLS
+
+#endif /* ABR_H */
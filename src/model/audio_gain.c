@@ -0,0 +1,240 @@
+#include "audio_gain.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AUDIO_GAIN_HAS_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define AUDIO_GAIN_HAS_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define AUDIO_GAIN_ROUND (1 << 13)
+
+/* Each kernel returns how many leading samples it handled; the rest are scalar. */
+typedef uint32_t (*audio_gain_apply_func_t)(int16_t *samples, uint32_t count,
+                                            int32_t gain);
+typedef uint32_t (*audio_gain_crossfade_func_t)(int16_t *dst, const int16_t *a,
+                                                const int16_t *b,
+                                                const int16_t *fade,
+                                                uint32_t count);
+
+static inline int16_t audio_gain_sat16(int32_t v) {
+  return v < -32768 ? -32768 : (v > 32767 ? 32767 : (int16_t)v);
+}
+
+static uint32_t audio_gain_apply_none(int16_t *samples, uint32_t count,
+                                      int32_t gain) {
+  (void)samples;
+  (void)count;
+  (void)gain;
+  return 0;
+}
+
+static uint32_t audio_gain_crossfade_none(int16_t *dst, const int16_t *a,
+                                          const int16_t *b, const int16_t *fade,
+                                          uint32_t count) {
+  (void)dst;
+  (void)a;
+  (void)b;
+  (void)fade;
+  (void)count;
+  return 0;
+}
+
+#ifdef AUDIO_GAIN_HAS_X86
+/*
+ * madd on (sample, 1) pairs against (gain, round) gives sample * gain +
+ * round in 32 bits; on (a, b) against (1 - fade, fade) the crossfade.
+ */
+__attribute__((target("sse2"))) static uint32_t
+audio_gain_apply_sse2(int16_t *samples, uint32_t count, int32_t gain) {
+  const __m128i one = _mm_set1_epi16(1);
+  const __m128i coef = _mm_set1_epi32((AUDIO_GAIN_ROUND << 16) | (uint16_t)gain);
+  uint32_t i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    __m128i s = _mm_loadu_si128((const __m128i *)(samples + i));
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(s, one), coef);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(s, one), coef);
+    lo = _mm_srai_epi32(lo, 14);
+    hi = _mm_srai_epi32(hi, 14);
+    _mm_storeu_si128((__m128i *)(samples + i), _mm_packs_epi32(lo, hi));
+  }
+
+  return i;
+}
+
+__attribute__((target("sse2"))) static uint32_t
+audio_gain_crossfade_sse2(int16_t *dst, const int16_t *a, const int16_t *b,
+                          const int16_t *fade, uint32_t count) {
+  const __m128i unity = _mm_set1_epi16(AUDIO_GAIN_UNITY);
+  const __m128i round = _mm_set1_epi32(AUDIO_GAIN_ROUND);
+  uint32_t i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+    __m128i f = _mm_loadu_si128((const __m128i *)(fade + i));
+    __m128i w = _mm_sub_epi16(unity, f);
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(va, vb), _mm_unpacklo_epi16(w, f));
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(va, vb), _mm_unpackhi_epi16(w, f));
+    lo = _mm_srai_epi32(_mm_add_epi32(lo, round), 14);
+    hi = _mm_srai_epi32(_mm_add_epi32(hi, round), 14);
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(lo, hi));
+  }
+
+  return i;
+}
+
+/* unpack and packs both work within 128-bit lanes, so lane order survives. */
+__attribute__((target("avx2"))) static uint32_t
+audio_gain_apply_avx2(int16_t *samples, uint32_t count, int32_t gain) {
+  const __m256i one = _mm256_set1_epi16(1);
+  const __m256i coef =
+      _mm256_set1_epi32((AUDIO_GAIN_ROUND << 16) | (uint16_t)gain);
+  uint32_t i = 0;
+
+  for (; i + 16 <= count; i += 16) {
+    __m256i s = _mm256_loadu_si256((const __m256i *)(samples + i));
+    __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(s, one), coef);
+    __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(s, one), coef);
+    lo = _mm256_srai_epi32(lo, 14);
+    hi = _mm256_srai_epi32(hi, 14);
+    _mm256_storeu_si256((__m256i *)(samples + i), _mm256_packs_epi32(lo, hi));
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2"))) static uint32_t
+audio_gain_crossfade_avx2(int16_t *dst, const int16_t *a, const int16_t *b,
+                          const int16_t *fade, uint32_t count) {
+  const __m256i unity = _mm256_set1_epi16(AUDIO_GAIN_UNITY);
+  const __m256i round = _mm256_set1_epi32(AUDIO_GAIN_ROUND);
+  uint32_t i = 0;
+
+  for (; i + 16 <= count; i += 16) {
+    __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+    __m256i f = _mm256_loadu_si256((const __m256i *)(fade + i));
+    __m256i w = _mm256_sub_epi16(unity, f);
+    __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(va, vb),
+                                   _mm256_unpacklo_epi16(w, f));
+    __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(va, vb),
+                                   _mm256_unpackhi_epi16(w, f));
+    lo = _mm256_srai_epi32(_mm256_add_epi32(lo, round), 14);
+    hi = _mm256_srai_epi32(_mm256_add_epi32(hi, round), 14);
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packs_epi32(lo, hi));
+  }
+
+  return i;
+}
+#endif /* AUDIO_GAIN_HAS_X86 */
+
+#ifdef AUDIO_GAIN_HAS_NEON
+/* vqrshrn rounds, shifts and saturates exactly like the scalar code. */
+static uint32_t audio_gain_apply_neon(int16_t *samples, uint32_t count,
+                                      int32_t gain) {
+  uint32_t i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    int16x8_t s = vld1q_s16(samples + i);
+    int32x4_t lo = vmull_n_s16(vget_low_s16(s), (int16_t)gain);
+    int32x4_t hi = vmull_n_s16(vget_high_s16(s), (int16_t)gain);
+    vst1q_s16(samples + i, vcombine_s16(vqrshrn_n_s32(lo, 14), vqrshrn_n_s32(hi, 14)));
+  }
+
+  return i;
+}
+
+static uint32_t audio_gain_crossfade_neon(int16_t *dst, const int16_t *a,
+                                          const int16_t *b, const int16_t *fade,
+                                          uint32_t count) {
+  const int16x8_t unity = vdupq_n_s16(AUDIO_GAIN_UNITY);
+  uint32_t i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    int16x8_t va = vld1q_s16(a + i);
+    int16x8_t vb = vld1q_s16(b + i);
+    int16x8_t f = vld1q_s16(fade + i);
+    int16x8_t w = vsubq_s16(unity, f);
+    int32x4_t lo = vmull_s16(vget_low_s16(va), vget_low_s16(w));
+    int32x4_t hi = vmull_s16(vget_high_s16(va), vget_high_s16(w));
+    lo = vmlal_s16(lo, vget_low_s16(vb), vget_low_s16(f));
+    hi = vmlal_s16(hi, vget_high_s16(vb), vget_high_s16(f));
+    vst1q_s16(dst + i, vcombine_s16(vqrshrn_n_s32(lo, 14), vqrshrn_n_s32(hi, 14)));
+  }
+
+  return i;
+}
+#endif /* AUDIO_GAIN_HAS_NEON */
+
+static audio_gain_apply_func_t s_apply;
+static audio_gain_crossfade_func_t s_crossfade;
+
+/* Idempotent, so a race between first callers is harmless. */
+static void audio_gain_select(void) {
+  audio_gain_apply_func_t apply = audio_gain_apply_none;
+  audio_gain_crossfade_func_t crossfade = audio_gain_crossfade_none;
+
+#ifdef AUDIO_GAIN_HAS_X86
+  if (__builtin_cpu_supports("avx2")) {
+    apply = audio_gain_apply_avx2;
+    crossfade = audio_gain_crossfade_avx2;
+  } else if (__builtin_cpu_supports("sse2")) {
+    apply = audio_gain_apply_sse2;
+    crossfade = audio_gain_crossfade_sse2;
+  }
+#endif
+#ifdef AUDIO_GAIN_HAS_NEON
+  apply = audio_gain_apply_neon;
+  crossfade = audio_gain_crossfade_neon;
+#endif
+
+  s_crossfade = crossfade;
+  s_apply = apply;
+}
+
+void audio_gain_apply(int16_t *samples, uint32_t count, int32_t gain) {
+  return_if_fail(samples != NULL);
+
+  gain = tk_clamp(gain, 0, AUDIO_GAIN_MAX);
+  if (gain == AUDIO_GAIN_UNITY) {
+    return;
+  }
+  if (s_apply == NULL) {
+    audio_gain_select();
+  }
+
+  for (uint32_t i = s_apply(samples, count, gain); i < count; i++) {
+    samples[i] = audio_gain_sat16((samples[i] * gain + AUDIO_GAIN_ROUND) >> 14);
+  }
+}
+
+void audio_gain_ramp(int16_t *samples, uint32_t frames, uint32_t channels, int32_t from,
+                     int32_t to) {
+  return_if_fail(samples != NULL && channels > 0);
+
+  for (uint32_t f = 0; f < frames; f++) {
+    int32_t gain = from + (int32_t)((int64_t)(to - from) * f / frames);
+    for (uint32_t c = 0; c < channels; c++, samples++) {
+      *samples = audio_gain_sat16((*samples * gain + AUDIO_GAIN_ROUND) >> 14);
+    }
+  }
+}
+
+void audio_gain_crossfade(int16_t *dst, const int16_t *a, const int16_t *b,
+                          const int16_t *fade, uint32_t count) {
+  return_if_fail(dst != NULL && a != NULL && b != NULL && fade != NULL);
+
+  if (s_crossfade == NULL) {
+    audio_gain_select();
+  }
+
+  for (uint32_t i = s_crossfade(dst, a, b, fade, count); i < count; i++) {
+    int32_t v = a[i] * (AUDIO_GAIN_UNITY - fade[i]) + b[i] * fade[i];
+    dst[i] = audio_gain_sat16((v + AUDIO_GAIN_ROUND) >> 14);
+  }
+}
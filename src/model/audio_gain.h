@@ -0,0 +1,29 @@
+#ifndef AUDIO_GAIN_H
+#define AUDIO_GAIN_H
+
+#include "tkc/types_def.h"
+
+BEGIN_C_DECLS
+
+/*
+ * S16 sample arithmetic for the audio path, in Q14 fixed point with
+ * rounding and saturation. The fastest of the SSE2/AVX2/NEON kernels is
+ * picked at run time; all give the same result as the scalar code.
+ */
+#define AUDIO_GAIN_UNITY 16384
+#define AUDIO_GAIN_MAX 32767
+
+/* samples[i] = samples[i] * gain; gain is Q14, at most AUDIO_GAIN_MAX. */
+void audio_gain_apply(int16_t *samples, uint32_t count, int32_t gain);
+
+/* Gain moving linearly from one value to another over frames, for clickless changes. */
+void audio_gain_ramp(int16_t *samples, uint32_t frames, uint32_t channels, int32_t from,
+                     int32_t to);
+
+/* dst[i] = a[i] * (1 - fade[i]) + b[i] * fade[i]; fade is Q14 in 0..AUDIO_GAIN_UNITY. */
+void audio_gain_crossfade(int16_t *dst, const int16_t *a, const int16_t *b,
+                          const int16_t *fade, uint32_t count);
+
+END_C_DECLS
+
+#endif /* AUDIO_GAIN_H */
@@ -0,0 +1,140 @@
+#include "audio_ring.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+ret_t audio_ring_init(audio_ring_t *ring, uint32_t size, uint32_t bytes_per_sec) {
+  return_value_if_fail(ring != NULL && size > 0 && bytes_per_sec > 0,
+                       RET_BAD_PARAMS);
+
+  memset(ring, 0x00, sizeof(*ring));
+  ring->data = (uint8_t *)malloc(size);
+  return_value_if_fail(ring->data != NULL, RET_OOM);
+  ring->size = size;
+  ring->bytes_per_sec = bytes_per_sec;
+  ring->speed = 1.0;
+
+  return RET_OK;
+}
+
+ret_t audio_ring_deinit(audio_ring_t *ring) {
+  return_value_if_fail(ring != NULL, RET_BAD_PARAMS);
+
+  free(ring->data);
+  memset(ring, 0x00, sizeof(*ring));
+
+  return RET_OK;
+}
+
+uint32_t audio_ring_write(audio_ring_t *ring, const uint8_t *data, uint32_t size,
+                          double end_pts, double speed) {
+  return_value_if_fail(ring != NULL && ring->data != NULL && data != NULL, 0);
+
+  uint64_t read_pos = __atomic_load_n(&ring->read_pos, __ATOMIC_ACQUIRE);
+  uint32_t space = ring->size - (uint32_t)(ring->write_pos - read_pos);
+  uint32_t len = tk_min(size, space);
+  if (len == 0) {
+    return 0;
+  }
+
+  uint32_t offset = ring->write_pos % ring->size;
+  uint32_t first = tk_min(len, ring->size - offset);
+  memcpy(ring->data + offset, data, first);
+  memcpy(ring->data, data + first, len - first);
+  __atomic_store_n(&ring->write_pos, ring->write_pos + len, __ATOMIC_RELEASE);
+
+  // With the mark ring full the consumer extrapolates from an older mark.
+  uint32_t head = __atomic_load_n(&ring->mark_head, __ATOMIC_ACQUIRE);
+  if (ring->mark_tail - head < AUDIO_RING_MARKS) {
+    audio_ring_mark_t *mark = &ring->marks[ring->mark_tail % AUDIO_RING_MARKS];
+    mark->pos = ring->write_pos;
+    mark->pts = end_pts - (double)(size - len) * speed / ring->bytes_per_sec;
+    mark->speed = speed;
+    __atomic_store_n(&ring->mark_tail, ring->mark_tail + 1, __ATOMIC_RELEASE);
+  }
+
+  return len;
+}
+
+/* pts at byte pos, from the nearest mark ahead of it or the last one passed. */
+static double audio_ring_pts_at(audio_ring_t *ring, uint64_t pos) {
+  uint32_t tail = __atomic_load_n(&ring->mark_tail, __ATOMIC_ACQUIRE);
+
+  while (ring->mark_head != tail &&
+         ring->marks[ring->mark_head % AUDIO_RING_MARKS].pos <= pos) {
+    ring->mark = ring->marks[ring->mark_head % AUDIO_RING_MARKS];
+    ring->has_mark = TRUE;
+    __atomic_store_n(&ring->mark_head, ring->mark_head + 1, __ATOMIC_RELEASE);
+  }
+
+  if (ring->mark_head != tail) {
+    audio_ring_mark_t *next = &ring->marks[ring->mark_head % AUDIO_RING_MARKS];
+    ring->speed = next->speed;
+    return next->pts - (double)(next->pos - pos) * next->speed / ring->bytes_per_sec;
+  } else if (ring->has_mark) {
+    ring->speed = ring->mark.speed;
+    return ring->mark.pts +
+           (double)(pos - ring->mark.pos) * ring->mark.speed / ring->bytes_per_sec;
+  }
+  return NAN;
+}
+
+uint32_t audio_ring_read(audio_ring_t *ring, uint8_t *out, uint32_t size, double *pts) {
+  return_value_if_fail(ring != NULL && out != NULL, 0);
+
+  uint64_t write_pos = __atomic_load_n(&ring->write_pos, __ATOMIC_ACQUIRE);
+  uint32_t len = tk_min(size, (uint32_t)(write_pos - ring->read_pos));
+
+  if (pts != NULL) {
+    *pts = audio_ring_pts_at(ring, ring->read_pos);
+  }
+  if (len > 0) {
+    uint32_t offset = ring->read_pos % ring->size;
+    uint32_t first = tk_min(len, ring->size - offset);
+    memcpy(out, ring->data + offset, first);
+    memcpy(out + first, ring->data, len - first);
+    __atomic_store_n(&ring->read_pos, ring->read_pos + len, __ATOMIC_RELEASE);
+    ring->started = TRUE;
+  }
+
+  // Count each stall once, not every callback it lasts; silence before the
+  // first sample is start-up, not an underrun.
+  if (len < size) {
+    memset(out + len, 0, size - len);
+    if (ring->started) {
+      if (!ring->starved) {
+        ring->underruns++;
+      }
+      ring->silence_bytes += size - len;
+    }
+    ring->starved = TRUE;
+  } else {
+    ring->starved = FALSE;
+  }
+
+  return len;
+}
+
+uint32_t audio_ring_available(audio_ring_t *ring) {
+  return_value_if_fail(ring != NULL, 0);
+
+  uint64_t read_pos = __atomic_load_n(&ring->read_pos, __ATOMIC_ACQUIRE);
+  uint64_t write_pos = __atomic_load_n(&ring->write_pos, __ATOMIC_ACQUIRE);
+  return (uint32_t)(write_pos - read_pos);
+}
+
+ret_t audio_ring_clear(audio_ring_t *ring) {
+  return_value_if_fail(ring != NULL, RET_BAD_PARAMS);
+
+  __atomic_store_n(&ring->read_pos,
+                   __atomic_load_n(&ring->write_pos, __ATOMIC_ACQUIRE),
+                   __ATOMIC_RELEASE);
+  __atomic_store_n(&ring->mark_head,
+                   __atomic_load_n(&ring->mark_tail, __ATOMIC_ACQUIRE),
+                   __ATOMIC_RELEASE);
+  ring->has_mark = FALSE;
+  ring->starved = FALSE;
+  ring->started = FALSE;
+
+  return RET_OK;
+}
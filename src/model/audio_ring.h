@@ -0,0 +1,74 @@
+#ifndef AUDIO_RING_H
+#define AUDIO_RING_H
+
+#include "tkc/types_def.h"
+
+BEGIN_C_DECLS
+
+#define AUDIO_RING_MARKS 64
+
+/*
+ * pts of the sample ending at byte pos of the stream written to the ring,
+ * and the media seconds each second of that audio covers.
+ */
+typedef struct _audio_ring_mark_t {
+  uint64_t pos;
+  double pts;
+  double speed;
+} audio_ring_mark_t;
+
+/*
+ * Lock-free single-producer/single-consumer ring of PCM bytes between the
+ * audio decode thread and the device callback. Positions only grow; each
+ * side owns one and reads the other's with acquire semantics. Timestamps
+ * travel alongside as marks, so the consumer knows the pts of what it reads.
+ */
+typedef struct _audio_ring_t {
+  uint8_t *data;
+  uint32_t size;
+  uint32_t bytes_per_sec;
+
+  /* Owned by the producer */
+  uint64_t write_pos;
+  uint32_t mark_tail;
+  /* Owned by the consumer */
+  uint64_t read_pos;
+  uint32_t mark_head;
+  audio_ring_mark_t mark;
+  bool_t has_mark;
+  /* Speed of the audio at the read position */
+  double speed;
+  bool_t starved;
+  bool_t started;
+  uint32_t underruns;
+  uint64_t silence_bytes;
+
+  audio_ring_mark_t marks[AUDIO_RING_MARKS];
+} audio_ring_t;
+
+ret_t audio_ring_init(audio_ring_t *ring, uint32_t size, uint32_t bytes_per_sec);
+ret_t audio_ring_deinit(audio_ring_t *ring);
+
+/*
+ * Producer: copies up to size bytes ending at end_pts, played at speed
+ * (1.0 unless time-stretched); returns bytes taken.
+ */
+uint32_t audio_ring_write(audio_ring_t *ring, const uint8_t *data, uint32_t size,
+                          double end_pts, double speed);
+
+/*
+ * Consumer: fills out with size bytes, padding with silence on underrun, and
+ * sets pts to the pts of the first byte (NAN when unknown). Returns the bytes
+ * taken from the ring.
+ */
+uint32_t audio_ring_read(audio_ring_t *ring, uint8_t *out, uint32_t size, double *pts);
+
+/* Bytes written but not yet read; callable from either side. */
+uint32_t audio_ring_available(audio_ring_t *ring);
+
+/* Drop everything unread. The consumer must not run concurrently. */
+ret_t audio_ring_clear(audio_ring_t *ring);
+
+END_C_DECLS
+
+#endif /* AUDIO_RING_H */
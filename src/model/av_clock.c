@@ -0,0 +1,115 @@
+#include "av_clock.h"
+#include <libavutil/time.h>
+
+ret_t av_clock_init(av_clock_t *clock) {
+  return_value_if_fail(clock != NULL, RET_BAD_PARAMS);
+
+  memset(clock, 0x00, sizeof(*clock));
+  clock->speed = 1.0;
+  pthread_mutex_init(&clock->mutex, NULL);
+
+  return RET_OK;
+}
+
+ret_t av_clock_deinit(av_clock_t *clock) {
+  return_value_if_fail(clock != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_destroy(&clock->mutex);
+
+  return RET_OK;
+}
+
+ret_t av_clock_reset(av_clock_t *clock) {
+  return_value_if_fail(clock != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&clock->mutex);
+  clock->pts = 0;
+  clock->valid = FALSE;
+  clock->updated_at = av_gettime_relative();
+  pthread_mutex_unlock(&clock->mutex);
+
+  return RET_OK;
+}
+
+ret_t av_clock_set(av_clock_t *clock, double pts) {
+  return_value_if_fail(clock != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&clock->mutex);
+  clock->pts = pts;
+  clock->valid = TRUE;
+  clock->updated_at = av_gettime_relative();
+  pthread_mutex_unlock(&clock->mutex);
+
+  return RET_OK;
+}
+
+ret_t av_clock_set_paused(av_clock_t *clock, bool_t paused) {
+  return_value_if_fail(clock != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&clock->mutex);
+  if (clock->paused != paused) {
+    int64_t now = av_gettime_relative();
+    // Fold the running time in so the clock resumes where it stopped.
+    if (!clock->paused) {
+      clock->pts += (now - clock->updated_at) / 1000000.0 * clock->speed;
+    }
+    clock->updated_at = now;
+    clock->paused = paused;
+  }
+  pthread_mutex_unlock(&clock->mutex);
+
+  return RET_OK;
+}
+
+ret_t av_clock_set_speed(av_clock_t *clock, double speed) {
+  return_value_if_fail(clock != NULL && speed > 0, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&clock->mutex);
+  if (clock->speed != speed) {
+    int64_t now = av_gettime_relative();
+    if (clock->valid && !clock->paused) {
+      clock->pts += (now - clock->updated_at) / 1000000.0 * clock->speed;
+    }
+    clock->updated_at = now;
+    clock->speed = speed;
+  }
+  pthread_mutex_unlock(&clock->mutex);
+
+  return RET_OK;
+}
+
+bool_t av_clock_is_valid(av_clock_t *clock) {
+  bool_t valid;
+  return_value_if_fail(clock != NULL, FALSE);
+
+  pthread_mutex_lock(&clock->mutex);
+  valid = clock->valid;
+  pthread_mutex_unlock(&clock->mutex);
+
+  return valid;
+}
+
+double av_clock_get_pts(av_clock_t *clock) {
+  double pts;
+  return_value_if_fail(clock != NULL, 0);
+
+  pthread_mutex_lock(&clock->mutex);
+  pts = clock->pts;
+  pthread_mutex_unlock(&clock->mutex);
+
+  return pts;
+}
+
+double av_clock_get(av_clock_t *clock) {
+  double pts;
+  return_value_if_fail(clock != NULL, 0);
+
+  pthread_mutex_lock(&clock->mutex);
+  pts = clock->pts;
+  if (clock->valid && !clock->paused) {
+    pts += (av_gettime_relative() - clock->updated_at) / 1000000.0 * clock->speed;
+  }
+  pthread_mutex_unlock(&clock->mutex);
+
+  return pts;
+}
@@ -0,0 +1,40 @@
+#ifndef AV_CLOCK_H
+#define AV_CLOCK_H
+
+#include "tkc/types_def.h"
+#include <pthread.h>
+
+BEGIN_C_DECLS
+
+/*
+ * A media clock: the last pts it was set to, advanced by wall time times
+ * its speed while it is running. Safe to read and update from any thread.
+ */
+typedef struct _av_clock_t {
+  double pts;
+  int64_t updated_at; /* av_gettime_relative() of the last update, in us */
+  double speed;
+  bool_t valid;
+  bool_t paused;
+  pthread_mutex_t mutex;
+} av_clock_t;
+
+ret_t av_clock_init(av_clock_t *clock);
+ret_t av_clock_deinit(av_clock_t *clock);
+
+/* Invalidate the clock until the next av_clock_set. */
+ret_t av_clock_reset(av_clock_t *clock);
+ret_t av_clock_set(av_clock_t *clock, double pts);
+ret_t av_clock_set_paused(av_clock_t *clock, bool_t paused);
+/* Media seconds per wall second, 1.0 by default; kept across resets. */
+ret_t av_clock_set_speed(av_clock_t *clock, double speed);
+
+bool_t av_clock_is_valid(av_clock_t *clock);
+/* The pts passed to the last av_clock_set. */
+double av_clock_get_pts(av_clock_t *clock);
+/* The current media time: the last pts plus the media time elapsed since. */
+double av_clock_get(av_clock_t *clock);
+
+END_C_DECLS
+
+#endif /* AV_CLOCK_H */
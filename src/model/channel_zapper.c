@@ -0,0 +1,191 @@
+#include "channel_zapper.h"
+#include "tkc/log.h"
+#include "tkc/utils.h"
+#include <stdlib.h>
+
+/*
+ * An asynchronous stop of the standby, handed from its player thread to the
+ * UI thread. destroy clears zapper when it goes first; queue is kept here
+ * so the player thread never reads the zapper.
+ */
+typedef struct _channel_zapper_request_t {
+  channel_zapper_t *zapper;
+  channel_zapper_queue_t queue;
+} channel_zapper_request_t;
+
+channel_zapper_t *channel_zapper_create(hls_player_t *player,
+                                        channel_zapper_queue_t queue) {
+  return_value_if_fail(player != NULL, NULL);
+
+  channel_zapper_t *zapper =
+      (channel_zapper_t *)calloc(1, sizeof(channel_zapper_t));
+  return_value_if_fail(zapper != NULL, NULL);
+
+  zapper->active = player;
+  zapper->queue = queue;
+
+  return zapper;
+}
+
+ret_t channel_zapper_destroy(channel_zapper_t *zapper) {
+  return_value_if_fail(zapper != NULL, RET_BAD_PARAMS);
+
+  // A stop still on its way reaches the UI thread with nothing to start.
+  if (zapper->request != NULL) {
+    zapper->request->zapper = NULL;
+  }
+
+  // Let both tear down at once before waiting on either.
+  hls_player_stop_async(zapper->active, NULL, NULL);
+  if (zapper->standby != NULL) {
+    hls_player_stop_async(zapper->standby, NULL, NULL);
+    hls_player_destroy(zapper->standby);
+  }
+  hls_player_destroy(zapper->active);
+  free(zapper->standby_url);
+  free(zapper->pending_url);
+  free(zapper);
+
+  return RET_OK;
+}
+
+hls_player_t *channel_zapper_get_player(channel_zapper_t *zapper) {
+  return_value_if_fail(zapper != NULL, NULL);
+  return zapper->active;
+}
+
+/* The standby is stopped: give it the active player's settings and preroll. */
+static ret_t channel_zapper_start_standby(channel_zapper_t *zapper) {
+  char *url = zapper->pending_url;
+  zapper->pending_url = NULL;
+  if (url == NULL) {
+    return RET_OK;
+  }
+
+  hls_player_copy_settings(zapper->standby, zapper->active);
+  hls_player_set_url(zapper->standby, url);
+  ret_t ret = hls_player_preroll(zapper->standby);
+  if (ret != RET_OK) {
+    log_warn("zap: could not prepare %s\n", url);
+  }
+  free(url);
+
+  return ret;
+}
+
+static ret_t channel_zapper_on_standby_stopped_ui(const idle_info_t *info) {
+  channel_zapper_request_t *request = (channel_zapper_request_t *)(info->ctx);
+  channel_zapper_t *zapper = request->zapper;
+
+  free(request);
+  if (zapper != NULL) {
+    zapper->request = NULL;
+    channel_zapper_start_standby(zapper);
+  }
+
+  return RET_REMOVE;
+}
+
+/* Player thread, or prepare itself if nothing was running. */
+static void channel_zapper_on_standby_stopped(void *ctx, hls_player_t *player) {
+  channel_zapper_request_t *request = (channel_zapper_request_t *)ctx;
+  request->queue(channel_zapper_on_standby_stopped_ui, request);
+}
+
+ret_t channel_zapper_prepare(channel_zapper_t *zapper, const char *url) {
+  return_value_if_fail(zapper != NULL && url != NULL, RET_BAD_PARAMS);
+
+  if (zapper->standby_url != NULL && tk_str_eq(zapper->standby_url, url) &&
+      hls_player_get_state(zapper->standby) == PLAYER_STATE_BUFFERING) {
+    return RET_OK;
+  }
+
+  if (zapper->standby == NULL) {
+    zapper->standby = hls_player_create();
+    return_value_if_fail(zapper->standby != NULL, RET_OOM);
+  }
+  char *next = tk_strdup(url);
+  return_value_if_fail(next != NULL, RET_OOM);
+  free(zapper->pending_url);
+  zapper->pending_url = next;
+  free(zapper->standby_url);
+  zapper->standby_url = tk_strdup(url);
+
+  // A stop already under way starts the new url instead.
+  if (zapper->request != NULL) {
+    return RET_OK;
+  }
+  if (zapper->queue == NULL) {
+    hls_player_stop(zapper->standby);
+    return channel_zapper_start_standby(zapper);
+  }
+
+  // Never wait here for a standby prepared on another url to tear down, nor
+  // touch its settings while it does: the preroll starts once it has.
+  channel_zapper_request_t *request =
+      (channel_zapper_request_t *)calloc(1, sizeof(channel_zapper_request_t));
+  return_value_if_fail(request != NULL, RET_OOM);
+  request->zapper = zapper;
+  request->queue = zapper->queue;
+  zapper->request = request;
+  hls_player_stop_async(zapper->standby, channel_zapper_on_standby_stopped,
+                        request);
+
+  return RET_OK;
+}
+
+ret_t channel_zapper_zap(channel_zapper_t *zapper, const char *url) {
+  return_value_if_fail(zapper != NULL && url != NULL, RET_BAD_PARAMS);
+
+  zapper->zaps++;
+  if (zapper->standby_url == NULL || !tk_str_eq(zapper->standby_url, url) ||
+      hls_player_get_state(zapper->standby) != PLAYER_STATE_BUFFERING) {
+    return hls_player_zap(zapper->active, url);
+  }
+
+  // The standby is warm on url: it takes the screen, the active one retires.
+  hls_player_t *next = zapper->standby;
+  hls_player_t *prev = zapper->active;
+
+  hls_player_stop_async(prev, NULL, NULL);
+  // What may have changed on screen since the standby was prepared, through
+  // the setters that apply to a running player; the rest was copied then.
+  hls_player_set_volume(next, hls_player_get_volume(prev));
+  hls_player_set_mute(next, hls_player_get_mute(prev));
+  hls_player_set_playback_rate(next, hls_player_get_playback_rate(prev));
+  hls_player_set_priority(next, hls_player_get_priority(prev));
+  ret_t ret = hls_player_play(next);
+
+  zapper->active = next;
+  zapper->standby = prev;
+  free(zapper->standby_url);
+  zapper->standby_url = NULL;
+  zapper->standby_hits++;
+  log_debug("zap: standby took over on %s\n", url);
+
+  return ret;
+}
+
+ret_t channel_zapper_get_stats(channel_zapper_t *zapper,
+                               channel_zapper_stats_t *stats) {
+  hls_player_zap_stats_t active;
+  hls_player_zap_stats_t standby = {0, -1, -1, -1};
+  return_value_if_fail(zapper != NULL && stats != NULL, RET_BAD_PARAMS);
+
+  hls_player_get_zap_stats(zapper->active, &active);
+  if (zapper->standby != NULL) {
+    hls_player_get_zap_stats(zapper->standby, &standby);
+  }
+
+  stats->zaps = zapper->zaps;
+  stats->standby_hits = zapper->standby_hits;
+  // The player on screen made the last zap.
+  stats->last = active.last;
+  stats->max = tk_max(active.max, standby.max);
+  uint32_t n = active.zaps + standby.zaps;
+  stats->avg = n > 0 ? (tk_max(active.avg, 0) * active.zaps +
+                        tk_max(standby.avg, 0) * standby.zaps) / n
+                     : -1;
+
+  return RET_OK;
+}
@@ -0,0 +1,71 @@
+#ifndef CHANNEL_ZAPPER_H
+#define CHANNEL_ZAPPER_H
+
+#include "hls_player.h"
+
+BEGIN_C_DECLS
+
+/*
+ * Switches one screen between channels as fast as the network allows. The
+ * active player zaps in place (hls_player_zap), keeping its audio device and
+ * output buffers; and the channel expected next can be prepared on a standby
+ * player, pre-opened and decoded up to its first frame, so that zapping to it
+ * only swaps the two players.
+ */
+/* Run on_idle on the UI thread: idle_queue in an AWTK application */
+typedef ret_t (*channel_zapper_queue_t)(idle_func_t on_idle, void *ctx);
+
+typedef struct _channel_zapper_t {
+  hls_player_t *active;
+  hls_player_t *standby;
+  /* url the standby was prepared with, NULL while it is idle */
+  char *standby_url;
+  /*
+   * The standby's last run is stopped asynchronously; once it is torn down
+   * the preroll on pending_url starts on the UI thread, through queue.
+   * request is that stop's, cut loose if the zapper goes first.
+   */
+  channel_zapper_queue_t queue;
+  char *pending_url;
+  struct _channel_zapper_request_t *request;
+  uint32_t zaps;
+  uint32_t standby_hits;
+} channel_zapper_t;
+
+/* Zap time over both players: counts, and milliseconds to the first frame */
+typedef struct _channel_zapper_stats_t {
+  uint32_t zaps;
+  /* Zaps served by the standby */
+  uint32_t standby_hits;
+  double last;
+  double avg;
+  double max;
+} channel_zapper_stats_t;
+
+/*
+ * Takes ownership of player, which becomes the active one. The zapper is
+ * used from the UI thread only; without queue, prepare waits for the
+ * standby's last run to tear down.
+ */
+channel_zapper_t *channel_zapper_create(hls_player_t *player,
+                                        channel_zapper_queue_t queue);
+/* Stops and destroys both players too. */
+ret_t channel_zapper_destroy(channel_zapper_t *zapper);
+
+/* The player on screen; it changes when a zap hits the standby. */
+hls_player_t *channel_zapper_get_player(channel_zapper_t *zapper);
+
+/*
+ * Warm the standby up on url, with the settings of the active player.
+ * Returns at once: the standby starts once its last run is torn down.
+ */
+ret_t channel_zapper_prepare(channel_zapper_t *zapper, const char *url);
+/* Switch the screen to url, through the standby if it was prepared on url. */
+ret_t channel_zapper_zap(channel_zapper_t *zapper, const char *url);
+
+ret_t channel_zapper_get_stats(channel_zapper_t *zapper,
+                               channel_zapper_stats_t *stats);
+
+END_C_DECLS
+
+#endif /* CHANNEL_ZAPPER_H */
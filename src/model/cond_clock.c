@@ -0,0 +1,25 @@
+#include "cond_clock.h"
+
+ret_t cond_clock_init(pthread_cond_t *cond) {
+  pthread_condattr_t attr;
+  return_value_if_fail(cond != NULL, RET_BAD_PARAMS);
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  int ret = pthread_cond_init(cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  return ret == 0 ? RET_OK : RET_FAIL;
+}
+
+void cond_clock_deadline(struct timespec *deadline, uint32_t timeout_ms) {
+  return_if_fail(deadline != NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, deadline);
+  deadline->tv_sec += timeout_ms / 1000;
+  deadline->tv_nsec += (timeout_ms % 1000) * 1000000L;
+  if (deadline->tv_nsec >= 1000000000) {
+    deadline->tv_sec++;
+    deadline->tv_nsec -= 1000000000;
+  }
+}
@@ -0,0 +1,23 @@
+#ifndef COND_CLOCK_H
+#define COND_CLOCK_H
+
+#include "tkc/types_def.h"
+#include <pthread.h>
+#include <time.h>
+
+BEGIN_C_DECLS
+
+/*
+ * Timed condition waits against the monotonic clock, so that a wall clock
+ * step (NTP, a user setting the time) neither cuts a wait short nor makes
+ * it hang. A condition initialized with cond_clock_init takes deadlines
+ * from cond_clock_deadline in pthread_cond_timedwait.
+ */
+ret_t cond_clock_init(pthread_cond_t *cond);
+
+/* The monotonic time timeout_ms from now. */
+void cond_clock_deadline(struct timespec *deadline, uint32_t timeout_ms);
+
+END_C_DECLS
+
+#endif /* COND_CLOCK_H */
@@ -0,0 +1,129 @@
+#include "decode_ladder.h"
+#include <math.h>
+#include <string.h>
+
+/* Half-life in seconds of the late and spare averages */
+#define DECODE_LADDER_HALF_LIFE 1.0
+/* Share of late frames that steps down, after this many seconds at a level */
+#define DECODE_LADDER_DOWN_LATE 0.25
+#define DECODE_LADDER_DOWN_HOLD 1.0
+/* Stepping up wants fewer late frames than this and this much frame time spare */
+#define DECODE_LADDER_UP_LATE 0.02
+#define DECODE_LADDER_UP_SPARE 0.3
+/* Seconds at a level before stepping up; doubled up to the max on failure */
+#define DECODE_LADDER_UP_HOLD 5.0
+#define DECODE_LADDER_MAX_UP_HOLD 60.0
+/* Longer gaps between frames (a pause, a stall) count as this long */
+#define DECODE_LADDER_MAX_GAP 5.0
+
+static void decode_ladder_step(decode_ladder_t *ladder, int64_t now,
+                               decode_level_t level) {
+  __atomic_store_n(&ladder->level, level, __ATOMIC_RELAXED);
+  ladder->level_start = now;
+  // The next level proves itself from scratch.
+  ladder->late = 0;
+  ladder->spare = 0;
+}
+
+ret_t decode_ladder_init(decode_ladder_t *ladder) {
+  return_value_if_fail(ladder != NULL, RET_BAD_PARAMS);
+
+  memset(ladder, 0x00, sizeof(*ladder));
+  ladder->up_hold = DECODE_LADDER_UP_HOLD;
+
+  return RET_OK;
+}
+
+ret_t decode_ladder_reset(decode_ladder_t *ladder) {
+  return_value_if_fail(ladder != NULL, RET_BAD_PARAMS);
+
+  __atomic_store_n(&ladder->level, DECODE_LEVEL_FULL, __ATOMIC_RELAXED);
+  ladder->late = 0;
+  ladder->spare = 0;
+  ladder->last_sample = 0;
+  ladder->level_start = 0;
+  ladder->last_up = 0;
+  ladder->up_hold = DECODE_LADDER_UP_HOLD;
+
+  return RET_OK;
+}
+
+decode_level_t decode_ladder_update(decode_ladder_t *ladder, int64_t now,
+                                    double lateness, double frame_duration) {
+  return_value_if_fail(ladder != NULL && frame_duration > 0, DECODE_LEVEL_FULL);
+
+  if (ladder->last_sample == 0) {
+    ladder->last_sample = now;
+    ladder->level_start = now;
+    return ladder->level;
+  }
+
+  double dt = tk_min((now - ladder->last_sample) / 1000000.0, DECODE_LADDER_MAX_GAP);
+  ladder->last_sample = now;
+  if (dt <= 0) {
+    return ladder->level;
+  }
+  double seconds = ladder->seconds[ladder->level] + dt;
+  __atomic_store(&ladder->seconds[ladder->level], &seconds, __ATOMIC_RELAXED);
+
+  double weight = 1 - pow(0.5, dt / DECODE_LADDER_HALF_LIFE);
+  double spare = -lateness / frame_duration;
+  spare = tk_max(tk_min(spare, 1.0), -1.0);
+  ladder->late += weight * ((lateness > 0 ? 1.0 : 0.0) - ladder->late);
+  ladder->spare += weight * (spare - ladder->spare);
+
+  double held = (now - ladder->level_start) / 1000000.0;
+  double since_up = (now - ladder->last_up) / 1000000.0;
+  if (ladder->last_up != 0 && since_up >= 2 * ladder->up_hold) {
+    // The last step up held: the next one needs no extra patience.
+    ladder->up_hold = DECODE_LADDER_UP_HOLD;
+    ladder->last_up = 0;
+  }
+
+  if (ladder->level < DECODE_LEVEL_KEYFRAMES &&
+      ladder->late > DECODE_LADDER_DOWN_LATE && held >= DECODE_LADDER_DOWN_HOLD) {
+    if (ladder->last_up != 0 && since_up < ladder->up_hold) {
+      ladder->up_hold = tk_min(ladder->up_hold * 2, DECODE_LADDER_MAX_UP_HOLD);
+    }
+    ladder->last_up = 0;
+    __atomic_fetch_add(&ladder->steps_down, 1, __ATOMIC_RELAXED);
+    decode_ladder_step(ladder, now, (decode_level_t)(ladder->level + 1));
+  } else if (ladder->level > DECODE_LEVEL_FULL &&
+             ladder->late < DECODE_LADDER_UP_LATE &&
+             ladder->spare > DECODE_LADDER_UP_SPARE && held >= ladder->up_hold) {
+    ladder->last_up = now;
+    __atomic_fetch_add(&ladder->steps_up, 1, __ATOMIC_RELAXED);
+    decode_ladder_step(ladder, now, (decode_level_t)(ladder->level - 1));
+  }
+
+  return ladder->level;
+}
+
+ret_t decode_ladder_get_stats(decode_ladder_t *ladder,
+                              decode_ladder_stats_t *stats) {
+  return_value_if_fail(ladder != NULL && stats != NULL, RET_BAD_PARAMS);
+
+  stats->level = __atomic_load_n(&ladder->level, __ATOMIC_RELAXED);
+  stats->steps_down = __atomic_load_n(&ladder->steps_down, __ATOMIC_RELAXED);
+  stats->steps_up = __atomic_load_n(&ladder->steps_up, __ATOMIC_RELAXED);
+  for (uint32_t i = 0; i < DECODE_LEVELS; i++) {
+    __atomic_load(&ladder->seconds[i], &stats->seconds[i], __ATOMIC_RELAXED);
+  }
+
+  return RET_OK;
+}
+
+const char *decode_level_name(decode_level_t level) {
+  switch (level) {
+  case DECODE_LEVEL_FULL:
+    return "full";
+  case DECODE_LEVEL_SKIP_LOOP_FILTER:
+    return "skip_loop_filter";
+  case DECODE_LEVEL_SKIP_NONREF:
+    return "skip_nonref";
+  case DECODE_LEVEL_KEYFRAMES:
+    return "keyframes";
+  default:
+    return "unknown";
+  }
+}
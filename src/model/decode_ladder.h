@@ -0,0 +1,71 @@
+#ifndef DECODE_LADDER_H
+#define DECODE_LADDER_H
+
+#include "tkc/types_def.h"
+
+BEGIN_C_DECLS
+
+/* What the video decoder leaves out, cheapest loss of quality first */
+typedef enum _decode_level_t {
+  DECODE_LEVEL_FULL = 0,
+  /* No deblocking */
+  DECODE_LEVEL_SKIP_LOOP_FILTER,
+  /* No deblocking, and frames nothing refers to are not decoded */
+  DECODE_LEVEL_SKIP_NONREF,
+  DECODE_LEVEL_KEYFRAMES,
+  DECODE_LEVELS
+} decode_level_t;
+
+/*
+ * Degrades decoding when the CPU cannot keep up, and restores it when it
+ * can. Each decoded frame reports how late it came out relative to its
+ * display time; the share of late frames and the share of the frame time
+ * left over are tracked as averages over time. Sustained lateness steps one
+ * level down; a step up needs almost no late frames, plenty of time to spare
+ * and a longer stay at the level, and that stay doubles each time a step up
+ * is undone straight away.
+ */
+typedef struct _decode_ladder_t {
+  decode_level_t level;
+  double late;
+  double spare;
+  /* Microseconds, 0 before the first frame */
+  int64_t last_sample;
+  int64_t level_start;
+  int64_t last_up;
+  double up_hold;
+  uint32_t steps_down;
+  uint32_t steps_up;
+  /* Seconds decoded at each level */
+  double seconds[DECODE_LEVELS];
+} decode_ladder_t;
+
+typedef struct _decode_ladder_stats_t {
+  decode_level_t level;
+  uint32_t steps_down;
+  uint32_t steps_up;
+  double seconds[DECODE_LEVELS];
+} decode_ladder_stats_t;
+
+ret_t decode_ladder_init(decode_ladder_t *ladder);
+
+/* Back to full decoding for a new stream; the counters are kept. */
+ret_t decode_ladder_reset(decode_ladder_t *ladder);
+
+/*
+ * A frame of frame_duration seconds came out of the decoder at now (in
+ * microseconds), lateness seconds after its display time (negative when
+ * early). Returns the level to decode the next frames at.
+ */
+decode_level_t decode_ladder_update(decode_ladder_t *ladder, int64_t now,
+                                    double lateness, double frame_duration);
+
+/* Safe from any thread while another one updates the ladder. */
+ret_t decode_ladder_get_stats(decode_ladder_t *ladder,
+                              decode_ladder_stats_t *stats);
+
+const char *decode_level_name(decode_level_t level);
+
+END_C_DECLS
+
+#endif /* DECODE_LADDER_H */
@@ -0,0 +1,142 @@
+#include "decode_scheduler.h"
+#include "cond_clock.h"
+#include <errno.h>
+#include <libavutil/cpu.h>
+#include <libavutil/time.h>
+#include <string.h>
+
+/* Queueing is averaged over windows of this length */
+#define DECODE_SCHEDULER_WINDOW_US 500000
+/* Average number of callers queueing to enter and to leave saturation */
+#define DECODE_SCHEDULER_HIGH_LOAD 0.5
+#define DECODE_SCHEDULER_LOW_LOAD 0.1
+/*
+ * Saturation lasts at least this long, so that shedding load (which ends
+ * the queueing) does not switch it straight back off.
+ */
+#define DECODE_SCHEDULER_HOLD_US 3000000
+
+ret_t decode_scheduler_init(decode_scheduler_t *s, uint32_t nr_slots) {
+  return_value_if_fail(s != NULL, RET_BAD_PARAMS);
+
+  memset(s, 0x00, sizeof(*s));
+  s->nr_slots = nr_slots > 0 ? nr_slots : tk_max(1, av_cpu_count());
+  s->window_start = av_gettime_relative();
+  pthread_mutex_init(&s->mutex, NULL);
+  cond_clock_init(&s->cond);
+
+  return RET_OK;
+}
+
+ret_t decode_scheduler_deinit(decode_scheduler_t *s) {
+  return_value_if_fail(s != NULL, RET_BAD_PARAMS);
+
+  pthread_cond_destroy(&s->cond);
+  pthread_mutex_destroy(&s->mutex);
+
+  return RET_OK;
+}
+
+static void decode_scheduler_update_locked(decode_scheduler_t *s, int64_t now) {
+  int64_t elapsed = now - s->window_start;
+  if (elapsed < DECODE_SCHEDULER_WINDOW_US) {
+    return;
+  }
+
+  double load = (double)s->wait_us / elapsed;
+  if (load > DECODE_SCHEDULER_HIGH_LOAD) {
+    if (!s->saturated) {
+      log_debug("decode: saturated, %.2f callers queueing\n", load);
+    }
+    s->saturated = TRUE;
+    s->saturated_since = now;
+  } else if (s->saturated && load < DECODE_SCHEDULER_LOW_LOAD &&
+             now - s->saturated_since >= DECODE_SCHEDULER_HOLD_US) {
+    log_debug("decode: no longer saturated\n");
+    s->saturated = FALSE;
+  }
+
+  s->window_start = now;
+  s->wait_us = 0;
+}
+
+static bool_t decode_scheduler_can_enter_locked(decode_scheduler_t *s,
+                                                decode_priority_t priority) {
+  if (s->busy >= s->nr_slots) {
+    return FALSE;
+  }
+  for (uint32_t p = priority + 1; p < DECODE_PRIORITIES; p++) {
+    if (s->waiting[p] > 0) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+ret_t decode_scheduler_acquire(decode_scheduler_t *s, decode_priority_t priority,
+                               uint32_t timeout_ms) {
+  ret_t ret = RET_OK;
+  struct timespec deadline;
+
+  return_value_if_fail(s != NULL && priority < DECODE_PRIORITIES, RET_BAD_PARAMS);
+
+  cond_clock_deadline(&deadline, timeout_ms);
+
+  pthread_mutex_lock(&s->mutex);
+  if (!decode_scheduler_can_enter_locked(s, priority)) {
+    int64_t start = av_gettime_relative();
+    s->waiting[priority]++;
+    while (!decode_scheduler_can_enter_locked(s, priority)) {
+      if (pthread_cond_timedwait(&s->cond, &s->mutex, &deadline) == ETIMEDOUT) {
+        ret = RET_TIMEOUT;
+        break;
+      }
+    }
+    s->waiting[priority]--;
+
+    int64_t end = av_gettime_relative();
+    s->wait_us += end - start;
+    decode_scheduler_update_locked(s, end);
+    if (ret != RET_OK) {
+      // Lower priorities may have been held back by this waiter.
+      pthread_cond_broadcast(&s->cond);
+    }
+  }
+  if (ret == RET_OK) {
+    s->busy++;
+  }
+  pthread_mutex_unlock(&s->mutex);
+
+  return ret;
+}
+
+ret_t decode_scheduler_release(decode_scheduler_t *s) {
+  return_value_if_fail(s != NULL, RET_BAD_PARAMS);
+
+  ret_t ret = RET_FAIL;
+  pthread_mutex_lock(&s->mutex);
+  if (s->busy > 0) {
+    s->busy--;
+    pthread_cond_broadcast(&s->cond);
+    ret = RET_OK;
+  }
+  pthread_mutex_unlock(&s->mutex);
+
+  return ret;
+}
+
+bool_t decode_scheduler_is_saturated(decode_scheduler_t *s) {
+  return_value_if_fail(s != NULL, FALSE);
+
+  pthread_mutex_lock(&s->mutex);
+  decode_scheduler_update_locked(s, av_gettime_relative());
+  bool_t saturated = s->saturated;
+  pthread_mutex_unlock(&s->mutex);
+
+  return saturated;
+}
+
+uint32_t decode_scheduler_get_slots(decode_scheduler_t *s) {
+  return_value_if_fail(s != NULL, 0);
+  return s->nr_slots;
+}
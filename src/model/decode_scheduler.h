@@ -0,0 +1,57 @@
+#ifndef DECODE_SCHEDULER_H
+#define DECODE_SCHEDULER_H
+
+#include "tkc/types_def.h"
+#include <pthread.h>
+
+BEGIN_C_DECLS
+
+typedef enum _decode_priority_t {
+  DECODE_PRIORITY_BACKGROUND = 0,
+  DECODE_PRIORITY_NORMAL,
+  DECODE_PRIORITY_FOCUSED,
+  DECODE_PRIORITIES
+} decode_priority_t;
+
+/*
+ * Admission control for video decoders sharing the machine: a fixed number
+ * of slots, usually one per core, each held for one decode call. A waiter
+ * gets a free slot only when nobody of a higher priority is waiting.
+ *
+ * The scheduler is saturated while callers spend more time queueing for a
+ * slot than the cores have to spare; see decode_scheduler_is_saturated.
+ */
+typedef struct _decode_scheduler_t {
+  uint32_t nr_slots;
+  uint32_t busy;
+  uint32_t waiting[DECODE_PRIORITIES];
+
+  /* Microseconds spent waiting by all callers since window_start */
+  int64_t window_start;
+  int64_t wait_us;
+  bool_t saturated;
+  int64_t saturated_since;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+} decode_scheduler_t;
+
+/* nr_slots 0 is one per core */
+ret_t decode_scheduler_init(decode_scheduler_t *s, uint32_t nr_slots);
+ret_t decode_scheduler_deinit(decode_scheduler_t *s);
+
+/* Returns RET_TIMEOUT if no slot was granted within timeout_ms. */
+ret_t decode_scheduler_acquire(decode_scheduler_t *s, decode_priority_t priority,
+                               uint32_t timeout_ms);
+ret_t decode_scheduler_release(decode_scheduler_t *s);
+
+/*
+ * True once on average more than half a caller has been queueing over a
+ * window, until the queueing nearly stops for a few seconds.
+ */
+bool_t decode_scheduler_is_saturated(decode_scheduler_t *s);
+uint32_t decode_scheduler_get_slots(decode_scheduler_t *s);
+
+END_C_DECLS
+
+#endif /* DECODE_SCHEDULER_H */
@@ -1,14 +1,33 @@
 #include "hls_player.h"
+#include "audio_gain.h"
+#include "audio_ring.h"
+#include "av_clock.h"
+#include "decode_ladder.h"
+#include "decode_scheduler.h"
+#include "hls_source.h"
+#include "http_pool.h"
+#include "latency_histogram.h"
+#include "packet_queue.h"
+#include "seek_index.h"
+#include "segment_cache.h"
+#include "time_stretch.h"
+#include "timeshift.h"
+#include "video_scaler.h"
+#include "worker_pool.h"
 #include "tkc/log.h"
 #include <SDL.h>
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/channel_layout.h>
+#include <libavutil/cpu.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
 #include <libavutil/opt.h>
+#include <libavutil/time.h>
 #include <libswresample/swresample.h>
 #include <libswscale/swscale.h>
+#include <math.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,32 +37,328 @@ struct _hls_player_t {
   player_state_t state;
 
   AVFormatContext *fmt_ctx;
+  /* Native playlist engine feeding fmt_ctx; NULL when FFmpeg's hls demuxer is used */
+  hls_source_t *source;
+  bool_t native_hls;
+  uint32_t prefetch_segments;
+  /* Variant pinned by the application, -1 to adapt */
+  int variant;
+  /* Persistent VOD segment cache, NULL when disabled */
+  segment_cache_t *cache;
+  /* Keep-alive connections of the playlist engine, kept across runs */
+  http_pool_t *http_pool;
+  /* Optional, not owned: used instead of http_pool */
+  http_pool_t *shared_http_pool;
+  /* FALSE sends every request through FFmpeg's HTTP, one connection each */
+  bool_t keep_alive;
+  /* Guards source and timeshift against the player thread tearing them down */
+  pthread_mutex_t source_mutex;
   AVCodecContext *video_dec_ctx;
   AVCodecContext *audio_dec_ctx;
   int video_stream_idx;
   int audio_stream_idx;
-  struct SwsContext *sws_ctx;
+  video_scaler_t scaler_ctx;
+  /* Runs colour conversion slices; NULL converts on the video thread */
+  worker_pool_t *convert_pool;
+  /* Optional, not owned: used as convert_pool instead of a pool of our own */
+  worker_pool_t *shared_convert_pool;
+  /* Optional, not owned: each video decode call holds one of its slots */
+  decode_scheduler_t *decode_scheduler;
+  hls_player_priority_t priority;
+  bool_t keyframes_only;
+  /* Decode less while frames come out late; stepped by the video thread */
+  bool_t auto_degrade;
+  decode_ladder_t decode_ladder;
+  /* Largest variant to play, 0 for no limit */
+  int max_width;
+  int max_height;
+  /* 0 picks a default from the core count */
+  uint32_t decode_threads;
+  uint32_t decode_thread_types;
+  uint32_t convert_threads;
+  /* Size of the widget showing the video; 0 converts at native size */
+  int output_width;
+  int output_height;
+  hls_player_scaler_t scaler;
+  hls_player_converter_t converter;
+  hls_player_pixel_format_t output_format;
   struct SwrContext *swr_ctx;
   SDL_AudioDeviceID audio_dev;
   bool_t audio_initialized;
   int audio_channels;
   int audio_sample_rate;
+  int audio_bytes_per_sec;
+  double audio_hw_latency;
+  /* Decoded PCM feeding the SDL callback, and how far ahead it is filled */
+  audio_ring_t audio_ring;
+  double audio_latency;
+  /* Resampler output, grown as needed and reused across frames */
+  uint8_t *audio_buf;
+  unsigned int audio_buf_size;
+  /* Volume and mute as set, and the Q14 gain last applied on the way to them */
+  double volume;
+  bool_t muted;
+  int32_t audio_gain;
+  /* Audio is time-stretched while the rate is not 1.0, or until drained */
+  double playback_rate;
+  time_stretch_t stretch;
+  int16_t *stretch_buf;
+  bool_t stretching;
+
+  /*
+   * audio_clock holds the pts at the ring's read position less the device
+   * buffer, set from the SDL callback and advanced by wall time in between.
+   * ext_clock is the system clock, slaved to audio while audio is flowing
+   * and used as master for video-only streams or while audio is starved.
+   */
+  av_clock_t audio_clock;
+  av_clock_t ext_clock;
+
+  /*
+   * Pipeline metrics: per-stage latency and frame counts since play. Like
+   * the histograms, the counters and gauges are read and reset from any
+   * thread with relaxed atomics.
+   */
+  latency_histogram_t stage_latency[HLS_PLAYER_STAGES];
+  uint64_t frames_decoded;
+  uint64_t frames_displayed;
+  uint64_t frames_dropped;
+  /* Demuxed bytes since bitrate_start, and the rate over the last window */
+  int64_t bitrate_start;
+  uint64_t bitrate_bytes;
+  double bitrate;
+
+  /* demux -> decode worker handoff */
+  packet_queue_t video_queue;
+  packet_queue_t audio_queue;
+  pthread_t video_thread;
+  pthread_t audio_thread;
+  bool_t video_thread_running;
+  bool_t audio_thread_running;
 
   pthread_t thread;
   bool_t running;
   bool_t quit;
+  /* Set from pthread_create until joined; running is cleared by the thread */
+  bool_t joinable;
+
+  /*
+   * Asynchronous stop: the completion callback, handed over under
+   * stop_mutex so it runs exactly once whichever side comes second
+   */
+  pthread_mutex_t stop_mutex;
+  hls_player_on_stopped_t on_stopped;
+  void *on_stopped_ctx;
+  int64_t stop_requested;
+  uint32_t stops;
+  double stop_latency_last;
+  double stop_latency_max;
+
+  /* Zap: the url the running pipeline restarts on and when, under stop_mutex */
+  char *zap_url;
+  int64_t zap_requested;
+  /* Set under stop_mutex once the player thread has no run left to zap */
+  bool_t finishing;
+  /* Set on a zap or a switch to a standby, cleared by its first frame */
+  int64_t zap_start;
+  uint32_t zaps;
+  double zap_last;
+  double zap_total;
+  double zap_max;
+  /*
+   * Standby (BUFFERING): the first frame is decoded and held for play, or
+   * without video the first audio is queued. preroll_cond, under
+   * stop_mutex, wakes the video hold when it ends or the run is quit.
+   */
+  bool_t prerolled;
+  pthread_cond_t preroll_cond;
+  /* Held while a frame is on its way to the sinks, for stop's output fence */
+  pthread_mutex_t output_mutex;
+
+  /* Demuxer I/O deadlines, and the one armed for the call in progress */
+  int64_t open_timeout;
+  int64_t read_timeout;
+  int64_t io_deadline;
+  bool_t io_timed_out;
+  uint32_t io_timeouts;
 
   hls_player_on_frame_t on_frame;
   void *on_frame_ctx;
+  hls_player_acquire_frame_t acquire_frame;
+  hls_player_release_frame_t release_frame;
+  void *frame_sink_ctx;
 
+  /* Published by the player threads, read atomically by any */
   double position;
   double duration;
+
+  /* Present frames as soon as they are decoded, ignoring the clocks */
+  bool_t free_run;
+  /* Probe less, start low and show the first frame at once */
+  bool_t fast_start;
+  int audio_in_rate;
+  pthread_t audio_open_thread;
+  bool_t audio_opening;
+  /* av_gettime_relative() of play, and microseconds from it to each phase */
+  int64_t play_start;
+  int64_t startup_us[HLS_PLAYER_STARTUP_PHASES];
+
+  /* First pts of the stream; positions are reported relative to it */
+  double start_time;
+  seek_index_t seek_index;
+  /* Latest request from hls_player_seek, taken by the demux thread */
+  double seek_target;
+  bool_t seek_requested;
+  /* Demuxed packets before this pts are dropped after a seek, -1 for none */
+  double skip_until;
+  /* av_gettime_relative() of the last seek, and time to its first frame */
+  int64_t seek_start;
+  uint32_t seeks;
+  double seek_ttff_last;
+  double seek_ttff_total;
+  double seek_ttff_max;
+
+  /* Live timeshift: the ingest thread demuxes into the buffer, 0 bytes disables */
+  uint32_t timeshift_bytes;
+  char *timeshift_dir;
+  uint64_t timeshift_spill_bytes;
+  timeshift_t *timeshift;
+  pthread_t ingest_thread;
+  bool_t ingest_running;
+  /* Latest request from hls_player_timeshift_seek, in seconds behind live */
+  double timeshift_target;
+  bool_t timeshift_requested;
+
+  /*
+   * Low-latency live: catchup_rate scales playback_rate to steer
+   * live_latency, both written by the player thread only.
+   */
+  bool_t low_latency;
+  double target_latency;
+  double catchup_rate;
+  double live_latency;
 };
 
+#define HLS_PLAYER_QUEUE_SLOTS 1024
+#define HLS_PLAYER_QUEUE_MAX_BYTES (8 * 1024 * 1024)
+#define HLS_PLAYER_QUEUE_MAX_DURATION 5.0
+/* Default audio buffered ahead of the device, and the ring holding it */
+#define HLS_PLAYER_AUDIO_LATENCY 0.5
+#define HLS_PLAYER_AUDIO_RING_MIN 1.0
+/* Device buffer range, in samples */
+#define HLS_PLAYER_AUDIO_MIN_SAMPLES 256
+#define HLS_PLAYER_AUDIO_MAX_SAMPLES 1024
+/* Time-stretched frames produced per call, and the rates allowed */
+#define HLS_PLAYER_STRETCH_FRAMES 4096
+#define HLS_PLAYER_MIN_RATE 0.5
+#define HLS_PLAYER_MAX_RATE 2.0
+#define HLS_PLAYER_WAIT_MS 10
+#define HLS_PLAYER_PREFETCH_SEGMENTS 3
+/* Fast start: probing limits, and the device format opened before probing */
+#define HLS_PLAYER_FAST_PROBESIZE (256 * 1024)
+#define HLS_PLAYER_FAST_ANALYZE_US 500000
+#define HLS_PLAYER_AUDIO_RATE 48000
+#define HLS_PLAYER_AUDIO_CHANNELS 2
+/* Attempts to hand the first frame to a sink that is still allocating */
+#define HLS_PLAYER_FIRST_FRAME_RETRIES 20
+/* Audio can be muxed this far from the video around a seek point */
+#define HLS_PLAYER_SEEK_SKEW 1.0
+/* How often the demuxer tells the playlist engine its buffer level */
+#define HLS_PLAYER_BUFFER_REPORT_US 100000
+/* Frames later than this (or one frame duration) are dropped */
+#define HLS_PLAYER_LATE_THRESHOLD 0.05
+/* Window the demuxed bitrate is averaged over */
+#define HLS_PLAYER_BITRATE_WINDOW_US 1000000
+/* Clock differences beyond this are treated as a timestamp discontinuity */
+#define HLS_PLAYER_NOSYNC_THRESHOLD 10.0
+/* Default demuxer I/O deadlines: open and probe, and each packet read */
+#define HLS_PLAYER_OPEN_TIMEOUT_US (10 * 1000000)
+#define HLS_PLAYER_READ_TIMEOUT_US (15 * 1000000)
+/*
+ * Live catch-up: the rate bounds, the latency error that starts a catch-up
+ * and the one that ends it, and the rate change per second of error
+ */
+#define HLS_PLAYER_CATCHUP_MIN_RATE 0.95
+#define HLS_PLAYER_CATCHUP_MAX_RATE 1.10
+#define HLS_PLAYER_CATCHUP_START 0.3
+#define HLS_PLAYER_CATCHUP_STOP 0.1
+#define HLS_PLAYER_CATCHUP_GAIN 0.05
+
 static void *player_thread(void *arg);
 
+/* Wait for the player thread of the last run, if it has not been joined. */
+static void hls_player_join(hls_player_t *player) {
+  if (player->joinable) {
+    // From on_stopped on the player thread itself, which is done with the
+    // player once the callback returns.
+    if (pthread_equal(player->thread, pthread_self())) {
+      pthread_detach(player->thread);
+    } else {
+      pthread_join(player->thread, NULL);
+    }
+    player->joinable = FALSE;
+  }
+}
+
+static void hls_player_mark_startup(hls_player_t *player,
+                                    hls_player_startup_phase_t phase) {
+  if (player->startup_us[phase] == 0) {
+    int64_t elapsed = av_gettime_relative() - player->play_start;
+    player->startup_us[phase] = tk_max(elapsed, 1);
+  }
+}
+
 hls_player_t *hls_player_create(void) {
   hls_player_t *player = (hls_player_t *)calloc(1, sizeof(hls_player_t));
+  return_value_if_fail(player != NULL, NULL);
+  player->scaler = HLS_PLAYER_SCALER_BILINEAR;
+  player->decode_thread_types = HLS_PLAYER_THREAD_FRAME | HLS_PLAYER_THREAD_SLICE;
+  player->native_hls = TRUE;
+  player->prefetch_segments = HLS_PLAYER_PREFETCH_SEGMENTS;
+  player->variant = -1;
+  player->priority = HLS_PLAYER_PRIORITY_NORMAL;
+  pthread_mutex_init(&player->source_mutex, NULL);
+  video_scaler_init(&player->scaler_ctx);
+
+  if (packet_queue_init(&player->video_queue, HLS_PLAYER_QUEUE_SLOTS,
+                        HLS_PLAYER_QUEUE_MAX_BYTES,
+                        HLS_PLAYER_QUEUE_MAX_DURATION) != RET_OK) {
+    pthread_mutex_destroy(&player->source_mutex);
+    free(player);
+    return NULL;
+  }
+  if (packet_queue_init(&player->audio_queue, HLS_PLAYER_QUEUE_SLOTS,
+                        HLS_PLAYER_QUEUE_MAX_BYTES / 8,
+                        HLS_PLAYER_QUEUE_MAX_DURATION) != RET_OK) {
+    packet_queue_deinit(&player->video_queue);
+    pthread_mutex_destroy(&player->source_mutex);
+    free(player);
+    return NULL;
+  }
+  pthread_mutex_init(&player->stop_mutex, NULL);
+  pthread_mutex_init(&player->output_mutex, NULL);
+  pthread_cond_init(&player->preroll_cond, NULL);
+  player->open_timeout = HLS_PLAYER_OPEN_TIMEOUT_US;
+  player->read_timeout = HLS_PLAYER_READ_TIMEOUT_US;
+  av_clock_init(&player->audio_clock);
+  av_clock_init(&player->ext_clock);
+  player->audio_latency = HLS_PLAYER_AUDIO_LATENCY;
+  player->volume = 1.0;
+  player->audio_gain = AUDIO_GAIN_UNITY;
+  player->playback_rate = 1.0;
+  player->catchup_rate = 1.0;
+  player->live_latency = -1;
+  seek_index_init(&player->seek_index);
+  decode_ladder_init(&player->decode_ladder);
+  player->auto_degrade = TRUE;
+  player->http_pool = http_pool_create(0, 0, 0);
+  if (player->http_pool == NULL) {
+    // Each request then opens its own FFmpeg HTTP connection, as with
+    // keep-alive off, unless a shared pool is set.
+    log_warn("Failed to create HTTP pool\n");
+  }
+  player->keep_alive = TRUE;
+
   return player;
 }
 
@@ -57,363 +372,2611 @@ ret_t hls_player_set_url(hls_player_t *player, const char *url) {
   return RET_OK;
 }
 
+static void hls_player_store_position(hls_player_t *player, double position) {
+  __atomic_store(&player->position, &position, __ATOMIC_RELEASE);
+}
+
+/* A metrics gauge written on one thread and read on others. */
+static void hls_player_store_gauge(double *gauge, double value) {
+  __atomic_store(gauge, &value, __ATOMIC_RELAXED);
+}
+
+static double hls_player_load_gauge(double *gauge) {
+  double value;
+  __atomic_load(gauge, &value, __ATOMIC_RELAXED);
+  return value;
+}
+
+/*
+ * Per-run state, reset when a run starts from play, preroll or a zap. The
+ * threads of the previous run are gone by then.
+ */
+static void hls_player_reset_run(hls_player_t *player, int64_t start) {
+  hls_player_store_position(player, 0);
+  player->play_start = start;
+  memset(player->startup_us, 0x00, sizeof(player->startup_us));
+  player->start_time = 0;
+  player->skip_until = -1;
+  player->seek_requested = FALSE;
+  player->timeshift_requested = FALSE;
+  player->prerolled = FALSE;
+  seek_index_reset(&player->seek_index);
+  decode_ladder_reset(&player->decode_ladder);
+  av_clock_reset(&player->audio_clock);
+  av_clock_reset(&player->ext_clock);
+}
+
+/* Start a run from STOPPED, playing or as a standby (BUFFERING). */
+static ret_t hls_player_start(hls_player_t *player, player_state_t state) {
+  bool_t paused = state != PLAYER_STATE_PLAYING;
+
+  // An asynchronous stop may still be tearing the last run down.
+  hls_player_join(player);
+  pthread_mutex_lock(&player->stop_mutex);
+  // A zap that came too late for the last run must not steer a later one.
+  if (player->zap_url != NULL) {
+    free(player->zap_url);
+    player->zap_url = NULL;
+  }
+  player->finishing = FALSE;
+  pthread_mutex_unlock(&player->stop_mutex);
+  player->quit = FALSE;
+  player->running = TRUE;
+  hls_player_reset_metrics(player);
+  hls_player_reset_run(player, av_gettime_relative());
+  av_clock_set_paused(&player->audio_clock, paused);
+  av_clock_set_paused(&player->ext_clock, paused);
+  // Before the thread: it opens the audio device paused or not from this.
+  player->state = state;
+  player->joinable =
+      pthread_create(&player->thread, NULL, player_thread, player) == 0;
+  if (!player->joinable) {
+    player->running = FALSE;
+    player->state = PLAYER_STATE_STOPPED;
+    return RET_FAIL;
+  }
+
+  return RET_OK;
+}
+
 ret_t hls_player_play(hls_player_t *player) {
   return_value_if_fail(player != NULL, RET_BAD_PARAMS);
-  if (player->state == PLAYER_STATE_PLAYING) {
+  player_state_t state = hls_player_get_state(player);
+  if (state == PLAYER_STATE_PLAYING) {
     return RET_OK;
   }
 
-  if (player->state == PLAYER_STATE_STOPPED) {
-    player->quit = FALSE;
-    player->running = TRUE;
-    pthread_create(&player->thread, NULL, player_thread, player);
-  } else if (player->state == PLAYER_STATE_PAUSED) {
+  if (state == PLAYER_STATE_STOPPED) {
+    return hls_player_start(player, PLAYER_STATE_PLAYING);
+  } else if (state == PLAYER_STATE_BUFFERING) {
+    // A warmed-up standby: its first frame is decoded and waiting for this.
+    __atomic_store_n(&player->zap_start, av_gettime_relative(), __ATOMIC_RELEASE);
     if (player->audio_dev != 0) {
       SDL_PauseAudioDevice(player->audio_dev, 0);
     }
+    av_clock_set_paused(&player->audio_clock, FALSE);
+    av_clock_set_paused(&player->ext_clock, FALSE);
+  } else if (state == PLAYER_STATE_PAUSED) {
+    if (player->audio_dev != 0) {
+      SDL_PauseAudioDevice(player->audio_dev, 0);
+    }
+    av_clock_set_paused(&player->audio_clock, FALSE);
+    av_clock_set_paused(&player->ext_clock, FALSE);
   }
 
-  player->state = PLAYER_STATE_PLAYING;
+  // The run may have ended meanwhile: its STOPPED is not overwritten.
+  pthread_mutex_lock(&player->stop_mutex);
+  bool_t ended = player->state == PLAYER_STATE_STOPPED;
+  if (!ended) {
+    player->state = PLAYER_STATE_PLAYING;
+    pthread_cond_broadcast(&player->preroll_cond);
+  }
+  pthread_mutex_unlock(&player->stop_mutex);
+  if (ended) {
+    return hls_player_start(player, PLAYER_STATE_PLAYING);
+  }
   return RET_OK;
 }
 
 ret_t hls_player_pause(hls_player_t *player) {
   return_value_if_fail(player != NULL, RET_BAD_PARAMS);
-  if (player->state == PLAYER_STATE_PLAYING) {
+
+  // Checked and set together with the player thread's STOPPED.
+  pthread_mutex_lock(&player->stop_mutex);
+  bool_t pause = player->stop_requested == 0 &&
+                 player->state == PLAYER_STATE_PLAYING;
+  if (pause) {
     player->state = PLAYER_STATE_PAUSED;
+  }
+  pthread_mutex_unlock(&player->stop_mutex);
+
+  if (pause) {
     if (player->audio_dev != 0) {
       SDL_PauseAudioDevice(player->audio_dev, 1);
     }
+    av_clock_set_paused(&player->audio_clock, TRUE);
+    av_clock_set_paused(&player->ext_clock, TRUE);
   }
   return RET_OK;
 }
 
-ret_t hls_player_stop(hls_player_t *player) {
+ret_t hls_player_stop_async(hls_player_t *player,
+                            hls_player_on_stopped_t on_stopped, void *ctx) {
   return_value_if_fail(player != NULL, RET_BAD_PARAMS);
-  player->quit = TRUE;
+
+  pthread_mutex_lock(&player->stop_mutex);
+  bool_t running = player->running;
+  if (running) {
+    if (on_stopped != NULL) {
+      player->on_stopped = on_stopped;
+      player->on_stopped_ctx = ctx;
+    }
+    if (player->stop_requested == 0) {
+      player->stop_requested = av_gettime_relative();
+    }
+  }
+  if (player->zap_url != NULL) {
+    free(player->zap_url);
+    player->zap_url = NULL;
+  }
+  // The interrupt callbacks see quit and abort whatever I/O is blocking.
+  __atomic_store_n(&player->quit, TRUE, __ATOMIC_SEQ_CST);
+  pthread_cond_broadcast(&player->preroll_cond);
+  pthread_mutex_unlock(&player->stop_mutex);
+
+  // A frame already on its way to the sinks is waited out, so the caller may
+  // hand the same sinks to another player as soon as this returns. Any later
+  // one sees quit under the lock and is dropped.
+  pthread_mutex_lock(&player->output_mutex);
+  pthread_mutex_unlock(&player->output_mutex);
+  packet_queue_abort(&player->video_queue);
+  packet_queue_abort(&player->audio_queue);
   if (player->audio_dev != 0) {
-    SDL_ClearQueuedAudio(player->audio_dev);
     SDL_PauseAudioDevice(player->audio_dev, 1);
   }
-  if (player->running) {
-    pthread_join(player->thread, NULL);
-    player->running = FALSE;
+
+  if (!running && on_stopped != NULL) {
+    on_stopped(ctx, player);
   }
-  player->state = PLAYER_STATE_STOPPED;
+
+  return RET_OK;
+}
+
+ret_t hls_player_stop(hls_player_t *player) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  hls_player_stop_async(player, NULL, NULL);
+  hls_player_join(player);
+  return RET_OK;
+}
+
+ret_t hls_player_zap(hls_player_t *player, const char *url) {
+  return_value_if_fail(player != NULL && url != NULL, RET_BAD_PARAMS);
+
+  char *next = tk_strdup(url);
+  return_value_if_fail(next != NULL, RET_OOM);
+
+  // Still running, and not stopping (unless for an earlier zap), nor past
+  // the point where the player thread looks for a zap.
+  pthread_mutex_lock(&player->stop_mutex);
+  bool_t running = player->running && !player->finishing &&
+                   (!player->quit || player->zap_url != NULL);
+  if (running) {
+    if (player->zap_url != NULL) {
+      free(player->zap_url);
+    }
+    player->zap_url = next;
+    player->zap_requested = av_gettime_relative();
+    // End the current run; the player thread goes round again on the new
+    // url. Under the lock, so a run that has already taken the url (its
+    // predecessor having ended on its own) is not ended in turn.
+    __atomic_store_n(&player->quit, TRUE, __ATOMIC_SEQ_CST);
+    pthread_cond_broadcast(&player->preroll_cond);
+    packet_queue_abort(&player->video_queue);
+    packet_queue_abort(&player->audio_queue);
+  }
+  pthread_mutex_unlock(&player->stop_mutex);
+
+  if (!running) {
+    // Nothing to keep: a cold start on url.
+    free(next);
+    hls_player_stop(player);
+    hls_player_set_url(player, url);
+    __atomic_store_n(&player->zap_start, av_gettime_relative(), __ATOMIC_RELEASE);
+    return hls_player_play(player);
+  }
+
+  if (hls_player_get_state(player) == PLAYER_STATE_PAUSED) {
+    hls_player_play(player);
+  }
+
+  return RET_OK;
+}
+
+ret_t hls_player_preroll(hls_player_t *player) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  return_value_if_fail(hls_player_get_state(player) == PLAYER_STATE_STOPPED,
+                       RET_BUSY);
+  return hls_player_start(player, PLAYER_STATE_BUFFERING);
+}
+
+bool_t hls_player_is_prerolled(hls_player_t *player) {
+  return_value_if_fail(player != NULL, FALSE);
+  return hls_player_get_state(player) == PLAYER_STATE_BUFFERING &&
+         __atomic_load_n(&player->prerolled, __ATOMIC_ACQUIRE);
+}
+
+ret_t hls_player_copy_settings(hls_player_t *dst, hls_player_t *src) {
+  hls_player_queue_stats_t qs;
+  return_value_if_fail(dst != NULL && src != NULL && dst != src, RET_BAD_PARAMS);
+
+  hls_player_set_on_frame(dst, src->on_frame, src->on_frame_ctx);
+  hls_player_set_frame_sink(dst, src->acquire_frame, src->release_frame,
+                            src->frame_sink_ctx);
+  hls_player_set_output_size(dst, src->output_width, src->output_height);
+  hls_player_set_output_format(dst, src->output_format);
+  hls_player_set_scaler(dst, src->scaler);
+  hls_player_set_converter(dst, src->converter);
+  hls_player_set_max_resolution(dst, src->max_width, src->max_height);
+  hls_player_set_audio_latency(dst, src->audio_latency);
+  hls_player_set_volume(dst, src->volume);
+  hls_player_set_mute(dst, src->muted);
+  hls_player_set_playback_rate(dst, src->playback_rate);
+  hls_player_set_free_run(dst, src->free_run);
+  hls_player_set_low_latency(dst, src->low_latency, src->target_latency);
+  hls_player_set_timeshift(dst, src->timeshift_bytes, src->timeshift_dir,
+                           src->timeshift_spill_bytes);
+  hls_player_set_native_hls(dst, src->native_hls, src->prefetch_segments);
+  hls_player_set_fast_start(dst, src->fast_start);
+  hls_player_set_decode_threads(dst, src->decode_threads,
+                                src->decode_thread_types);
+  hls_player_set_convert_threads(dst, src->convert_threads);
+  hls_player_set_decode_scheduler(dst, src->decode_scheduler);
+  hls_player_set_convert_pool(dst, src->shared_convert_pool);
+  hls_player_set_priority(dst, src->priority);
+  hls_player_set_keyframes_only(dst, src->keyframes_only);
+  hls_player_set_auto_degrade(dst, src->auto_degrade);
+  hls_player_set_http_pool(dst, src->shared_http_pool);
+  hls_player_set_keep_alive(dst, src->keep_alive);
+  dst->open_timeout = src->open_timeout;
+  dst->read_timeout = src->read_timeout;
+  for (int i = HLS_PLAYER_STREAM_VIDEO; i <= HLS_PLAYER_STREAM_AUDIO; i++) {
+    hls_player_get_queue_stats(src, (hls_player_stream_t)i, &qs);
+    hls_player_set_queue_limits(dst, (hls_player_stream_t)i, qs.max_bytes,
+                                qs.max_duration);
+  }
+
+  return RET_OK;
+}
+
+ret_t hls_player_get_zap_stats(hls_player_t *player,
+                               hls_player_zap_stats_t *stats) {
+  return_value_if_fail(player != NULL && stats != NULL, RET_BAD_PARAMS);
+
+  uint32_t zaps = __atomic_load_n(&player->zaps, __ATOMIC_RELAXED);
+  stats->zaps = zaps;
+  stats->last = zaps > 0 ? hls_player_load_gauge(&player->zap_last) : -1;
+  stats->avg = zaps > 0 ? hls_player_load_gauge(&player->zap_total) / zaps : -1;
+  stats->max = zaps > 0 ? hls_player_load_gauge(&player->zap_max) : -1;
+
+  return RET_OK;
+}
+
+ret_t hls_player_set_io_timeouts(hls_player_t *player, double open_timeout,
+                                 double read_timeout) {
+  return_value_if_fail(player != NULL && open_timeout >= 0 && read_timeout >= 0,
+                       RET_BAD_PARAMS);
+  player->open_timeout = (int64_t)(open_timeout * 1000000);
+  player->read_timeout = (int64_t)(read_timeout * 1000000);
+  return RET_OK;
+}
+
+ret_t hls_player_get_stop_stats(hls_player_t *player,
+                                hls_player_stop_stats_t *stats) {
+  return_value_if_fail(player != NULL && stats != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&player->stop_mutex);
+  stats->stops = player->stops;
+  stats->last_latency = player->stops > 0 ? player->stop_latency_last : -1;
+  stats->max_latency = player->stops > 0 ? player->stop_latency_max : -1;
+  pthread_mutex_unlock(&player->stop_mutex);
+  stats->io_timeouts = player->io_timeouts;
+
   return RET_OK;
 }
 
 ret_t hls_player_destroy(hls_player_t *player) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
   hls_player_stop(player);
+  packet_queue_deinit(&player->video_queue);
+  packet_queue_deinit(&player->audio_queue);
+  av_clock_deinit(&player->audio_clock);
+  av_clock_deinit(&player->ext_clock);
+  seek_index_deinit(&player->seek_index);
+  av_freep(&player->audio_buf);
+  video_scaler_deinit(&player->scaler_ctx);
+  if (player->cache != NULL) {
+    segment_cache_destroy(player->cache);
+  }
+  if (player->http_pool != NULL) {
+    http_pool_destroy(player->http_pool);
+  }
+  if (player->timeshift_dir != NULL) {
+    free(player->timeshift_dir);
+  }
+  pthread_mutex_destroy(&player->source_mutex);
+  pthread_mutex_destroy(&player->stop_mutex);
+  pthread_mutex_destroy(&player->output_mutex);
+  pthread_cond_destroy(&player->preroll_cond);
   if (player->url)
     free(player->url);
+  if (player->zap_url)
+    free(player->zap_url);
   free(player);
   return RET_OK;
 }
 
+/*
+ * The player thread leaves state as it is until its run has been torn
+ * down; a stop asked for meanwhile already reads as STOPPED.
+ */
 player_state_t hls_player_get_state(hls_player_t *player) {
-  return player ? player->state : PLAYER_STATE_STOPPED;
-}
+  return_value_if_fail(player != NULL, PLAYER_STATE_STOPPED);
 
-double hls_player_get_position(hls_player_t *player) {
-  return player ? player->position : 0;
+  pthread_mutex_lock(&player->stop_mutex);
+  bool_t stopping = player->stop_requested != 0;
+  pthread_mutex_unlock(&player->stop_mutex);
+
+  return stopping ? PLAYER_STATE_STOPPED : player->state;
 }
 
-double hls_player_get_duration(hls_player_t *player) {
-  return player ? player->duration : 0;
+/*
+ * Audio master: the pts the device is playing, as of the last callback and
+ * advanced since. Once the ring runs dry the system clock, kept in step
+ * with audio until then, takes over so video never waits on a stalled clock.
+ */
+static double hls_player_get_master_clock(hls_player_t *player) {
+  if (player->audio_dev != 0 && av_clock_is_valid(&player->audio_clock) &&
+      audio_ring_available(&player->audio_ring) > 0) {
+    double clock = av_clock_get(&player->audio_clock);
+    av_clock_set(&player->ext_clock, clock);
+    return clock;
+  }
+
+  return av_clock_get(&player->ext_clock);
 }
 
-void hls_player_set_on_frame(hls_player_t *player,
-                             hls_player_on_frame_t on_frame, void *ctx) {
-  if (player) {
-    player->on_frame = on_frame;
-    player->on_frame_ctx = ctx;
+/*
+ * Player side only: the threads driving the clocks publish the playhead, so
+ * hls_player_get_position is a plain read from the UI thread.
+ */
+static void hls_player_publish_position(hls_player_t *player) {
+  if (av_clock_is_valid(&player->ext_clock)) {
+    hls_player_store_position(
+        player, hls_player_get_master_clock(player) - player->start_time);
   }
 }
 
-static void *player_thread(void *arg) {
-  hls_player_t *player = (hls_player_t *)arg;
-  AVPacket *pkt = av_packet_alloc();
-  AVFrame *frame = av_frame_alloc();
-  AVFrame *frame_rgb = av_frame_alloc();
-  AVFrame *audio_frame = av_frame_alloc();
-  uint8_t *buffer = NULL;
-  int ret;
+double hls_player_get_position(hls_player_t *player) {
+  double position;
+  return_value_if_fail(player != NULL, 0);
 
-  log_debug("play url: %s\n", player->url);
+  __atomic_load(&player->position, &position, __ATOMIC_ACQUIRE);
+  return position;
+}
 
-  // Open input
-  if (avformat_open_input(&player->fmt_ctx, player->url, NULL, NULL) < 0) {
-    log_error("Could not open source file %s\n", player->url);
-    goto end;
+ret_t hls_player_seek(hls_player_t *player, double seconds) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  return_value_if_fail(player->running, RET_FAIL);
+  if (player->duration <= 0) {
+    return RET_NOT_IMPL;
   }
 
-  if (avformat_find_stream_info(player->fmt_ctx, NULL) < 0) {
-    log_error("Could not find stream information\n");
-    goto end;
-  }
+  // Requests arriving faster than the demuxer takes them collapse into one.
+  player->seek_target = tk_clamp(seconds, 0, player->duration);
+  __atomic_store_n(&player->seek_requested, TRUE, __ATOMIC_RELEASE);
 
-  // Find streams
-  player->video_stream_idx = -1;
-  player->audio_stream_idx = -1;
-  for (unsigned int i = 0; i < player->fmt_ctx->nb_streams; i++) {
-    enum AVMediaType type = player->fmt_ctx->streams[i]->codecpar->codec_type;
-    if (type == AVMEDIA_TYPE_VIDEO && player->video_stream_idx == -1) {
-      player->video_stream_idx = i;
-    } else if (type == AVMEDIA_TYPE_AUDIO && player->audio_stream_idx == -1) {
-      player->audio_stream_idx = i;
-    }
-  }
+  return RET_OK;
+}
 
-  if (player->video_stream_idx == -1 && player->audio_stream_idx == -1) {
-    log_error("Could not find any video or audio stream\n");
-    goto end;
-  }
+ret_t hls_player_set_volume(hls_player_t *player, double volume) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  player->volume = tk_clamp(volume, 0, 1);
+  return RET_OK;
+}
 
-  // Open video codec (only if video stream exists)
-  int width = 0;
-  int height = 0;
-  if (player->video_stream_idx != -1) {
-    AVCodecParameters *codecpar =
-        player->fmt_ctx->streams[player->video_stream_idx]->codecpar;
-    const AVCodec *codec = avcodec_find_decoder(codecpar->codec_id);
-    player->video_dec_ctx = avcodec_alloc_context3(codec);
-    avcodec_parameters_to_context(player->video_dec_ctx, codecpar);
-    avcodec_open2(player->video_dec_ctx, codec, NULL);
+double hls_player_get_volume(hls_player_t *player) {
+  return_value_if_fail(player != NULL, 0);
+  return player->volume;
+}
 
-    // Prepare SWS context for RGB conversion
-    width = codecpar->width;
-    height = codecpar->height;
-    player->sws_ctx =
-        sws_getContext(width, height, player->video_dec_ctx->pix_fmt, width,
-                       height, AV_PIX_FMT_RGBA, SWS_BILINEAR, NULL, NULL, NULL);
+ret_t hls_player_set_mute(hls_player_t *player, bool_t mute) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  player->muted = mute;
+  return RET_OK;
+}
 
-    int numBytes = av_image_get_buffer_size(AV_PIX_FMT_RGBA, width, height, 1);
-    buffer = (uint8_t *)av_malloc(numBytes * sizeof(uint8_t));
-    av_image_fill_arrays(frame_rgb->data, frame_rgb->linesize, buffer,
-                         AV_PIX_FMT_RGBA, width, height, 1);
-  }
+bool_t hls_player_get_mute(hls_player_t *player) {
+  return_value_if_fail(player != NULL, FALSE);
+  return player->muted;
+}
 
-  player->duration = (double)player->fmt_ctx->duration / AV_TIME_BASE;
+ret_t hls_player_set_playback_rate(hls_player_t *player, double rate) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  return_value_if_fail(rate >= HLS_PLAYER_MIN_RATE && rate <= HLS_PLAYER_MAX_RATE,
+                       RET_BAD_PARAMS);
 
-  // Setup audio decoding if available
-  if (player->audio_stream_idx != -1) {
-    AVCodecParameters *audio_par =
-        player->fmt_ctx->streams[player->audio_stream_idx]->codecpar;
-    const AVCodec *audio_codec = avcodec_find_decoder(audio_par->codec_id);
-    if (audio_codec != NULL) {
-      player->audio_dec_ctx = avcodec_alloc_context3(audio_codec);
-      if (player->audio_dec_ctx &&
-          avcodec_parameters_to_context(player->audio_dec_ctx, audio_par) >=
-              0 &&
-          avcodec_open2(player->audio_dec_ctx, audio_codec, NULL) >= 0) {
-        player->audio_sample_rate = player->audio_dec_ctx->sample_rate;
+  // The audio clock follows when the device reaches the stretched audio.
+  player->playback_rate = rate;
+  av_clock_set_speed(&player->ext_clock, rate * player->catchup_rate);
 
-#if LIBAVCODEC_VERSION_MAJOR >= 59
-        AVChannelLayout in_layout;
-        AVChannelLayout out_layout;
-        if (player->audio_dec_ctx->ch_layout.nb_channels == 0) {
-          av_channel_layout_default(&player->audio_dec_ctx->ch_layout, 2);
-        }
-        av_channel_layout_copy(&in_layout, &player->audio_dec_ctx->ch_layout);
-        av_channel_layout_copy(&out_layout, &player->audio_dec_ctx->ch_layout);
-        player->audio_channels = in_layout.nb_channels;
-        if (swr_alloc_set_opts2(&player->swr_ctx, &out_layout,
-                                AV_SAMPLE_FMT_S16, player->audio_sample_rate,
-                                &in_layout, player->audio_dec_ctx->sample_fmt,
-                                player->audio_sample_rate, 0, NULL) < 0) {
-          log_error("Failed to configure audio resampler\n");
-          player->swr_ctx = NULL;
-        } else if (swr_init(player->swr_ctx) < 0) {
-          log_error("Failed to initialize audio resampler\n");
-          swr_free(&player->swr_ctx);
-        }
-        av_channel_layout_uninit(&in_layout);
-        av_channel_layout_uninit(&out_layout);
-#else
-        player->audio_channels = player->audio_dec_ctx->channels;
-        int64_t in_layout = player->audio_dec_ctx->channel_layout;
-        if (in_layout == 0 && player->audio_channels > 0) {
-          in_layout = av_get_default_channel_layout(player->audio_channels);
-        }
-        int64_t out_layout = in_layout;
-        player->swr_ctx = swr_alloc_set_opts(
-            NULL, out_layout, AV_SAMPLE_FMT_S16, player->audio_sample_rate,
-            in_layout, player->audio_dec_ctx->sample_fmt,
-            player->audio_sample_rate, 0, NULL);
-        if (player->swr_ctx && swr_init(player->swr_ctx) < 0) {
-          log_error("Failed to initialize audio resampler\n");
-          swr_free(&player->swr_ctx);
-        }
-#endif
+  return RET_OK;
+}
 
-        if (player->audio_channels <= 0) {
-          player->audio_channels = 2;
-        }
+double hls_player_get_playback_rate(hls_player_t *player) {
+  return_value_if_fail(player != NULL, 1.0);
+  return player->playback_rate;
+}
 
-        if (player->swr_ctx) {
-          if (!player->audio_initialized) {
-            if (SDL_InitSubSystem(SDL_INIT_AUDIO) == 0) {
-              player->audio_initialized = TRUE;
-            } else {
-              log_error("SDL_InitSubSystem audio failed: %s\n", SDL_GetError());
-            }
-          }
+ret_t hls_player_set_low_latency(hls_player_t *player, bool_t enable,
+                                 double target_latency) {
+  return_value_if_fail(player != NULL && target_latency >= 0, RET_BAD_PARAMS);
+  player->low_latency = enable;
+  player->target_latency = target_latency;
+  return RET_OK;
+}
 
-          if (player->audio_initialized) {
-            SDL_AudioSpec want;
-            SDL_zero(want);
-            want.freq = player->audio_sample_rate;
-            want.format = AUDIO_S16SYS;
-            want.channels = (Uint8)player->audio_channels;
-            want.samples = 1024;
-            want.callback = NULL;
-
-            player->audio_dev = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0);
-            if (player->audio_dev == 0) {
-              log_error("SDL_OpenAudioDevice failed: %s\n", SDL_GetError());
-            } else {
-              if (player->state == PLAYER_STATE_PAUSED) {
-                SDL_PauseAudioDevice(player->audio_dev, 1);
-              } else {
-                SDL_PauseAudioDevice(player->audio_dev, 0);
-              }
-            }
-          }
-        }
-      } else {
-        log_error("Failed to open audio decoder\n");
-      }
-    }
-  }
+double hls_player_get_live_latency(hls_player_t *player) {
+  return_value_if_fail(player != NULL, -1);
+  return hls_player_load_gauge(&player->live_latency);
+}
 
-  while (!player->quit) {
-    if (player->state == PLAYER_STATE_PAUSED) {
-      sleep_ms(100);
-      continue;
-    }
+ret_t hls_player_set_free_run(hls_player_t *player, bool_t enable) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  player->free_run = enable;
+  return RET_OK;
+}
 
-    ret = av_read_frame(player->fmt_ctx, pkt);
-    if (ret < 0)
-      break; // End of stream or error
+ret_t hls_player_set_audio_latency(hls_player_t *player, double seconds) {
+  return_value_if_fail(player != NULL && seconds > 0, RET_BAD_PARAMS);
+  player->audio_latency = seconds;
+  return RET_OK;
+}
 
-    if (pkt->stream_index == player->video_stream_idx) {
-      ret = avcodec_send_packet(player->video_dec_ctx, pkt);
-      if (ret < 0) {
-        av_packet_unref(pkt);
-        continue;
-      }
+double hls_player_get_audio_latency(hls_player_t *player) {
+  return_value_if_fail(player != NULL, 0);
+  return player->audio_latency;
+}
 
-      while (ret >= 0) {
-        ret = avcodec_receive_frame(player->video_dec_ctx, frame);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-          break;
-        if (ret < 0)
-          break;
+ret_t hls_player_get_audio_stats(hls_player_t *player,
+                                 hls_player_audio_stats_t *stats) {
+  return_value_if_fail(player != NULL && stats != NULL, RET_BAD_PARAMS);
 
-        // Convert to RGB
-        sws_scale(player->sws_ctx, (uint8_t const *const *)frame->data,
-                  frame->linesize, 0, height, frame_rgb->data,
-                  frame_rgb->linesize);
+  memset(stats, 0x00, sizeof(*stats));
+  stats->target_latency = player->audio_latency;
+  if (player->audio_dev == 0 || player->audio_bytes_per_sec <= 0) {
+    return RET_OK;
+  }
 
-        // Notify callback
-        if (player->on_frame) {
-          player->on_frame(player->on_frame_ctx, frame_rgb->data[0], width,
-                           height, AV_PIX_FMT_RGBA);
-        }
+  stats->buffered = (double)audio_ring_available(&player->audio_ring) /
+                    player->audio_bytes_per_sec;
+  stats->device_latency = player->audio_hw_latency;
+  stats->underruns = player->audio_ring.underruns;
+  stats->silence =
+      (double)player->audio_ring.silence_bytes / player->audio_bytes_per_sec;
 
-        // Simple sync (very basic)
-        double pts =
-            frame->pts *
-            av_q2d(
-                player->fmt_ctx->streams[player->video_stream_idx]->time_base);
-        player->position = pts;
+  return RET_OK;
+}
 
-        // Delay to match framerate (approximate)
-        // Ideally use audio clock or system clock
-        sleep_ms(30);
+ret_t hls_player_record_stage(hls_player_t *player, hls_player_stage_t stage,
+                              int64_t us) {
+  return_value_if_fail(player != NULL && stage < HLS_PLAYER_STAGES, RET_BAD_PARAMS);
+  latency_histogram_record(&player->stage_latency[stage], us);
+  return RET_OK;
+}
 
-        av_frame_unref(frame);
-      }
-    } else if (pkt->stream_index == player->audio_stream_idx &&
-               player->audio_dec_ctx) {
-      ret = avcodec_send_packet(player->audio_dec_ctx, pkt);
-      if (ret < 0) {
-        av_packet_unref(pkt);
-        continue;
-      }
+ret_t hls_player_reset_metrics(hls_player_t *player) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
 
-      while (ret >= 0) {
-        ret = avcodec_receive_frame(player->audio_dec_ctx, audio_frame);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-          break;
-        if (ret < 0)
-          break;
+  for (uint32_t i = 0; i < HLS_PLAYER_STAGES; i++) {
+    latency_histogram_reset(&player->stage_latency[i]);
+  }
+  __atomic_store_n(&player->frames_decoded, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&player->frames_displayed, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&player->frames_dropped, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&player->bitrate_start, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&player->bitrate_bytes, 0, __ATOMIC_RELAXED);
+  hls_player_store_gauge(&player->bitrate, 0);
 
-        if (player->swr_ctx && player->audio_dev != 0) {
-          int dst_nb_samples = av_rescale_rnd(
-              swr_get_delay(player->swr_ctx, player->audio_sample_rate) +
-                  audio_frame->nb_samples,
-              player->audio_sample_rate, player->audio_sample_rate,
-              AV_ROUND_UP);
-          int out_channels = player->audio_channels;
-          int out_buffer_size = av_samples_get_buffer_size(
-              NULL, out_channels, dst_nb_samples, AV_SAMPLE_FMT_S16, 1);
-          if (out_buffer_size > 0) {
-            uint8_t *audio_buf = (uint8_t *)av_malloc(out_buffer_size);
-            if (audio_buf) {
-              int converted = swr_convert(
-                  player->swr_ctx, &audio_buf, dst_nb_samples,
-                  (const uint8_t **)audio_frame->data, audio_frame->nb_samples);
-              if (converted > 0) {
-                int bytes = av_samples_get_buffer_size(
-                    NULL, out_channels, converted, AV_SAMPLE_FMT_S16, 1);
-                if (bytes > 0) {
-                  SDL_QueueAudio(player->audio_dev, audio_buf, bytes);
-                }
-              }
-              av_free(audio_buf);
-            }
-          }
-        }
+  return RET_OK;
+}
 
-        // Update position for audio-only streams
-        if (player->video_stream_idx == -1) {
-          double pts = audio_frame->pts *
-                       av_q2d(player->fmt_ctx->streams[player->audio_stream_idx]
-                                  ->time_base);
-          player->position = pts;
-        }
-        av_frame_unref(audio_frame);
-      }
-    }
-    av_packet_unref(pkt);
-  }
+ret_t hls_player_get_metrics(hls_player_t *player,
+                             hls_player_metrics_t *metrics) {
+  hls_player_queue_stats_t qs;
+  hls_player_audio_stats_t audio;
+  hls_player_abr_stats_t abr;
+  http_pool_stats_t http;
+  decode_ladder_stats_t decode;
+  return_value_if_fail(player != NULL && metrics != NULL, RET_BAD_PARAMS);
 
-end:
-  if (buffer)
-    av_free(buffer);
-  av_frame_free(&frame);
-  av_frame_free(&frame_rgb);
-  av_frame_free(&audio_frame);
-  av_packet_free(&pkt);
-  if (player->video_dec_ctx)
-    avcodec_free_context(&player->video_dec_ctx);
-  if (player->audio_dec_ctx)
-    avcodec_free_context(&player->audio_dec_ctx);
-  if (player->fmt_ctx)
-    avformat_close_input(&player->fmt_ctx);
-  if (player->sws_ctx)
-    sws_freeContext(player->sws_ctx);
-  if (player->swr_ctx)
-    swr_free(&player->swr_ctx);
-  if (player->audio_dev != 0) {
-    SDL_ClearQueuedAudio(player->audio_dev);
-    SDL_CloseAudioDevice(player->audio_dev);
-    player->audio_dev = 0;
+  memset(metrics, 0x00, sizeof(*metrics));
+  for (uint32_t i = 0; i < HLS_PLAYER_STAGES; i++) {
+    latency_histogram_stats_t hs;
+    latency_histogram_get_stats(&player->stage_latency[i], &hs);
+    metrics->stages[i].count = hs.count;
+    metrics->stages[i].avg = hs.avg;
+    metrics->stages[i].p50 = hs.p50;
+    metrics->stages[i].p95 = hs.p95;
+    metrics->stages[i].p99 = hs.p99;
+    metrics->stages[i].max = hs.max;
   }
+  metrics->frames_decoded =
+      __atomic_load_n(&player->frames_decoded, __ATOMIC_RELAXED);
+  metrics->frames_displayed =
+      __atomic_load_n(&player->frames_displayed, __ATOMIC_RELAXED);
+  metrics->frames_dropped =
+      __atomic_load_n(&player->frames_dropped, __ATOMIC_RELAXED);
 
-  player->running = FALSE;
+  hls_player_get_audio_stats(player, &audio);
+  metrics->audio_underruns = audio.underruns;
+  metrics->audio_buffer = audio.buffered;
+  hls_player_get_queue_stats(player, HLS_PLAYER_STREAM_VIDEO, &qs);
+  metrics->video_queue = qs.duration;
+  hls_player_get_queue_stats(player, HLS_PLAYER_STREAM_AUDIO, &qs);
+  metrics->audio_queue = qs.duration;
+  hls_player_get_abr_stats(player, &abr);
+  metrics->network_buffer = abr.buffer_level;
+  metrics->throughput = abr.bandwidth;
+  metrics->bitrate = hls_player_load_gauge(&player->bitrate);
+  metrics->live_latency = hls_player_load_gauge(&player->live_latency);
+  metrics->zap_ms = __atomic_load_n(&player->zaps, __ATOMIC_RELAXED) > 0
+                        ? hls_player_load_gauge(&player->zap_last)
+                        : -1;
+  hls_player_get_http_stats(player, &http);
+  metrics->connection_reuse =
+      http.requests > 0 ? (double)http.reused / http.requests : -1;
+  metrics->handshake_ms = http.handshake_avg;
+  hls_player_get_decode_stats(player, &decode);
+  metrics->decode_level = decode.level;
+  metrics->decode_changes = decode.steps_down + decode.steps_up;
+
+  return RET_OK;
+}
+
+ret_t hls_player_dump_metrics(hls_player_t *player, str_t *json) {
+  static const char *const stage_names[HLS_PLAYER_STAGES] = {
+      "network", "demux", "decode", "convert", "handoff", "paint"};
+  hls_player_metrics_t m;
+  decode_ladder_stats_t decode;
+  return_value_if_fail(player != NULL && json != NULL, RET_BAD_PARAMS);
+
+  hls_player_get_metrics(player, &m);
+  str_append(json, "{\"stages\":{");
+  for (uint32_t i = 0; i < HLS_PLAYER_STAGES; i++) {
+    const hls_player_stage_stats_t *st = &m.stages[i];
+    str_append_format(json, 256,
+                      "%s\"%s\":{\"count\":%llu,\"avg_ms\":%.3f,\"p50_ms\":%.3f,"
+                      "\"p95_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f}",
+                      i > 0 ? "," : "", stage_names[i],
+                      (unsigned long long)st->count, st->avg, st->p50, st->p95,
+                      st->p99, st->max);
+  }
+  str_append_format(json, 256,
+                    "},\"frames\":{\"decoded\":%llu,\"displayed\":%llu,"
+                    "\"dropped\":%llu},\"audio_underruns\":%u,",
+                    (unsigned long long)m.frames_decoded,
+                    (unsigned long long)m.frames_displayed,
+                    (unsigned long long)m.frames_dropped, m.audio_underruns);
+  str_append_format(json, 256,
+                    "\"buffers\":{\"network\":%.3f,\"video_queue\":%.3f,"
+                    "\"audio_queue\":%.3f,\"audio\":%.3f},",
+                    m.network_buffer, m.video_queue, m.audio_queue, m.audio_buffer);
+  str_append_format(json, 160,
+                    "\"bitrate\":%.0f,\"throughput\":%.0f,\"live_latency\":%.3f,"
+                    "\"zap_ms\":%.1f,",
+                    m.bitrate, m.throughput, m.live_latency, m.zap_ms);
+  str_append_format(json, 128,
+                    "\"http\":{\"connection_reuse\":%.3f,\"handshake_ms\":%.2f},",
+                    m.connection_reuse, m.handshake_ms);
+  hls_player_get_decode_stats(player, &decode);
+  str_append_format(json, 64, "\"decode\":{\"level\":\"%s\",\"changes\":%u,",
+                    decode_level_name((decode_level_t)m.decode_level), m.decode_changes);
+  str_append(json, "\"seconds\":{");
+  for (uint32_t i = 0; i < DECODE_LEVELS; i++) {
+    str_append_format(json, 64, "%s\"%s\":%.1f", i > 0 ? "," : "",
+                      decode_level_name((decode_level_t)i), decode.seconds[i]);
+  }
+  str_append(json, "}}}");
+
+  return RET_OK;
+}
+
+ret_t hls_player_set_timeshift(hls_player_t *player, uint32_t max_bytes,
+                               const char *dir, uint64_t max_spill_bytes) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+
+  player->timeshift_bytes = max_bytes;
+  player->timeshift_spill_bytes = max_spill_bytes;
+  if (player->timeshift_dir != NULL) {
+    free(player->timeshift_dir);
+  }
+  player->timeshift_dir = dir != NULL ? tk_strdup(dir) : NULL;
+
+  return RET_OK;
+}
+
+ret_t hls_player_timeshift_seek(hls_player_t *player, double delay) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  if (player->timeshift == NULL) {
+    return RET_NOT_IMPL;
+  }
+
+  player->timeshift_target = tk_max(delay, 0);
+  __atomic_store_n(&player->timeshift_requested, TRUE, __ATOMIC_RELEASE);
+
+  return RET_OK;
+}
+
+ret_t hls_player_go_live(hls_player_t *player) {
+  return hls_player_timeshift_seek(player, 0);
+}
+
+ret_t hls_player_get_timeshift_stats(hls_player_t *player,
+                                     hls_player_timeshift_stats_t *stats) {
+  timeshift_stats_t ts;
+  return_value_if_fail(player != NULL && stats != NULL, RET_BAD_PARAMS);
+
+  memset(stats, 0x00, sizeof(*stats));
+  pthread_mutex_lock(&player->source_mutex);
+  if (player->timeshift == NULL) {
+    pthread_mutex_unlock(&player->source_mutex);
+    return RET_NOT_FOUND;
+  }
+  timeshift_get_stats(player->timeshift, &ts);
+  pthread_mutex_unlock(&player->source_mutex);
+
+  stats->window = ts.window;
+  stats->delay = ts.delay;
+  stats->memory_bytes = ts.memory_bytes;
+  stats->disk_bytes = ts.disk_bytes;
+  stats->skips = ts.skips;
+
+  return RET_OK;
+}
+
+ret_t hls_player_get_seek_stats(hls_player_t *player,
+                                hls_player_seek_stats_t *stats) {
+  return_value_if_fail(player != NULL && stats != NULL, RET_BAD_PARAMS);
+
+  stats->seeks = player->seeks;
+  stats->last_ttff = player->seeks > 0 ? player->seek_ttff_last : -1;
+  stats->avg_ttff =
+      player->seeks > 0 ? player->seek_ttff_total / player->seeks : -1;
+  stats->max_ttff = player->seeks > 0 ? player->seek_ttff_max : -1;
+
+  return RET_OK;
+}
+
+double hls_player_get_duration(hls_player_t *player) {
+  return player ? player->duration : 0;
+}
+
+ret_t hls_player_set_queue_limits(hls_player_t *player,
+                                  hls_player_stream_t stream,
+                                  uint32_t max_bytes, double max_duration) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  packet_queue_t *q = stream == HLS_PLAYER_STREAM_VIDEO ? &player->video_queue
+                                                        : &player->audio_queue;
+  return packet_queue_set_limits(q, max_bytes, max_duration);
+}
+
+ret_t hls_player_get_queue_stats(hls_player_t *player,
+                                 hls_player_stream_t stream,
+                                 hls_player_queue_stats_t *stats) {
+  packet_queue_stats_t qs;
+  return_value_if_fail(player != NULL && stats != NULL, RET_BAD_PARAMS);
+
+  packet_queue_t *q = stream == HLS_PLAYER_STREAM_VIDEO ? &player->video_queue
+                                                        : &player->audio_queue;
+  packet_queue_get_stats(q, &qs);
+  stats->packets = qs.packets;
+  stats->bytes = qs.bytes;
+  stats->duration = qs.duration;
+  stats->max_bytes = q->max_bytes;
+  stats->max_duration = q->max_duration;
+  stats->full = packet_queue_is_full(q);
+
+  return RET_OK;
+}
+
+void hls_player_set_on_frame(hls_player_t *player,
+                             hls_player_on_frame_t on_frame, void *ctx) {
+  if (player) {
+    player->on_frame = on_frame;
+    player->on_frame_ctx = ctx;
+  }
+}
+
+ret_t hls_player_set_output_size(hls_player_t *player, int width, int height) {
+  return_value_if_fail(player != NULL && width >= 0 && height >= 0,
+                       RET_BAD_PARAMS);
+  player->output_width = width;
+  player->output_height = height;
+  return RET_OK;
+}
+
+ret_t hls_player_set_scaler(hls_player_t *player, hls_player_scaler_t scaler) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  player->scaler = scaler;
+  return RET_OK;
+}
+
+static yuv2rgb_kernel_t hls_player_kernel(hls_player_converter_t converter) {
+  switch (converter) {
+  case HLS_PLAYER_CONVERTER_SCALAR:
+    return YUV2RGB_KERNEL_SCALAR;
+  case HLS_PLAYER_CONVERTER_SSE2:
+    return YUV2RGB_KERNEL_SSE2;
+  case HLS_PLAYER_CONVERTER_AVX2:
+    return YUV2RGB_KERNEL_AVX2;
+  case HLS_PLAYER_CONVERTER_NEON:
+    return YUV2RGB_KERNEL_NEON;
+  default:
+    return YUV2RGB_KERNEL_AUTO;
+  }
+}
+
+ret_t hls_player_set_converter(hls_player_t *player,
+                               hls_player_converter_t converter) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  if (converter != HLS_PLAYER_CONVERTER_SWSCALE &&
+      !yuv2rgb_kernel_available(hls_player_kernel(converter))) {
+    return RET_NOT_IMPL;
+  }
+  player->converter = converter;
+  return RET_OK;
+}
+
+hls_player_converter_t hls_player_get_converter(hls_player_t *player) {
+  return_value_if_fail(player != NULL, HLS_PLAYER_CONVERTER_AUTO);
+  return player->converter;
+}
+
+static enum AVPixelFormat
+hls_player_av_pixel_format(hls_player_pixel_format_t format) {
+  switch (format) {
+  case HLS_PLAYER_PIXEL_BGRA:
+    return AV_PIX_FMT_BGRA;
+  case HLS_PLAYER_PIXEL_RGB565:
+    return AV_PIX_FMT_RGB565;
+  case HLS_PLAYER_PIXEL_BGR565:
+    return AV_PIX_FMT_BGR565;
+  case HLS_PLAYER_PIXEL_YUV420P:
+    return AV_PIX_FMT_YUV420P;
+  default:
+    return AV_PIX_FMT_RGBA;
+  }
+}
+
+ret_t hls_player_set_output_format(hls_player_t *player,
+                                   hls_player_pixel_format_t format) {
+  return_value_if_fail(player != NULL && format <= HLS_PLAYER_PIXEL_YUV420P,
+                       RET_BAD_PARAMS);
+  player->output_format = format;
+  return RET_OK;
+}
+
+hls_player_pixel_format_t hls_player_get_output_format(hls_player_t *player) {
+  return_value_if_fail(player != NULL, HLS_PLAYER_PIXEL_RGBA);
+  return player->output_format;
+}
+
+ret_t hls_player_set_native_hls(hls_player_t *player, bool_t enable,
+                                 uint32_t prefetch_segments) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  player->native_hls = enable;
+  player->prefetch_segments =
+      prefetch_segments > 0 ? prefetch_segments : HLS_PLAYER_PREFETCH_SEGMENTS;
+  return RET_OK;
+}
+
+ret_t hls_player_set_fast_start(hls_player_t *player, bool_t enable) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  player->fast_start = enable;
+  return RET_OK;
+}
+
+bool_t hls_player_get_fast_start(hls_player_t *player) {
+  return_value_if_fail(player != NULL, FALSE);
+  return player->fast_start;
+}
+
+static double hls_player_startup_ms(hls_player_t *player,
+                                    hls_player_startup_phase_t phase) {
+  int64_t us = player->startup_us[phase];
+  return us > 0 ? us / 1000.0 : -1;
+}
+
+ret_t hls_player_get_startup_times(hls_player_t *player,
+                                   hls_player_startup_times_t *times) {
+  return_value_if_fail(player != NULL && times != NULL, RET_BAD_PARAMS);
+
+  times->open = hls_player_startup_ms(player, HLS_PLAYER_STARTUP_OPEN);
+  times->probe = hls_player_startup_ms(player, HLS_PLAYER_STARTUP_PROBE);
+  times->first_packet =
+      hls_player_startup_ms(player, HLS_PLAYER_STARTUP_FIRST_PACKET);
+  times->first_frame =
+      hls_player_startup_ms(player, HLS_PLAYER_STARTUP_FIRST_FRAME);
+  times->first_audio =
+      hls_player_startup_ms(player, HLS_PLAYER_STARTUP_FIRST_AUDIO);
+
+  return RET_OK;
+}
+
+static void hls_player_log_startup(hls_player_t *player) {
+  hls_player_startup_times_t t;
+  hls_player_get_startup_times(player, &t);
+  log_info("startup: open %.0f ms, probe %.0f ms, first packet %.0f ms, "
+           "first frame %.0f ms\n",
+           t.open, t.probe, t.first_packet, t.first_frame);
+}
+
+ret_t hls_player_set_segment_cache(hls_player_t *player, const char *dir,
+                                   uint64_t max_bytes) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  return_value_if_fail(!player->running, RET_BUSY);
+
+  if (player->cache != NULL) {
+    segment_cache_destroy(player->cache);
+    player->cache = NULL;
+  }
+  if (dir != NULL) {
+    player->cache = segment_cache_create(dir, max_bytes);
+    return_value_if_fail(player->cache != NULL, RET_FAIL);
+  }
+
+  return RET_OK;
+}
+
+ret_t hls_player_get_cache_stats(hls_player_t *player,
+                                 hls_player_cache_stats_t *stats) {
+  segment_cache_stats_t cs;
+  return_value_if_fail(player != NULL && stats != NULL, RET_BAD_PARAMS);
+
+  memset(stats, 0x00, sizeof(*stats));
+  if (player->cache == NULL) {
+    return RET_OK;
+  }
+
+  segment_cache_get_stats(player->cache, &cs);
+  stats->hits = cs.hits;
+  stats->misses = cs.misses;
+  stats->bytes_saved = cs.bytes_saved;
+  stats->entries = cs.entries;
+  stats->bytes_used = cs.bytes_used;
+  stats->max_bytes = cs.max_bytes;
+  stats->evictions = cs.evictions;
+
+  return RET_OK;
+}
+
+/* The pool the next run's playlist engine sends its requests through */
+static http_pool_t *hls_player_http_pool(hls_player_t *player) {
+  if (!player->keep_alive) {
+    return NULL;
+  }
+  return player->shared_http_pool != NULL ? player->shared_http_pool
+                                          : player->http_pool;
+}
+
+ret_t hls_player_set_http_pool(hls_player_t *player, http_pool_t *pool) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  player->shared_http_pool = pool;
+  return RET_OK;
+}
+
+ret_t hls_player_set_keep_alive(hls_player_t *player, bool_t enable) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  player->keep_alive = enable;
+  return RET_OK;
+}
+
+ret_t hls_player_get_http_stats(hls_player_t *player, http_pool_stats_t *stats) {
+  return_value_if_fail(player != NULL && stats != NULL, RET_BAD_PARAMS);
+
+  http_pool_t *pool = hls_player_http_pool(player);
+  if (pool == NULL) {
+    memset(stats, 0x00, sizeof(*stats));
+    stats->handshake_last = -1;
+    stats->handshake_avg = -1;
+    stats->handshake_max = -1;
+    stats->dns_avg = -1;
+    return RET_OK;
+  }
+
+  return http_pool_get_stats(pool, stats);
+}
+
+ret_t hls_player_select_variant(hls_player_t *player, int index) {
+  ret_t ret = RET_OK;
+  return_value_if_fail(player != NULL && index >= -1, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&player->source_mutex);
+  if (player->source != NULL) {
+    ret = hls_source_select_variant(player->source, index);
+  }
+  if (ret == RET_OK) {
+    player->variant = index;
+  }
+  pthread_mutex_unlock(&player->source_mutex);
+
+  return ret;
+}
+
+int hls_player_get_selected_variant(hls_player_t *player) {
+  return_value_if_fail(player != NULL, -1);
+  return player->variant;
+}
+
+ret_t hls_player_get_abr_stats(hls_player_t *player,
+                               hls_player_abr_stats_t *stats) {
+  hls_source_stats_t ss;
+  return_value_if_fail(player != NULL && stats != NULL, RET_BAD_PARAMS);
+
+  memset(stats, 0x00, sizeof(*stats));
+  stats->variant = -1;
+
+  pthread_mutex_lock(&player->source_mutex);
+  if (player->source != NULL && hls_source_get_stats(player->source, &ss) == RET_OK) {
+    stats->variant = ss.variant;
+    stats->nr_variants = hls_source_get_variant_count(player->source);
+    stats->bandwidth = ss.bandwidth;
+    stats->buffer_level = ss.buffered;
+    stats->switches = ss.switches;
+    if (ss.variant >= 0) {
+      const m3u8_variant_t *variant =
+          hls_source_get_variant(player->source, (uint32_t)ss.variant);
+      stats->variant_bandwidth = variant->bandwidth;
+      stats->width = variant->width;
+      stats->height = variant->height;
+    }
+  }
+  pthread_mutex_unlock(&player->source_mutex);
+
+  return RET_OK;
+}
+
+ret_t hls_player_set_decode_threads(hls_player_t *player, uint32_t count,
+                                    uint32_t types) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  player->decode_threads = count;
+  player->decode_thread_types = types;
+  return RET_OK;
+}
+
+ret_t hls_player_set_convert_threads(hls_player_t *player, uint32_t count) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  player->convert_threads = tk_min(count, VIDEO_SCALER_MAX_SLICES);
+  return RET_OK;
+}
+
+uint32_t hls_player_get_decode_threads(hls_player_t *player) {
+  return_value_if_fail(player != NULL, 0);
+  if (player->decode_threads > 0) {
+    return player->decode_threads;
+  }
+  return tk_max(1, av_cpu_count());
+}
+
+uint32_t hls_player_get_convert_threads(hls_player_t *player) {
+  return_value_if_fail(player != NULL, 0);
+  if (player->convert_threads > 0) {
+    return player->convert_threads;
+  }
+  // Conversion is memory bound; beyond a few cores the bus is saturated.
+  return tk_max(1, tk_min(av_cpu_count() / 2, 4));
+}
+
+ret_t hls_player_set_decode_scheduler(hls_player_t *player,
+                                      decode_scheduler_t *scheduler) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  player->decode_scheduler = scheduler;
+  return RET_OK;
+}
+
+ret_t hls_player_set_convert_pool(hls_player_t *player, worker_pool_t *pool) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  player->shared_convert_pool = pool;
+  return RET_OK;
+}
+
+ret_t hls_player_set_priority(hls_player_t *player,
+                              hls_player_priority_t priority) {
+  return_value_if_fail(player != NULL && priority <= HLS_PLAYER_PRIORITY_FOCUSED,
+                       RET_BAD_PARAMS);
+  player->priority = priority;
+  return RET_OK;
+}
+
+hls_player_priority_t hls_player_get_priority(hls_player_t *player) {
+  return_value_if_fail(player != NULL, HLS_PLAYER_PRIORITY_NORMAL);
+  return player->priority;
+}
+
+ret_t hls_player_set_keyframes_only(hls_player_t *player, bool_t enable) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  player->keyframes_only = enable;
+  return RET_OK;
+}
+
+bool_t hls_player_is_keyframes_only(hls_player_t *player) {
+  return_value_if_fail(player != NULL, FALSE);
+  return player->keyframes_only ||
+         (player->priority == HLS_PLAYER_PRIORITY_BACKGROUND &&
+          player->decode_scheduler != NULL &&
+          decode_scheduler_is_saturated(player->decode_scheduler));
+}
+
+ret_t hls_player_set_auto_degrade(hls_player_t *player, bool_t enable) {
+  return_value_if_fail(player != NULL, RET_BAD_PARAMS);
+  player->auto_degrade = enable;
+  return RET_OK;
+}
+
+ret_t hls_player_get_decode_stats(hls_player_t *player,
+                                  decode_ladder_stats_t *stats) {
+  return_value_if_fail(player != NULL && stats != NULL, RET_BAD_PARAMS);
+  return decode_ladder_get_stats(&player->decode_ladder, stats);
+}
+
+ret_t hls_player_set_max_resolution(hls_player_t *player, int width,
+                                    int height) {
+  return_value_if_fail(player != NULL && width >= 0 && height >= 0,
+                       RET_BAD_PARAMS);
+  player->max_width = width;
+  player->max_height = height;
+  return RET_OK;
+}
+
+void hls_player_set_frame_sink(hls_player_t *player,
+                               hls_player_acquire_frame_t acquire,
+                               hls_player_release_frame_t release, void *ctx) {
+  if (player) {
+    player->acquire_frame = acquire;
+    player->release_frame = release;
+    player->frame_sink_ctx = ctx;
+  }
+}
+
+static bool_t hls_player_queue_empty(packet_queue_t *q) {
+  packet_queue_stats_t stats;
+  packet_queue_get_stats(q, &stats);
+  return stats.packets == 0;
+}
+
+/*
+ * Backpressure for the demux thread. A full queue only stalls reading while
+ * the other stream still has packets buffered, so a stream whose packets are
+ * interleaved far apart cannot starve its sibling.
+ */
+static bool_t hls_player_queues_full(hls_player_t *player) {
+  bool_t has_video = player->video_thread_running;
+  bool_t has_audio = player->audio_thread_running;
+  bool_t video_full = has_video && packet_queue_is_full(&player->video_queue);
+  bool_t audio_full = has_audio && packet_queue_is_full(&player->audio_queue);
+
+  if (video_full) {
+    return !(has_audio && hls_player_queue_empty(&player->audio_queue));
+  }
+  if (audio_full) {
+    return !(has_video && hls_player_queue_empty(&player->video_queue));
+  }
+  return FALSE;
+}
+
+/*
+ * Hold a decoded video frame until the master clock reaches its pts.
+ * Returns FALSE when the frame is already too late to be worth showing.
+ */
+static bool_t hls_player_schedule_video(hls_player_t *player, double pts,
+                                        double frame_duration) {
+  double late = tk_max(frame_duration, HLS_PLAYER_LATE_THRESHOLD);
+
+  if (player->free_run) {
+    return TRUE;
+  }
+
+  // Video-only streams (and the first frame) start the system clock.
+  if (!av_clock_is_valid(&player->ext_clock)) {
+    av_clock_set(&player->ext_clock, pts);
+    return TRUE;
+  }
+
+  while (!player->quit) {
+    if (player->state == PLAYER_STATE_PAUSED) {
+      sleep_ms(HLS_PLAYER_WAIT_MS);
+      continue;
+    }
+
+    double diff = pts - hls_player_get_master_clock(player);
+    if (fabs(diff) > HLS_PLAYER_NOSYNC_THRESHOLD) {
+      if (player->audio_dev == 0) {
+        av_clock_set(&player->ext_clock, pts);
+      }
+      return TRUE;
+    }
+    if (diff <= 0) {
+      return diff > -late;
+    }
+
+    sleep_ms((uint32_t)(tk_min(diff, 0.01) * 1000) + 1);
+  }
+
+  return FALSE;
+}
+
+static int hls_player_sws_flags(hls_player_scaler_t scaler) {
+  switch (scaler) {
+  case HLS_PLAYER_SCALER_FAST_BILINEAR:
+    return SWS_FAST_BILINEAR;
+  case HLS_PLAYER_SCALER_BICUBIC:
+    return SWS_BICUBIC;
+  default:
+    return SWS_BILINEAR;
+  }
+}
+
+/*
+ * Size to convert the picture to: the largest that fits the output box at
+ * its display aspect ratio, never above the native size. Placing it in the
+ * box, and any upscaling, is left to the paint, which costs nothing extra.
+ */
+static void hls_player_fit_output(hls_player_t *player, AVFrame *frame,
+                                  int *width, int *height) {
+  double sar = 1.0;
+  if (frame->sample_aspect_ratio.num > 0 && frame->sample_aspect_ratio.den > 0) {
+    sar = av_q2d(frame->sample_aspect_ratio);
+  }
+  double native_w = frame->width * sar;
+  double native_h = frame->height;
+  double dar = native_w / native_h;
+
+  double box_w = player->output_width > 0 ? player->output_width : native_w;
+  double box_h = player->output_height > 0 ? player->output_height : native_h;
+  double w = box_w;
+  double h = box_h;
+  if (box_w / box_h > dar) {
+    w = box_h * dar;
+  } else {
+    h = box_w / dar;
+  }
+  if (w > native_w || h > native_h) {
+    w = native_w;
+    h = native_h;
+  }
+
+  // Even sizes keep the chroma planes aligned.
+  *width = tk_max(2, (int)(w + 0.5) & ~1);
+  *height = tk_max(2, (int)(h + 0.5) & ~1);
+}
+
+static ret_t hls_player_update_scaler(hls_player_t *player, AVFrame *frame,
+                                      int dst_w, int dst_h,
+                                      enum AVPixelFormat dst_fmt) {
+  uint32_t nr_slices = worker_pool_concurrency(player->convert_pool);
+
+  // Small pictures are not worth the fork-join overhead.
+  if (dst_h < 64 * (int)nr_slices) {
+    nr_slices = tk_max(1, dst_h / 64);
+  }
+
+  video_scaler_set_kernel(&player->scaler_ctx,
+                          player->converter != HLS_PLAYER_CONVERTER_SWSCALE,
+                          hls_player_kernel(player->converter));
+
+  return video_scaler_configure(&player->scaler_ctx, frame, dst_w, dst_h,
+                                dst_fmt,
+                                hls_player_sws_flags(player->scaler),
+                                nr_slices);
+}
+
+/*
+ * Convert a decoded frame for display. With a frame sink the scaler writes
+ * straight into the consumer's locked buffer; otherwise it goes through
+ * frame_rgb, allocated on first use, and the on_frame callback.
+ */
+static ret_t hls_player_deliver_frame(hls_player_t *player, AVFrame *frame,
+                                      AVFrame *frame_rgb, uint8_t **buffer) {
+  hls_player_frame_t out;
+  int width = 0;
+  int height = 0;
+  memset(&out, 0x00, sizeof(out));
+  hls_player_fit_output(player, frame, &width, &height);
+  // Read once: the display may renegotiate the format at any time.
+  hls_player_pixel_format_t format = player->output_format;
+  enum AVPixelFormat dst_fmt = hls_player_av_pixel_format(format);
+
+  return_value_if_fail(hls_player_update_scaler(player, frame, width, height,
+                                                dst_fmt) == RET_OK,
+                       RET_FAIL);
+
+  if (player->acquire_frame != NULL && player->release_frame != NULL) {
+    if (player->acquire_frame(player->frame_sink_ctx, width, height, format,
+                              &out) != RET_OK) {
+      return RET_BUSY;
+    }
+
+    uint8_t *dst[4] = {out.data, out.chroma[0], out.chroma[1], NULL};
+    int dst_linesize[4] = {(int)out.line_length, (int)out.chroma_line_length[0],
+                           (int)out.chroma_line_length[1], 0};
+    int64_t start = av_gettime_relative();
+    video_scaler_convert(&player->scaler_ctx, frame, dst, dst_linesize,
+                         player->convert_pool);
+    latency_histogram_record(&player->stage_latency[HLS_PLAYER_STAGE_CONVERT],
+                             av_gettime_relative() - start);
+
+    return player->release_frame(player->frame_sink_ctx, &out, TRUE);
+  }
+
+  if (player->on_frame == NULL) {
+    return RET_OK;
+  }
+
+  if (*buffer != NULL &&
+      (frame_rgb->width != width || frame_rgb->height != height ||
+       frame_rgb->format != dst_fmt)) {
+    av_freep(buffer);
+  }
+  if (*buffer == NULL) {
+    int numBytes = av_image_get_buffer_size(dst_fmt, width, height, 1);
+    *buffer = (uint8_t *)av_malloc(numBytes * sizeof(uint8_t));
+    return_value_if_fail(*buffer != NULL, RET_OOM);
+    av_image_fill_arrays(frame_rgb->data, frame_rgb->linesize, *buffer,
+                         dst_fmt, width, height, 1);
+    frame_rgb->width = width;
+    frame_rgb->height = height;
+    frame_rgb->format = dst_fmt;
+  }
+
+  // Convert to the output format
+  int64_t start = av_gettime_relative();
+  video_scaler_convert(&player->scaler_ctx, frame, frame_rgb->data,
+                       frame_rgb->linesize, player->convert_pool);
+  latency_histogram_record(&player->stage_latency[HLS_PLAYER_STAGE_CONVERT],
+                           av_gettime_relative() - start);
+
+  // Notify callback
+  player->on_frame(player->on_frame_ctx, frame_rgb->data[0], width, height,
+                   format);
+
+  return RET_OK;
+}
+
+/*
+ * Hand a frame to the sinks unless the player is stopping. output_mutex lets
+ * hls_player_stop_async wait out a frame already under way.
+ */
+static ret_t hls_player_output_frame(hls_player_t *player, AVFrame *frame,
+                                     AVFrame *frame_rgb, uint8_t **buffer) {
+  ret_t ret = RET_BUSY;
+
+  pthread_mutex_lock(&player->output_mutex);
+  if (!__atomic_load_n(&player->quit, __ATOMIC_SEQ_CST)) {
+    ret = hls_player_deliver_frame(player, frame, frame_rgb, buffer);
+  }
+  pthread_mutex_unlock(&player->output_mutex);
+
+  return ret;
+}
+
+/* Called on the video thread with the first frame shown after a zap. */
+static void hls_player_record_zap(hls_player_t *player) {
+  int64_t start = __atomic_exchange_n(&player->zap_start, 0, __ATOMIC_ACQ_REL);
+  if (start <= 0) {
+    return;
+  }
+
+  double ms = (av_gettime_relative() - start) / 1000.0;
+  // Only this thread writes them; readers take each with a relaxed load.
+  hls_player_store_gauge(&player->zap_last, ms);
+  hls_player_store_gauge(&player->zap_total, player->zap_total + ms);
+  hls_player_store_gauge(&player->zap_max, tk_max(player->zap_max, ms));
+  __atomic_fetch_add(&player->zaps, 1, __ATOMIC_RELAXED);
+  log_debug("zap: first frame after %.1f ms\n", ms);
+}
+
+/* Called on the video thread with the first frame shown after a seek. */
+static void hls_player_record_seek(hls_player_t *player) {
+  double ttff = (av_gettime_relative() - player->seek_start) / 1000.0;
+
+  player->seek_ttff_last = ttff;
+  player->seek_ttff_total += ttff;
+  player->seek_ttff_max = tk_max(player->seek_ttff_max, ttff);
+  player->seeks++;
+  log_debug("seek: first frame after %.0f ms\n", ttff);
+}
+
+static decode_priority_t hls_player_decode_priority(hls_player_t *player) {
+  switch (player->priority) {
+  case HLS_PLAYER_PRIORITY_BACKGROUND:
+    return DECODE_PRIORITY_BACKGROUND;
+  case HLS_PLAYER_PRIORITY_FOCUSED:
+    return DECODE_PRIORITY_FOCUSED;
+  default:
+    return DECODE_PRIORITY_NORMAL;
+  }
+}
+
+/*
+ * With a scheduler, hold one of its slots around each decode call. Returns
+ * FALSE if the player quit while waiting.
+ */
+static bool_t hls_player_enter_decode(hls_player_t *player,
+                                      decode_scheduler_t *scheduler) {
+  if (scheduler == NULL) {
+    return TRUE;
+  }
+  while (decode_scheduler_acquire(scheduler, hls_player_decode_priority(player),
+                                  100) != RET_OK) {
+    if (player->quit) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static void hls_player_leave_decode(hls_player_t *player,
+                                    decode_scheduler_t *scheduler) {
+  if (scheduler != NULL) {
+    decode_scheduler_release(scheduler);
+  }
+}
+
+/* Level the video decoder runs at: the ladder's while it is on */
+static decode_level_t hls_player_decode_level(hls_player_t *player) {
+  return player->auto_degrade ? player->decode_ladder.level : DECODE_LEVEL_FULL;
+}
+
+/*
+ * Step the ladder with how late the frame at pts came out of the decoder.
+ * Paused, in free run or across a timestamp discontinuity the clock says
+ * nothing about the CPU, so those frames are left out.
+ */
+static void hls_player_update_ladder(hls_player_t *player, double pts,
+                                     double frame_duration) {
+  if (!player->auto_degrade || player->free_run ||
+      player->state != PLAYER_STATE_PLAYING ||
+      !av_clock_is_valid(&player->ext_clock)) {
+    return;
+  }
+
+  double lateness = hls_player_get_master_clock(player) - pts;
+  if (fabs(lateness) > HLS_PLAYER_NOSYNC_THRESHOLD) {
+    return;
+  }
+
+  decode_level_t prev = player->decode_ladder.level;
+  decode_level_t level = decode_ladder_update(
+      &player->decode_ladder, av_gettime_relative(), lateness, frame_duration);
+  if (level != prev) {
+    log_info("decode: %s -> %s\n", decode_level_name(prev),
+             decode_level_name(level));
+  }
+}
+
+static void *video_thread(void *arg) {
+  hls_player_t *player = (hls_player_t *)arg;
+  AVStream *stream = player->fmt_ctx->streams[player->video_stream_idx];
+  AVPacket *pkt = av_packet_alloc();
+  AVFrame *frame = av_frame_alloc();
+  AVFrame *frame_rgb = av_frame_alloc();
+  uint8_t *buffer = NULL;
+  double frame_duration = 0.04;
+  double next_pts = 0;
+  bool_t seeking = FALSE;
+  decode_scheduler_t *scheduler = player->decode_scheduler;
+  bool_t own_pool = FALSE;
+  /* The decoder is discarding everything but keyframes */
+  bool_t skipping = FALSE;
+  int ret;
+
+  if (stream->avg_frame_rate.num > 0 && stream->avg_frame_rate.den > 0) {
+    frame_duration = 1.0 / av_q2d(stream->avg_frame_rate);
+  }
+
+  if (pkt == NULL || frame == NULL || frame_rgb == NULL) {
+    goto end;
+  }
+
+  uint32_t convert_threads = hls_player_get_convert_threads(player);
+  if (player->shared_convert_pool != NULL) {
+    player->convert_pool = player->shared_convert_pool;
+  } else if (convert_threads > 1) {
+    player->convert_pool = worker_pool_create(convert_threads - 1);
+    own_pool = TRUE;
+  }
+
+  while (!player->quit) {
+    if (player->state == PLAYER_STATE_PAUSED) {
+      sleep_ms(HLS_PLAYER_WAIT_MS);
+      continue;
+    }
+
+    ret_t got = packet_queue_get(&player->video_queue, pkt, 100);
+    if (got == RET_TIMEOUT) {
+      continue;
+    } else if (got == RET_QUIT) {
+      break;
+    } else if (got == RET_SKIP) {
+      // Seek: what the decoder holds belongs to the old position.
+      avcodec_flush_buffers(player->video_dec_ctx);
+      next_pts = 0;
+      seeking = TRUE;
+      continue;
+    }
+
+    // Keyframes only: the decoder discards the rest almost for free, and
+    // leaves it at a keyframe so no reference is missing. Non-reference
+    // frames and the loop filter can be dropped and restored anywhere.
+    decode_scheduler_t *slots = scheduler;
+    if (got == RET_OK) {
+      AVCodecContext *dec = player->video_dec_ctx;
+      bool_t key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+      decode_level_t level = hls_player_decode_level(player);
+      enum AVDiscard discard = AVDISCARD_DEFAULT;
+      if (hls_player_is_keyframes_only(player) || level >= DECODE_LEVEL_KEYFRAMES) {
+        discard = AVDISCARD_NONKEY;
+      } else if (level >= DECODE_LEVEL_SKIP_NONREF) {
+        discard = AVDISCARD_NONREF;
+      }
+      if (discard != dec->skip_frame && (!skipping || key)) {
+        dec->skip_frame = discard;
+        skipping = discard == AVDISCARD_NONKEY;
+      }
+      dec->skip_loop_filter = level >= DECODE_LEVEL_SKIP_LOOP_FILTER
+                                  ? AVDISCARD_ALL
+                                  : AVDISCARD_DEFAULT;
+      if (skipping && !key) {
+        slots = NULL;
+      }
+    }
+
+    if (!hls_player_enter_decode(player, slots)) {
+      av_packet_unref(pkt);
+      break;
+    }
+
+    // A NULL packet drains the frames still buffered in the decoder.
+    int64_t decode_start = av_gettime_relative();
+    ret = avcodec_send_packet(player->video_dec_ctx, got == RET_OK ? pkt : NULL);
+    av_packet_unref(pkt);
+    if (ret < 0 && got == RET_OK) {
+      hls_player_leave_decode(player, slots);
+      continue;
+    }
+
+    // The slot is given up while a frame waits for its time and is converted.
+    bool_t in_slot = TRUE;
+    while (ret >= 0 && !player->quit) {
+      if (!in_slot) {
+        if (!hls_player_enter_decode(player, slots)) {
+          break;
+        }
+        in_slot = TRUE;
+        decode_start = av_gettime_relative();
+      }
+      ret = avcodec_receive_frame(player->video_dec_ctx, frame);
+      hls_player_leave_decode(player, slots);
+      in_slot = FALSE;
+      if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+        break;
+      if (ret < 0)
+        break;
+
+      // The first frame of a packet carries the send as well as the receive.
+      int64_t now = av_gettime_relative();
+      latency_histogram_record(&player->stage_latency[HLS_PLAYER_STAGE_DECODE],
+                               now - decode_start);
+      __atomic_fetch_add(&player->frames_decoded, 1, __ATOMIC_RELAXED);
+
+      double pts = next_pts;
+      if (frame->best_effort_timestamp != AV_NOPTS_VALUE) {
+        pts = frame->best_effort_timestamp * av_q2d(stream->time_base);
+      }
+      next_pts = pts + frame_duration;
+
+      bool_t first = player->startup_us[HLS_PLAYER_STARTUP_FIRST_FRAME] == 0;
+      // A standby holds its first picture until it is switched to.
+      if (first && player->state == PLAYER_STATE_BUFFERING) {
+        __atomic_store_n(&player->prerolled, TRUE, __ATOMIC_RELEASE);
+        pthread_mutex_lock(&player->stop_mutex);
+        while (player->state == PLAYER_STATE_BUFFERING && !player->quit) {
+          pthread_cond_wait(&player->preroll_cond, &player->stop_mutex);
+        }
+        pthread_mutex_unlock(&player->stop_mutex);
+      }
+      if (!first && !seeking) {
+        hls_player_update_ladder(player, pts, frame_duration);
+      }
+      if (first && player->fast_start) {
+        // Show the first picture now; sync takes over from the next one.
+        if (!av_clock_is_valid(&player->ext_clock)) {
+          av_clock_set(&player->ext_clock, pts);
+        }
+      } else if (!hls_player_schedule_video(player, pts, frame_duration)) {
+        __atomic_fetch_add(&player->frames_dropped, 1, __ATOMIC_RELAXED);
+        av_frame_unref(frame);
+        continue;
+      }
+
+      ret_t shown = hls_player_output_frame(player, frame, frame_rgb, &buffer);
+      // The sink may still be allocating for the first size it sees.
+      for (int i = 0; first && player->fast_start && shown == RET_BUSY &&
+                      i < HLS_PLAYER_FIRST_FRAME_RETRIES && !player->quit;
+           i++) {
+        sleep_ms(HLS_PLAYER_WAIT_MS);
+        shown = hls_player_output_frame(player, frame, frame_rgb, &buffer);
+      }
+      if (shown == RET_OK) {
+        __atomic_fetch_add(&player->frames_displayed, 1, __ATOMIC_RELAXED);
+        hls_player_publish_position(player);
+      }
+      if (shown == RET_BUSY) {
+        __atomic_fetch_add(&player->frames_dropped, 1, __ATOMIC_RELAXED);
+      } else if (shown == RET_OK && first) {
+        hls_player_mark_startup(player, HLS_PLAYER_STARTUP_FIRST_FRAME);
+        hls_player_log_startup(player);
+        hls_player_record_zap(player);
+      }
+      if (shown == RET_OK && seeking) {
+        hls_player_record_seek(player);
+        seeking = FALSE;
+      }
+
+      av_frame_unref(frame);
+    }
+    if (in_slot) {
+      hls_player_leave_decode(player, slots);
+    }
+
+    if (got == RET_EOS) {
+      break;
+    }
+  }
+
+end:
+  if (own_pool) {
+    worker_pool_destroy(player->convert_pool);
+  }
+  player->convert_pool = NULL;
+  if (buffer)
+    av_free(buffer);
+  av_frame_free(&frame);
+  av_frame_free(&frame_rgb);
+  av_packet_free(&pkt);
+  return NULL;
+}
+
+static uint32_t hls_player_audio_target(hls_player_t *player) {
+  uint32_t target = player->audio_bytes_per_sec * player->audio_latency;
+  return tk_min(target, player->audio_ring.size / 2);
+}
+
+/* Producer side: waits for room while the device drains the ring. */
+static void hls_player_write_audio(hls_player_t *player, const void *data,
+                                   uint32_t size, double end_pts, double speed) {
+  uint32_t written = 0;
+
+  while (written < size && !player->quit) {
+    written += audio_ring_write(&player->audio_ring, (const uint8_t *)data + written,
+                                size - written, end_pts, speed);
+    if (written < size) {
+      sleep_ms(HLS_PLAYER_WAIT_MS);
+    }
+  }
+}
+
+/* Volume changes ramp over one frame so they do not click. */
+static void hls_player_apply_volume(hls_player_t *player, int16_t *pcm,
+                                    uint32_t frames) {
+  int32_t gain =
+      player->muted ? 0 : (int32_t)(player->volume * AUDIO_GAIN_UNITY + 0.5);
+
+  if (gain != player->audio_gain) {
+    audio_gain_ramp(pcm, frames, player->audio_channels, player->audio_gain, gain);
+    player->audio_gain = gain;
+  } else {
+    audio_gain_apply(pcm, frames * player->audio_channels, gain);
+  }
+}
+
+/*
+ * Queue converted audio for the device, time-stretched while the playback
+ * rate is not 1.0. Each chunk carries the pts of the last input sample it
+ * reaches, so the audio clock stays on media time at any rate.
+ */
+static void hls_player_output_audio(hls_player_t *player, int16_t *pcm,
+                                    uint32_t frames, double end_pts) {
+  uint32_t ch = player->audio_channels;
+  double sample_rate = player->audio_sample_rate;
+  double speed = player->playback_rate * player->catchup_rate;
+  uint32_t done = 0;
+  uint32_t out;
+
+  if (player->stretch_buf == NULL || (speed == 1.0 && !player->stretching)) {
+    hls_player_write_audio(player, pcm, frames * ch * sizeof(int16_t), end_pts,
+                           1.0);
+    return;
+  }
+
+  if (speed != 1.0) {
+    time_stretch_set_rate(&player->stretch, speed);
+    player->stretching = TRUE;
+    while (done < frames && !player->quit) {
+      done += time_stretch_put(&player->stretch, pcm + done * ch, frames - done);
+      while ((out = time_stretch_get(&player->stretch, player->stretch_buf,
+                                     HLS_PLAYER_STRETCH_FRAMES)) > 0) {
+        uint32_t pending = frames - done + time_stretch_get_latency(&player->stretch);
+        hls_player_write_audio(player, player->stretch_buf,
+                               out * ch * sizeof(int16_t),
+                               end_pts - pending / sample_rate, speed);
+      }
+    }
+    return;
+  }
+
+  // Back at normal speed: hand on what the stretcher holds, then pass through.
+  while ((out = time_stretch_drain(&player->stretch, player->stretch_buf,
+                                   HLS_PLAYER_STRETCH_FRAMES)) > 0) {
+    uint32_t pending = frames + time_stretch_get_latency(&player->stretch);
+    hls_player_write_audio(player, player->stretch_buf, out * ch * sizeof(int16_t),
+                           end_pts - pending / sample_rate, 1.0);
+  }
+  player->stretching = FALSE;
+  hls_player_write_audio(player, pcm, frames * ch * sizeof(int16_t), end_pts, 1.0);
+}
+
+/* Drop unplayed audio; the callback is held off while the ring resets. */
+static void hls_player_clear_audio(hls_player_t *player) {
+  if (player->audio_dev != 0) {
+    SDL_LockAudioDevice(player->audio_dev);
+    audio_ring_clear(&player->audio_ring);
+    SDL_UnlockAudioDevice(player->audio_dev);
+  }
+}
+
+static void *audio_thread(void *arg) {
+  hls_player_t *player = (hls_player_t *)arg;
+  AVStream *stream = player->fmt_ctx->streams[player->audio_stream_idx];
+  AVPacket *pkt = av_packet_alloc();
+  AVFrame *audio_frame = av_frame_alloc();
+  double next_pts = 0;
+  int ret;
+
+  if (pkt == NULL || audio_frame == NULL) {
+    goto end;
+  }
+
+  while (!player->quit) {
+    // Keep the target latency queued; the ring may hold up to twice that.
+    if (player->state == PLAYER_STATE_PAUSED ||
+        (player->audio_dev != 0 &&
+         audio_ring_available(&player->audio_ring) >=
+             hls_player_audio_target(player))) {
+      hls_player_publish_position(player);
+      sleep_ms(HLS_PLAYER_WAIT_MS);
+      continue;
+    }
+
+    ret_t got = packet_queue_get(&player->audio_queue, pkt, 100);
+    if (got == RET_TIMEOUT) {
+      continue;
+    } else if (got == RET_QUIT) {
+      break;
+    } else if (got == RET_SKIP) {
+      avcodec_flush_buffers(player->audio_dec_ctx);
+      if (player->swr_ctx != NULL) {
+        swr_init(player->swr_ctx);
+      }
+      hls_player_clear_audio(player);
+      time_stretch_reset(&player->stretch);
+      player->stretching = FALSE;
+      av_clock_reset(&player->audio_clock);
+      next_pts = 0;
+      continue;
+    }
+
+    ret = avcodec_send_packet(player->audio_dec_ctx, got == RET_OK ? pkt : NULL);
+    av_packet_unref(pkt);
+    if (ret < 0 && got == RET_OK) {
+      continue;
+    }
+
+    while (ret >= 0 && !player->quit) {
+      ret = avcodec_receive_frame(player->audio_dec_ctx, audio_frame);
+      if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+        break;
+      if (ret < 0)
+        break;
+
+      double pts = next_pts;
+      if (audio_frame->best_effort_timestamp != AV_NOPTS_VALUE) {
+        pts = audio_frame->best_effort_timestamp * av_q2d(stream->time_base);
+      }
+      next_pts = pts + (double)audio_frame->nb_samples / player->audio_in_rate;
+
+      if (player->swr_ctx && player->audio_dev != 0) {
+        int dst_nb_samples = av_rescale_rnd(
+            swr_get_delay(player->swr_ctx, player->audio_in_rate) +
+                audio_frame->nb_samples,
+            player->audio_sample_rate, player->audio_in_rate, AV_ROUND_UP);
+        int out_channels = player->audio_channels;
+        int out_buffer_size = av_samples_get_buffer_size(
+            NULL, out_channels, dst_nb_samples, AV_SAMPLE_FMT_S16, 1);
+        if (out_buffer_size > 0) {
+          av_fast_malloc(&player->audio_buf, &player->audio_buf_size,
+                         out_buffer_size);
+        }
+        if (out_buffer_size > 0 && player->audio_buf != NULL) {
+          int converted = swr_convert(
+              player->swr_ctx, &player->audio_buf, dst_nb_samples,
+              (const uint8_t **)audio_frame->data, audio_frame->nb_samples);
+          if (converted > 0) {
+            int bytes = av_samples_get_buffer_size(
+                NULL, out_channels, converted, AV_SAMPLE_FMT_S16, 1);
+            if (bytes > 0) {
+              int16_t *pcm = (int16_t *)player->audio_buf;
+              hls_player_apply_volume(player, pcm, converted);
+              hls_player_output_audio(player, pcm, converted, next_pts);
+              hls_player_mark_startup(player, HLS_PLAYER_STARTUP_FIRST_AUDIO);
+              // Without video, a standby is ready with its first audio
+              // queued; the paused device and the full ring hold it.
+              if (!player->video_thread_running &&
+                  player->state == PLAYER_STATE_BUFFERING) {
+                __atomic_store_n(&player->prerolled, TRUE, __ATOMIC_RELEASE);
+              }
+            }
+          }
+        }
+      }
+
+      if (!av_clock_is_valid(&player->ext_clock)) {
+        av_clock_set(&player->ext_clock, pts);
+      }
+      av_frame_unref(audio_frame);
+    }
+
+    if (got == RET_EOS) {
+      break;
+    }
+  }
+
+end:
+  av_frame_free(&audio_frame);
+  av_packet_free(&pkt);
+  return NULL;
+}
+
+/* SDL audio thread: play from the ring and move the audio clock with it. */
+static void hls_player_audio_callback(void *ctx, Uint8 *stream, int len) {
+  hls_player_t *player = (hls_player_t *)ctx;
+  double pts = NAN;
+
+  audio_ring_read(&player->audio_ring, stream, len, &pts);
+  if (!isnan(pts)) {
+    // What was just read starts playing once the device buffer drains.
+    double speed = player->audio_ring.speed;
+    av_clock_set_speed(&player->audio_clock, speed);
+    av_clock_set(&player->audio_clock, pts - player->audio_hw_latency * speed);
+  }
+}
+
+static void hls_player_close_audio_device(hls_player_t *player) {
+  if (player->audio_dev != 0) {
+    SDL_CloseAudioDevice(player->audio_dev);
+    player->audio_dev = 0;
+    audio_ring_deinit(&player->audio_ring);
+  }
+}
+
+/*
+ * Open the SDL output for S16 at rate and channels. Runs on its own thread
+ * in fast start, while the input is still being probed; nothing else touches
+ * the audio fields until hls_player_join_audio_open.
+ */
+static ret_t hls_player_open_audio_device(hls_player_t *player, int rate,
+                                          int channels) {
+  if (!player->audio_initialized) {
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+      log_error("SDL_InitSubSystem audio failed: %s\n", SDL_GetError());
+      return RET_FAIL;
+    }
+    player->audio_initialized = TRUE;
+  }
+
+  // A low target latency gets a small device buffer to match.
+  uint32_t samples = HLS_PLAYER_AUDIO_MIN_SAMPLES;
+  while (samples < HLS_PLAYER_AUDIO_MAX_SAMPLES &&
+         samples * 8 < rate * player->audio_latency) {
+    samples *= 2;
+  }
+
+  int bytes_per_sec = rate * channels * 2;
+  double ring_seconds =
+      tk_max(player->audio_latency * 2, HLS_PLAYER_AUDIO_RING_MIN);
+  if (audio_ring_init(&player->audio_ring, bytes_per_sec * ring_seconds,
+                      bytes_per_sec) != RET_OK) {
+    return RET_OOM;
+  }
+
+  SDL_AudioSpec want;
+  SDL_zero(want);
+  want.freq = rate;
+  want.format = AUDIO_S16SYS;
+  want.channels = (Uint8)channels;
+  want.samples = samples;
+  want.callback = hls_player_audio_callback;
+  want.userdata = player;
+
+  player->audio_dev = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0);
+  if (player->audio_dev == 0) {
+    log_error("SDL_OpenAudioDevice failed: %s\n", SDL_GetError());
+    audio_ring_deinit(&player->audio_ring);
+    return RET_FAIL;
+  }
+
+  player->audio_sample_rate = rate;
+  player->audio_channels = channels;
+  player->audio_bytes_per_sec = bytes_per_sec;
+  player->audio_hw_latency = (double)want.samples / rate;
+  SDL_PauseAudioDevice(player->audio_dev,
+                       player->state == PLAYER_STATE_PAUSED ||
+                               player->state == PLAYER_STATE_BUFFERING
+                           ? 1
+                           : 0);
+
+  return RET_OK;
+}
+
+static void *audio_open_thread(void *arg) {
+  hls_player_t *player = (hls_player_t *)arg;
+  hls_player_open_audio_device(player, HLS_PLAYER_AUDIO_RATE,
+                               HLS_PLAYER_AUDIO_CHANNELS);
+  return NULL;
+}
+
+static void hls_player_join_audio_open(hls_player_t *player) {
+  if (player->audio_opening) {
+    pthread_join(player->audio_open_thread, NULL);
+    player->audio_opening = FALSE;
+  }
+}
+
+/*
+ * Audio decoder plus a resampler to the device's S16 format. Without a
+ * device opened up front, the device takes the stream's own format.
+ */
+static ret_t hls_player_open_audio_decoder(hls_player_t *player) {
+  AVCodecParameters *par =
+      player->fmt_ctx->streams[player->audio_stream_idx]->codecpar;
+  const AVCodec *codec = avcodec_find_decoder(par->codec_id);
+  if (codec == NULL) {
+    return RET_NOT_FOUND;
+  }
+
+  player->audio_dec_ctx = avcodec_alloc_context3(codec);
+  if (player->audio_dec_ctx == NULL ||
+      avcodec_parameters_to_context(player->audio_dec_ctx, par) < 0 ||
+      avcodec_open2(player->audio_dec_ctx, codec, NULL) < 0) {
+    log_error("Failed to open audio decoder\n");
+    avcodec_free_context(&player->audio_dec_ctx);
+    return RET_FAIL;
+  }
+
+  AVCodecContext *dec = player->audio_dec_ctx;
+  player->audio_in_rate = dec->sample_rate;
+#if LIBAVCODEC_VERSION_MAJOR >= 59
+  if (dec->ch_layout.nb_channels == 0) {
+    av_channel_layout_default(&dec->ch_layout, 2);
+  }
+  int in_channels = dec->ch_layout.nb_channels;
+#else
+  int in_channels = dec->channels > 0 ? dec->channels : 2;
+#endif
+
+  if (player->audio_dev == 0 &&
+      hls_player_open_audio_device(player, dec->sample_rate, in_channels) !=
+          RET_OK) {
+    return RET_OK;
+  }
+
+#if LIBAVCODEC_VERSION_MAJOR >= 59
+  AVChannelLayout out_layout;
+  av_channel_layout_default(&out_layout, player->audio_channels);
+  if (swr_alloc_set_opts2(&player->swr_ctx, &out_layout, AV_SAMPLE_FMT_S16,
+                          player->audio_sample_rate, &dec->ch_layout,
+                          dec->sample_fmt, dec->sample_rate, 0, NULL) < 0) {
+    log_error("Failed to configure audio resampler\n");
+    player->swr_ctx = NULL;
+  } else if (swr_init(player->swr_ctx) < 0) {
+    log_error("Failed to initialize audio resampler\n");
+    swr_free(&player->swr_ctx);
+  }
+  av_channel_layout_uninit(&out_layout);
+#else
+  int64_t in_layout = dec->channel_layout;
+  if (in_layout == 0) {
+    in_layout = av_get_default_channel_layout(in_channels);
+  }
+  player->swr_ctx = swr_alloc_set_opts(
+      NULL, av_get_default_channel_layout(player->audio_channels),
+      AV_SAMPLE_FMT_S16, player->audio_sample_rate, in_layout, dec->sample_fmt,
+      dec->sample_rate, 0, NULL);
+  if (player->swr_ctx && swr_init(player->swr_ctx) < 0) {
+    log_error("Failed to initialize audio resampler\n");
+    swr_free(&player->swr_ctx);
+  }
+#endif
+
+  // Sized once for the device format, so rate changes never allocate.
+  if (player->stretch_buf == NULL &&
+      time_stretch_init(&player->stretch, player->audio_channels,
+                        player->audio_sample_rate) == RET_OK) {
+    player->stretch_buf = (int16_t *)malloc(HLS_PLAYER_STRETCH_FRAMES *
+                                            player->audio_channels * sizeof(int16_t));
+    if (player->stretch_buf == NULL) {
+      time_stretch_deinit(&player->stretch);
+    }
+  }
+
+  return RET_OK;
+}
+
+/* For the playlist engine, whose requests carry their own deadlines */
+static int hls_player_quit_requested(void *ctx) {
+  hls_player_t *player = (hls_player_t *)ctx;
+  return player->quit;
+}
+
+/* For the demuxer: abort on quit, or once the armed deadline has passed. */
+static int hls_player_interrupt(void *ctx) {
+  hls_player_t *player = (hls_player_t *)ctx;
+
+  if (player->quit) {
+    return 1;
+  }
+  if (player->io_deadline > 0 && av_gettime_relative() >= player->io_deadline) {
+    player->io_timed_out = TRUE;
+    return 1;
+  }
+  return 0;
+}
+
+/* Bound the demuxer call that follows by timeout_us, 0 for none. */
+static void hls_player_begin_io(hls_player_t *player, int64_t timeout_us) {
+  player->io_timed_out = FALSE;
+  player->io_deadline = timeout_us > 0 ? av_gettime_relative() + timeout_us : 0;
+}
+
+/* Disarm the deadline; TRUE if it is what ended the call. */
+static bool_t hls_player_end_io(hls_player_t *player, const char *what) {
+  player->io_deadline = 0;
+  if (!player->io_timed_out) {
+    return FALSE;
+  }
+
+  player->io_timeouts++;
+  log_warn("%s timed out for %s\n", what, player->url);
+  return TRUE;
+}
+
+/*
+ * Playlists go through our own engine, which prefetches segments in
+ * parallel, and reach the demuxer as one continuous stream.
+ */
+static ret_t hls_player_open_source(hls_player_t *player) {
+  AVIOInterruptCB int_cb = {hls_player_quit_requested, player};
+  hls_source_t *source =
+      hls_source_create(player->url, player->prefetch_segments, &int_cb);
+  return_value_if_fail(source != NULL, RET_OOM);
+
+  pthread_mutex_lock(&player->source_mutex);
+  player->source = source;
+  pthread_mutex_unlock(&player->source_mutex);
+
+  hls_source_set_cache(source, player->cache);
+  hls_source_set_fast_start(source, player->fast_start);
+  hls_source_set_max_resolution(source, player->max_width, player->max_height);
+  hls_source_set_low_latency(source, player->low_latency, player->target_latency);
+  hls_source_set_read_latency(source,
+                              &player->stage_latency[HLS_PLAYER_STAGE_NETWORK]);
+  hls_source_set_http_pool(source, hls_player_http_pool(player));
+  if (hls_source_open(source) != RET_OK) {
+    return RET_FAIL;
+  }
+  if (player->variant >= 0 &&
+      hls_source_select_variant(source, player->variant) != RET_OK) {
+    log_warn("hls: no variant %d, adapting\n", player->variant);
+  }
+
+  player->fmt_ctx = avformat_alloc_context();
+  return_value_if_fail(player->fmt_ctx != NULL, RET_OOM);
+  player->fmt_ctx->pb = hls_source_get_avio(player->source);
+  player->fmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+  return RET_OK;
+}
+
+/*
+ * Discard what the decode workers hold after the input jumped: they flush
+ * their decoders on the marker packet_queue_seek leaves, and the clocks
+ * restart from the first frame after it.
+ */
+static void hls_player_restart_playback(hls_player_t *player, int64_t start) {
+  packet_queue_seek(&player->video_queue);
+  packet_queue_seek(&player->audio_queue);
+  hls_player_clear_audio(player);
+  av_clock_reset(&player->audio_clock);
+  av_clock_reset(&player->ext_clock);
+  player->seek_start = start;
+}
+
+/*
+ * Reposition the input on the demux thread without reopening it. The native
+ * engine restarts at the segment holding the target, and a keyframe learned
+ * inside that segment lets decoding begin there instead of at its head;
+ * other inputs seek through the demuxer.
+ */
+static void hls_player_do_seek(hls_player_t *player, double target) {
+  int64_t start = av_gettime_relative();
+  double keyframe = seek_index_floor(&player->seek_index, target);
+  double land = target;
+
+  player->skip_until = -1;
+  if (player->source != NULL) {
+    double segment = 0;
+    if (hls_source_seek(player->source, target, &segment) != RET_OK) {
+      log_warn("seek: input is not seekable\n");
+      return;
+    }
+    avio_flush(player->fmt_ctx->pb);
+    avformat_flush(player->fmt_ctx);
+    land = segment;
+    if (keyframe > segment) {
+      land = keyframe;
+      player->skip_until = keyframe + player->start_time;
+    }
+  } else {
+    int64_t ts = (int64_t)((target + player->start_time) * AV_TIME_BASE);
+    if (avformat_seek_file(player->fmt_ctx, -1, INT64_MIN, ts, ts, 0) < 0) {
+      log_warn("seek: could not seek to %.3f\n", target);
+      return;
+    }
+    if (keyframe >= 0) {
+      land = keyframe;
+    }
+  }
+
+  hls_player_restart_playback(player, start);
+  hls_player_store_position(player, land);
+  log_debug("seek: %.3f, resuming at %.3f\n", target, land);
+}
+
+/*
+ * Jump within the timeshift buffer. The ingest thread keeps writing at the
+ * live edge; only the read cursor moves.
+ */
+static void hls_player_do_timeshift_seek(hls_player_t *player, double delay) {
+  int64_t start = av_gettime_relative();
+  double landed = 0;
+
+  if (timeshift_seek(player->timeshift, delay, &landed) != RET_OK) {
+    return;
+  }
+  hls_player_restart_playback(player, start);
+  log_debug("timeshift: %.3f s behind live, resuming %.3f s behind\n", delay,
+            landed);
+}
+
+/*
+ * Learn keyframe positions, and drop what precedes the keyframe a seek
+ * landed on. Returns FALSE for a packet to drop.
+ */
+static bool_t hls_player_index_packet(hls_player_t *player, AVPacket *pkt) {
+  if (pkt->pts == AV_NOPTS_VALUE) {
+    return TRUE;
+  }
+
+  AVStream *stream = player->fmt_ctx->streams[pkt->stream_index];
+  double pts = pkt->pts * av_q2d(stream->time_base);
+  if (pkt->stream_index == player->video_stream_idx &&
+      (pkt->flags & AV_PKT_FLAG_KEY)) {
+    seek_index_add(&player->seek_index, pts - player->start_time);
+  }
+
+  if (player->skip_until < 0) {
+    return TRUE;
+  }
+  if (pts >= player->skip_until + HLS_PLAYER_SEEK_SKEW) {
+    player->skip_until = -1;
+  }
+  return pts >= player->skip_until - 0.001;
+}
+
+/*
+ * Steer the latency towards the target with a small rate change, only
+ * while the user left the rate at 1.0 and plays at the live edge. Rates
+ * move in steps of 1% so the stretcher is not retuned on every report.
+ */
+static void hls_player_catch_up(hls_player_t *player, double latency) {
+  double error = latency - player->target_latency;
+  double rate = 1.0;
+  bool_t active = player->low_latency && player->target_latency > 0 &&
+                  player->playback_rate == 1.0 &&
+                  player->timeshift_target <= 0 &&
+                  player->state == PLAYER_STATE_PLAYING;
+
+  if (active && (fabs(error) >= HLS_PLAYER_CATCHUP_START ||
+                 (player->catchup_rate != 1.0 &&
+                  fabs(error) > HLS_PLAYER_CATCHUP_STOP))) {
+    rate = 1.0 + error * HLS_PLAYER_CATCHUP_GAIN;
+    rate = tk_max(HLS_PLAYER_CATCHUP_MIN_RATE,
+                  tk_min(HLS_PLAYER_CATCHUP_MAX_RATE, rate));
+    rate = round(rate * 100) / 100;
+  }
+
+  if (rate != player->catchup_rate) {
+    player->catchup_rate = rate;
+    av_clock_set_speed(&player->ext_clock, player->playback_rate * rate);
+  }
+}
+
+/*
+ * Tell the playlist engine how much media is demuxed but not yet decoded,
+ * so its variant choice sees the whole buffer ahead of the playhead. On
+ * live streams this also measures the latency: the distance from the
+ * source's read position to the live edge, plus everything demuxed but
+ * not yet heard.
+ */
+static void hls_player_report_buffer(hls_player_t *player) {
+  packet_queue_stats_t qs;
+  packet_queue_t *q = player->video_thread_running ? &player->video_queue
+                                                   : &player->audio_queue;
+  packet_queue_get_stats(q, &qs);
+  hls_source_report_buffer(player->source, qs.duration);
+
+  if (!hls_source_is_live(player->source)) {
+    hls_player_store_gauge(&player->live_latency, -1);
+    return;
+  }
+
+  hls_player_audio_stats_t audio;
+  double latency = hls_source_get_edge_distance(player->source) + qs.duration;
+  hls_player_get_audio_stats(player, &audio);
+  latency += audio.buffered;
+  if (player->timeshift != NULL) {
+    timeshift_stats_t ts;
+    timeshift_get_stats(player->timeshift, &ts);
+    latency += ts.delay;
+  }
+
+  hls_player_store_gauge(&player->live_latency, latency);
+  hls_player_catch_up(player, latency);
+}
+
+/* av_read_frame, timed and counted towards the demuxed bitrate. */
+static int hls_player_read_packet(hls_player_t *player, AVPacket *pkt) {
+  int64_t start = av_gettime_relative();
+  hls_player_begin_io(player, player->read_timeout);
+  int ret = av_read_frame(player->fmt_ctx, pkt);
+  hls_player_end_io(player, "read");
+  int64_t now = av_gettime_relative();
+
+  latency_histogram_record(&player->stage_latency[HLS_PLAYER_STAGE_DEMUX],
+                           now - start);
+  if (ret < 0) {
+    return ret;
+  }
+
+  // reset_metrics may zero the window from another thread at any point.
+  int64_t window = __atomic_load_n(&player->bitrate_start, __ATOMIC_RELAXED);
+  if (window == 0) {
+    window = now;
+    __atomic_store_n(&player->bitrate_start, window, __ATOMIC_RELAXED);
+  }
+  uint64_t bytes = __atomic_add_fetch(&player->bitrate_bytes, pkt->size,
+                                      __ATOMIC_RELAXED);
+  if (now - window >= HLS_PLAYER_BITRATE_WINDOW_US) {
+    hls_player_store_gauge(&player->bitrate,
+                           bytes * 8.0 * 1000000 / (now - window));
+    __atomic_store_n(&player->bitrate_start, now, __ATOMIC_RELAXED);
+    __atomic_store_n(&player->bitrate_bytes, 0, __ATOMIC_RELAXED);
+  }
+
+  return ret;
+}
+
+/* Hand a demuxed packet to its decode worker; takes the reference. */
+static void hls_player_dispatch_packet(hls_player_t *player, AVPacket *pkt) {
+  packet_queue_t *q = NULL;
+  if (pkt->stream_index == player->video_stream_idx &&
+      player->video_thread_running) {
+    q = &player->video_queue;
+  } else if (pkt->stream_index == player->audio_stream_idx &&
+             player->audio_thread_running) {
+    q = &player->audio_queue;
+  }
+
+  if (q != NULL) {
+    while (packet_queue_put(q, pkt) == RET_BUSY && !player->quit) {
+      sleep_ms(HLS_PLAYER_WAIT_MS);
+    }
+  }
+  av_packet_unref(pkt);
+}
+
+/* Live timeshift: demux at the pace of the stream, whatever playback does. */
+static void *ingest_thread(void *arg) {
+  hls_player_t *player = (hls_player_t *)arg;
+  AVPacket *pkt = av_packet_alloc();
+  double time = 0;
+
+  while (pkt != NULL && !player->quit) {
+    if (hls_player_read_packet(player, pkt) < 0) {
+      break;
+    }
+    hls_player_mark_startup(player, HLS_PLAYER_STARTUP_FIRST_PACKET);
+
+    int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+    if (ts != AV_NOPTS_VALUE) {
+      time = ts * av_q2d(player->fmt_ctx->streams[pkt->stream_index]->time_base);
+    }
+    timeshift_write(player->timeshift, pkt, time);
+    av_packet_unref(pkt);
+  }
+
+  timeshift_set_eof(player->timeshift);
+  av_packet_free(&pkt);
+  return NULL;
+}
+
+static ret_t hls_player_start_timeshift(hls_player_t *player) {
+  int key_stream = player->video_dec_ctx != NULL ? player->video_stream_idx : -1;
+  timeshift_t *timeshift =
+      timeshift_create(player->timeshift_bytes, player->timeshift_dir,
+                       player->timeshift_spill_bytes, key_stream);
+  return_value_if_fail(timeshift != NULL, RET_OOM);
+
+  player->timeshift = timeshift;
+  player->ingest_running =
+      pthread_create(&player->ingest_thread, NULL, ingest_thread, player) == 0;
+  if (!player->ingest_running) {
+    player->timeshift = NULL;
+    timeshift_destroy(timeshift);
+    return RET_FAIL;
+  }
+  log_debug("timeshift: %u bytes\n", player->timeshift_bytes);
+
+  return RET_OK;
+}
+
+/* Feed the decode workers from the timeshift buffer instead of the demuxer. */
+static void hls_player_play_timeshift(hls_player_t *player, AVPacket *pkt) {
+  int64_t last_report = 0;
+
+  while (!player->quit) {
+    if (__atomic_exchange_n(&player->timeshift_requested, FALSE,
+                            __ATOMIC_ACQ_REL)) {
+      hls_player_do_timeshift_seek(player, player->timeshift_target);
+    }
+
+    if (player->source != NULL &&
+        av_gettime_relative() - last_report >= HLS_PLAYER_BUFFER_REPORT_US) {
+      hls_player_report_buffer(player);
+      last_report = av_gettime_relative();
+    }
+
+    // Pausing only stops the cursor; the ingest thread keeps recording.
+    if (player->state == PLAYER_STATE_PAUSED || hls_player_queues_full(player)) {
+      sleep_ms(HLS_PLAYER_WAIT_MS);
+      continue;
+    }
+
+    ret_t ret = timeshift_read(player->timeshift, pkt, 100);
+    if (ret == RET_EOS) {
+      break;
+    } else if (ret == RET_SKIP) {
+      // Paused for longer than the buffer holds: resume at its oldest end.
+      hls_player_restart_playback(player, av_gettime_relative());
+    } else if (ret == RET_OK) {
+      hls_player_dispatch_packet(player, pkt);
+    }
+  }
+}
+
+/*
+ * Last step of the player thread: time the stop that ended it, if any, and
+ * call the completion callback of an asynchronous stop.
+ */
+static void hls_player_finish(hls_player_t *player) {
+  pthread_mutex_lock(&player->stop_mutex);
+  // Under the lock that play and pause set the state with.
   player->state = PLAYER_STATE_STOPPED;
+  player->running = FALSE;
+  hls_player_on_stopped_t on_stopped = player->on_stopped;
+  void *ctx = player->on_stopped_ctx;
+  player->on_stopped = NULL;
+  if (player->stop_requested > 0) {
+    double latency = (av_gettime_relative() - player->stop_requested) / 1000.0;
+    player->stops++;
+    player->stop_latency_last = latency;
+    player->stop_latency_max = tk_max(player->stop_latency_max, latency);
+    log_debug("stopped in %.1f ms\n", latency);
+  }
+  player->stop_requested = 0;
+  pthread_mutex_unlock(&player->stop_mutex);
+
+  if (on_stopped != NULL) {
+    on_stopped(ctx, player);
+  }
+}
+
+/*
+ * After a run has ended: TRUE to go round again on the url a zap asked
+ * for, with the audio device and scaler left as they are.
+ */
+static bool_t hls_player_take_zap(hls_player_t *player) {
+  pthread_mutex_lock(&player->stop_mutex);
+  char *url = player->zap_url;
+  int64_t requested = player->zap_requested;
+  player->zap_url = NULL;
+  if (url != NULL) {
+    player->quit = FALSE;
+  } else {
+    // Anything from here on is too late: a zap starts the player afresh.
+    player->finishing = TRUE;
+  }
+  pthread_mutex_unlock(&player->stop_mutex);
+  if (url == NULL) {
+    return FALSE;
+  }
+
+  free(player->url);
+  player->url = url;
+  // Startup phases of the new run count from the zap, like its zap time.
+  hls_player_reset_run(player, requested);
+  __atomic_store_n(&player->zap_start, requested, __ATOMIC_RELEASE);
+  av_clock_set_paused(&player->audio_clock, FALSE);
+  av_clock_set_paused(&player->ext_clock, FALSE);
+  // What the old channel left in the ring must not play over the new one.
+  hls_player_clear_audio(player);
+
+  return TRUE;
+}
+
+/* One run of the pipeline on player->url, from opening it to closing it. */
+static void hls_player_run(hls_player_t *player, AVPacket *pkt) {
+  const char *open_url = player->url;
+  int64_t last_report = 0;
+  int ret;
+
+  log_debug("play url: %s\n", player->url);
+
+  // SDL audio start-up is slow; overlap it with the network round trips.
+  if (player->fast_start && player->audio_dev == 0) {
+    player->audio_opening = pthread_create(&player->audio_open_thread, NULL,
+                                           audio_open_thread, player) == 0;
+  }
+
+  if (player->native_hls && hls_source_is_playlist_url(player->url)) {
+    if (hls_player_open_source(player) != RET_OK) {
+      log_error("Could not open playlist %s\n", player->url);
+      goto end;
+    }
+    // The demuxer probes the segment data itself.
+    open_url = "";
+  }
+
+  // Open input
+  if (player->fmt_ctx == NULL) {
+    player->fmt_ctx = avformat_alloc_context();
+  }
+  if (player->fmt_ctx != NULL) {
+    player->fmt_ctx->interrupt_callback.callback = hls_player_interrupt;
+    player->fmt_ctx->interrupt_callback.opaque = player;
+    if (player->fast_start) {
+      player->fmt_ctx->probesize = HLS_PLAYER_FAST_PROBESIZE;
+      player->fmt_ctx->max_analyze_duration = HLS_PLAYER_FAST_ANALYZE_US;
+    }
+  }
+  hls_player_begin_io(player, player->open_timeout);
+  ret = avformat_open_input(&player->fmt_ctx, open_url, NULL, NULL);
+  if (hls_player_end_io(player, "open") || ret < 0) {
+    log_error("Could not open source file %s\n", player->url);
+    goto end;
+  }
+  hls_player_mark_startup(player, HLS_PLAYER_STARTUP_OPEN);
+
+  hls_player_begin_io(player, player->open_timeout);
+  ret = avformat_find_stream_info(player->fmt_ctx, NULL);
+  if (hls_player_end_io(player, "probe") || ret < 0) {
+    log_error("Could not find stream information\n");
+    goto end;
+  }
+  hls_player_mark_startup(player, HLS_PLAYER_STARTUP_PROBE);
+  if (player->fmt_ctx->start_time != AV_NOPTS_VALUE) {
+    player->start_time = (double)player->fmt_ctx->start_time / AV_TIME_BASE;
+  }
+
+  // Find streams
+  player->video_stream_idx = -1;
+  player->audio_stream_idx = -1;
+  for (unsigned int i = 0; i < player->fmt_ctx->nb_streams; i++) {
+    enum AVMediaType type = player->fmt_ctx->streams[i]->codecpar->codec_type;
+    if (type == AVMEDIA_TYPE_VIDEO && player->video_stream_idx == -1) {
+      player->video_stream_idx = i;
+    } else if (type == AVMEDIA_TYPE_AUDIO && player->audio_stream_idx == -1) {
+      player->audio_stream_idx = i;
+    }
+  }
+
+  if (player->video_stream_idx == -1 && player->audio_stream_idx == -1) {
+    log_error("Could not find any video or audio stream\n");
+    goto end;
+  }
+
+  // Open video codec (only if video stream exists)
+  if (player->video_stream_idx != -1) {
+    AVCodecParameters *codecpar =
+        player->fmt_ctx->streams[player->video_stream_idx]->codecpar;
+    const AVCodec *codec = avcodec_find_decoder(codecpar->codec_id);
+    player->video_dec_ctx = avcodec_alloc_context3(codec);
+    avcodec_parameters_to_context(player->video_dec_ctx, codecpar);
+    player->video_dec_ctx->thread_count = hls_player_get_decode_threads(player);
+    player->video_dec_ctx->thread_type = 0;
+    if (player->decode_thread_types & HLS_PLAYER_THREAD_FRAME) {
+      player->video_dec_ctx->thread_type |= FF_THREAD_FRAME;
+    }
+    if (player->decode_thread_types & HLS_PLAYER_THREAD_SLICE) {
+      player->video_dec_ctx->thread_type |= FF_THREAD_SLICE;
+    }
+    if (avcodec_open2(player->video_dec_ctx, codec, NULL) < 0) {
+      log_error("Failed to open video decoder\n");
+      avcodec_free_context(&player->video_dec_ctx);
+    }
+  }
+
+  player->duration = (double)player->fmt_ctx->duration / AV_TIME_BASE;
+  if (player->source != NULL) {
+    player->duration = hls_source_get_duration(player->source);
+  }
+
+  // The device opened up front is only worth keeping for an audio stream.
+  hls_player_join_audio_open(player);
+  if (player->audio_stream_idx != -1) {
+    hls_player_open_audio_decoder(player);
+  } else {
+    hls_player_close_audio_device(player);
+  }
+
+  // Start the decode workers, then demux into their queues.
+  if (player->video_dec_ctx) {
+    packet_queue_start(
+        &player->video_queue,
+        player->fmt_ctx->streams[player->video_stream_idx]->time_base);
+    player->video_thread_running =
+        pthread_create(&player->video_thread, NULL, video_thread, player) == 0;
+  }
+  if (player->audio_dec_ctx) {
+    packet_queue_start(
+        &player->audio_queue,
+        player->fmt_ctx->streams[player->audio_stream_idx]->time_base);
+    player->audio_thread_running =
+        pthread_create(&player->audio_thread, NULL, audio_thread, player) == 0;
+  }
+
+  // Live streams with a timeshift buffer are demuxed on their own thread.
+  if (player->duration <= 0 && player->timeshift_bytes > 0 &&
+      hls_player_start_timeshift(player) == RET_OK) {
+    hls_player_play_timeshift(player, pkt);
+  }
+
+  while (!player->quit && player->timeshift == NULL) {
+    if (__atomic_exchange_n(&player->seek_requested, FALSE, __ATOMIC_ACQ_REL)) {
+      hls_player_do_seek(player, player->seek_target);
+    }
+
+    if (player->source != NULL &&
+        av_gettime_relative() - last_report >= HLS_PLAYER_BUFFER_REPORT_US) {
+      hls_player_report_buffer(player);
+      last_report = av_gettime_relative();
+    }
+
+    if (player->state == PLAYER_STATE_PAUSED || hls_player_queues_full(player)) {
+      sleep_ms(HLS_PLAYER_WAIT_MS);
+      continue;
+    }
+
+    ret = hls_player_read_packet(player, pkt);
+    if (ret < 0)
+      break; // End of stream or error
+    hls_player_mark_startup(player, HLS_PLAYER_STARTUP_FIRST_PACKET);
+    if (!hls_player_index_packet(player, pkt)) {
+      av_packet_unref(pkt);
+      continue;
+    }
+
+    hls_player_dispatch_packet(player, pkt);
+  }
+
+  if (player->ingest_running) {
+    pthread_join(player->ingest_thread, NULL);
+    player->ingest_running = FALSE;
+  }
+
+  // Let the workers drain what is queued; stop() aborts the queues instead.
+  packet_queue_set_eof(&player->video_queue);
+  packet_queue_set_eof(&player->audio_queue);
+
+end:
+  hls_player_join_audio_open(player);
+  if (player->video_thread_running) {
+    pthread_join(player->video_thread, NULL);
+    player->video_thread_running = FALSE;
+  }
+  if (player->audio_thread_running) {
+    pthread_join(player->audio_thread, NULL);
+    player->audio_thread_running = FALSE;
+  }
+  packet_queue_flush(&player->video_queue);
+  packet_queue_flush(&player->audio_queue);
+
+  if (player->video_dec_ctx)
+    avcodec_free_context(&player->video_dec_ctx);
+  if (player->audio_dec_ctx)
+    avcodec_free_context(&player->audio_dec_ctx);
+  if (player->timeshift != NULL) {
+    pthread_mutex_lock(&player->source_mutex);
+    timeshift_destroy(player->timeshift);
+    player->timeshift = NULL;
+    pthread_mutex_unlock(&player->source_mutex);
+  }
+  if (player->fmt_ctx)
+    avformat_close_input(&player->fmt_ctx);
+  if (player->source != NULL) {
+    pthread_mutex_lock(&player->source_mutex);
+    hls_source_destroy(player->source);
+    player->source = NULL;
+    pthread_mutex_unlock(&player->source_mutex);
+  }
+  hls_player_store_gauge(&player->live_latency, -1);
+  if (player->catchup_rate != 1.0) {
+    player->catchup_rate = 1.0;
+    av_clock_set_speed(&player->ext_clock, player->playback_rate);
+  }
+  if (player->swr_ctx)
+    swr_free(&player->swr_ctx);
+}
+
+static void *player_thread(void *arg) {
+  hls_player_t *player = (hls_player_t *)arg;
+  AVPacket *pkt = av_packet_alloc();
+
+  // A zap restarts the pipeline here and keeps the outputs below alive.
+  do {
+    hls_player_run(player, pkt);
+  } while (hls_player_take_zap(player));
+  av_packet_free(&pkt);
+
+  video_scaler_deinit(&player->scaler_ctx);
+  if (player->stretch_buf != NULL) {
+    time_stretch_deinit(&player->stretch);
+    free(player->stretch_buf);
+    player->stretch_buf = NULL;
+  }
+  player->stretching = FALSE;
+  hls_player_close_audio_device(player);
+
+  hls_player_finish(player);
   return NULL;
 }
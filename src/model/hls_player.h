@@ -5,6 +5,14 @@
 
 BEGIN_C_DECLS
 
+/* Shared resources of player_manager.h, see decode_scheduler.h and worker_pool.h */
+struct _decode_scheduler_t;
+struct _worker_pool_t;
+/* See decode_ladder.h and http_pool.h */
+struct _decode_ladder_stats_t;
+struct _http_pool_t;
+struct _http_pool_stats_t;
+
 typedef enum _player_state_t {
   PLAYER_STATE_STOPPED = 0,
   PLAYER_STATE_PLAYING,
@@ -12,6 +20,56 @@ typedef enum _player_state_t {
   PLAYER_STATE_BUFFERING
 } player_state_t;
 
+typedef enum _hls_player_stream_t {
+  HLS_PLAYER_STREAM_VIDEO = 0,
+  HLS_PLAYER_STREAM_AUDIO
+} hls_player_stream_t;
+
+/* Depth of the packet queue between the demuxer and one decode worker */
+typedef struct _hls_player_queue_stats_t {
+  uint32_t packets;
+  uint32_t bytes;
+  double duration;
+  uint32_t max_bytes;
+  double max_duration;
+  bool_t full;
+} hls_player_queue_stats_t;
+
+typedef enum _hls_player_scaler_t {
+  HLS_PLAYER_SCALER_FAST_BILINEAR = 0,
+  HLS_PLAYER_SCALER_BILINEAR,
+  HLS_PLAYER_SCALER_BICUBIC
+} hls_player_scaler_t;
+
+/* Colour conversion backend for frames shown at native size */
+typedef enum _hls_player_converter_t {
+  HLS_PLAYER_CONVERTER_AUTO = 0,
+  HLS_PLAYER_CONVERTER_SWSCALE,
+  HLS_PLAYER_CONVERTER_SCALAR,
+  HLS_PLAYER_CONVERTER_SSE2,
+  HLS_PLAYER_CONVERTER_AVX2,
+  HLS_PLAYER_CONVERTER_NEON
+} hls_player_converter_t;
+
+/*
+ * Pixel layout of the frames handed to on_frame and the frame sink, matching
+ * the AWTK bitmap formats of the same names. YUV420P passes the planes
+ * through for a renderer that converts on its own.
+ */
+typedef enum _hls_player_pixel_format_t {
+  HLS_PLAYER_PIXEL_RGBA = 0,
+  HLS_PLAYER_PIXEL_BGRA,
+  HLS_PLAYER_PIXEL_RGB565,
+  HLS_PLAYER_PIXEL_BGR565,
+  HLS_PLAYER_PIXEL_YUV420P
+} hls_player_pixel_format_t;
+
+/* Decoder threading modes, combined as flags */
+typedef enum _hls_player_thread_type_t {
+  HLS_PLAYER_THREAD_FRAME = 1,
+  HLS_PLAYER_THREAD_SLICE = 2
+} hls_player_thread_type_t;
+
 typedef struct _hls_player_t hls_player_t;
 
 hls_player_t* hls_player_create(void);
@@ -21,14 +79,459 @@ ret_t hls_player_pause(hls_player_t* player);
 ret_t hls_player_stop(hls_player_t* player);
 ret_t hls_player_destroy(hls_player_t* player);
 
+/*
+ * Stop without waiting for the player thread: network I/O in flight is
+ * interrupted, the state reads STOPPED at once and on_stopped (may be NULL)
+ * is called from the player thread when everything is released, or right
+ * away if nothing is running. A later play or stop waits for the teardown;
+ * on_stopped itself may play or preroll the player again. A pending
+ * on_stopped is replaced by the next one given, and still runs across a
+ * synchronous stop or destroy.
+ */
+typedef void (*hls_player_on_stopped_t)(void* ctx, hls_player_t* player);
+ret_t hls_player_stop_async(hls_player_t* player, hls_player_on_stopped_t on_stopped,
+                            void* ctx);
+
+/*
+ * Deadlines for the demuxer's I/O, in seconds: opening and probing the input,
+ * and each packet read. A call that runs past its deadline is aborted and
+ * playback ends as on a network error. 0 waits indefinitely.
+ */
+ret_t hls_player_set_io_timeouts(hls_player_t* player, double open_timeout,
+                                 double read_timeout);
+
+/* Milliseconds from a stop request until the player thread has finished */
+typedef struct _hls_player_stop_stats_t {
+  uint32_t stops;
+  double last_latency;
+  double max_latency;
+  /* Demuxer calls aborted by their I/O deadline */
+  uint32_t io_timeouts;
+} hls_player_stop_stats_t;
+
+ret_t hls_player_get_stop_stats(hls_player_t* player, hls_player_stop_stats_t* stats);
+
+/*
+ * Switch to another url without tearing the player down: the current input
+ * is aborted and the player thread reopens on url, keeping the audio device,
+ * scaler and output buffers. A stopped or finished player starts cold.
+ */
+ret_t hls_player_zap(hls_player_t* player, const char* url);
+
+/*
+ * Warm a stopped player up as a standby: it opens its url, fills its queues
+ * and decodes up to the first frame, then holds in BUFFERING with audio
+ * paused and nothing shown. play() then starts from that frame at once.
+ * is_prerolled is TRUE once the first frame is waiting.
+ */
+ret_t hls_player_preroll(hls_player_t* player);
+bool_t hls_player_is_prerolled(hls_player_t* player);
+
+/*
+ * Give dst the output, audio, decode and buffering settings of src, so a
+ * standby can take over its place. The url and segment cache are not copied.
+ */
+ret_t hls_player_copy_settings(hls_player_t* dst, hls_player_t* src);
+
+/* Milliseconds from a zap or standby play to its first frame; -1 before any */
+typedef struct _hls_player_zap_stats_t {
+  uint32_t zaps;
+  double last;
+  double avg;
+  double max;
+} hls_player_zap_stats_t;
+
+ret_t hls_player_get_zap_stats(hls_player_t* player, hls_player_zap_stats_t* stats);
+
 player_state_t hls_player_get_state(hls_player_t* player);
 double hls_player_get_position(hls_player_t* player);
 double hls_player_get_duration(hls_player_t* player);
 
-/* Callback for video frame update */
+/*
+ * Seek a VOD stream to seconds from its start, without reopening the input.
+ * Playback resumes from the latest keyframe known at or before the target,
+ * or from the start of its segment. Returns RET_NOT_IMPL for live streams.
+ */
+ret_t hls_player_seek(hls_player_t* player, double seconds);
+
+/* Milliseconds from a seek to its first frame on screen; -1 before any seek */
+typedef struct _hls_player_seek_stats_t {
+  uint32_t seeks;
+  double last_ttff;
+  double avg_ttff;
+  double max_ttff;
+} hls_player_seek_stats_t;
+
+ret_t hls_player_get_seek_stats(hls_player_t* player, hls_player_seek_stats_t* stats);
+
+/*
+ * Decoded audio kept ahead of the device: low for live, larger to ride out
+ * flaky links. Takes effect at once within the ring allocated on play (at
+ * least twice the latency then in force); the device buffer is sized from it
+ * on the next play.
+ */
+ret_t hls_player_set_audio_latency(hls_player_t* player, double seconds);
+double hls_player_get_audio_latency(hls_player_t* player);
+
+typedef struct _hls_player_audio_stats_t {
+  double target_latency;
+  /* Seconds of audio in the ring, and in the device buffer after it */
+  double buffered;
+  double device_latency;
+  /* Times the device ran dry mid-stream, and the silence played meanwhile */
+  uint32_t underruns;
+  double silence;
+} hls_player_audio_stats_t;
+
+ret_t hls_player_get_audio_stats(hls_player_t* player, hls_player_audio_stats_t* stats);
+
+/* Volume from 0 to 1, ramped over one audio frame; mute keeps the volume. */
+ret_t hls_player_set_volume(hls_player_t* player, double volume);
+double hls_player_get_volume(hls_player_t* player);
+ret_t hls_player_set_mute(hls_player_t* player, bool_t mute);
+bool_t hls_player_get_mute(hls_player_t* player);
+
+/*
+ * Playback rate from 0.5 to 2.0. Audio is time-stretched so pitch is kept,
+ * and video follows the audio clock.
+ */
+ret_t hls_player_set_playback_rate(hls_player_t* player, double rate);
+double hls_player_get_playback_rate(hls_player_t* player);
+
+/*
+ * Present video frames as soon as they are decoded instead of at their
+ * timestamps, for benchmarking. Audio still plays from the ring.
+ */
+ret_t hls_player_set_free_run(hls_player_t* player, bool_t enable);
+
+/*
+ * Low-latency live: follow LL-HLS parts of the segment being written and hold
+ * playback target_latency seconds behind the live edge, speeding up or
+ * slowing down by a few percent (pitch kept) while the playback rate is 1.0
+ * and no timeshift delay is set. 0 only follows parts. Applied on the next
+ * play; streams without parts still catch up at segment granularity.
+ */
+ret_t hls_player_set_low_latency(hls_player_t* player, bool_t enable, double target_latency);
+/* Seconds from the live edge to what is heard, -1 when not playing live */
+double hls_player_get_live_latency(hls_player_t* player);
+
+/*
+ * Timeshift for live streams: demuxing continues into a buffer of at most
+ * max_bytes (packet index included) while paused or playing behind live.
+ * With dir set, packets pushed out of memory spill to a file there of at
+ * most max_spill_bytes instead of being dropped. 0 bytes disables; applied
+ * on the next play.
+ */
+ret_t hls_player_set_timeshift(hls_player_t* player, uint32_t max_bytes, const char* dir,
+                               uint64_t max_spill_bytes);
+
+/* Play from delay seconds behind the live edge, clamped to what is buffered. */
+ret_t hls_player_timeshift_seek(hls_player_t* player, double delay);
+ret_t hls_player_go_live(hls_player_t* player);
+
+typedef struct _hls_player_timeshift_stats_t {
+  /* Seconds buffered, and how far behind live playback is */
+  double window;
+  double delay;
+  uint64_t memory_bytes;
+  uint64_t disk_bytes;
+  /* Times a long pause outlasted the buffer and playback skipped ahead */
+  uint32_t skips;
+} hls_player_timeshift_stats_t;
+
+ret_t hls_player_get_timeshift_stats(hls_player_t* player, hls_player_timeshift_stats_t* stats);
+
+/*
+ * Convert straight to the size the video is shown at (aspect-preserving, never
+ * above native size) instead of the stream's native resolution. 0x0 restores
+ * native-size output.
+ */
+ret_t hls_player_set_output_size(hls_player_t* player, int width, int height);
+ret_t hls_player_set_scaler(hls_player_t* player, hls_player_scaler_t scaler);
+
+/*
+ * AUTO uses the fastest SIMD yuv2rgb kernel for yuv420p/yuvj420p/nv12 frames
+ * that need no scaling and swscale for everything else. Returns RET_NOT_IMPL
+ * for a kernel this CPU lacks.
+ */
+ret_t hls_player_set_converter(hls_player_t* player, hls_player_converter_t converter);
+hls_player_converter_t hls_player_get_converter(hls_player_t* player);
+
+/*
+ * Deliver frames in the display's own format so nothing converts them again
+ * on the way to the screen. RGBA and BGRA use the yuv2rgb kernels, the others
+ * a single swscale pass. Takes effect with the next frame.
+ */
+ret_t hls_player_set_output_format(hls_player_t* player, hls_player_pixel_format_t format);
+hls_player_pixel_format_t hls_player_get_output_format(hls_player_t* player);
+
+/*
+ * Play .m3u8 URLs through the built-in playlist engine, which downloads the
+ * next prefetch_segments segments in parallel (0 for the default), instead
+ * of FFmpeg's hls demuxer. Enabled by default; applied on the next play.
+ */
+ret_t hls_player_set_native_hls(hls_player_t* player, bool_t enable, uint32_t prefetch_segments);
+
+/*
+ * Fast start: cap stream probing, start on the lowest-bandwidth variant and
+ * let ABR step up, open the audio device while the input is probed, and show
+ * the first decoded frame before A/V sync settles. Applied on the next play.
+ */
+ret_t hls_player_set_fast_start(hls_player_t* player, bool_t enable);
+bool_t hls_player_get_fast_start(hls_player_t* player);
+
+typedef enum _hls_player_startup_phase_t {
+  HLS_PLAYER_STARTUP_OPEN = 0,
+  HLS_PLAYER_STARTUP_PROBE,
+  HLS_PLAYER_STARTUP_FIRST_PACKET,
+  HLS_PLAYER_STARTUP_FIRST_FRAME,
+  HLS_PLAYER_STARTUP_FIRST_AUDIO,
+  HLS_PLAYER_STARTUP_PHASES
+} hls_player_startup_phase_t;
+
+/* Milliseconds from hls_player_play to each startup phase, -1 until reached */
+typedef struct _hls_player_startup_times_t {
+  double open;
+  double probe;
+  double first_packet;
+  double first_frame;
+  double first_audio;
+} hls_player_startup_times_t;
+
+ret_t hls_player_get_startup_times(hls_player_t* player, hls_player_startup_times_t* times);
+
+/* Segment cache counters, cumulative over the cache's lifetime */
+typedef struct _hls_player_cache_stats_t {
+  uint32_t hits;
+  uint32_t misses;
+  /* Bytes read from disk instead of downloaded */
+  uint64_t bytes_saved;
+  uint32_t entries;
+  uint64_t bytes_used;
+  uint64_t max_bytes;
+  uint32_t evictions;
+} hls_player_cache_stats_t;
+
+/*
+ * Keep VOD segments fetched by the native playlist engine in dir, up to
+ * max_bytes with least recently used ones evicted, and play them from there
+ * on later plays. NULL dir disables the cache. Returns RET_BUSY while playing.
+ */
+ret_t hls_player_set_segment_cache(hls_player_t* player, const char* dir, uint64_t max_bytes);
+ret_t hls_player_get_cache_stats(hls_player_t* player, hls_player_cache_stats_t* stats);
+
+/*
+ * The native playlist engine sends http:// requests on keep-alive
+ * connections with cached DNS, from a pool of the player's own kept across
+ * plays and zaps. pool (not owned, must outlive playback) is shared instead,
+ * as among the players of a mosaic; NULL restores the player's own. With
+ * keep-alive off each request opens its own FFmpeg HTTP connection. Both
+ * apply on the next play. The stats are those of the pool in use.
+ */
+ret_t hls_player_set_http_pool(hls_player_t* player, struct _http_pool_t* pool);
+ret_t hls_player_set_keep_alive(hls_player_t* player, bool_t enable);
+ret_t hls_player_get_http_stats(hls_player_t* player,
+                                struct _http_pool_stats_t* stats);
+
+/* Adaptive bitrate state of the native playlist engine */
+typedef struct _hls_player_abr_stats_t {
+  /* Variant playing and the number on offer; -1 and 0 without a master playlist */
+  int variant;
+  uint32_t nr_variants;
+  /* Declared bandwidth (bits/s) and resolution of the variant playing */
+  uint32_t variant_bandwidth;
+  int width;
+  int height;
+  /* Measured download throughput, bits per second */
+  double bandwidth;
+  /* Seconds of media buffered ahead of the playhead */
+  double buffer_level;
+  uint32_t switches;
+} hls_player_abr_stats_t;
+
+/*
+ * Pin the variant of the master playlist to play, switching at the next
+ * segment boundary, or -1 (the default) to adapt to throughput and buffer
+ * level. Only applies with the native playlist engine.
+ */
+ret_t hls_player_select_variant(hls_player_t* player, int index);
+int hls_player_get_selected_variant(hls_player_t* player);
+ret_t hls_player_get_abr_stats(hls_player_t* player, hls_player_abr_stats_t* stats);
+
+/*
+ * Threads for video decoding (frame and/or slice threading) and for the
+ * slice-parallel colour conversion. A count of 0 derives a default from the
+ * core count. Applied on the next play.
+ */
+ret_t hls_player_set_decode_threads(hls_player_t* player, uint32_t count, uint32_t types);
+ret_t hls_player_set_convert_threads(hls_player_t* player, uint32_t count);
+uint32_t hls_player_get_decode_threads(hls_player_t* player);
+uint32_t hls_player_get_convert_threads(hls_player_t* player);
+
+/*
+ * Share the machine with other players (see player_manager.h): every video
+ * decode call takes a slot of scheduler at the player's priority, and colour
+ * conversion runs on pool instead of threads of the player's own. Neither
+ * is owned and both must outlive playback; NULL restores the defaults.
+ * Applied on the next play. Decoder threads outside the scheduler's control
+ * are not limited, so pair this with hls_player_set_decode_threads(1).
+ */
+ret_t hls_player_set_decode_scheduler(hls_player_t* player,
+                                      struct _decode_scheduler_t* scheduler);
+ret_t hls_player_set_convert_pool(hls_player_t* player, struct _worker_pool_t* pool);
+
+/* Claim on the scheduler's slots, lowest first */
+typedef enum _hls_player_priority_t {
+  HLS_PLAYER_PRIORITY_BACKGROUND = 0,
+  HLS_PLAYER_PRIORITY_NORMAL,
+  HLS_PLAYER_PRIORITY_FOCUSED
+} hls_player_priority_t;
+
+/* Takes effect from the next decode call. */
+ret_t hls_player_set_priority(hls_player_t* player, hls_player_priority_t priority);
+hls_player_priority_t hls_player_get_priority(hls_player_t* player);
+
+/*
+ * Decode keyframes only, dropping the other video packets before the decoder
+ * and resuming at the next keyframe once cleared. A background player of a
+ * saturated scheduler does this on its own.
+ */
+ret_t hls_player_set_keyframes_only(hls_player_t* player, bool_t enable);
+bool_t hls_player_is_keyframes_only(hls_player_t* player);
+
+/*
+ * When video frames keep coming out of the decoder after their display time,
+ * decode less: skip the deblocking loop filter, then non-reference frames,
+ * then everything but keyframes. Full decoding comes back a level at a time
+ * once frames come out with time to spare. On by default; free run has no
+ * clock to be late against and never degrades. Each run starts at full.
+ */
+ret_t hls_player_set_auto_degrade(hls_player_t* player, bool_t enable);
+/* Current level, level changes and seconds at each level over the player's life */
+ret_t hls_player_get_decode_stats(hls_player_t* player,
+                                  struct _decode_ladder_stats_t* stats);
+
+/*
+ * Only consider master playlist variants that fit in width x height (the
+ * smallest one if none does), so a small tile is not fed a stream decoded
+ * at full HD. 0x0 lifts the limit. Only applies with the native playlist
+ * engine; applied on the next play.
+ */
+ret_t hls_player_set_max_resolution(hls_player_t* player, int width, int height);
+
+/* Packet queue limits and depth, per stream; 0 disables a limit */
+ret_t hls_player_set_queue_limits(hls_player_t* player, hls_player_stream_t stream,
+                                  uint32_t max_bytes, double max_duration);
+ret_t hls_player_get_queue_stats(hls_player_t* player, hls_player_stream_t stream,
+                                 hls_player_queue_stats_t* stats);
+
+/*
+ * Pipeline stages timed per operation: a network read of a download (native
+ * playlist engine only), an av_read_frame, a video frame out of the decoder,
+ * its colour conversion, its wait for the UI thread and its paint. The UI
+ * reports the last two through hls_player_record_stage.
+ */
+typedef enum _hls_player_stage_t {
+  HLS_PLAYER_STAGE_NETWORK = 0,
+  HLS_PLAYER_STAGE_DEMUX,
+  HLS_PLAYER_STAGE_DECODE,
+  HLS_PLAYER_STAGE_CONVERT,
+  HLS_PLAYER_STAGE_HANDOFF,
+  HLS_PLAYER_STAGE_PAINT,
+  HLS_PLAYER_STAGES
+} hls_player_stage_t;
+
+/* Latency of one stage since play, in milliseconds */
+typedef struct _hls_player_stage_stats_t {
+  uint64_t count;
+  double avg;
+  double p50;
+  double p95;
+  double p99;
+  double max;
+} hls_player_stage_stats_t;
+
+typedef struct _hls_player_metrics_t {
+  hls_player_stage_stats_t stages[HLS_PLAYER_STAGES];
+  uint64_t frames_decoded;
+  uint64_t frames_displayed;
+  uint64_t frames_dropped;
+  uint32_t audio_underruns;
+  /* Seconds buffered: downloaded ahead, in each packet queue, decoded audio */
+  double network_buffer;
+  double video_queue;
+  double audio_queue;
+  double audio_buffer;
+  /* Bits per second: demuxed over the last second, and download throughput */
+  double bitrate;
+  double throughput;
+  /* Seconds behind the live edge, -1 for VOD */
+  double live_latency;
+  /* Milliseconds to the first frame of the last zap, -1 before any */
+  double zap_ms;
+  /*
+   * Share of playlist engine requests sent on a kept-alive connection, and
+   * milliseconds to establish a new one; -1 before any
+   */
+  double connection_reuse;
+  double handshake_ms;
+  /*
+   * Decoding level now (a decode_level_t), and level changes since the
+   * player was created
+   */
+  uint32_t decode_level;
+  uint32_t decode_changes;
+} hls_player_metrics_t;
+
+/*
+ * Lock-free to record, read and reset from any thread; reading also takes
+ * the queue and source locks briefly. Metrics restart on each play from
+ * stopped.
+ */
+ret_t hls_player_record_stage(hls_player_t* player, hls_player_stage_t stage, int64_t us);
+ret_t hls_player_get_metrics(hls_player_t* player, hls_player_metrics_t* metrics);
+ret_t hls_player_reset_metrics(hls_player_t* player);
+
+/* Append the metrics to json as one object. */
+ret_t hls_player_dump_metrics(hls_player_t* player, str_t* json);
+
+/*
+ * Callback for video frame update. format is a hls_player_pixel_format_t; a
+ * YUV420P frame is one buffer holding the Y, U and V planes back to back.
+ */
 typedef void (*hls_player_on_frame_t)(void* ctx, const void* data, int width, int height, int format);
 void hls_player_set_on_frame(hls_player_t* player, hls_player_on_frame_t on_frame, void* ctx);
 
+/*
+ * Zero-copy output: the consumer lends a locked buffer the scaler writes into
+ * directly, honouring line_length. acquire may return RET_BUSY to drop the
+ * frame (e.g. while it reallocates for a new size). A frame sink takes
+ * precedence over on_frame.
+ *
+ * width x height is the picture alone, at its display aspect ratio and fitted
+ * to the output size; centring it in the output area is up to the consumer.
+ *
+ * format is a hls_player_pixel_format_t. For YUV420P, data and line_length
+ * describe the Y plane and the sink also fills in the U and V planes.
+ */
+typedef struct _hls_player_frame_t {
+  uint8_t* data;
+  uint32_t line_length;
+  int width;
+  int height;
+  int format;
+  void* handle;
+  uint8_t* chroma[2];
+  uint32_t chroma_line_length[2];
+} hls_player_frame_t;
+
+typedef ret_t (*hls_player_acquire_frame_t)(void* ctx, int width, int height, int format,
+                                            hls_player_frame_t* frame);
+typedef ret_t (*hls_player_release_frame_t)(void* ctx, hls_player_frame_t* frame,
+                                            bool_t publish);
+void hls_player_set_frame_sink(hls_player_t* player, hls_player_acquire_frame_t acquire,
+                               hls_player_release_frame_t release, void* ctx);
+
 END_C_DECLS
 
 #endif /* HLS_PLAYER_H */
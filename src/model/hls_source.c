@@ -0,0 +1,1517 @@
+#include "hls_source.h"
+#include "abr.h"
+#include "cond_clock.h"
+#include "http_pool.h"
+#include "tkc/log.h"
+#include "tkc/platform.h"
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define HLS_SOURCE_AVIO_BUFFER_SIZE (64 * 1024)
+#define HLS_SOURCE_FETCH_CHUNK (256 * 1024)
+#define HLS_SOURCE_RETRIES 3
+#define HLS_SOURCE_RETRY_MS 200
+#define HLS_SOURCE_WAIT_MS 100
+/* Live playback starts this many segments from the end (RFC 8216 6.3.3) */
+#define HLS_SOURCE_LIVE_EDGE_SEGMENTS 3
+/* Failed part downloads retried before the segment ends early */
+#define HLS_SOURCE_PART_RETRIES 3
+/* Smallest download worth a throughput sample */
+#define HLS_SOURCE_ABR_MIN_BYTES (16 * 1024)
+/*
+ * A request is abandoned once it goes this long without receiving a byte,
+ * so a dead server fails the download instead of waiting out TCP timeouts
+ */
+#define HLS_SOURCE_IO_TIMEOUT_US (10 * 1000000)
+
+typedef enum _hls_slot_state_t {
+  HLS_SLOT_EMPTY = 0,
+  HLS_SLOT_LOADING,
+  HLS_SLOT_READY,
+  HLS_SLOT_FAILED
+} hls_slot_state_t;
+
+typedef struct _hls_slot_t {
+  int64_t seq;
+  hls_slot_state_t state;
+  /* Bumped by every claim and seek, so a stale download cannot land here */
+  uint32_t claim;
+  double duration;
+  uint8_t *data;
+  size_t size;
+  /* Set when data is a mapped cache hit rather than an av_malloc buffer */
+  segment_cache_entry_t *cached;
+  /*
+   * LL-HLS: index of the next part to append while the segment loads part
+   * by part, readable as it grows; -1 when it loads whole. start is the
+   * media time of the parts skipped before the first one loaded.
+   */
+  int next_part;
+  double start;
+} hls_slot_t;
+
+struct _hls_source_t {
+  char *url;
+  /* URL of the media playlist in use; fixed once opened */
+  char *media_url;
+  AVIOInterruptCB int_cb;
+  bool_t abort;
+  /* Optional, not owned; VOD segments are served from and saved to it */
+  segment_cache_t *cache;
+  /* Open on the lowest-bandwidth variant instead of the highest */
+  bool_t start_low;
+  /* Variants larger than this are dropped, 0 for no limit */
+  int max_width;
+  int max_height;
+  /* Optional, not owned; times every network read of a download */
+  latency_histogram_t *read_latency;
+  /* Optional, not owned; http:// requests keep their connections in it */
+  http_pool_t *http_pool;
+  /* LL-HLS: follow the segment being written part by part */
+  bool_t low_latency;
+  /* Seconds behind the live edge to start at, 0 for three segments */
+  double target_latency;
+  /* Live start inside segment read_seq, at this part; 0 loads it whole */
+  int64_t start_seq;
+  uint32_t start_part;
+
+  /* Master playlist, empty for a plain media playlist; fixed once opened */
+  m3u8_playlist_t master;
+  m3u8_playlist_t media;
+  /* Index into master.variants of media, -1 without a master playlist */
+  int variant;
+  /* Bumped on every switch, so a reload of the old variant is discarded */
+  uint32_t generation;
+  /* Variant forced by the application, -1 to adapt */
+  int selected;
+  /* Switch requested, -1 for none */
+  int switch_to;
+  bool_t switching;
+  /* Init section of the new variant, prepended to segment switch_map_seq */
+  uint8_t *switch_map;
+  size_t switch_map_size;
+  int64_t switch_map_seq;
+
+  /*
+   * Throughput is measured over the time at least one segment download is
+   * in flight, so parallel downloads add up instead of splitting the link.
+   */
+  abr_t abr;
+  uint32_t active_fetches;
+  int64_t busy_start;
+  int64_t busy_us;
+  int64_t sample_busy_us;
+  uint64_t sample_bytes;
+  double downstream_buffer;
+
+  /* av_gettime_relative() of the next live reload, 0 for VOD */
+  int64_t next_reload;
+  bool_t reloading;
+  /* av_gettime_relative() the media playlist was last loaded */
+  int64_t loaded_at;
+  /* The last blocking reload came back without the part asked for */
+  bool_t block_missed;
+
+  /*
+   * The read window is [read_seq, read_seq + prefetch); segment seq lives in
+   * slots[seq % prefetch] while it is in the window.
+   */
+  hls_slot_t slots[HLS_SOURCE_MAX_PREFETCH];
+  uint32_t prefetch;
+  pthread_t threads[HLS_SOURCE_MAX_PREFETCH];
+  uint32_t nr_threads;
+
+  int64_t read_seq;
+  size_t read_offset;
+  /* EXT-X-MAP section, emitted ahead of the first segment */
+  uint8_t *map;
+  size_t map_size;
+  size_t map_offset;
+
+  AVIOContext *avio;
+  hls_source_stats_t stats;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+};
+
+static bool_t hls_source_aborted(hls_source_t *source) {
+  if (source->abort) {
+    return TRUE;
+  }
+  return source->int_cb.callback != NULL &&
+         source->int_cb.callback(source->int_cb.opaque) != 0;
+}
+
+/*
+ * One request, through the connection pool or FFmpeg's protocols, and the
+ * interrupt context whose deadline moves on with each read
+ */
+typedef struct _hls_fetch_t {
+  hls_source_t *source;
+  AVIOContext *io;
+  http_request_t *request;
+  int64_t timeout_us;
+  int64_t deadline;
+  int64_t bytes_read;
+  bool_t timed_out;
+} hls_fetch_t;
+
+static int hls_fetch_interrupt(void *ctx) {
+  hls_fetch_t *fetch = (hls_fetch_t *)ctx;
+  int64_t now = av_gettime_relative();
+
+  if (hls_source_aborted(fetch->source)) {
+    return 1;
+  }
+  int64_t bytes_read = fetch->request != NULL
+                           ? http_request_get_bytes_read(fetch->request)
+                           : (fetch->io != NULL ? fetch->io->bytes_read : 0);
+  if (bytes_read != fetch->bytes_read) {
+    fetch->bytes_read = bytes_read;
+    fetch->deadline = now + fetch->timeout_us;
+  }
+  fetch->timed_out = now >= fetch->deadline;
+
+  return fetch->timed_out;
+}
+
+static void hls_fetch_timed_out(hls_fetch_t *fetch, const char *url) {
+  log_warn("hls: %s timed out\n", url);
+  pthread_mutex_lock(&fetch->source->mutex);
+  fetch->source->stats.timeouts++;
+  pthread_mutex_unlock(&fetch->source->mutex);
+}
+
+static void hls_source_wait_locked(hls_source_t *source, uint32_t timeout_ms) {
+  struct timespec deadline;
+
+  cond_clock_deadline(&deadline, timeout_ms);
+  pthread_cond_timedwait(&source->cond, &source->mutex, &deadline);
+}
+
+/*
+ * Open url at offset: through the connection pool for http:// when the
+ * source has one, FFmpeg's protocols otherwise.
+ */
+static ret_t hls_fetch_open(hls_fetch_t *fetch, const char *url, int64_t offset,
+                            int64_t length, const AVIOInterruptCB *int_cb) {
+  hls_source_t *source = fetch->source;
+
+  if (source->http_pool != NULL && http_pool_supports(url)) {
+    ret_t ret = http_pool_open(source->http_pool, url, offset, length, int_cb,
+                               &fetch->request);
+    // Redirected off http://: FFmpeg takes the request over from the start.
+    if (ret != RET_NOT_IMPL) {
+      return ret;
+    }
+  }
+
+  if (avio_open2(&fetch->io, url, AVIO_FLAG_READ, int_cb, NULL) < 0) {
+    if (!fetch->timed_out) {
+      log_error("hls: could not open %s\n", url);
+    }
+    return RET_FAIL;
+  }
+  fetch->bytes_read = fetch->io->bytes_read;
+  if (offset > 0 && avio_seek(fetch->io, offset, SEEK_SET) < 0) {
+    log_error("hls: could not seek to %lld in %s\n", (long long)offset, url);
+    avio_closep(&fetch->io);
+    return RET_FAIL;
+  }
+
+  return RET_OK;
+}
+
+static int64_t hls_fetch_size(hls_fetch_t *fetch) {
+  return fetch->request != NULL ? http_request_get_size(fetch->request)
+                                : avio_size(fetch->io);
+}
+
+static int hls_fetch_read(hls_fetch_t *fetch, uint8_t *buf, int size) {
+  return fetch->request != NULL ? http_request_read(fetch->request, buf, size)
+                                : avio_read(fetch->io, buf, size);
+}
+
+/* A pooled connection read to the end goes back to the pool. */
+static void hls_fetch_close(hls_fetch_t *fetch) {
+  if (fetch->request != NULL) {
+    http_request_close(fetch->request);
+    fetch->request = NULL;
+  }
+  if (fetch->io != NULL) {
+    avio_closep(&fetch->io);
+  }
+}
+
+/*
+ * Download url, or length bytes of it from offset when length >= 0, into a
+ * NUL-terminated buffer allocated with av_malloc. The request fails once it
+ * waits timeout_us for the server without a byte arriving.
+ */
+static ret_t hls_source_fetch_within(hls_source_t *source, const char *url,
+                                     int64_t offset, int64_t length,
+                                     int64_t timeout_us, uint8_t **data,
+                                     size_t *size) {
+  hls_fetch_t fetch = {source, NULL, NULL, timeout_us,
+                       av_gettime_relative() + timeout_us, 0, FALSE};
+  AVIOInterruptCB int_cb = {hls_fetch_interrupt, &fetch};
+  uint8_t *buf = NULL;
+  size_t capacity = 0;
+  size_t used = 0;
+
+  ret_t ret = hls_fetch_open(&fetch, url, offset, length, &int_cb);
+  if (ret != RET_OK) {
+    if (fetch.timed_out) {
+      hls_fetch_timed_out(&fetch, url);
+    }
+    return ret == RET_OOM ? RET_OOM : RET_FAIL;
+  }
+
+  if (length >= 0) {
+    capacity = (size_t)length;
+  } else {
+    int64_t total = hls_fetch_size(&fetch);
+    capacity = total > 0 ? (size_t)total : HLS_SOURCE_FETCH_CHUNK;
+  }
+
+  buf = (uint8_t *)av_malloc(capacity + 1);
+  if (buf == NULL) {
+    hls_fetch_close(&fetch);
+    return RET_OOM;
+  }
+
+  for (;;) {
+    if (used == capacity) {
+      if (length >= 0) {
+        break;
+      }
+      uint8_t *grown = (uint8_t *)av_realloc(buf, capacity * 2 + 1);
+      if (grown == NULL) {
+        av_free(buf);
+        hls_fetch_close(&fetch);
+        return RET_OOM;
+      }
+      buf = grown;
+      capacity *= 2;
+    }
+
+    int64_t start = av_gettime_relative();
+    int n = hls_fetch_read(&fetch, buf + used,
+                           (int)tk_min(capacity - used, (size_t)INT32_MAX));
+    if (source->read_latency != NULL) {
+      latency_histogram_record(source->read_latency, av_gettime_relative() - start);
+    }
+    if (n == AVERROR_EOF || n == 0) {
+      break;
+    }
+    if (n < 0 || hls_source_aborted(source)) {
+      av_free(buf);
+      hls_fetch_close(&fetch);
+      if (hls_source_aborted(source)) {
+        return RET_QUIT;
+      }
+      if (fetch.timed_out) {
+        hls_fetch_timed_out(&fetch, url);
+      }
+      return RET_FAIL;
+    }
+    used += n;
+  }
+  // A ranged read that got its length has also reached the end of the body,
+  // so a pooled connection is free for the next request.
+  if (fetch.request != NULL && length >= 0 && used == capacity) {
+    uint8_t end;
+    hls_fetch_read(&fetch, &end, 1);
+  }
+  hls_fetch_close(&fetch);
+
+  if (length >= 0 && used < (size_t)length) {
+    log_warn("hls: short read of %s, %zu of %lld bytes\n", url, used,
+             (long long)length);
+  }
+  buf[used] = '\0';
+  *data = buf;
+  *size = used;
+
+  return RET_OK;
+}
+
+static ret_t hls_source_fetch(hls_source_t *source, const char *url,
+                              int64_t offset, int64_t length, uint8_t **data,
+                              size_t *size) {
+  return hls_source_fetch_within(source, url, offset, length,
+                                 HLS_SOURCE_IO_TIMEOUT_US, data, size);
+}
+
+/* Blocking reloads wait up to timeout_us for the server to answer */
+static ret_t hls_source_load_playlist(hls_source_t *source, const char *url,
+                                      int64_t timeout_us, m3u8_playlist_t *pl) {
+  uint8_t *text = NULL;
+  size_t size = 0;
+
+  m3u8_playlist_init(pl);
+  ret_t ret = hls_source_fetch_within(source, url, 0, -1, timeout_us, &text, &size);
+  if (ret != RET_OK) {
+    return ret;
+  }
+
+  ret = m3u8_playlist_parse(pl, (const char *)text, url);
+  av_free(text);
+  if (ret != RET_OK) {
+    m3u8_playlist_deinit(pl);
+  }
+
+  return ret;
+}
+
+static void hls_slot_free_data(uint8_t *data, segment_cache_entry_t *cached) {
+  if (cached != NULL) {
+    segment_cache_release(cached);
+  } else {
+    av_free(data);
+  }
+}
+
+static void hls_source_release_slot_locked(hls_slot_t *slot) {
+  hls_slot_free_data(slot->data, slot->cached);
+  slot->data = NULL;
+  slot->cached = NULL;
+  slot->size = 0;
+  slot->state = HLS_SLOT_EMPTY;
+}
+
+/* Free downloaded segments that fell out of the read window. */
+static void hls_source_drop_stale_locked(hls_source_t *source) {
+  for (uint32_t i = 0; i < source->prefetch; i++) {
+    hls_slot_t *slot = source->slots + i;
+    if (slot->seq < source->read_seq &&
+        (slot->state == HLS_SLOT_READY || slot->state == HLS_SLOT_FAILED)) {
+      hls_source_release_slot_locked(slot);
+    }
+  }
+}
+
+/*
+ * Media playlist URL, asking a server that can block reloads to answer only
+ * once part block_part of segment block_seq is listed (RFC 8216bis 6.2.5.2).
+ */
+static char *hls_source_reload_url_locked(hls_source_t *source, int64_t block_seq,
+                                          int block_part) {
+  if (block_seq < 0 || !source->media.can_block_reload) {
+    return strdup(source->media_url);
+  }
+
+  return m3u8_blocking_reload_url(source->media_url, block_seq, block_part);
+}
+
+/*
+ * Seconds to the next live reload: a target duration if the playlist moved,
+ * half of one if it did not (RFC 8216 6.3.4). Following parts, a part target
+ * instead, unless blocking reloads already track every part.
+ */
+static double hls_source_reload_interval_locked(hls_source_t *source,
+                                                bool_t changed) {
+  const m3u8_playlist_t *media = &source->media;
+  double interval = media->target_duration > 0 ? media->target_duration : 1.0;
+
+  if (source->low_latency && media->part_target > 0 && !media->can_block_reload) {
+    interval = media->part_target;
+  }
+  return changed ? interval : interval / 2;
+}
+
+static void hls_source_reload(hls_source_t *source, int64_t block_seq,
+                              int block_part) {
+  m3u8_playlist_t pl;
+  bool_t changed = FALSE;
+
+  pthread_mutex_lock(&source->mutex);
+  char *url = hls_source_reload_url_locked(source, block_seq, block_part);
+  uint32_t generation = source->generation;
+  // The server may hold a blocking reload for three target durations.
+  int64_t timeout = HLS_SOURCE_IO_TIMEOUT_US;
+  if (block_seq >= 0 && source->media.can_block_reload) {
+    timeout += (int64_t)(3 * source->media.target_duration * 1000000);
+  }
+  pthread_mutex_unlock(&source->mutex);
+
+  ret_t ret =
+      url != NULL ? hls_source_load_playlist(source, url, timeout, &pl) : RET_OOM;
+  free(url);
+
+  pthread_mutex_lock(&source->mutex);
+  source->stats.playlist_reloads++;
+  if (ret == RET_OK && !pl.is_master && generation == source->generation) {
+    m3u8_playlist_t *media = &source->media;
+    changed = pl.media_sequence + pl.nr_segments !=
+                  media->media_sequence + media->nr_segments ||
+              pl.nr_parts != media->nr_parts || pl.endlist != media->endlist;
+
+    m3u8_playlist_deinit(media);
+    *media = pl;
+    source->loaded_at = av_gettime_relative();
+    if (block_seq >= 0) {
+      uint32_t nr_parts = 0;
+      bool_t complete = FALSE;
+      m3u8_playlist_get_parts(media, block_seq, &nr_parts, &complete);
+      source->block_missed = !complete && nr_parts <= (uint32_t)block_part &&
+                             block_seq >= media->media_sequence;
+    }
+    if (source->read_seq < media->media_sequence) {
+      log_warn("hls: fell behind the live window, skipping %lld segments\n",
+               (long long)(media->media_sequence - source->read_seq));
+      source->read_seq = media->media_sequence;
+      source->read_offset = 0;
+      hls_source_drop_stale_locked(source);
+    }
+  } else if (ret == RET_OK) {
+    m3u8_playlist_deinit(&pl);
+  }
+
+  if (source->media.endlist) {
+    source->next_reload = 0;
+  } else {
+    double interval = hls_source_reload_interval_locked(source, changed);
+    source->next_reload = av_gettime_relative() + (int64_t)(interval * 1000000);
+  }
+  source->reloading = FALSE;
+  pthread_cond_broadcast(&source->cond);
+  pthread_mutex_unlock(&source->mutex);
+}
+
+/* The first segment of the read window no download has claimed yet */
+static int64_t hls_source_next_unclaimed_locked(hls_source_t *source) {
+  int64_t seq = source->read_seq;
+  while (seq < source->read_seq + source->prefetch &&
+         source->slots[seq % source->prefetch].state != HLS_SLOT_EMPTY) {
+    seq++;
+  }
+  return seq;
+}
+
+static double hls_source_buffered_locked(hls_source_t *source) {
+  double buffered = source->downstream_buffer;
+
+  for (uint32_t i = 0; i < source->prefetch; i++) {
+    hls_slot_t *slot = source->slots + i;
+    bool_t readable = slot->state == HLS_SLOT_READY ||
+                      (slot->state == HLS_SLOT_LOADING && slot->next_part >= 0);
+    if (!readable || slot->seq < source->read_seq) {
+      continue;
+    }
+    if (slot->seq == source->read_seq && slot->size > 0) {
+      buffered += slot->duration * (1 - (double)source->read_offset / slot->size);
+    } else {
+      buffered += slot->duration;
+    }
+  }
+
+  return buffered;
+}
+
+static void hls_source_adapt_locked(hls_source_t *source);
+
+static void hls_source_sample_locked(hls_source_t *source, size_t bytes,
+                                     int64_t now) {
+  int64_t busy = source->busy_us;
+  if (source->active_fetches > 0) {
+    busy += now - source->busy_start;
+  }
+
+  source->sample_bytes += bytes;
+  if (source->sample_bytes >= HLS_SOURCE_ABR_MIN_BYTES &&
+      busy > source->sample_busy_us) {
+    abr_add_sample(&source->abr, source->sample_bytes,
+                   (busy - source->sample_busy_us) / 1000000.0);
+    source->sample_bytes = 0;
+    source->sample_busy_us = busy;
+    hls_source_adapt_locked(source);
+  }
+}
+
+static void hls_source_adapt_locked(hls_source_t *source) {
+  if (source->variant < 0 || source->selected >= 0 || source->switching ||
+      source->switch_to >= 0) {
+    return;
+  }
+
+  uint32_t target =
+      abr_choose(&source->abr, source->master.variants, source->master.nr_variants,
+                 (uint32_t)source->variant, hls_source_buffered_locked(source));
+  if ((int)target != source->variant) {
+    source->switch_to = (int)target;
+    pthread_cond_broadcast(&source->cond);
+  }
+}
+
+/*
+ * Load the playlist of variant index and make it current. Segments already
+ * claimed finish from the old variant; the new one takes over at the first
+ * segment nobody has started downloading, so the demuxer sees the change at
+ * a segment boundary.
+ */
+static void hls_source_switch(hls_source_t *source, uint32_t index) {
+  const m3u8_variant_t *variant = source->master.variants + index;
+  m3u8_playlist_t pl;
+  uint8_t *map = NULL;
+  size_t map_size = 0;
+  char *url = strdup(variant->uri);
+
+  // Deinited on every failure, whether or not it got loaded.
+  m3u8_playlist_init(&pl);
+  ret_t ret = RET_OOM;
+  if (url != NULL) {
+    ret = hls_source_load_playlist(source, url, HLS_SOURCE_IO_TIMEOUT_US, &pl);
+  }
+  if (ret == RET_OK && (pl.is_master || pl.encrypted || pl.nr_segments == 0)) {
+    log_warn("hls: variant %u is not playable\n", index);
+    ret = RET_FAIL;
+  }
+  if (ret == RET_OK && pl.map_uri != NULL) {
+    ret = hls_source_fetch(source, pl.map_uri, pl.map_offset, pl.map_length,
+                           &map, &map_size);
+  }
+
+  pthread_mutex_lock(&source->mutex);
+  source->switching = FALSE;
+  int64_t seq = hls_source_next_unclaimed_locked(source);
+  if (ret == RET_OK &&
+      (seq < pl.media_sequence || seq > pl.media_sequence + pl.nr_segments)) {
+    log_warn("hls: variant %u has no segment %lld, not switching\n", index,
+             (long long)seq);
+    ret = RET_FAIL;
+  }
+
+  if (ret == RET_OK) {
+    log_debug("hls: variant %u -> %u (%u bps, %dx%d) at segment %lld\n",
+              source->variant, index, variant->bandwidth, variant->width,
+              variant->height, (long long)seq);
+    m3u8_playlist_deinit(&source->media);
+    source->media = pl;
+    free(source->media_url);
+    source->media_url = url;
+    url = NULL;
+    source->variant = (int)index;
+    source->generation++;
+    source->stats.switches++;
+    abr_on_switch(&source->abr);
+
+    av_free(source->switch_map);
+    source->switch_map = map;
+    source->switch_map_size = map_size;
+    source->switch_map_seq = seq;
+    map = NULL;
+  } else {
+    m3u8_playlist_deinit(&pl);
+  }
+  pthread_cond_broadcast(&source->cond);
+  pthread_mutex_unlock(&source->mutex);
+
+  av_free(map);
+  free(url);
+}
+
+/*
+ * LL-HLS: the segment being written, or the live start inside a segment, is
+ * loaded part by part. Anything else loads whole.
+ */
+static bool_t hls_source_wants_parts_locked(hls_source_t *source, int64_t seq,
+                                            const m3u8_segment_t *seg) {
+  const m3u8_playlist_t *media = &source->media;
+
+  if (!source->low_latency || media->part_target <= 0) {
+    return FALSE;
+  }
+  if (seg == NULL) {
+    return seq == media->media_sequence + media->nr_segments &&
+           (media->nr_parts > 0 || media->preload_hint.uri != NULL);
+  }
+  return seq == source->start_seq && source->start_part > 0 &&
+         source->start_part < seg->nr_parts;
+}
+
+/*
+ * Load segment slot->seq part by part from slot->next_part, appending each
+ * part as it arrives so the reader follows the segment while it is still
+ * being written. A part not listed yet is fetched through the preload hint,
+ * which the server answers once the part exists, or waited for with a
+ * blocking playlist reload. Called and returns with the mutex held.
+ */
+static ret_t hls_source_load_parts_locked(hls_source_t *source, hls_slot_t *slot,
+                                          uint32_t claim) {
+  uint32_t generation = source->generation;
+  uint32_t failures = 0;
+
+  while (!hls_source_aborted(source)) {
+    m3u8_playlist_t *media = &source->media;
+    int64_t seq = slot->seq;
+    uint32_t index = (uint32_t)slot->next_part;
+    uint32_t nr_parts = 0;
+    bool_t complete = FALSE;
+
+    if (slot->claim != claim || seq < source->read_seq) {
+      return RET_SKIP;
+    }
+    // A switch replaced the playlist: its parts belong to another variant.
+    if (generation != source->generation || seq < media->media_sequence) {
+      return RET_FAIL;
+    }
+
+    const m3u8_part_t *parts = m3u8_playlist_get_parts(media, seq, &nr_parts, &complete);
+    const m3u8_part_t *part = NULL;
+    if (index < nr_parts) {
+      part = parts + index;
+    } else if (complete) {
+      return RET_OK;
+    } else if (media->preload_hint.uri != NULL &&
+               seq == media->media_sequence + media->nr_segments &&
+               index == media->nr_parts) {
+      part = &media->preload_hint;
+    }
+
+    if (part == NULL) {
+      int64_t now = av_gettime_relative();
+      // A server that answered a blocking reload early is polled instead.
+      bool_t block = media->can_block_reload && !source->block_missed;
+      if (!source->reloading && (block || now >= source->next_reload)) {
+        // Block for our part, or for the one before it if the playlist is
+        // behind what we fetched: that answers at once, hinting at ours.
+        int block_part = index > nr_parts ? (int)index - 1 : (int)index;
+        source->reloading = TRUE;
+        pthread_mutex_unlock(&source->mutex);
+        hls_source_reload(source, seq, block_part);
+        pthread_mutex_lock(&source->mutex);
+      } else {
+        int64_t until = (source->next_reload - now) / 1000;
+        hls_source_wait_locked(
+            source, (uint32_t)tk_max(1, tk_min((int64_t)HLS_SOURCE_WAIT_MS, until)));
+      }
+      continue;
+    }
+
+    char *uri = strdup(part->uri);
+    int64_t offset = part->offset;
+    int64_t length = part->length;
+    // A hinted part has no duration yet; it is a part target long.
+    double duration = part == &media->preload_hint ? media->part_target : part->duration;
+    pthread_mutex_unlock(&source->mutex);
+
+    uint8_t *data = NULL;
+    size_t size = 0;
+    ret_t ret = uri != NULL ? hls_source_fetch(source, uri, offset, length, &data, &size)
+                            : RET_OOM;
+    free(uri);
+
+    pthread_mutex_lock(&source->mutex);
+    if (ret == RET_QUIT) {
+      return ret;
+    }
+    if (ret != RET_OK) {
+      // A stale hint fails once the server moved on; reload and go again.
+      if (++failures >= HLS_SOURCE_PART_RETRIES) {
+        return RET_FAIL;
+      }
+      hls_source_wait_locked(source, HLS_SOURCE_RETRY_MS);
+      continue;
+    }
+    if (slot->claim != claim) {
+      av_free(data);
+      return RET_SKIP;
+    }
+
+    uint8_t *joined = (uint8_t *)av_realloc(slot->data, slot->size + size + 1);
+    if (joined == NULL) {
+      av_free(data);
+      return RET_OOM;
+    }
+    memcpy(joined + slot->size, data, size);
+    joined[slot->size + size] = '\0';
+    av_free(data);
+    slot->data = joined;
+    slot->size += size;
+    slot->duration += duration;
+    slot->next_part++;
+    source->stats.bytes_fetched += size;
+    failures = 0;
+    pthread_cond_broadcast(&source->cond);
+  }
+
+  return RET_QUIT;
+}
+
+/* Claim slot for segment seq and load it part by part. */
+static void hls_source_load_segment_parts_locked(hls_source_t *source,
+                                                 hls_slot_t *slot, int64_t seq) {
+  slot->seq = seq;
+  slot->state = HLS_SLOT_LOADING;
+  slot->duration = 0;
+  slot->start = 0;
+  slot->next_part = 0;
+  uint32_t claim = ++slot->claim;
+
+  if (seq == source->start_seq && source->start_part > 0) {
+    uint32_t nr_parts = 0;
+    bool_t complete = FALSE;
+    const m3u8_part_t *parts =
+        m3u8_playlist_get_parts(&source->media, seq, &nr_parts, &complete);
+    for (uint32_t i = 0; i < source->start_part && i < nr_parts; i++) {
+      slot->start += parts[i].duration;
+    }
+    slot->next_part = (int)source->start_part;
+    source->start_part = 0;
+  }
+  if (source->switch_map != NULL && seq == source->switch_map_seq) {
+    // First segment of a new variant: the demuxer needs its init section.
+    slot->data = source->switch_map;
+    slot->size = source->switch_map_size;
+    source->switch_map = NULL;
+  }
+
+  ret_t ret = hls_source_load_parts_locked(source, slot, claim);
+  if (ret == RET_QUIT || slot->claim != claim) {
+    return;
+  }
+  if (ret == RET_SKIP) {
+    hls_source_release_slot_locked(slot);
+  } else if (ret == RET_OK || slot->size > 0) {
+    // Cut short, what arrived still plays; the demuxer resyncs after it.
+    slot->state = HLS_SLOT_READY;
+    source->stats.segments_fetched++;
+  } else {
+    slot->state = HLS_SLOT_FAILED;
+    source->stats.segments_failed++;
+  }
+  pthread_cond_broadcast(&source->cond);
+}
+
+static void *hls_source_worker(void *arg) {
+  hls_source_t *source = (hls_source_t *)arg;
+
+  pthread_mutex_lock(&source->mutex);
+  while (!hls_source_aborted(source)) {
+    int64_t now = av_gettime_relative();
+    if (source->next_reload > 0 && now >= source->next_reload &&
+        !source->reloading) {
+      source->reloading = TRUE;
+      pthread_mutex_unlock(&source->mutex);
+      hls_source_reload(source, -1, 0);
+      pthread_mutex_lock(&source->mutex);
+      continue;
+    }
+
+    if (source->switch_to >= 0 && !source->switching) {
+      uint32_t index = (uint32_t)source->switch_to;
+      source->switch_to = -1;
+      source->switching = TRUE;
+      pthread_mutex_unlock(&source->mutex);
+      hls_source_switch(source, index);
+      pthread_mutex_lock(&source->mutex);
+      continue;
+    }
+
+    // Claim the earliest segment of the window nobody is loading yet.
+    hls_slot_t *slot = NULL;
+    const m3u8_segment_t *seg = NULL;
+    bool_t parts = FALSE;
+    int64_t seq = source->read_seq;
+    for (; seq < source->read_seq + source->prefetch; seq++) {
+      seg = m3u8_playlist_find(&source->media, seq);
+      parts = hls_source_wants_parts_locked(source, seq, seg);
+      if (seg == NULL && !parts) {
+        break;
+      }
+      if (source->slots[seq % source->prefetch].state == HLS_SLOT_EMPTY) {
+        slot = source->slots + seq % source->prefetch;
+        break;
+      }
+    }
+
+    // Hold off new downloads while the next variant's playlist loads.
+    if (slot == NULL || source->switching) {
+      uint32_t timeout = HLS_SOURCE_WAIT_MS;
+      if (source->next_reload > 0) {
+        int64_t until = (source->next_reload - now) / 1000;
+        timeout = (uint32_t)tk_max(1, tk_min((int64_t)timeout, until));
+      }
+      hls_source_wait_locked(source, timeout);
+      continue;
+    }
+
+    if (parts) {
+      hls_source_load_segment_parts_locked(source, slot, seq);
+      continue;
+    }
+
+    char *uri = strdup(seg->uri);
+    int64_t offset = seg->offset;
+    int64_t length = seg->length;
+    slot->seq = seq;
+    slot->state = HLS_SLOT_LOADING;
+    slot->duration = seg->duration;
+    slot->start = 0;
+    slot->next_part = -1;
+    uint32_t claim = ++slot->claim;
+    uint8_t *map = NULL;
+    size_t map_size = 0;
+    if (source->switch_map != NULL && seq == source->switch_map_seq) {
+      map = source->switch_map;
+      map_size = source->switch_map_size;
+      source->switch_map = NULL;
+    }
+    // Live segments are never replayed, so only VOD goes through the cache.
+    segment_cache_t *cache = source->media.endlist ? source->cache : NULL;
+    segment_cache_entry_t *cached = NULL;
+    if (cache != NULL && uri != NULL) {
+      cached = segment_cache_lookup(cache, uri, offset, length);
+    }
+    bool_t from_cache = cached != NULL;
+    if (!from_cache && source->active_fetches++ == 0) {
+      source->busy_start = now;
+    }
+    pthread_mutex_unlock(&source->mutex);
+
+    uint8_t *data = NULL;
+    size_t size = 0;
+    ret_t ret = RET_FAIL;
+    if (cached != NULL) {
+      data = (uint8_t *)cached->data;
+      size = cached->size;
+      ret = RET_OK;
+    }
+    for (int i = 0; i < HLS_SOURCE_RETRIES && !from_cache && uri != NULL; i++) {
+      ret = hls_source_fetch(source, uri, offset, length, &data, &size);
+      if (ret == RET_OK || ret == RET_QUIT) {
+        break;
+      }
+      sleep_ms(HLS_SOURCE_RETRY_MS);
+    }
+    if (ret == RET_OK && !from_cache && cache != NULL) {
+      segment_cache_store(cache, uri, offset, length, data, size);
+    }
+    free(uri);
+
+    if (ret == RET_OK && map != NULL) {
+      // First segment of a new variant: the demuxer needs its init section.
+      uint8_t *joined = (uint8_t *)av_malloc(map_size + size + 1);
+      if (joined != NULL) {
+        memcpy(joined, map, map_size);
+        memcpy(joined + map_size, data, size);
+        joined[map_size + size] = '\0';
+        size += map_size;
+      } else {
+        ret = RET_OOM;
+      }
+      hls_slot_free_data(data, cached);
+      data = joined;
+      cached = NULL;
+      av_freep(&map);
+    }
+
+    pthread_mutex_lock(&source->mutex);
+    now = av_gettime_relative();
+    if (!from_cache && --source->active_fetches == 0) {
+      source->busy_us += now - source->busy_start;
+    }
+    if (map != NULL && source->switch_map == NULL) {
+      source->switch_map = map;
+      source->switch_map_size = map_size;
+      source->switch_map_seq = hls_source_next_unclaimed_locked(source);
+      map = NULL;
+    }
+    if (slot->claim == claim && slot->state == HLS_SLOT_LOADING &&
+        seq >= source->read_seq) {
+      slot->data = data;
+      slot->size = size;
+      slot->cached = cached;
+      if (ret == RET_OK) {
+        slot->state = HLS_SLOT_READY;
+        source->stats.segments_fetched++;
+        if (!from_cache) {
+          source->stats.bytes_fetched += size;
+          hls_source_sample_locked(source, size, now);
+        }
+      } else {
+        slot->state = HLS_SLOT_FAILED;
+        source->stats.segments_failed++;
+      }
+    } else {
+      // The reader skipped past this segment while it was loading.
+      hls_slot_free_data(data, cached);
+      if (slot->claim == claim && slot->state == HLS_SLOT_LOADING) {
+        slot->state = HLS_SLOT_EMPTY;
+      }
+    }
+    pthread_cond_broadcast(&source->cond);
+    av_free(map);
+  }
+  pthread_mutex_unlock(&source->mutex);
+
+  return NULL;
+}
+
+static int hls_source_read(void *opaque, uint8_t *buf, int buf_size) {
+  hls_source_t *source = (hls_source_t *)opaque;
+  bool_t stalled = FALSE;
+  int ret = 0;
+
+  pthread_mutex_lock(&source->mutex);
+  while (ret == 0) {
+    if (hls_source_aborted(source)) {
+      ret = AVERROR_EXIT;
+      break;
+    }
+
+    if (source->map_offset < source->map_size) {
+      ret = (int)tk_min((size_t)buf_size, source->map_size - source->map_offset);
+      memcpy(buf, source->map + source->map_offset, ret);
+      source->map_offset += ret;
+      break;
+    }
+
+    hls_slot_t *slot = source->slots + source->read_seq % source->prefetch;
+    if (slot->seq == source->read_seq && slot->state == HLS_SLOT_LOADING &&
+        slot->next_part >= 0 && source->read_offset < slot->size) {
+      // A segment still arriving part by part: hand on what is there.
+      ret = (int)tk_min((size_t)buf_size, slot->size - source->read_offset);
+      memcpy(buf, slot->data + source->read_offset, ret);
+      source->read_offset += ret;
+      break;
+    }
+    if (slot->seq == source->read_seq && slot->state == HLS_SLOT_READY) {
+      ret = (int)tk_min((size_t)buf_size, slot->size - source->read_offset);
+      memcpy(buf, slot->data + source->read_offset, ret);
+      source->read_offset += ret;
+      if (source->read_offset == slot->size) {
+        hls_source_release_slot_locked(slot);
+        source->read_seq++;
+        source->read_offset = 0;
+        pthread_cond_broadcast(&source->cond);
+      }
+      continue;
+    }
+    if (slot->seq == source->read_seq && slot->state == HLS_SLOT_FAILED) {
+      log_warn("hls: skipping segment %lld\n", (long long)source->read_seq);
+      hls_source_release_slot_locked(slot);
+      source->read_seq++;
+      source->read_offset = 0;
+      pthread_cond_broadcast(&source->cond);
+      continue;
+    }
+
+    m3u8_playlist_t *media = &source->media;
+    if (media->endlist &&
+        source->read_seq >= media->media_sequence + media->nr_segments) {
+      ret = AVERROR_EOF;
+      break;
+    }
+
+    if (!stalled) {
+      stalled = TRUE;
+      source->stats.stalls++;
+    }
+    hls_source_wait_locked(source, HLS_SOURCE_WAIT_MS);
+  }
+  pthread_mutex_unlock(&source->mutex);
+
+  return ret;
+}
+
+hls_source_t *hls_source_create(const char *url, uint32_t prefetch,
+                                const AVIOInterruptCB *int_cb) {
+  return_value_if_fail(url != NULL, NULL);
+
+  hls_source_t *source = (hls_source_t *)calloc(1, sizeof(hls_source_t));
+  return_value_if_fail(source != NULL, NULL);
+
+  source->url = strdup(url);
+  if (source->url == NULL) {
+    free(source);
+    return NULL;
+  }
+  if (int_cb != NULL) {
+    source->int_cb = *int_cb;
+  }
+  source->prefetch = tk_max(1, tk_min(prefetch, HLS_SOURCE_MAX_PREFETCH));
+  for (uint32_t i = 0; i < HLS_SOURCE_MAX_PREFETCH; i++) {
+    source->slots[i].seq = -1;
+  }
+  source->variant = -1;
+  source->selected = -1;
+  source->switch_to = -1;
+  source->start_seq = -1;
+  abr_init(&source->abr);
+  m3u8_playlist_init(&source->master);
+  m3u8_playlist_init(&source->media);
+  pthread_mutex_init(&source->mutex, NULL);
+  cond_clock_init(&source->cond);
+
+  return source;
+}
+
+ret_t hls_source_destroy(hls_source_t *source) {
+  return_value_if_fail(source != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&source->mutex);
+  source->abort = TRUE;
+  pthread_cond_broadcast(&source->cond);
+  pthread_mutex_unlock(&source->mutex);
+  for (uint32_t i = 0; i < source->nr_threads; i++) {
+    pthread_join(source->threads[i], NULL);
+  }
+
+  log_debug("hls: %u segments, %llu bytes fetched, %u failed, %u stalls, "
+            "%u timeouts\n",
+            source->stats.segments_fetched,
+            (unsigned long long)source->stats.bytes_fetched,
+            source->stats.segments_failed, source->stats.stalls,
+            source->stats.timeouts);
+
+  for (uint32_t i = 0; i < HLS_SOURCE_MAX_PREFETCH; i++) {
+    hls_source_release_slot_locked(source->slots + i);
+  }
+  if (source->avio != NULL) {
+    av_freep(&source->avio->buffer);
+    avio_context_free(&source->avio);
+  }
+  av_freep(&source->map);
+  av_freep(&source->switch_map);
+  m3u8_playlist_deinit(&source->master);
+  m3u8_playlist_deinit(&source->media);
+  pthread_mutex_destroy(&source->mutex);
+  pthread_cond_destroy(&source->cond);
+  free(source->media_url);
+  free(source->url);
+  free(source);
+
+  return RET_OK;
+}
+
+static uint32_t hls_source_pick_variant(const m3u8_playlist_t *master,
+                                        bool_t lowest) {
+  uint32_t best = 0;
+  for (uint32_t i = 1; i < master->nr_variants; i++) {
+    uint32_t bandwidth = master->variants[i].bandwidth;
+    if (lowest ? bandwidth < master->variants[best].bandwidth
+               : bandwidth > master->variants[best].bandwidth) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+static bool_t hls_source_variant_fits(const m3u8_variant_t *variant,
+                                      int max_width, int max_height) {
+  if (variant->width <= 0 || variant->height <= 0) {
+    return TRUE;
+  }
+  return (max_width <= 0 || variant->width <= max_width) &&
+         (max_height <= 0 || variant->height <= max_height);
+}
+
+static void hls_source_limit_variants(m3u8_playlist_t *master, int max_width,
+                                      int max_height) {
+  uint32_t smallest = 0;
+  bool_t any_fits = FALSE;
+
+  if (max_width <= 0 && max_height <= 0) {
+    return;
+  }
+
+  for (uint32_t i = 0; i < master->nr_variants; i++) {
+    const m3u8_variant_t *v = master->variants + i;
+    const m3u8_variant_t *s = master->variants + smallest;
+    if ((int64_t)v->width * v->height < (int64_t)s->width * s->height) {
+      smallest = i;
+    }
+    any_fits = any_fits || hls_source_variant_fits(v, max_width, max_height);
+  }
+
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < master->nr_variants; i++) {
+    m3u8_variant_t *v = master->variants + i;
+    if (any_fits ? hls_source_variant_fits(v, max_width, max_height)
+                 : i == smallest) {
+      master->variants[kept++] = *v;
+    } else {
+      free(v->uri);
+      free(v->codecs);
+    }
+  }
+  if (kept < master->nr_variants) {
+    log_debug("hls: %u of %u variants fit in %dx%d\n", kept,
+              master->nr_variants, max_width, max_height);
+  }
+  master->nr_variants = kept;
+}
+
+static void hls_source_start_at(hls_source_t *source, int64_t seq, uint32_t part) {
+  source->read_seq = seq;
+  source->start_seq = seq;
+  source->start_part = part;
+}
+
+/*
+ * Start target_latency behind the live edge, never closer than the
+ * playlist's hold back, at an independent part when following parts.
+ * Without a target, three segments from the end.
+ */
+static void hls_source_pick_live_start(hls_source_t *source) {
+  const m3u8_playlist_t *media = &source->media;
+  bool_t parts = source->low_latency && media->part_target > 0;
+  double target = source->target_latency;
+  double behind = 0;
+
+  if (target <= 0) {
+    if (media->nr_segments > HLS_SOURCE_LIVE_EDGE_SEGMENTS) {
+      source->read_seq += media->nr_segments - HLS_SOURCE_LIVE_EDGE_SEGMENTS;
+    }
+    return;
+  }
+  target = tk_max(target, parts ? media->part_hold_back : media->hold_back);
+
+  // Walk back from the last part of the segment still being written.
+  int64_t seq = media->media_sequence + media->nr_segments;
+  for (uint32_t i = media->nr_parts; parts && i-- > 0;) {
+    behind += media->parts[i].duration;
+    if (behind >= target && media->parts[i].independent) {
+      hls_source_start_at(source, seq, i);
+      return;
+    }
+  }
+  for (uint32_t i = media->nr_segments; i-- > 0;) {
+    const m3u8_segment_t *seg = media->segments + i;
+    seq = media->media_sequence + i;
+    if (parts && seg->nr_parts > 0) {
+      for (uint32_t j = seg->nr_parts; j-- > 0;) {
+        behind += seg->parts[j].duration;
+        if (behind >= target && seg->parts[j].independent) {
+          hls_source_start_at(source, seq, j);
+          return;
+        }
+      }
+    } else {
+      behind += seg->duration;
+      if (behind >= target) {
+        hls_source_start_at(source, seq, 0);
+        return;
+      }
+    }
+  }
+  // A short playlist: start at its oldest segment.
+}
+
+ret_t hls_source_open(hls_source_t *source) {
+  m3u8_playlist_t pl;
+  ret_t ret;
+
+  return_value_if_fail(source != NULL && source->avio == NULL, RET_BAD_PARAMS);
+
+  ret = hls_source_load_playlist(source, source->url, HLS_SOURCE_IO_TIMEOUT_US,
+                                &pl);
+  if (ret != RET_OK) {
+    log_error("hls: could not load playlist %s\n", source->url);
+    return ret;
+  }
+
+  if (pl.is_master) {
+    hls_source_limit_variants(&pl, source->max_width, source->max_height);
+    uint32_t index = hls_source_pick_variant(&pl, source->start_low);
+    const m3u8_variant_t *variant = pl.variants + index;
+    log_debug("hls: variant %u of %u, %u bps, %dx%d\n", index + 1,
+              pl.nr_variants, variant->bandwidth, variant->width,
+              variant->height);
+    source->media_url = strdup(variant->uri);
+    source->variant = (int)index;
+    source->master = pl;
+    return_value_if_fail(source->media_url != NULL, RET_OOM);
+
+    ret = hls_source_load_playlist(source, source->media_url,
+                                   HLS_SOURCE_IO_TIMEOUT_US, &pl);
+    if (ret != RET_OK) {
+      log_error("hls: could not load playlist %s\n", source->media_url);
+      return ret;
+    }
+    if (pl.is_master) {
+      log_error("hls: nested master playlist %s\n", source->media_url);
+      m3u8_playlist_deinit(&pl);
+      return RET_FAIL;
+    }
+  } else {
+    source->media_url = strdup(source->url);
+    return_value_if_fail(source->media_url != NULL, RET_OOM);
+  }
+
+  if (pl.encrypted) {
+    log_error("hls: encrypted segments are not supported\n");
+    m3u8_playlist_deinit(&pl);
+    return RET_NOT_IMPL;
+  }
+  if (pl.nr_segments == 0) {
+    log_error("hls: empty playlist %s\n", source->media_url);
+    m3u8_playlist_deinit(&pl);
+    return RET_FAIL;
+  }
+  if (pl.map_uri != NULL) {
+    ret = hls_source_fetch(source, pl.map_uri, pl.map_offset, pl.map_length,
+                           &source->map, &source->map_size);
+    if (ret != RET_OK) {
+      log_error("hls: could not load init section %s\n", pl.map_uri);
+      m3u8_playlist_deinit(&pl);
+      return ret;
+    }
+  }
+
+  source->media = pl;
+  source->read_seq = pl.media_sequence;
+  source->start_seq = -1;
+  source->loaded_at = av_gettime_relative();
+  if (!pl.endlist) {
+    hls_source_pick_live_start(source);
+    double interval = hls_source_reload_interval_locked(source, TRUE);
+    source->next_reload = source->loaded_at + (int64_t)(interval * 1000000);
+  }
+  log_debug("hls: %s playlist, %u segments, %u parts, starting at %lld part %u\n",
+            pl.endlist ? "vod" : "live", pl.nr_segments, pl.nr_parts,
+            (long long)source->read_seq, source->start_part);
+
+  uint8_t *buffer = (uint8_t *)av_malloc(HLS_SOURCE_AVIO_BUFFER_SIZE);
+  return_value_if_fail(buffer != NULL, RET_OOM);
+  source->avio = avio_alloc_context(buffer, HLS_SOURCE_AVIO_BUFFER_SIZE, 0,
+                                    source, hls_source_read, NULL, NULL);
+  if (source->avio == NULL) {
+    av_free(buffer);
+    return RET_OOM;
+  }
+
+  for (uint32_t i = 0; i < source->prefetch; i++) {
+    if (pthread_create(&source->threads[i], NULL, hls_source_worker, source) != 0) {
+      break;
+    }
+    source->nr_threads++;
+  }
+  return_value_if_fail(source->nr_threads > 0, RET_FAIL);
+
+  return RET_OK;
+}
+
+uint32_t hls_source_get_variant_count(hls_source_t *source) {
+  return_value_if_fail(source != NULL, 0);
+  return source->master.nr_variants;
+}
+
+const m3u8_variant_t *hls_source_get_variant(hls_source_t *source,
+                                             uint32_t index) {
+  return_value_if_fail(source != NULL, NULL);
+  return_value_if_fail(index < source->master.nr_variants, NULL);
+  return source->master.variants + index;
+}
+
+ret_t hls_source_select_variant(hls_source_t *source, int index) {
+  return_value_if_fail(source != NULL, RET_BAD_PARAMS);
+  return_value_if_fail(index < (int)source->master.nr_variants, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&source->mutex);
+  source->selected = index;
+  if (index >= 0 && index != source->variant) {
+    source->switch_to = index;
+    pthread_cond_broadcast(&source->cond);
+  }
+  pthread_mutex_unlock(&source->mutex);
+
+  return RET_OK;
+}
+
+ret_t hls_source_report_buffer(hls_source_t *source, double seconds) {
+  return_value_if_fail(source != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&source->mutex);
+  source->downstream_buffer = seconds;
+  pthread_mutex_unlock(&source->mutex);
+
+  return RET_OK;
+}
+
+ret_t hls_source_set_fast_start(hls_source_t *source, bool_t enable) {
+  return_value_if_fail(source != NULL && source->avio == NULL, RET_BAD_PARAMS);
+  source->start_low = enable;
+  return RET_OK;
+}
+
+ret_t hls_source_set_max_resolution(hls_source_t *source, int width, int height) {
+  return_value_if_fail(source != NULL && source->avio == NULL, RET_BAD_PARAMS);
+  source->max_width = width;
+  source->max_height = height;
+  return RET_OK;
+}
+
+ret_t hls_source_set_low_latency(hls_source_t *source, bool_t enable,
+                                 double target_latency) {
+  return_value_if_fail(source != NULL && source->avio == NULL && target_latency >= 0,
+                       RET_BAD_PARAMS);
+  source->low_latency = enable;
+  source->target_latency = target_latency;
+  return RET_OK;
+}
+
+ret_t hls_source_set_cache(hls_source_t *source, segment_cache_t *cache) {
+  return_value_if_fail(source != NULL && source->avio == NULL, RET_BAD_PARAMS);
+  source->cache = cache;
+  return RET_OK;
+}
+
+ret_t hls_source_set_read_latency(hls_source_t *source, latency_histogram_t *hist) {
+  return_value_if_fail(source != NULL && source->avio == NULL, RET_BAD_PARAMS);
+  source->read_latency = hist;
+  return RET_OK;
+}
+
+ret_t hls_source_set_http_pool(hls_source_t *source, http_pool_t *pool) {
+  return_value_if_fail(source != NULL && source->avio == NULL, RET_BAD_PARAMS);
+  source->http_pool = pool;
+  return RET_OK;
+}
+
+AVIOContext *hls_source_get_avio(hls_source_t *source) {
+  return_value_if_fail(source != NULL, NULL);
+  return source->avio;
+}
+
+bool_t hls_source_is_live(hls_source_t *source) {
+  bool_t live;
+  return_value_if_fail(source != NULL, FALSE);
+
+  pthread_mutex_lock(&source->mutex);
+  live = !source->media.endlist;
+  pthread_mutex_unlock(&source->mutex);
+
+  return live;
+}
+
+double hls_source_get_duration(hls_source_t *source) {
+  double duration = 0;
+  return_value_if_fail(source != NULL, 0);
+
+  pthread_mutex_lock(&source->mutex);
+  if (source->media.endlist) {
+    duration = m3u8_playlist_get_duration(&source->media);
+  }
+  pthread_mutex_unlock(&source->mutex);
+
+  return duration;
+}
+
+double hls_source_get_edge_distance(hls_source_t *source) {
+  double distance = 0;
+  return_value_if_fail(source != NULL, 0);
+
+  pthread_mutex_lock(&source->mutex);
+  const m3u8_playlist_t *media = &source->media;
+  if (media->endlist) {
+    pthread_mutex_unlock(&source->mutex);
+    return 0;
+  }
+
+  int64_t edge_seq = media->media_sequence + media->nr_segments;
+  for (int64_t seq = tk_max(source->read_seq, media->media_sequence);
+       seq < edge_seq; seq++) {
+    distance += media->segments[seq - media->media_sequence].duration;
+  }
+  if (source->read_seq <= edge_seq) {
+    for (uint32_t i = 0; i < media->nr_parts; i++) {
+      distance += media->parts[i].duration;
+    }
+  }
+
+  // Less what the demuxer already read of the current segment.
+  const hls_slot_t *slot = source->slots + source->read_seq % source->prefetch;
+  if (slot->seq == source->read_seq && slot->size > 0 &&
+      (slot->state == HLS_SLOT_READY || slot->state == HLS_SLOT_LOADING)) {
+    distance -= slot->start + slot->duration * source->read_offset / slot->size;
+  }
+
+  // The edge has moved on since the playlist was loaded, by up to a reload.
+  double interval = source->low_latency && media->part_target > 0
+                        ? media->part_target
+                        : media->target_duration;
+  distance += tk_min((av_gettime_relative() - source->loaded_at) / 1000000.0, interval);
+  pthread_mutex_unlock(&source->mutex);
+
+  return tk_max(distance, 0);
+}
+
+ret_t hls_source_seek(hls_source_t *source, double seconds, double *start) {
+  return_value_if_fail(source != NULL && source->avio != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&source->mutex);
+  m3u8_playlist_t *media = &source->media;
+  if (!media->endlist || media->nr_segments == 0) {
+    pthread_mutex_unlock(&source->mutex);
+    return RET_NOT_IMPL;
+  }
+
+  // The index: segment start times are the running sum of their durations.
+  uint32_t index = 0;
+  double t = 0;
+  for (; index + 1 < media->nr_segments; index++) {
+    if (t + media->segments[index].duration > seconds) {
+      break;
+    }
+    t += media->segments[index].duration;
+  }
+  int64_t seq = media->media_sequence + index;
+
+  // In-flight downloads finish into nothing: their claim no longer matches.
+  for (uint32_t i = 0; i < source->prefetch; i++) {
+    hls_slot_t *slot = source->slots + i;
+    hls_source_release_slot_locked(slot);
+    slot->seq = -1;
+    slot->claim++;
+  }
+  source->read_seq = seq;
+  source->read_offset = 0;
+  if (source->switch_map != NULL) {
+    source->switch_map_seq = seq;
+  }
+  log_debug("hls: seek to %.3f, segment %lld at %.3f\n", seconds,
+            (long long)seq, t);
+  pthread_cond_broadcast(&source->cond);
+  pthread_mutex_unlock(&source->mutex);
+
+  if (start != NULL) {
+    *start = t;
+  }
+
+  return RET_OK;
+}
+
+ret_t hls_source_get_stats(hls_source_t *source, hls_source_stats_t *stats) {
+  return_value_if_fail(source != NULL && stats != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&source->mutex);
+  *stats = source->stats;
+  stats->variant = source->variant;
+  stats->bandwidth = abr_get_estimate(&source->abr);
+  stats->buffered = hls_source_buffered_locked(source);
+  stats->segments_ready = 0;
+  for (uint32_t i = 0; i < source->prefetch; i++) {
+    if (source->slots[i].state == HLS_SLOT_READY) {
+      stats->segments_ready++;
+    }
+  }
+  pthread_mutex_unlock(&source->mutex);
+
+  return RET_OK;
+}
+
+bool_t hls_source_is_playlist_url(const char *url) {
+  return_value_if_fail(url != NULL, FALSE);
+
+  size_t path_len = strcspn(url, "?#");
+  return path_len >= 5 && strncasecmp(url + path_len - 5, ".m3u8", 5) == 0;
+}
@@ -0,0 +1,135 @@
+#ifndef HLS_SOURCE_H
+#define HLS_SOURCE_H
+
+#include "http_pool.h"
+#include "latency_histogram.h"
+#include "m3u8.h"
+#include "segment_cache.h"
+#include <libavformat/avio.h>
+
+BEGIN_C_DECLS
+
+#define HLS_SOURCE_MAX_PREFETCH 8
+
+/*
+ * Native HLS engine: fetches and reloads the playlists itself and keeps the
+ * next N segments of the selected variant downloading in parallel, in
+ * memory. The demuxer reads the concatenated segments through a custom
+ * AVIOContext.
+ */
+typedef struct _hls_source_t hls_source_t;
+
+typedef struct _hls_source_stats_t {
+  uint32_t segments_fetched;
+  uint32_t segments_failed;
+  uint64_t bytes_fetched;
+  uint32_t playlist_reloads;
+  /* Reads that had to wait for a segment still downloading */
+  uint32_t stalls;
+  /* Requests abandoned after waiting too long for the server */
+  uint32_t timeouts;
+  /* Segments downloaded and not yet read */
+  uint32_t segments_ready;
+
+  /* Variant in use, -1 for a plain media playlist */
+  int variant;
+  uint32_t switches;
+  /* Measured throughput, bits per second */
+  double bandwidth;
+  /* Seconds of media downloaded ahead of the playhead */
+  double buffered;
+} hls_source_stats_t;
+
+/*
+ * int_cb, if given, is polled while waiting and passed to every request, so
+ * the owner can abort a blocked source.
+ */
+hls_source_t *hls_source_create(const char *url, uint32_t prefetch,
+                                const AVIOInterruptCB *int_cb);
+ret_t hls_source_destroy(hls_source_t *source);
+
+/*
+ * Serve VOD segments from cache when present and save downloaded ones to it.
+ * The cache must outlive the source. Call before hls_source_open.
+ */
+ret_t hls_source_set_cache(hls_source_t *source, segment_cache_t *cache);
+
+/*
+ * Open on the lowest-bandwidth variant, whose first segment arrives soonest,
+ * and leave stepping up to ABR. Call before hls_source_open.
+ */
+ret_t hls_source_set_fast_start(hls_source_t *source, bool_t enable);
+
+/*
+ * Drop the master playlist variants larger than width x height, keeping the
+ * smallest if none fits, so ABR only chooses among the rest. Variants
+ * without a resolution are kept. Call before hls_source_open.
+ */
+ret_t hls_source_set_max_resolution(hls_source_t *source, int width, int height);
+
+/*
+ * Low-latency live: follow the segment still being written part by part
+ * (LL-HLS EXT-X-PART, with blocking playlist reloads and preload hints when
+ * the server offers them), and start target_latency seconds behind the live
+ * edge, or three segments back with 0. The start never comes closer than the
+ * playlist's (PART-)HOLD-BACK. Call before hls_source_open.
+ */
+ret_t hls_source_set_low_latency(hls_source_t *source, bool_t enable,
+                                 double target_latency);
+
+/*
+ * Record how long each network read of a playlist or segment download takes.
+ * The histogram must outlive the source. Call before hls_source_open.
+ */
+ret_t hls_source_set_read_latency(hls_source_t *source, latency_histogram_t *hist);
+
+/*
+ * Send http:// requests through pool, on kept-alive connections, instead of
+ * a new FFmpeg HTTP connection each. The pool must outlive the source. Call
+ * before hls_source_open.
+ */
+ret_t hls_source_set_http_pool(hls_source_t *source, http_pool_t *pool);
+
+/* Fetch the playlists, pick a variant and start the prefetch threads. */
+ret_t hls_source_open(hls_source_t *source);
+AVIOContext *hls_source_get_avio(hls_source_t *source);
+
+/*
+ * Variants of the master playlist, in playlist order. They stay valid until
+ * the source is destroyed.
+ */
+uint32_t hls_source_get_variant_count(hls_source_t *source);
+const m3u8_variant_t *hls_source_get_variant(hls_source_t *source, uint32_t index);
+
+/*
+ * Switch to variant index at the next segment boundary and stop adapting,
+ * or adapt automatically again with index -1 (the default).
+ */
+ret_t hls_source_select_variant(hls_source_t *source, int index);
+
+/* Seconds buffered downstream of the source (demuxed, not yet played), for ABR */
+ret_t hls_source_report_buffer(hls_source_t *source, double seconds);
+
+/*
+ * VOD only: continue reading from the segment containing seconds, whose
+ * start time is returned in start. The caller flushes its AVIOContext
+ * buffer and demuxer. Returns RET_NOT_IMPL for live playlists.
+ */
+ret_t hls_source_seek(hls_source_t *source, double seconds, double *start);
+
+bool_t hls_source_is_live(hls_source_t *source);
+/*
+ * Live only: seconds of media from the demuxer's read position to the live
+ * edge, counting the time since the last reload as the edge moving on.
+ */
+double hls_source_get_edge_distance(hls_source_t *source);
+/* Total duration of a VOD playlist, 0 for live */
+double hls_source_get_duration(hls_source_t *source);
+ret_t hls_source_get_stats(hls_source_t *source, hls_source_stats_t *stats);
+
+/* True if url looks like an HLS playlist */
+bool_t hls_source_is_playlist_url(const char *url);
+
+END_C_DECLS
+
+#endif /* HLS_SOURCE_H */
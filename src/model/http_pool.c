@@ -0,0 +1,841 @@
+#include "http_pool.h"
+#include "m3u8.h"
+#include "tkc/log.h"
+#include "tkc/utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <libavformat/avformat.h>
+#include <libavutil/error.h>
+#include <libavutil/time.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define HTTP_POOL_MAX_IDLE 8
+#define HTTP_POOL_KEEP_ALIVE_US (30 * 1000000LL)
+#define HTTP_POOL_DNS_TTL_US (60 * 1000000LL)
+/* The interrupt callback is polled at least this often while waiting */
+#define HTTP_POOL_POLL_MS 100
+#define HTTP_POOL_BUFFER_SIZE (64 * 1024)
+#define HTTP_POOL_MAX_HOST 256
+#define HTTP_POOL_MAX_LINE 8192
+#define HTTP_POOL_MAX_REDIRECTS 5
+
+/* A peer that closed must fail the send, not raise SIGPIPE */
+#ifdef MSG_NOSIGNAL
+#define HTTP_POOL_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define HTTP_POOL_SEND_FLAGS 0
+#endif
+
+typedef struct _http_conn_t {
+  char host[HTTP_POOL_MAX_HOST];
+  int port;
+  int fd;
+  /* Received and not consumed yet: [pos, len) */
+  uint8_t buf[HTTP_POOL_BUFFER_SIZE];
+  size_t pos;
+  size_t len;
+  int64_t idle_since;
+  struct _http_conn_t *next;
+} http_conn_t;
+
+typedef struct _http_dns_entry_t {
+  char host[HTTP_POOL_MAX_HOST];
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  int64_t expires;
+  struct _http_dns_entry_t *next;
+} http_dns_entry_t;
+
+struct _http_pool_t {
+  uint32_t max_idle;
+  int64_t keep_alive_us;
+  int64_t dns_ttl_us;
+  /* Idle connections, most recently used first */
+  http_conn_t *idle;
+  uint32_t nr_idle;
+  http_dns_entry_t *dns;
+
+  http_pool_stats_t stats;
+  double handshake_total;
+  /* Lookups that went to the resolver, and their total time */
+  uint32_t dns_misses;
+  double dns_total;
+
+  pthread_mutex_t mutex;
+};
+
+struct _http_request_t {
+  http_pool_t *pool;
+  http_conn_t *conn;
+  AVIOInterruptCB int_cb;
+  int64_t bytes_read;
+
+  /* Response head */
+  int status;
+  bool_t keep_alive;
+  char *location;
+
+  /* Body: size bytes, or chunk by chunk, or up to the end of the connection */
+  int64_t size;
+  int64_t remaining;
+  bool_t chunked;
+  /* Left in the current chunk; 0 before its CRLF, -1 before its size line */
+  int64_t chunk_left;
+  bool_t done;
+  bool_t failed;
+};
+
+static void http_conn_close(http_conn_t *conn) {
+  if (conn->fd >= 0) {
+    close(conn->fd);
+  }
+  free(conn);
+}
+
+static bool_t http_request_interrupted(http_request_t *request) {
+  return request->int_cb.callback != NULL &&
+         request->int_cb.callback(request->int_cb.opaque) != 0;
+}
+
+/* Wait until fd is ready for events, polling the interrupt callback. */
+static int http_request_wait(http_request_t *request, int fd, short events) {
+  struct pollfd p;
+
+  for (;;) {
+    if (http_request_interrupted(request)) {
+      return AVERROR_EXIT;
+    }
+    p.fd = fd;
+    p.events = events;
+    p.revents = 0;
+    int n = poll(&p, 1, HTTP_POOL_POLL_MS);
+    if (n > 0) {
+      return 0;
+    }
+    if (n < 0 && errno != EINTR) {
+      return AVERROR(errno);
+    }
+  }
+}
+
+static int http_request_fail(http_request_t *request, int err) {
+  request->failed = TRUE;
+  request->keep_alive = FALSE;
+  return err;
+}
+
+/*
+ * Resolve host, from the cache while its entry is fresh. getaddrinfo itself
+ * cannot be interrupted, as with FFmpeg's tcp protocol.
+ */
+static int http_pool_resolve(http_pool_t *pool, const char *host, int port,
+                             struct sockaddr_storage *addr, socklen_t *addr_len) {
+  int64_t now = av_gettime_relative();
+  bool_t hit = FALSE;
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->stats.lookups++;
+  http_dns_entry_t **link = &pool->dns;
+  while (*link != NULL) {
+    http_dns_entry_t *entry = *link;
+    if (entry->expires <= now) {
+      *link = entry->next;
+      free(entry);
+      continue;
+    }
+    if (!hit && strcmp(entry->host, host) == 0) {
+      memcpy(addr, &entry->addr, entry->addr_len);
+      *addr_len = entry->addr_len;
+      hit = TRUE;
+    }
+    link = &entry->next;
+  }
+  if (hit) {
+    pool->stats.dns_hits++;
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  if (!hit) {
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+
+    memset(&hints, 0x00, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int err = getaddrinfo(host, NULL, &hints, &res);
+    double ms = (av_gettime_relative() - now) / 1000.0;
+    if (err != 0) {
+      log_error("http: could not resolve %s: %s\n", host, gai_strerror(err));
+      return AVERROR(EHOSTUNREACH);
+    }
+    memcpy(addr, res->ai_addr, res->ai_addrlen);
+    *addr_len = (socklen_t)res->ai_addrlen;
+    freeaddrinfo(res);
+
+    http_dns_entry_t *entry = (http_dns_entry_t *)calloc(1, sizeof(http_dns_entry_t));
+    pthread_mutex_lock(&pool->mutex);
+    pool->dns_misses++;
+    pool->dns_total += ms;
+    if (entry != NULL) {
+      snprintf(entry->host, sizeof(entry->host), "%s", host);
+      memcpy(&entry->addr, addr, *addr_len);
+      entry->addr_len = *addr_len;
+      entry->expires = now + pool->dns_ttl_us;
+      entry->next = pool->dns;
+      pool->dns = entry;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+  }
+
+  if (addr->ss_family == AF_INET) {
+    ((struct sockaddr_in *)addr)->sin_port = htons((uint16_t)port);
+  } else if (addr->ss_family == AF_INET6) {
+    ((struct sockaddr_in6 *)addr)->sin6_port = htons((uint16_t)port);
+  }
+
+  return 0;
+}
+
+/* Take an idle connection to host:port, NULL if none is left open. */
+static http_conn_t *http_pool_take(http_pool_t *pool, const char *host, int port) {
+  int64_t now = av_gettime_relative();
+  http_conn_t *found = NULL;
+  http_conn_t *expired = NULL;
+
+  pthread_mutex_lock(&pool->mutex);
+  http_conn_t **link = &pool->idle;
+  while (*link != NULL) {
+    http_conn_t *conn = *link;
+    bool_t match = found == NULL && conn->port == port && strcmp(conn->host, host) == 0;
+    if (match || now - conn->idle_since >= pool->keep_alive_us) {
+      *link = conn->next;
+      pool->nr_idle--;
+      if (match) {
+        found = conn;
+      } else {
+        conn->next = expired;
+        expired = conn;
+      }
+      continue;
+    }
+    link = &conn->next;
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  while (expired != NULL) {
+    http_conn_t *next = expired->next;
+    http_conn_close(expired);
+    expired = next;
+  }
+
+  // Readable while idle: the server has closed it (or sent what it should not).
+  if (found != NULL) {
+    struct pollfd p = {found->fd, POLLIN, 0};
+    if (poll(&p, 1, 0) != 0) {
+      http_conn_close(found);
+      found = NULL;
+      pthread_mutex_lock(&pool->mutex);
+      pool->stats.stale++;
+      pthread_mutex_unlock(&pool->mutex);
+    }
+  }
+
+  return found;
+}
+
+static void http_pool_put(http_pool_t *pool, http_conn_t *conn) {
+  http_conn_t *evicted = NULL;
+
+  conn->idle_since = av_gettime_relative();
+  pthread_mutex_lock(&pool->mutex);
+  conn->next = pool->idle;
+  pool->idle = conn;
+  pool->nr_idle++;
+  if (pool->nr_idle > pool->max_idle) {
+    // Over the limit: the least recently used goes, from the tail.
+    http_conn_t **link = &pool->idle;
+    while ((*link)->next != NULL) {
+      link = &(*link)->next;
+    }
+    evicted = *link;
+    *link = NULL;
+    pool->nr_idle--;
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  if (evicted != NULL) {
+    http_conn_close(evicted);
+  }
+}
+
+static int http_pool_connect(http_pool_t *pool, http_request_t *request,
+                             const char *host, int port, http_conn_t **out) {
+  struct sockaddr_storage addr;
+  socklen_t addr_len = 0;
+  int one = 1;
+  int err = 0;
+  socklen_t err_len = sizeof(err);
+
+  int ret = http_pool_resolve(pool, host, port, &addr, &addr_len);
+  if (ret < 0) {
+    return ret;
+  }
+
+  http_conn_t *conn = (http_conn_t *)calloc(1, sizeof(http_conn_t));
+  return_value_if_fail(conn != NULL, AVERROR(ENOMEM));
+  snprintf(conn->host, sizeof(conn->host), "%s", host);
+  conn->port = port;
+  conn->fd = socket(addr.ss_family, SOCK_STREAM, 0);
+  if (conn->fd < 0) {
+    ret = AVERROR(errno);
+    http_conn_close(conn);
+    return ret;
+  }
+  fcntl(conn->fd, F_SETFL, fcntl(conn->fd, F_GETFL) | O_NONBLOCK);
+  setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+  setsockopt(conn->fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+  int64_t start = av_gettime_relative();
+  if (connect(conn->fd, (struct sockaddr *)&addr, addr_len) < 0) {
+    if (errno != EINPROGRESS) {
+      ret = AVERROR(errno);
+    } else if ((ret = http_request_wait(request, conn->fd, POLLOUT)) == 0 &&
+               getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &err_len) == 0 &&
+               err != 0) {
+      ret = AVERROR(err);
+    }
+  }
+  if (ret < 0) {
+    if (ret != AVERROR_EXIT) {
+      log_error("http: could not connect to %s:%d\n", host, port);
+    }
+    http_conn_close(conn);
+    return ret;
+  }
+
+  double ms = (av_gettime_relative() - start) / 1000.0;
+  pthread_mutex_lock(&pool->mutex);
+  pool->stats.connects++;
+  pool->stats.handshake_last = ms;
+  pool->stats.handshake_max = tk_max(pool->stats.handshake_max, ms);
+  pool->handshake_total += ms;
+  pthread_mutex_unlock(&pool->mutex);
+  *out = conn;
+
+  return 0;
+}
+
+static int http_request_send(http_request_t *request, const char *data, size_t size) {
+  int fd = request->conn->fd;
+
+  while (size > 0) {
+    ssize_t n = send(fd, data, size, HTTP_POOL_SEND_FLAGS);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        return AVERROR(errno);
+      }
+      int ret = http_request_wait(request, fd, POLLOUT);
+      if (ret < 0) {
+        return ret;
+      }
+      continue;
+    }
+    data += n;
+    size -= (size_t)n;
+  }
+
+  return 0;
+}
+
+/* Receive into the connection buffer once it is all consumed. */
+static int http_request_fill(http_request_t *request) {
+  http_conn_t *conn = request->conn;
+
+  if (conn->pos < conn->len) {
+    return 0;
+  }
+  conn->pos = 0;
+  conn->len = 0;
+  for (;;) {
+    ssize_t n = recv(conn->fd, conn->buf, sizeof(conn->buf), 0);
+    if (n > 0) {
+      conn->len = (size_t)n;
+      request->bytes_read += n;
+      return 0;
+    }
+    if (n == 0) {
+      return AVERROR_EOF;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      return AVERROR(errno);
+    }
+    int ret = http_request_wait(request, conn->fd, POLLIN);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+}
+
+/* One line of the head or of the chunk framing, without its CRLF. */
+static int http_request_read_line(http_request_t *request, char *line, size_t size) {
+  size_t used = 0;
+
+  for (;;) {
+    int ret = http_request_fill(request);
+    if (ret < 0) {
+      return ret;
+    }
+
+    http_conn_t *conn = request->conn;
+    while (conn->pos < conn->len) {
+      char c = (char)conn->buf[conn->pos++];
+      if (c == '\n') {
+        while (used > 0 && line[used - 1] == '\r') {
+          used--;
+        }
+        line[used] = '\0';
+        return 0;
+      }
+      if (used + 1 >= size) {
+        return AVERROR_INVALIDDATA;
+      }
+      line[used++] = c;
+    }
+  }
+}
+
+static int http_request_send_head(http_request_t *request, const char *host,
+                                  int port, const char *path, int64_t offset,
+                                  int64_t length) {
+  char range[64] = "";
+  char port_str[16] = "";
+  // An IPv6 literal keeps its brackets in the Host header.
+  bool_t ipv6 = strchr(host, ':') != NULL;
+
+  if (length > 0) {
+    snprintf(range, sizeof(range), "Range: bytes=%lld-%lld\r\n",
+             (long long)offset, (long long)(offset + length - 1));
+  } else if (offset > 0) {
+    snprintf(range, sizeof(range), "Range: bytes=%lld-\r\n", (long long)offset);
+  }
+  if (port != 80) {
+    snprintf(port_str, sizeof(port_str), ":%d", port);
+  }
+
+  size_t size = strlen(path) + strlen(host) + strlen(range) + 160;
+  char *head = (char *)malloc(size);
+  return_value_if_fail(head != NULL, AVERROR(ENOMEM));
+  int len = snprintf(head, size,
+                     "GET %s HTTP/1.1\r\n"
+                     "Host: %s%s%s%s\r\n"
+                     "User-Agent: hls_player\r\n"
+                     "Accept: */*\r\n"
+                     "Connection: keep-alive\r\n"
+                     "%s\r\n",
+                     path, ipv6 ? "[" : "", host, ipv6 ? "]" : "", port_str, range);
+  int ret = http_request_send(request, head, (size_t)len);
+  free(head);
+
+  return ret;
+}
+
+static int http_request_read_head(http_request_t *request) {
+  char line[HTTP_POOL_MAX_LINE];
+  int minor = 0;
+
+  request->status = 0;
+  request->size = -1;
+  request->chunked = FALSE;
+  request->chunk_left = -1;
+  request->done = FALSE;
+  request->failed = FALSE;
+  free(request->location);
+  request->location = NULL;
+
+  int ret = http_request_read_line(request, line, sizeof(line));
+  if (ret < 0) {
+    return ret;
+  }
+  if (sscanf(line, "HTTP/1.%d %d", &minor, &request->status) != 2) {
+    return AVERROR_INVALIDDATA;
+  }
+  request->keep_alive = minor >= 1;
+
+  for (;;) {
+    ret = http_request_read_line(request, line, sizeof(line));
+    if (ret < 0) {
+      return ret;
+    }
+    if (line[0] == '\0') {
+      break;
+    }
+
+    char *value = strchr(line, ':');
+    if (value == NULL) {
+      continue;
+    }
+    *value++ = '\0';
+    while (*value == ' ' || *value == '\t') {
+      value++;
+    }
+    if (strcasecmp(line, "Content-Length") == 0) {
+      request->size = strtoll(value, NULL, 10);
+    } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+      request->chunked = strcasecmp(value, "chunked") == 0;
+    } else if (strcasecmp(line, "Connection") == 0) {
+      if (strcasecmp(value, "close") == 0) {
+        request->keep_alive = FALSE;
+      } else if (strcasecmp(value, "keep-alive") == 0) {
+        request->keep_alive = TRUE;
+      }
+    } else if (strcasecmp(line, "Location") == 0) {
+      request->location = tk_strdup(value);
+    }
+  }
+
+  if (request->chunked) {
+    request->size = -1;
+  } else if (request->status == 204 || request->status == 304) {
+    request->size = 0;
+  } else if (request->size < 0) {
+    // The body runs to the end of the connection, which cannot be kept.
+    request->keep_alive = FALSE;
+  }
+  request->remaining = request->size;
+  request->done = request->size == 0;
+
+  return 0;
+}
+
+/*
+ * Send the request on a kept connection to host:port if there is one, or a
+ * new one, and read the response head. The server may have closed a kept
+ * connection meanwhile: if it fails before answering, the request goes out
+ * once more on a new connection.
+ */
+static int http_pool_request(http_pool_t *pool, http_request_t *request,
+                             const char *host, int port, const char *path,
+                             int64_t offset, int64_t length) {
+  request->conn = http_pool_take(pool, host, port);
+  bool_t reused = request->conn != NULL;
+
+  for (;;) {
+    if (request->conn == NULL) {
+      int ret = http_pool_connect(pool, request, host, port, &request->conn);
+      if (ret < 0) {
+        return ret;
+      }
+    }
+
+    int64_t received = request->bytes_read;
+    int ret = http_request_send_head(request, host, port, path, offset, length);
+    if (ret == 0) {
+      ret = http_request_read_head(request);
+    }
+    if (ret == 0) {
+      pthread_mutex_lock(&pool->mutex);
+      pool->stats.requests++;
+      if (reused) {
+        pool->stats.reused++;
+      }
+      pthread_mutex_unlock(&pool->mutex);
+      return 0;
+    }
+
+    http_conn_close(request->conn);
+    request->conn = NULL;
+    if (!reused || ret == AVERROR_EXIT || request->bytes_read != received) {
+      return ret;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    pool->stats.stale++;
+    pthread_mutex_unlock(&pool->mutex);
+    reused = FALSE;
+  }
+}
+
+/* Done with the response: keep the connection if it can take another. */
+static void http_request_end(http_request_t *request) {
+  http_conn_t *conn = request->conn;
+  if (conn == NULL) {
+    return;
+  }
+
+  request->conn = NULL;
+  if (request->done && request->keep_alive && !request->failed &&
+      conn->pos == conn->len) {
+    http_pool_put(request->pool, conn);
+  } else {
+    http_conn_close(conn);
+  }
+}
+
+/* Read and drop bytes of the body; RET_OK once they are all gone. */
+static ret_t http_request_skip(http_request_t *request, int64_t bytes) {
+  uint8_t scratch[4096];
+
+  while (bytes > 0) {
+    int n = http_request_read(request, scratch, (int)tk_min(bytes, (int64_t)sizeof(scratch)));
+    if (n <= 0) {
+      return RET_FAIL;
+    }
+    bytes -= n;
+  }
+
+  return RET_OK;
+}
+
+http_pool_t *http_pool_create(uint32_t max_idle, double keep_alive, double dns_ttl) {
+  http_pool_t *pool = (http_pool_t *)calloc(1, sizeof(http_pool_t));
+  return_value_if_fail(pool != NULL, NULL);
+
+  pool->max_idle = max_idle > 0 ? max_idle : HTTP_POOL_MAX_IDLE;
+  pool->keep_alive_us =
+      keep_alive > 0 ? (int64_t)(keep_alive * 1000000) : HTTP_POOL_KEEP_ALIVE_US;
+  pool->dns_ttl_us = dns_ttl > 0 ? (int64_t)(dns_ttl * 1000000) : HTTP_POOL_DNS_TTL_US;
+  pthread_mutex_init(&pool->mutex, NULL);
+
+  return pool;
+}
+
+ret_t http_pool_destroy(http_pool_t *pool) {
+  return_value_if_fail(pool != NULL, RET_BAD_PARAMS);
+
+  while (pool->idle != NULL) {
+    http_conn_t *next = pool->idle->next;
+    http_conn_close(pool->idle);
+    pool->idle = next;
+  }
+  while (pool->dns != NULL) {
+    http_dns_entry_t *next = pool->dns->next;
+    free(pool->dns);
+    pool->dns = next;
+  }
+  log_debug("http: %u requests, %u on kept connections, %u connects\n",
+            pool->stats.requests, pool->stats.reused, pool->stats.connects);
+  pthread_mutex_destroy(&pool->mutex);
+  free(pool);
+
+  return RET_OK;
+}
+
+bool_t http_pool_supports(const char *url) {
+  return url != NULL && strncasecmp(url, "http://", 7) == 0;
+}
+
+ret_t http_pool_open(http_pool_t *pool, const char *url, int64_t offset,
+                     int64_t length, const AVIOInterruptCB *int_cb,
+                     http_request_t **out) {
+  char proto[16];
+  char host[HTTP_POOL_MAX_HOST];
+  char path[HTTP_POOL_MAX_LINE];
+  ret_t ret = RET_FAIL;
+  return_value_if_fail(pool != NULL && url != NULL && out != NULL, RET_BAD_PARAMS);
+
+  *out = NULL;
+  http_request_t *request = (http_request_t *)calloc(1, sizeof(http_request_t));
+  return_value_if_fail(request != NULL, RET_OOM);
+  request->pool = pool;
+  if (int_cb != NULL) {
+    request->int_cb = *int_cb;
+  }
+
+  char *target = tk_strdup(url);
+  for (uint32_t redirects = 0; target != NULL; redirects++) {
+    int port = -1;
+
+    av_url_split(proto, sizeof(proto), NULL, 0, host, sizeof(host), &port, path,
+                 sizeof(path), target);
+    if (strcasecmp(proto, "http") != 0 || host[0] == '\0') {
+      // Redirected to https: the caller goes through FFmpeg instead.
+      ret = RET_NOT_IMPL;
+      break;
+    }
+    if (redirects > HTTP_POOL_MAX_REDIRECTS) {
+      log_error("http: too many redirects for %s\n", url);
+      break;
+    }
+    if (port < 0) {
+      port = 80;
+    }
+    if (path[0] == '\0') {
+      snprintf(path, sizeof(path), "/");
+    }
+
+    int err = http_pool_request(pool, request, host, port, path, offset, length);
+    if (err < 0) {
+      ret = err == AVERROR_EXIT ? RET_QUIT : RET_FAIL;
+      break;
+    }
+
+    if (request->status >= 300 && request->status < 400 && request->location != NULL) {
+      char *next = m3u8_resolve_url(target, request->location);
+      // A short body is read out so the connection can carry the next request.
+      if (request->remaining >= 0 && request->remaining <= HTTP_POOL_BUFFER_SIZE) {
+        http_request_skip(request, request->remaining);
+      }
+      http_request_end(request);
+      free(target);
+      target = next;
+      continue;
+    }
+    if (request->status < 200 || request->status >= 300) {
+      log_error("http: %s: HTTP %d\n", target, request->status);
+      break;
+    }
+
+    // A server that ignores Range sends the whole resource.
+    if ((offset > 0 || length >= 0) && request->status != 206) {
+      if (offset > 0 && http_request_skip(request, offset) != RET_OK) {
+        break;
+      }
+      request->size = request->remaining;
+      if (length >= 0 && (request->remaining < 0 || request->remaining > length)) {
+        // The rest of the body stays unread, so the connection cannot be kept.
+        request->keep_alive = FALSE;
+        request->size = request->remaining < 0 ? -1 : length;
+        request->remaining = length;
+        request->done = length == 0;
+      }
+    }
+    ret = RET_OK;
+    break;
+  }
+  free(target);
+
+  if (ret != RET_OK) {
+    http_request_close(request);
+    return ret;
+  }
+  *out = request;
+
+  return RET_OK;
+}
+
+int64_t http_request_get_size(http_request_t *request) {
+  return_value_if_fail(request != NULL, -1);
+  return request->size;
+}
+
+int64_t http_request_get_bytes_read(http_request_t *request) {
+  return_value_if_fail(request != NULL, 0);
+  return request->bytes_read;
+}
+
+int http_request_read(http_request_t *request, uint8_t *buf, int size) {
+  char line[64];
+  int ret = 0;
+  return_value_if_fail(request != NULL && buf != NULL && size > 0, AVERROR(EINVAL));
+
+  if (request->done) {
+    return 0;
+  }
+  if (request->failed || request->conn == NULL) {
+    return AVERROR(EIO);
+  }
+
+  int64_t want = size;
+  if (request->chunked) {
+    if (request->chunk_left == 0) {
+      // The CRLF after the data of the last chunk read.
+      ret = http_request_read_line(request, line, sizeof(line));
+      if (ret < 0) {
+        return http_request_fail(request, ret);
+      }
+      request->chunk_left = -1;
+    }
+    if (request->chunk_left < 0) {
+      ret = http_request_read_line(request, line, sizeof(line));
+      if (ret < 0) {
+        return http_request_fail(request, ret);
+      }
+      request->chunk_left = strtoll(line, NULL, 16);
+      if (request->chunk_left <= 0) {
+        // The last chunk: skip the trailers up to the empty line.
+        do {
+          ret = http_request_read_line(request, line, sizeof(line));
+          if (ret < 0) {
+            return http_request_fail(request, ret);
+          }
+        } while (line[0] != '\0');
+        request->done = TRUE;
+        return 0;
+      }
+    }
+    want = tk_min(want, request->chunk_left);
+  }
+  // Also bounds a chunked body to the range a server ignored.
+  if (request->remaining >= 0) {
+    want = tk_min(want, request->remaining);
+  }
+
+  ret = http_request_fill(request);
+  if (ret == AVERROR_EOF && !request->chunked && request->remaining < 0) {
+    request->done = TRUE;
+    return 0;
+  }
+  if (ret < 0) {
+    return http_request_fail(request, ret == AVERROR_EOF ? AVERROR(EIO) : ret);
+  }
+
+  http_conn_t *conn = request->conn;
+  int n = (int)tk_min(want, (int64_t)(conn->len - conn->pos));
+  memcpy(buf, conn->buf + conn->pos, n);
+  conn->pos += n;
+  if (request->chunked) {
+    request->chunk_left -= n;
+  }
+  if (request->remaining >= 0) {
+    request->remaining -= n;
+    request->done = request->remaining == 0;
+  }
+
+  return n;
+}
+
+ret_t http_request_close(http_request_t *request) {
+  return_value_if_fail(request != NULL, RET_BAD_PARAMS);
+
+  http_request_end(request);
+  free(request->location);
+  free(request);
+
+  return RET_OK;
+}
+
+ret_t http_pool_get_stats(http_pool_t *pool, http_pool_stats_t *stats) {
+  return_value_if_fail(pool != NULL && stats != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&pool->mutex);
+  *stats = pool->stats;
+  stats->idle = pool->nr_idle;
+  if (pool->stats.connects > 0) {
+    stats->handshake_avg = pool->handshake_total / pool->stats.connects;
+  } else {
+    stats->handshake_last = -1;
+    stats->handshake_avg = -1;
+    stats->handshake_max = -1;
+  }
+  stats->dns_avg = pool->dns_misses > 0 ? pool->dns_total / pool->dns_misses : -1;
+  pthread_mutex_unlock(&pool->mutex);
+
+  return RET_OK;
+}
@@ -0,0 +1,72 @@
+#ifndef HTTP_POOL_H
+#define HTTP_POOL_H
+
+#include "tkc.h"
+#include <libavformat/avio.h>
+
+BEGIN_C_DECLS
+
+/*
+ * Keep-alive HTTP/1.1 client for the playlist engine. A connection whose
+ * response was read to the end is kept, per host and port, and the next
+ * request to that host goes out on it instead of paying for a new TCP
+ * handshake; host names are resolved once per TTL rather than per request.
+ * Only plain http:// is handled (http_pool_supports); https:// stays with
+ * FFmpeg's protocols. Thread-safe: one pool can serve many sources.
+ */
+typedef struct _http_pool_t http_pool_t;
+typedef struct _http_request_t http_request_t;
+
+/* Counters over the pool's lifetime; times in milliseconds, -1 before any */
+typedef struct _http_pool_stats_t {
+  uint32_t requests;
+  /* Requests sent on a connection kept from an earlier one */
+  uint32_t reused;
+  /* Kept connections the server had closed meanwhile, replaced by new ones */
+  uint32_t stale;
+  /* New connections, and the time to establish them */
+  uint32_t connects;
+  double handshake_last;
+  double handshake_avg;
+  double handshake_max;
+  /* Host name lookups, the ones answered from the cache, and their time */
+  uint32_t lookups;
+  uint32_t dns_hits;
+  double dns_avg;
+  /* Connections idle in the pool now */
+  uint32_t idle;
+} http_pool_stats_t;
+
+/*
+ * Keep up to max_idle idle connections for keep_alive seconds each, and
+ * host names for dns_ttl seconds. 0 picks the defaults (8, 30 s, 60 s).
+ */
+http_pool_t *http_pool_create(uint32_t max_idle, double keep_alive, double dns_ttl);
+/* Requests still open on the pool must be closed first. */
+ret_t http_pool_destroy(http_pool_t *pool);
+
+/* True if url can go through a pool */
+bool_t http_pool_supports(const char *url);
+
+/*
+ * GET url, or length bytes of it from offset when length >= 0, following
+ * redirects. Fails unless the answer is 2xx. int_cb, if given, is polled
+ * while connecting and waiting for the server, so the caller can abort.
+ */
+ret_t http_pool_open(http_pool_t *pool, const char *url, int64_t offset,
+                     int64_t length, const AVIOInterruptCB *int_cb,
+                     http_request_t **request);
+/* Size of the body, -1 if the server did not say */
+int64_t http_request_get_size(http_request_t *request);
+/* Bytes received on the connection for this request, headers included */
+int64_t http_request_get_bytes_read(http_request_t *request);
+/* Up to size bytes of the body; 0 at its end, an AVERROR code on failure */
+int http_request_read(http_request_t *request, uint8_t *buf, int size);
+/* The connection goes back to the pool if the body was read to its end. */
+ret_t http_request_close(http_request_t *request);
+
+ret_t http_pool_get_stats(http_pool_t *pool, http_pool_stats_t *stats);
+
+END_C_DECLS
+
+#endif /* HTTP_POOL_H */
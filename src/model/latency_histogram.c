@@ -0,0 +1,87 @@
+#include "latency_histogram.h"
+#include <string.h>
+
+static uint32_t latency_histogram_bucket(uint64_t us) {
+  uint32_t bucket = us == 0 ? 0 : 64 - __builtin_clzll(us);
+  return tk_min(bucket, LATENCY_HISTOGRAM_BUCKETS - 1);
+}
+
+void latency_histogram_record(latency_histogram_t *hist, int64_t us) {
+  return_if_fail(hist != NULL);
+
+  uint64_t v = us > 0 ? (uint64_t)us : 0;
+  __atomic_fetch_add(&hist->buckets[latency_histogram_bucket(v)], 1,
+                     __ATOMIC_RELAXED);
+  __atomic_fetch_add(&hist->sum, v, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+
+  uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+  while (v > max && !__atomic_compare_exchange_n(&hist->max, &max, v, TRUE,
+                                                 __ATOMIC_RELAXED,
+                                                 __ATOMIC_RELAXED)) {
+  }
+}
+
+void latency_histogram_reset(latency_histogram_t *hist) {
+  return_if_fail(hist != NULL);
+
+  for (uint32_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+    __atomic_store_n(&hist->buckets[i], 0, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&hist->sum, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&hist->count, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&hist->max, 0, __ATOMIC_RELAXED);
+}
+
+/* Value in us below which a fraction q of the samples fall. */
+static double latency_histogram_quantile(const uint64_t *buckets, uint64_t total,
+                                         double q, double max) {
+  double rank = q * total;
+  uint64_t seen = 0;
+
+  for (uint32_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+    if (buckets[i] == 0 || seen + buckets[i] < rank) {
+      seen += buckets[i];
+      continue;
+    }
+    if (i == 0) {
+      return 0;
+    }
+    double lo = (double)(1ULL << (i - 1));
+    // The top bucket is open-ended, and none reaches beyond the largest sample.
+    double hi = i + 1 < LATENCY_HISTOGRAM_BUCKETS ? tk_min(lo * 2, max) : max;
+    return lo + (hi - lo) * (rank - seen) / buckets[i];
+  }
+
+  return max;
+}
+
+ret_t latency_histogram_get_stats(latency_histogram_t *hist,
+                                  latency_histogram_stats_t *stats) {
+  uint64_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+  uint64_t total = 0;
+  return_value_if_fail(hist != NULL && stats != NULL, RET_BAD_PARAMS);
+
+  memset(stats, 0x00, sizeof(*stats));
+  // Percentiles come from the buckets read here, not the separate count.
+  for (uint32_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+    buckets[i] = __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+    total += buckets[i];
+  }
+  if (total == 0) {
+    return RET_OK;
+  }
+
+  uint64_t count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+  uint64_t sum = __atomic_load_n(&hist->sum, __ATOMIC_RELAXED);
+  double max = (double)__atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+
+  stats->count = count;
+  stats->avg = count > 0 ? sum / 1000.0 / count : 0;
+  stats->p50 = latency_histogram_quantile(buckets, total, 0.50, max) / 1000.0;
+  stats->p95 = latency_histogram_quantile(buckets, total, 0.95, max) / 1000.0;
+  stats->p99 = latency_histogram_quantile(buckets, total, 0.99, max) / 1000.0;
+  stats->max = max / 1000.0;
+
+  return RET_OK;
+}
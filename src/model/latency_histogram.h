@@ -0,0 +1,40 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include "tkc/types_def.h"
+
+BEGIN_C_DECLS
+
+/* Bucket i > 0 counts samples of [2^(i-1), 2^i) us; the last one everything above */
+#define LATENCY_HISTOGRAM_BUCKETS 28
+
+/*
+ * Log2-bucketed histogram of durations in microseconds. Recording is a few
+ * relaxed atomic adds, so any thread may record and read without a lock;
+ * a reader racing writers sees a snapshot a sample or two out of date.
+ */
+typedef struct _latency_histogram_t {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+} latency_histogram_t;
+
+/* In milliseconds; percentiles are interpolated within their bucket */
+typedef struct _latency_histogram_stats_t {
+  uint64_t count;
+  double avg;
+  double p50;
+  double p95;
+  double p99;
+  double max;
+} latency_histogram_stats_t;
+
+void latency_histogram_record(latency_histogram_t *hist, int64_t us);
+void latency_histogram_reset(latency_histogram_t *hist);
+ret_t latency_histogram_get_stats(latency_histogram_t *hist,
+                                  latency_histogram_stats_t *stats);
+
+END_C_DECLS
+
+#endif /* LATENCY_HISTOGRAM_H */
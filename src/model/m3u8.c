@@ -0,0 +1,462 @@
+#include "m3u8.h"
+#include "tkc/log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char *m3u8_strndup(const char *str, size_t len) {
+  char *copy = (char *)malloc(len + 1);
+  if (copy != NULL) {
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+  }
+  return copy;
+}
+
+static bool_t m3u8_starts_with(const char *line, const char *prefix) {
+  return strncmp(line, prefix, strlen(prefix)) == 0;
+}
+
+/*
+ * Find attribute name in an attribute list (NAME=value,NAME="quoted value",
+ * ...): its value, without the quotes, is the len bytes at *value.
+ */
+static bool_t m3u8_find_attr(const char *attrs, const char *name,
+                             const char **value, size_t *len) {
+  size_t name_len = strlen(name);
+  const char *p = attrs;
+
+  while (*p) {
+    const char *eq = strchr(p, '=');
+    if (eq == NULL) {
+      break;
+    }
+
+    const char *v = eq + 1;
+    const char *end;
+    if (*v == '"') {
+      v++;
+      end = strchr(v, '"');
+      if (end == NULL) {
+        end = v + strlen(v);
+      }
+    } else {
+      end = v + strcspn(v, ",");
+    }
+
+    if ((size_t)(eq - p) == name_len && strncmp(p, name, name_len) == 0) {
+      *value = v;
+      *len = end - v;
+      return TRUE;
+    }
+
+    p = end;
+    if (*p == '"') {
+      p++;
+    }
+    if (*p == ',') {
+      p++;
+    }
+  }
+
+  return FALSE;
+}
+
+/*
+ * Copy the value of attribute name into value, cut to fit: for the numbers
+ * and enumerated strings, whose length is bounded.
+ */
+static bool_t m3u8_get_attr(const char *attrs, const char *name, char *value,
+                            size_t size) {
+  const char *v;
+  size_t len;
+
+  if (!m3u8_find_attr(attrs, name, &v, &len)) {
+    return FALSE;
+  }
+  len = tk_min(len, size - 1);
+  memcpy(value, v, len);
+  value[len] = '\0';
+
+  return TRUE;
+}
+
+/* The value of attribute name as a new string, NULL if absent or on OOM */
+static char *m3u8_dup_attr(const char *attrs, const char *name) {
+  const char *v;
+  size_t len;
+
+  return m3u8_find_attr(attrs, name, &v, &len) ? m3u8_strndup(v, len) : NULL;
+}
+
+/* "<length>[@<offset>]"; without an offset the range follows the previous one */
+static void m3u8_parse_byterange(const char *str, int64_t next_offset,
+                                 int64_t *offset, int64_t *length) {
+  const char *at = strchr(str, '@');
+  *length = strtoll(str, NULL, 10);
+  *offset = at != NULL ? strtoll(at + 1, NULL, 10) : next_offset;
+}
+
+static void *m3u8_grow(void *array, uint32_t count, size_t item_size) {
+  // Capacity doubles at powers of two, so it is implied by count.
+  if (count == 0 || (count & (count - 1)) == 0) {
+    uint32_t capacity = count == 0 ? 8 : count * 2;
+    return realloc(array, capacity * item_size);
+  }
+  return array;
+}
+
+static void m3u8_parts_free(m3u8_part_t *parts, uint32_t nr_parts) {
+  for (uint32_t i = 0; i < nr_parts; i++) {
+    free(parts[i].uri);
+  }
+  free(parts);
+}
+
+/* EXT-X-PART attributes; returns RET_FAIL without a URI */
+static ret_t m3u8_parse_part(const char *attrs, const char *base_url,
+                             int64_t next_offset, m3u8_part_t *part) {
+  char attr[256];
+
+  memset(part, 0x00, sizeof(*part));
+  part->length = -1;
+  char *uri = m3u8_dup_attr(attrs, "URI");
+  if (uri == NULL) {
+    return RET_FAIL;
+  }
+  part->uri = m3u8_resolve_url(base_url, uri);
+  free(uri);
+  return_value_if_fail(part->uri != NULL, RET_OOM);
+
+  if (m3u8_get_attr(attrs, "DURATION", attr, sizeof(attr))) {
+    part->duration = atof(attr);
+  }
+  if (m3u8_get_attr(attrs, "INDEPENDENT", attr, sizeof(attr))) {
+    part->independent = strcmp(attr, "YES") == 0;
+  }
+  if (m3u8_get_attr(attrs, "BYTERANGE", attr, sizeof(attr))) {
+    m3u8_parse_byterange(attr, next_offset, &part->offset, &part->length);
+  }
+
+  return RET_OK;
+}
+
+ret_t m3u8_playlist_init(m3u8_playlist_t *pl) {
+  return_value_if_fail(pl != NULL, RET_BAD_PARAMS);
+
+  memset(pl, 0x00, sizeof(*pl));
+  pl->map_length = -1;
+  pl->preload_hint.length = -1;
+
+  return RET_OK;
+}
+
+ret_t m3u8_playlist_deinit(m3u8_playlist_t *pl) {
+  return_value_if_fail(pl != NULL, RET_BAD_PARAMS);
+
+  for (uint32_t i = 0; i < pl->nr_variants; i++) {
+    free(pl->variants[i].uri);
+    free(pl->variants[i].codecs);
+  }
+  for (uint32_t i = 0; i < pl->nr_segments; i++) {
+    free(pl->segments[i].uri);
+    m3u8_parts_free(pl->segments[i].parts, pl->segments[i].nr_parts);
+  }
+  free(pl->variants);
+  free(pl->segments);
+  free(pl->map_uri);
+  m3u8_parts_free(pl->parts, pl->nr_parts);
+  free(pl->preload_hint.uri);
+
+  return m3u8_playlist_init(pl);
+}
+
+ret_t m3u8_playlist_parse(m3u8_playlist_t *pl, const char *text,
+                          const char *base_url) {
+  char attr[256];
+  const char *p = text;
+  bool_t first = TRUE;
+  bool_t stream_inf = FALSE;
+  m3u8_variant_t variant;
+  double duration = 0;
+  bool_t discontinuity = FALSE;
+  int64_t range_offset = 0;
+  int64_t range_length = -1;
+  int64_t next_offset = 0;
+  /* Parts seen since the last segment URI */
+  m3u8_part_t *parts = NULL;
+  uint32_t nr_parts = 0;
+  int64_t next_part_offset = 0;
+
+  return_value_if_fail(pl != NULL && text != NULL && base_url != NULL,
+                       RET_BAD_PARAMS);
+  memset(&variant, 0x00, sizeof(variant));
+
+  while (*p) {
+    size_t len = strcspn(p, "\r\n");
+    char *line = m3u8_strndup(p, len);
+    return_value_if_fail(line != NULL, RET_OOM);
+    p += len;
+    p += strspn(p, "\r\n");
+
+    if (first) {
+      first = FALSE;
+      if (!m3u8_starts_with(line, "#EXTM3U")) {
+        log_error("m3u8: missing #EXTM3U header\n");
+        free(line);
+        return RET_FAIL;
+      }
+    } else if (m3u8_starts_with(line, "#EXT-X-PART-INF:")) {
+      if (m3u8_get_attr(line + strlen("#EXT-X-PART-INF:"), "PART-TARGET", attr,
+                        sizeof(attr))) {
+        pl->part_target = atof(attr);
+      }
+    } else if (m3u8_starts_with(line, "#EXT-X-PART:")) {
+      m3u8_part_t part;
+      ret_t ret = m3u8_parse_part(line + strlen("#EXT-X-PART:"), base_url,
+                                  next_part_offset, &part);
+      if (ret == RET_OK) {
+        m3u8_part_t *items =
+            (m3u8_part_t *)m3u8_grow(parts, nr_parts, sizeof(m3u8_part_t));
+        if (items == NULL) {
+          free(part.uri);
+          ret = RET_OOM;
+        } else {
+          parts = items;
+          parts[nr_parts++] = part;
+          next_part_offset = part.length >= 0 ? part.offset + part.length : 0;
+        }
+      }
+      if (ret == RET_OOM) {
+        m3u8_parts_free(parts, nr_parts);
+        free(variant.codecs);
+        free(line);
+        return RET_OOM;
+      }
+    } else if (m3u8_starts_with(line, "#EXT-X-PRELOAD-HINT:")) {
+      const char *attrs = line + strlen("#EXT-X-PRELOAD-HINT:");
+      char *uri = NULL;
+      if (m3u8_get_attr(attrs, "TYPE", attr, sizeof(attr)) &&
+          strcmp(attr, "PART") == 0 &&
+          (uri = m3u8_dup_attr(attrs, "URI")) != NULL) {
+        free(pl->preload_hint.uri);
+        pl->preload_hint.uri = m3u8_resolve_url(base_url, uri);
+        free(uri);
+        pl->preload_hint.offset = 0;
+        pl->preload_hint.length = -1;
+        if (m3u8_get_attr(attrs, "BYTERANGE-START", attr, sizeof(attr))) {
+          pl->preload_hint.offset = strtoll(attr, NULL, 10);
+        }
+        if (m3u8_get_attr(attrs, "BYTERANGE-LENGTH", attr, sizeof(attr))) {
+          pl->preload_hint.length = strtoll(attr, NULL, 10);
+        }
+      }
+    } else if (m3u8_starts_with(line, "#EXT-X-SERVER-CONTROL:")) {
+      const char *attrs = line + strlen("#EXT-X-SERVER-CONTROL:");
+      if (m3u8_get_attr(attrs, "CAN-BLOCK-RELOAD", attr, sizeof(attr))) {
+        pl->can_block_reload = strcmp(attr, "YES") == 0;
+      }
+      if (m3u8_get_attr(attrs, "PART-HOLD-BACK", attr, sizeof(attr))) {
+        pl->part_hold_back = atof(attr);
+      }
+      if (m3u8_get_attr(attrs, "HOLD-BACK", attr, sizeof(attr))) {
+        pl->hold_back = atof(attr);
+      }
+    } else if (m3u8_starts_with(line, "#EXT-X-STREAM-INF:")) {
+      const char *attrs = line + strlen("#EXT-X-STREAM-INF:");
+      free(variant.codecs);
+      memset(&variant, 0x00, sizeof(variant));
+      stream_inf = TRUE;
+      if (m3u8_get_attr(attrs, "BANDWIDTH", attr, sizeof(attr))) {
+        variant.bandwidth = (uint32_t)strtoul(attr, NULL, 10);
+      }
+      if (m3u8_get_attr(attrs, "RESOLUTION", attr, sizeof(attr))) {
+        char *x = strchr(attr, 'x');
+        variant.width = atoi(attr);
+        variant.height = x != NULL ? atoi(x + 1) : 0;
+      }
+      variant.codecs = m3u8_dup_attr(attrs, "CODECS");
+    } else if (m3u8_starts_with(line, "#EXT-X-TARGETDURATION:")) {
+      pl->target_duration = atof(line + strlen("#EXT-X-TARGETDURATION:"));
+    } else if (m3u8_starts_with(line, "#EXT-X-MEDIA-SEQUENCE:")) {
+      pl->media_sequence = strtoll(line + strlen("#EXT-X-MEDIA-SEQUENCE:"), NULL, 10);
+    } else if (m3u8_starts_with(line, "#EXT-X-ENDLIST")) {
+      pl->endlist = TRUE;
+    } else if (m3u8_starts_with(line, "#EXTINF:")) {
+      duration = atof(line + strlen("#EXTINF:"));
+    } else if (m3u8_starts_with(line, "#EXT-X-BYTERANGE:")) {
+      m3u8_parse_byterange(line + strlen("#EXT-X-BYTERANGE:"), next_offset,
+                           &range_offset, &range_length);
+    } else if (m3u8_starts_with(line, "#EXT-X-DISCONTINUITY")) {
+      discontinuity = TRUE;
+    } else if (m3u8_starts_with(line, "#EXT-X-KEY:")) {
+      if (m3u8_get_attr(line + strlen("#EXT-X-KEY:"), "METHOD", attr, sizeof(attr))) {
+        pl->encrypted = strcmp(attr, "NONE") != 0;
+      }
+    } else if (m3u8_starts_with(line, "#EXT-X-MAP:")) {
+      const char *attrs = line + strlen("#EXT-X-MAP:");
+      char *uri = m3u8_dup_attr(attrs, "URI");
+      if (uri != NULL) {
+        free(pl->map_uri);
+        pl->map_uri = m3u8_resolve_url(base_url, uri);
+        free(uri);
+        pl->map_offset = 0;
+        pl->map_length = -1;
+        if (m3u8_get_attr(attrs, "BYTERANGE", attr, sizeof(attr))) {
+          m3u8_parse_byterange(attr, 0, &pl->map_offset, &pl->map_length);
+        }
+      }
+    } else if (line[0] != '#' && line[0] != '\0') {
+      char *uri = m3u8_resolve_url(base_url, line);
+      if (uri == NULL) {
+        free(line);
+        return RET_OOM;
+      }
+
+      void *items = stream_inf
+                        ? m3u8_grow(pl->variants, pl->nr_variants, sizeof(m3u8_variant_t))
+                        : m3u8_grow(pl->segments, pl->nr_segments, sizeof(m3u8_segment_t));
+      if (items == NULL) {
+        free(uri);
+        free(line);
+        free(variant.codecs);
+        m3u8_parts_free(parts, nr_parts);
+        return RET_OOM;
+      }
+
+      if (stream_inf) {
+        pl->is_master = TRUE;
+        pl->variants = (m3u8_variant_t *)items;
+        variant.uri = uri;
+        pl->variants[pl->nr_variants++] = variant;
+        memset(&variant, 0x00, sizeof(variant));
+        stream_inf = FALSE;
+      } else {
+        pl->segments = (m3u8_segment_t *)items;
+        m3u8_segment_t *seg = pl->segments + pl->nr_segments++;
+        seg->uri = uri;
+        seg->duration = duration;
+        seg->offset = range_length >= 0 ? range_offset : 0;
+        seg->length = range_length;
+        seg->discontinuity = discontinuity;
+        seg->parts = parts;
+        seg->nr_parts = nr_parts;
+        parts = NULL;
+        nr_parts = 0;
+        next_part_offset = 0;
+        next_offset = range_length >= 0 ? range_offset + range_length : 0;
+        duration = 0;
+        discontinuity = FALSE;
+        range_length = -1;
+      }
+    }
+
+    free(line);
+  }
+
+  free(variant.codecs);
+  m3u8_parts_free(pl->parts, pl->nr_parts);
+  pl->parts = parts;
+  pl->nr_parts = nr_parts;
+  return first ? RET_FAIL : RET_OK;
+}
+
+const m3u8_segment_t *m3u8_playlist_find(const m3u8_playlist_t *pl, int64_t seq) {
+  return_value_if_fail(pl != NULL, NULL);
+
+  if (seq < pl->media_sequence || seq >= pl->media_sequence + pl->nr_segments) {
+    return NULL;
+  }
+  return pl->segments + (seq - pl->media_sequence);
+}
+
+const m3u8_part_t *m3u8_playlist_get_parts(const m3u8_playlist_t *pl, int64_t seq,
+                                           uint32_t *nr_parts, bool_t *complete) {
+  return_value_if_fail(pl != NULL && nr_parts != NULL && complete != NULL, NULL);
+
+  const m3u8_segment_t *seg = m3u8_playlist_find(pl, seq);
+  if (seg != NULL) {
+    *nr_parts = seg->nr_parts;
+    *complete = TRUE;
+    return seg->parts;
+  }
+
+  *nr_parts = 0;
+  *complete = FALSE;
+  if (seq == pl->media_sequence + pl->nr_segments) {
+    *nr_parts = pl->nr_parts;
+    return pl->parts;
+  }
+  return NULL;
+}
+
+double m3u8_playlist_get_duration(const m3u8_playlist_t *pl) {
+  double duration = 0;
+  return_value_if_fail(pl != NULL, 0);
+
+  for (uint32_t i = 0; i < pl->nr_segments; i++) {
+    duration += pl->segments[i].duration;
+  }
+  return duration;
+}
+
+char *m3u8_resolve_url(const char *base, const char *ref) {
+  return_value_if_fail(base != NULL && ref != NULL, NULL);
+
+  const char *scheme_end = strstr(ref, "://");
+  if (scheme_end != NULL && scheme_end < ref + strcspn(ref, "/?")) {
+    return m3u8_strndup(ref, strlen(ref));
+  }
+
+  size_t prefix;
+  const char *base_scheme = strstr(base, "://");
+  if (ref[0] == '/' && ref[1] == '/') {
+    // Network-path reference: keep only the scheme.
+    prefix = base_scheme != NULL ? (size_t)(base_scheme - base) + 1 : 0;
+  } else if (ref[0] == '/') {
+    // Absolute path: keep scheme and authority.
+    if (base_scheme != NULL) {
+      const char *host = base_scheme + 3;
+      prefix = (size_t)(host - base) + strcspn(host, "/?#");
+    } else {
+      prefix = 0;
+    }
+  } else {
+    // Relative path: keep the base up to its last '/' before any query.
+    size_t path_len = strcspn(base, "?#");
+    prefix = 0;
+    for (size_t i = 0; i < path_len; i++) {
+      if (base[i] == '/') {
+        prefix = i + 1;
+      }
+    }
+    if (base_scheme != NULL && prefix <= (size_t)(base_scheme - base) + 3) {
+      // "http://host" without a path
+      prefix = path_len;
+      char *url = (char *)malloc(prefix + 1 + strlen(ref) + 1);
+      return_value_if_fail(url != NULL, NULL);
+      memcpy(url, base, prefix);
+      url[prefix] = '/';
+      strcpy(url + prefix + 1, ref);
+      return url;
+    }
+  }
+
+  char *url = (char *)malloc(prefix + strlen(ref) + 1);
+  return_value_if_fail(url != NULL, NULL);
+  memcpy(url, base, prefix);
+  strcpy(url + prefix, ref);
+  return url;
+}
+
+char *m3u8_blocking_reload_url(const char *url, int64_t msn, int part) {
+  return_value_if_fail(url != NULL, NULL);
+
+  size_t size = strlen(url) + 64;
+  char *reload = (char *)malloc(size);
+  return_value_if_fail(reload != NULL, NULL);
+  snprintf(reload, size, "%s%c_HLS_msn=%lld&_HLS_part=%d", url,
+           strchr(url, '?') != NULL ? '&' : '?', (long long)msn, part);
+
+  return reload;
+}
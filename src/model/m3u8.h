@@ -0,0 +1,103 @@
+#ifndef M3U8_H
+#define M3U8_H
+
+#include "tkc/types_def.h"
+
+BEGIN_C_DECLS
+
+/*
+ * Parser for HLS (RFC 8216) master and media playlists. All URIs are
+ * resolved against the playlist's own URL when parsed.
+ */
+typedef struct _m3u8_variant_t {
+  char *uri;
+  uint32_t bandwidth;
+  int width;
+  int height;
+  char *codecs;
+} m3u8_variant_t;
+
+/* LL-HLS partial segment (EXT-X-PART), or the EXT-X-PRELOAD-HINT of one */
+typedef struct _m3u8_part_t {
+  char *uri;
+  double duration;
+  /* BYTERANGE; length is -1 for the whole resource */
+  int64_t offset;
+  int64_t length;
+  /* Starts with a keyframe, so playback can begin here */
+  bool_t independent;
+} m3u8_part_t;
+
+typedef struct _m3u8_segment_t {
+  char *uri;
+  double duration;
+  /* EXT-X-BYTERANGE; length is -1 for the whole resource */
+  int64_t offset;
+  int64_t length;
+  bool_t discontinuity;
+  /* Parts the segment was published as, listed near the live edge only */
+  m3u8_part_t *parts;
+  uint32_t nr_parts;
+} m3u8_segment_t;
+
+typedef struct _m3u8_playlist_t {
+  bool_t is_master;
+  m3u8_variant_t *variants;
+  uint32_t nr_variants;
+
+  double target_duration;
+  /* Sequence number of segments[0] */
+  int64_t media_sequence;
+  bool_t endlist;
+  /* EXT-X-KEY with a method other than NONE */
+  bool_t encrypted;
+  /* EXT-X-MAP initialization section, NULL if none */
+  char *map_uri;
+  int64_t map_offset;
+  int64_t map_length;
+  m3u8_segment_t *segments;
+  uint32_t nr_segments;
+
+  /* LL-HLS: EXT-X-PART-INF and EXT-X-SERVER-CONTROL, 0 when absent */
+  double part_target;
+  double part_hold_back;
+  double hold_back;
+  bool_t can_block_reload;
+  /* Parts of segment media_sequence + nr_segments, still being written */
+  m3u8_part_t *parts;
+  uint32_t nr_parts;
+  /* The part after the last one listed, uri NULL without a hint */
+  m3u8_part_t preload_hint;
+} m3u8_playlist_t;
+
+ret_t m3u8_playlist_init(m3u8_playlist_t *pl);
+ret_t m3u8_playlist_deinit(m3u8_playlist_t *pl);
+
+/* Parse NUL-terminated text into an initialized, empty playlist. */
+ret_t m3u8_playlist_parse(m3u8_playlist_t *pl, const char *text,
+                          const char *base_url);
+
+/* The segment with sequence number seq, or NULL if not in the playlist. */
+const m3u8_segment_t *m3u8_playlist_find(const m3u8_playlist_t *pl, int64_t seq);
+double m3u8_playlist_get_duration(const m3u8_playlist_t *pl);
+
+/*
+ * Parts listed for segment seq, including the segment still being written.
+ * complete is set when the segment is finished, so no more parts follow.
+ */
+const m3u8_part_t *m3u8_playlist_get_parts(const m3u8_playlist_t *pl, int64_t seq,
+                                           uint32_t *nr_parts, bool_t *complete);
+
+/* Resolve ref against base; the result is allocated with malloc. */
+char *m3u8_resolve_url(const char *base, const char *ref);
+
+/*
+ * url with the delivery directives asking a server that can block reloads
+ * to answer only once part part of segment msn is listed (RFC 8216bis
+ * 6.2.5.2); allocated with malloc.
+ */
+char *m3u8_blocking_reload_url(const char *url, int64_t msn, int part);
+
+END_C_DECLS
+
+#endif /* M3U8_H */
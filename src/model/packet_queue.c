@@ -0,0 +1,244 @@
+#include "packet_queue.h"
+#include "cond_clock.h"
+#include <errno.h>
+#include <stdlib.h>
+
+static void packet_queue_clear_locked(packet_queue_t *q) {
+  while (q->count > 0) {
+    av_packet_unref(q->slots[q->head]);
+    q->head = (q->head + 1) % q->capacity;
+    q->count--;
+  }
+  q->head = 0;
+  q->bytes = 0;
+  q->duration = 0;
+}
+
+static int64_t packet_queue_span_locked(packet_queue_t *q) {
+  if (q->count < 2) {
+    return q->duration;
+  }
+
+  // Fall back to the pts span when the demuxer leaves durations unset.
+  AVPacket *first = q->slots[q->head];
+  AVPacket *last = q->slots[(q->head + q->count - 1) % q->capacity];
+  if (first->pts != AV_NOPTS_VALUE && last->pts != AV_NOPTS_VALUE &&
+      last->pts - first->pts > q->duration) {
+    return last->pts - first->pts;
+  }
+  return q->duration;
+}
+
+ret_t packet_queue_init(packet_queue_t *q, uint32_t capacity, uint32_t max_bytes,
+                        double max_duration) {
+  return_value_if_fail(q != NULL && capacity > 0, RET_BAD_PARAMS);
+
+  memset(q, 0x00, sizeof(*q));
+  q->slots = (AVPacket **)calloc(capacity, sizeof(AVPacket *));
+  return_value_if_fail(q->slots != NULL, RET_OOM);
+
+  for (uint32_t i = 0; i < capacity; i++) {
+    q->slots[i] = av_packet_alloc();
+    if (q->slots[i] == NULL) {
+      q->capacity = i;
+      packet_queue_deinit(q);
+      return RET_OOM;
+    }
+  }
+
+  q->capacity = capacity;
+  q->max_bytes = max_bytes;
+  q->max_duration = max_duration;
+  q->time_base = (AVRational){1, AV_TIME_BASE};
+  pthread_mutex_init(&q->mutex, NULL);
+  cond_clock_init(&q->cond);
+
+  return RET_OK;
+}
+
+ret_t packet_queue_deinit(packet_queue_t *q) {
+  return_value_if_fail(q != NULL, RET_BAD_PARAMS);
+
+  if (q->slots != NULL) {
+    for (uint32_t i = 0; i < q->capacity; i++) {
+      av_packet_free(&q->slots[i]);
+    }
+    free(q->slots);
+    q->slots = NULL;
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->cond);
+  }
+
+  return RET_OK;
+}
+
+ret_t packet_queue_start(packet_queue_t *q, AVRational time_base) {
+  return_value_if_fail(q != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&q->mutex);
+  packet_queue_clear_locked(q);
+  q->time_base = time_base;
+  q->eof = FALSE;
+  q->abort = FALSE;
+  q->discontinuity = FALSE;
+  pthread_mutex_unlock(&q->mutex);
+
+  return RET_OK;
+}
+
+ret_t packet_queue_set_limits(packet_queue_t *q, uint32_t max_bytes,
+                              double max_duration) {
+  return_value_if_fail(q != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&q->mutex);
+  q->max_bytes = max_bytes;
+  q->max_duration = max_duration;
+  pthread_mutex_unlock(&q->mutex);
+
+  return RET_OK;
+}
+
+ret_t packet_queue_put(packet_queue_t *q, AVPacket *pkt) {
+  return_value_if_fail(q != NULL && pkt != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&q->mutex);
+  if (q->abort) {
+    pthread_mutex_unlock(&q->mutex);
+    av_packet_unref(pkt);
+    return RET_QUIT;
+  }
+  if (q->count == q->capacity) {
+    pthread_mutex_unlock(&q->mutex);
+    return RET_BUSY;
+  }
+
+  AVPacket *slot = q->slots[(q->head + q->count) % q->capacity];
+  av_packet_move_ref(slot, pkt);
+  q->count++;
+  q->bytes += slot->size;
+  q->duration += slot->duration;
+  pthread_cond_signal(&q->cond);
+  pthread_mutex_unlock(&q->mutex);
+
+  return RET_OK;
+}
+
+ret_t packet_queue_get(packet_queue_t *q, AVPacket *pkt, uint32_t timeout_ms) {
+  ret_t ret = RET_OK;
+  struct timespec deadline;
+
+  return_value_if_fail(q != NULL && pkt != NULL, RET_BAD_PARAMS);
+
+  cond_clock_deadline(&deadline, timeout_ms);
+
+  pthread_mutex_lock(&q->mutex);
+  for (;;) {
+    if (q->abort) {
+      ret = RET_QUIT;
+      break;
+    }
+    if (q->discontinuity) {
+      q->discontinuity = FALSE;
+      ret = RET_SKIP;
+      break;
+    }
+    if (q->count > 0) {
+      AVPacket *slot = q->slots[q->head];
+      q->head = (q->head + 1) % q->capacity;
+      q->count--;
+      q->bytes -= slot->size;
+      q->duration -= slot->duration;
+      av_packet_move_ref(pkt, slot);
+      ret = RET_OK;
+      break;
+    }
+    if (q->eof) {
+      ret = RET_EOS;
+      break;
+    }
+    if (pthread_cond_timedwait(&q->cond, &q->mutex, &deadline) == ETIMEDOUT) {
+      ret = RET_TIMEOUT;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&q->mutex);
+
+  return ret;
+}
+
+ret_t packet_queue_flush(packet_queue_t *q) {
+  return_value_if_fail(q != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&q->mutex);
+  packet_queue_clear_locked(q);
+  q->eof = FALSE;
+  pthread_mutex_unlock(&q->mutex);
+
+  return RET_OK;
+}
+
+ret_t packet_queue_seek(packet_queue_t *q) {
+  return_value_if_fail(q != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&q->mutex);
+  packet_queue_clear_locked(q);
+  q->eof = FALSE;
+  q->discontinuity = TRUE;
+  pthread_cond_broadcast(&q->cond);
+  pthread_mutex_unlock(&q->mutex);
+
+  return RET_OK;
+}
+
+ret_t packet_queue_set_eof(packet_queue_t *q) {
+  return_value_if_fail(q != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&q->mutex);
+  q->eof = TRUE;
+  pthread_cond_broadcast(&q->cond);
+  pthread_mutex_unlock(&q->mutex);
+
+  return RET_OK;
+}
+
+ret_t packet_queue_abort(packet_queue_t *q) {
+  return_value_if_fail(q != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&q->mutex);
+  q->abort = TRUE;
+  pthread_cond_broadcast(&q->cond);
+  pthread_mutex_unlock(&q->mutex);
+
+  return RET_OK;
+}
+
+bool_t packet_queue_is_full(packet_queue_t *q) {
+  bool_t full = FALSE;
+  return_value_if_fail(q != NULL, FALSE);
+
+  pthread_mutex_lock(&q->mutex);
+  if (q->count == q->capacity) {
+    full = TRUE;
+  } else if (q->max_bytes > 0 && q->bytes >= q->max_bytes) {
+    full = TRUE;
+  } else if (q->max_duration > 0 &&
+             packet_queue_span_locked(q) * av_q2d(q->time_base) >=
+                 q->max_duration) {
+    full = TRUE;
+  }
+  pthread_mutex_unlock(&q->mutex);
+
+  return full;
+}
+
+ret_t packet_queue_get_stats(packet_queue_t *q, packet_queue_stats_t *stats) {
+  return_value_if_fail(q != NULL && stats != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&q->mutex);
+  stats->packets = q->count;
+  stats->bytes = q->bytes;
+  stats->duration = packet_queue_span_locked(q) * av_q2d(q->time_base);
+  pthread_mutex_unlock(&q->mutex);
+
+  return RET_OK;
+}
@@ -0,0 +1,75 @@
+#ifndef PACKET_QUEUE_H
+#define PACKET_QUEUE_H
+
+#include "tkc/types_def.h"
+#include <libavcodec/avcodec.h>
+#include <pthread.h>
+
+BEGIN_C_DECLS
+
+/*
+ * Bounded FIFO of compressed packets between the demux thread and one
+ * decode worker. Slots are preallocated; put/get move packet references
+ * in and out so no packet data is copied.
+ */
+typedef struct _packet_queue_t {
+  AVPacket **slots;
+  uint32_t capacity;
+  uint32_t head;
+  uint32_t count;
+
+  /* Limits: a queue is "full" once any of them is reached. */
+  uint32_t max_bytes;
+  double max_duration;
+  AVRational time_base;
+
+  uint32_t bytes;
+  int64_t duration; /* sum of packet durations, in time_base units */
+
+  bool_t eof;
+  bool_t abort;
+  /* Set by packet_queue_seek until the reader has been told */
+  bool_t discontinuity;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+} packet_queue_t;
+
+typedef struct _packet_queue_stats_t {
+  uint32_t packets;
+  uint32_t bytes;
+  double duration;
+} packet_queue_stats_t;
+
+ret_t packet_queue_init(packet_queue_t *q, uint32_t capacity, uint32_t max_bytes,
+                        double max_duration);
+ret_t packet_queue_deinit(packet_queue_t *q);
+
+/* Reset to an empty, running queue for a new stream. */
+ret_t packet_queue_start(packet_queue_t *q, AVRational time_base);
+ret_t packet_queue_set_limits(packet_queue_t *q, uint32_t max_bytes,
+                              double max_duration);
+
+/* Takes the reference held by pkt. Returns RET_BUSY if there is no free slot. */
+ret_t packet_queue_put(packet_queue_t *q, AVPacket *pkt);
+
+/*
+ * Moves the oldest packet into pkt. Returns RET_EOS once the queue is empty
+ * after packet_queue_set_eof, RET_QUIT after packet_queue_abort,
+ * RET_TIMEOUT if nothing arrived within timeout_ms and, once after
+ * packet_queue_seek and before any newer packet, RET_SKIP.
+ */
+ret_t packet_queue_get(packet_queue_t *q, AVPacket *pkt, uint32_t timeout_ms);
+
+ret_t packet_queue_flush(packet_queue_t *q);
+/* Flush and tell the reader to reset its decoder before the next packet. */
+ret_t packet_queue_seek(packet_queue_t *q);
+ret_t packet_queue_set_eof(packet_queue_t *q);
+ret_t packet_queue_abort(packet_queue_t *q);
+
+bool_t packet_queue_is_full(packet_queue_t *q);
+ret_t packet_queue_get_stats(packet_queue_t *q, packet_queue_stats_t *stats);
+
+END_C_DECLS
+
+#endif /* PACKET_QUEUE_H */
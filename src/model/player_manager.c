@@ -0,0 +1,167 @@
+#include "player_manager.h"
+#include "tkc/log.h"
+#include <libavutil/cpu.h>
+#include <stdlib.h>
+
+static void player_manager_apply_focus(player_manager_t *manager,
+                                       uint32_t index) {
+  hls_player_t *player = manager->players[index];
+  bool_t focused = manager->focused == (int)index;
+
+  if (manager->focused < 0) {
+    hls_player_set_priority(player, HLS_PLAYER_PRIORITY_NORMAL);
+  } else {
+    hls_player_set_priority(player, focused ? HLS_PLAYER_PRIORITY_FOCUSED
+                                            : HLS_PLAYER_PRIORITY_BACKGROUND);
+  }
+  hls_player_set_mute(player, !focused);
+}
+
+player_manager_t *player_manager_create(uint32_t nr_threads) {
+  player_manager_t *manager =
+      (player_manager_t *)calloc(1, sizeof(player_manager_t));
+  return_value_if_fail(manager != NULL, NULL);
+
+  if (nr_threads == 0) {
+    nr_threads = tk_max(1, av_cpu_count());
+  }
+  decode_scheduler_init(&manager->scheduler, nr_threads);
+  // The caller of worker_pool_run is the last of the threads.
+  if (nr_threads > 1) {
+    manager->convert_pool = worker_pool_create(nr_threads - 1);
+    if (manager->convert_pool == NULL) {
+      decode_scheduler_deinit(&manager->scheduler);
+      free(manager);
+      return NULL;
+    }
+  }
+  manager->http_pool = http_pool_create(0, 0, 0);
+  manager->focused = -1;
+
+  return manager;
+}
+
+ret_t player_manager_destroy(player_manager_t *manager) {
+  return_value_if_fail(manager != NULL, RET_BAD_PARAMS);
+
+  // Players first: their threads use the scheduler and the pools.
+  for (uint32_t i = 0; i < manager->nr_players; i++) {
+    hls_player_destroy(manager->players[i]);
+  }
+  if (manager->convert_pool != NULL) {
+    worker_pool_destroy(manager->convert_pool);
+  }
+  if (manager->http_pool != NULL) {
+    http_pool_destroy(manager->http_pool);
+  }
+  decode_scheduler_deinit(&manager->scheduler);
+  free(manager);
+
+  return RET_OK;
+}
+
+hls_player_t *player_manager_add(player_manager_t *manager) {
+  return_value_if_fail(manager != NULL, NULL);
+  if (manager->nr_players >= PLAYER_MANAGER_MAX_PLAYERS) {
+    return NULL;
+  }
+
+  hls_player_t *player = hls_player_create();
+  return_value_if_fail(player != NULL, NULL);
+
+  // One decode thread each: the scheduler only sees the calling thread.
+  hls_player_set_decode_threads(player, 1, HLS_PLAYER_THREAD_SLICE);
+  hls_player_set_decode_scheduler(player, &manager->scheduler);
+  hls_player_set_convert_pool(player, manager->convert_pool);
+  hls_player_set_http_pool(player, manager->http_pool);
+  hls_player_set_fast_start(player, TRUE);
+
+  uint32_t index = manager->nr_players++;
+  manager->players[index] = player;
+  player_manager_apply_focus(manager, index);
+
+  return player;
+}
+
+ret_t player_manager_remove(player_manager_t *manager, uint32_t index) {
+  return_value_if_fail(manager != NULL && index < manager->nr_players,
+                       RET_BAD_PARAMS);
+
+  hls_player_destroy(manager->players[index]);
+  manager->nr_players--;
+  for (uint32_t i = index; i < manager->nr_players; i++) {
+    manager->players[i] = manager->players[i + 1];
+  }
+  manager->players[manager->nr_players] = NULL;
+
+  if (manager->focused == (int)index) {
+    player_manager_set_focus(manager, -1);
+  } else if (manager->focused > (int)index) {
+    manager->focused--;
+  }
+
+  return RET_OK;
+}
+
+uint32_t player_manager_count(player_manager_t *manager) {
+  return_value_if_fail(manager != NULL, 0);
+  return manager->nr_players;
+}
+
+hls_player_t *player_manager_get(player_manager_t *manager, uint32_t index) {
+  return_value_if_fail(manager != NULL && index < manager->nr_players, NULL);
+  return manager->players[index];
+}
+
+ret_t player_manager_set_focus(player_manager_t *manager, int index) {
+  return_value_if_fail(manager != NULL && index < (int)manager->nr_players,
+                       RET_BAD_PARAMS);
+
+  manager->focused = index < 0 ? -1 : index;
+  for (uint32_t i = 0; i < manager->nr_players; i++) {
+    player_manager_apply_focus(manager, i);
+  }
+
+  return RET_OK;
+}
+
+int player_manager_get_focus(player_manager_t *manager) {
+  return_value_if_fail(manager != NULL, -1);
+  return manager->focused;
+}
+
+ret_t player_manager_set_tile_size(player_manager_t *manager, uint32_t index,
+                                   int width, int height) {
+  return_value_if_fail(manager != NULL && index < manager->nr_players,
+                       RET_BAD_PARAMS);
+
+  hls_player_t *player = manager->players[index];
+  hls_player_set_output_size(player, width, height);
+  return hls_player_set_max_resolution(player, width, height);
+}
+
+ret_t player_manager_play_all(player_manager_t *manager) {
+  return_value_if_fail(manager != NULL, RET_BAD_PARAMS);
+
+  for (uint32_t i = 0; i < manager->nr_players; i++) {
+    hls_player_play(manager->players[i]);
+  }
+
+  return RET_OK;
+}
+
+ret_t player_manager_stop_all(player_manager_t *manager) {
+  return_value_if_fail(manager != NULL, RET_BAD_PARAMS);
+
+  // All of them tear down in parallel; a later play waits for its own.
+  for (uint32_t i = 0; i < manager->nr_players; i++) {
+    hls_player_stop_async(manager->players[i], NULL, NULL);
+  }
+
+  return RET_OK;
+}
+
+bool_t player_manager_is_saturated(player_manager_t *manager) {
+  return_value_if_fail(manager != NULL, FALSE);
+  return decode_scheduler_is_saturated(&manager->scheduler);
+}
@@ -0,0 +1,66 @@
+#ifndef PLAYER_MANAGER_H
+#define PLAYER_MANAGER_H
+
+#include "decode_scheduler.h"
+#include "hls_player.h"
+#include "http_pool.h"
+#include "worker_pool.h"
+
+BEGIN_C_DECLS
+
+#define PLAYER_MANAGER_MAX_PLAYERS 16
+
+/*
+ * Runs many players at once, as for a mosaic of camera feeds, within a
+ * fixed budget: video decoding of all players goes through one scheduler
+ * with a slot per thread, and colour conversion through one shared worker
+ * pool, instead of every player bringing threads for the whole machine.
+ *
+ * With a player focused it decodes ahead of the others and is the only one
+ * heard; the others run in the background and fall back to keyframes only
+ * while the scheduler is saturated. Without focus all are equal and muted.
+ * Their playlist engines share one pool of keep-alive connections.
+ */
+typedef struct _player_manager_t {
+  decode_scheduler_t scheduler;
+  worker_pool_t *convert_pool;
+  /* Keep-alive connections shared by all the players, often on one CDN */
+  http_pool_t *http_pool;
+  hls_player_t *players[PLAYER_MANAGER_MAX_PLAYERS];
+  uint32_t nr_players;
+  int focused;
+} player_manager_t;
+
+/* nr_threads 0 is one per core */
+player_manager_t *player_manager_create(uint32_t nr_threads);
+/* Stops and destroys the players too. */
+ret_t player_manager_destroy(player_manager_t *manager);
+
+/* A new player, owned by the manager; NULL once it holds the maximum. */
+hls_player_t *player_manager_add(player_manager_t *manager);
+/* Destroy the player at index; the ones after it move down by one. */
+ret_t player_manager_remove(player_manager_t *manager, uint32_t index);
+uint32_t player_manager_count(player_manager_t *manager);
+hls_player_t *player_manager_get(player_manager_t *manager, uint32_t index);
+
+/* Focus the player at index, or none with -1. */
+ret_t player_manager_set_focus(player_manager_t *manager, int index);
+int player_manager_get_focus(player_manager_t *manager);
+
+/*
+ * The player at index is shown in a width x height tile: convert to that
+ * size, and from the next play only consider variants that fit in it.
+ */
+ret_t player_manager_set_tile_size(player_manager_t *manager, uint32_t index,
+                                   int width, int height);
+
+ret_t player_manager_play_all(player_manager_t *manager);
+/* Returns without waiting for the players to finish (hls_player_stop_async) */
+ret_t player_manager_stop_all(player_manager_t *manager);
+
+/* True while background players are held to keyframes */
+bool_t player_manager_is_saturated(player_manager_t *manager);
+
+END_C_DECLS
+
+#endif /* PLAYER_MANAGER_H */
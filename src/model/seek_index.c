@@ -0,0 +1,77 @@
+#include "seek_index.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Keyframes closer than this are the same one seen twice */
+#define SEEK_INDEX_EPSILON 0.001
+
+ret_t seek_index_init(seek_index_t *index) {
+  return_value_if_fail(index != NULL, RET_BAD_PARAMS);
+  memset(index, 0x00, sizeof(*index));
+  return RET_OK;
+}
+
+ret_t seek_index_deinit(seek_index_t *index) {
+  return_value_if_fail(index != NULL, RET_BAD_PARAMS);
+  free(index->keyframes);
+  memset(index, 0x00, sizeof(*index));
+  return RET_OK;
+}
+
+ret_t seek_index_reset(seek_index_t *index) {
+  return_value_if_fail(index != NULL, RET_BAD_PARAMS);
+  index->nr_keyframes = 0;
+  return RET_OK;
+}
+
+/* Number of keyframes before t. */
+static uint32_t seek_index_lower_bound(seek_index_t *index, double t) {
+  uint32_t lo = 0;
+  uint32_t hi = index->nr_keyframes;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (index->keyframes[mid] < t) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+ret_t seek_index_add(seek_index_t *index, double t) {
+  return_value_if_fail(index != NULL && t >= 0, RET_BAD_PARAMS);
+
+  // Playback mostly appends; after a seek backwards it revisits known ones.
+  uint32_t pos = index->nr_keyframes;
+  if (pos > 0 && index->keyframes[pos - 1] >= t - SEEK_INDEX_EPSILON) {
+    pos = seek_index_lower_bound(index, t - SEEK_INDEX_EPSILON);
+    if (pos < index->nr_keyframes &&
+        index->keyframes[pos] <= t + SEEK_INDEX_EPSILON) {
+      return RET_OK;
+    }
+  }
+
+  if (index->nr_keyframes == index->capacity) {
+    uint32_t capacity = index->capacity ? index->capacity * 2 : 256;
+    double *keyframes =
+        (double *)realloc(index->keyframes, capacity * sizeof(double));
+    return_value_if_fail(keyframes != NULL, RET_OOM);
+    index->keyframes = keyframes;
+    index->capacity = capacity;
+  }
+
+  memmove(index->keyframes + pos + 1, index->keyframes + pos,
+          (index->nr_keyframes - pos) * sizeof(double));
+  index->keyframes[pos] = t;
+  index->nr_keyframes++;
+
+  return RET_OK;
+}
+
+double seek_index_floor(seek_index_t *index, double t) {
+  return_value_if_fail(index != NULL, -1);
+
+  uint32_t pos = seek_index_lower_bound(index, t + SEEK_INDEX_EPSILON);
+  return pos > 0 ? index->keyframes[pos - 1] : -1;
+}
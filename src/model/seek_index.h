@@ -0,0 +1,32 @@
+#ifndef SEEK_INDEX_H
+#define SEEK_INDEX_H
+
+#include "tkc/types_def.h"
+
+BEGIN_C_DECLS
+
+/*
+ * Keyframe times, in seconds from the start of the stream, learned while
+ * demuxing. Combined with the segment start times of the playlist it tells
+ * a seek the latest point at or before the target decoding can begin from.
+ * Owned by the demux thread; not thread-safe.
+ */
+typedef struct _seek_index_t {
+  double *keyframes;
+  uint32_t nr_keyframes;
+  uint32_t capacity;
+} seek_index_t;
+
+ret_t seek_index_init(seek_index_t *index);
+ret_t seek_index_deinit(seek_index_t *index);
+ret_t seek_index_reset(seek_index_t *index);
+
+/* Record a keyframe; keeps the index sorted and free of duplicates. */
+ret_t seek_index_add(seek_index_t *index, double t);
+
+/* The latest known keyframe at or before t, or -1 if there is none. */
+double seek_index_floor(seek_index_t *index, double t);
+
+END_C_DECLS
+
+#endif /* SEEK_INDEX_H */
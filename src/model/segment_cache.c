@@ -0,0 +1,432 @@
+#include "segment_cache.h"
+#include "tkc/log.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define SEGMENT_CACHE_MAGIC 0x43534c48 /* "HLSC" */
+#define SEGMENT_CACHE_VERSION 1
+#define SEGMENT_CACHE_SUFFIX ".seg"
+#define SEGMENT_CACHE_TMP ".tmp."
+
+/*
+ * On-disk layout: header, key (not NUL-terminated), data. The key guards
+ * against hash collisions; the sizes against truncated files.
+ */
+typedef struct _segment_cache_header_t {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t key_size;
+  uint32_t reserved;
+  uint64_t data_size;
+} segment_cache_header_t;
+
+typedef struct _segment_cache_item_t {
+  uint64_t hash;
+  /* File size, header included */
+  uint64_t size;
+  /* Wall clock microseconds, persisted as the file's mtime */
+  int64_t last_used;
+} segment_cache_item_t;
+
+struct _segment_cache_t {
+  char *dir;
+  uint64_t max_bytes;
+  uint64_t bytes_used;
+
+  segment_cache_item_t *items;
+  uint32_t nr_items;
+  uint32_t capacity;
+  uint32_t tmp_counter;
+
+  segment_cache_stats_t stats;
+  pthread_mutex_t mutex;
+};
+
+static int64_t segment_cache_now(void) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+/* FNV-1a */
+static uint64_t segment_cache_hash(const char *key) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (const uint8_t *p = (const uint8_t *)key; *p; p++) {
+    hash = (hash ^ *p) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static char *segment_cache_make_key(const char *url, int64_t offset,
+                                    int64_t length) {
+  if (offset == 0 && length < 0) {
+    return strdup(url);
+  }
+
+  size_t size = strlen(url) + 48;
+  char *key = (char *)malloc(size);
+  if (key != NULL) {
+    snprintf(key, size, "%s@%lld+%lld", url, (long long)offset,
+             (long long)length);
+  }
+  return key;
+}
+
+/* Fails rather than truncate, which would name some other file */
+static ret_t segment_cache_path(segment_cache_t *cache, uint64_t hash,
+                                char path[MAX_PATH + 1]) {
+  int n = snprintf(path, MAX_PATH + 1, "%s/%016llx" SEGMENT_CACHE_SUFFIX,
+                   cache->dir, (unsigned long long)hash);
+  return n >= 0 && n <= MAX_PATH ? RET_OK : RET_FAIL;
+}
+
+static segment_cache_item_t *segment_cache_find_locked(segment_cache_t *cache,
+                                                       uint64_t hash) {
+  for (uint32_t i = 0; i < cache->nr_items; i++) {
+    if (cache->items[i].hash == hash) {
+      return cache->items + i;
+    }
+  }
+  return NULL;
+}
+
+static void segment_cache_remove_locked(segment_cache_t *cache,
+                                        segment_cache_item_t *item) {
+  cache->bytes_used -= item->size;
+  *item = cache->items[--cache->nr_items];
+}
+
+/* Add or update the index entry for hash. */
+static ret_t segment_cache_put_locked(segment_cache_t *cache, uint64_t hash,
+                                      uint64_t size, int64_t last_used) {
+  segment_cache_item_t *item = segment_cache_find_locked(cache, hash);
+
+  if (item == NULL) {
+    if (cache->nr_items == cache->capacity) {
+      uint32_t capacity = cache->capacity ? cache->capacity * 2 : 64;
+      segment_cache_item_t *items = (segment_cache_item_t *)realloc(
+          cache->items, capacity * sizeof(segment_cache_item_t));
+      return_value_if_fail(items != NULL, RET_OOM);
+      cache->items = items;
+      cache->capacity = capacity;
+    }
+    item = cache->items + cache->nr_items++;
+    item->hash = hash;
+    item->size = 0;
+  }
+
+  cache->bytes_used += size - item->size;
+  item->size = size;
+  item->last_used = last_used;
+
+  return RET_OK;
+}
+
+/* Unlink least recently used entries, other than keep, until within budget. */
+static void segment_cache_evict_locked(segment_cache_t *cache, uint64_t keep) {
+  char path[MAX_PATH + 1];
+
+  while (cache->bytes_used > cache->max_bytes) {
+    segment_cache_item_t *oldest = NULL;
+    for (uint32_t i = 0; i < cache->nr_items; i++) {
+      segment_cache_item_t *item = cache->items + i;
+      if (item->hash != keep &&
+          (oldest == NULL || item->last_used < oldest->last_used)) {
+        oldest = item;
+      }
+    }
+    if (oldest == NULL) {
+      break;
+    }
+
+    // A mapped hit of this entry stays readable after the unlink.
+    if (segment_cache_path(cache, oldest->hash, path) == RET_OK) {
+      unlink(path);
+    }
+    segment_cache_remove_locked(cache, oldest);
+    cache->stats.evictions++;
+  }
+}
+
+static ret_t segment_cache_scan(segment_cache_t *cache) {
+  char path[MAX_PATH + 1];
+  struct dirent *ent;
+  DIR *dir = opendir(cache->dir);
+  return_value_if_fail(dir != NULL, RET_FAIL);
+
+  while ((ent = readdir(dir)) != NULL) {
+    const char *name = ent->d_name;
+    int n = snprintf(path, sizeof(path), "%s/%s", cache->dir, name);
+    if (n < 0 || n >= (int)sizeof(path)) {
+      continue;
+    }
+
+    // Left behind by a write that never completed.
+    if (strstr(name, SEGMENT_CACHE_TMP) != NULL) {
+      unlink(path);
+      continue;
+    }
+
+    char *end = NULL;
+    uint64_t hash = strtoull(name, &end, 16);
+    struct stat st;
+    if (end != name + 16 || strcmp(end, SEGMENT_CACHE_SUFFIX) != 0 ||
+        stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+      continue;
+    }
+    segment_cache_put_locked(cache, hash, (uint64_t)st.st_size,
+                             (int64_t)st.st_mtime * 1000000);
+  }
+  closedir(dir);
+
+  segment_cache_evict_locked(cache, 0);
+
+  return RET_OK;
+}
+
+segment_cache_t *segment_cache_create(const char *dir, uint64_t max_bytes) {
+  return_value_if_fail(dir != NULL && *dir && max_bytes > 0, NULL);
+
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+    log_error("cache: could not create %s\n", dir);
+    return NULL;
+  }
+
+  segment_cache_t *cache = (segment_cache_t *)calloc(1, sizeof(segment_cache_t));
+  return_value_if_fail(cache != NULL, NULL);
+
+  cache->dir = strdup(dir);
+  cache->max_bytes = max_bytes;
+  pthread_mutex_init(&cache->mutex, NULL);
+
+  if (cache->dir == NULL || segment_cache_scan(cache) != RET_OK) {
+    log_error("cache: could not index %s\n", dir);
+    segment_cache_destroy(cache);
+    return NULL;
+  }
+  log_debug("cache: %s, %u entries, %llu of %llu bytes\n", dir, cache->nr_items,
+            (unsigned long long)cache->bytes_used,
+            (unsigned long long)cache->max_bytes);
+
+  return cache;
+}
+
+ret_t segment_cache_destroy(segment_cache_t *cache) {
+  return_value_if_fail(cache != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_destroy(&cache->mutex);
+  free(cache->items);
+  free(cache->dir);
+  free(cache);
+
+  return RET_OK;
+}
+
+/* Maps path and checks it is a complete entry for key. */
+static ret_t segment_cache_map(const char *path, const char *key,
+                               segment_cache_entry_t *entry) {
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return RET_NOT_FOUND;
+  }
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(segment_cache_header_t)) {
+    close(fd);
+    return RET_FAIL;
+  }
+
+  void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (base == MAP_FAILED) {
+    close(fd);
+    return RET_FAIL;
+  }
+
+  const segment_cache_header_t *header = (const segment_cache_header_t *)base;
+  const char *stored_key = (const char *)(header + 1);
+  size_t key_size = strlen(key);
+  ret_t ret = RET_OK;
+  if (header->magic != SEGMENT_CACHE_MAGIC ||
+      header->version != SEGMENT_CACHE_VERSION ||
+      sizeof(*header) + header->key_size + header->data_size != (uint64_t)st.st_size) {
+    ret = RET_FAIL;
+  } else if (header->key_size != key_size ||
+             memcmp(stored_key, key, key_size) != 0) {
+    // Another URL with the same hash; the next store replaces it.
+    ret = RET_NOT_FOUND;
+  }
+  if (ret != RET_OK) {
+    munmap(base, (size_t)st.st_size);
+    close(fd);
+    return ret;
+  }
+
+  // Persist the access for LRU order across restarts.
+  futimens(fd, NULL);
+  close(fd);
+
+  entry->base = base;
+  entry->length = (size_t)st.st_size;
+  entry->data = (const uint8_t *)stored_key + key_size;
+  entry->size = (size_t)header->data_size;
+
+  return RET_OK;
+}
+
+segment_cache_entry_t *segment_cache_lookup(segment_cache_t *cache, const char *url,
+                                            int64_t offset, int64_t length) {
+  char path[MAX_PATH + 1];
+  return_value_if_fail(cache != NULL && url != NULL, NULL);
+
+  char *key = segment_cache_make_key(url, offset, length);
+  return_value_if_fail(key != NULL, NULL);
+  uint64_t hash = segment_cache_hash(key);
+  if (segment_cache_path(cache, hash, path) != RET_OK) {
+    free(key);
+    return NULL;
+  }
+
+  segment_cache_entry_t *entry =
+      (segment_cache_entry_t *)calloc(1, sizeof(segment_cache_entry_t));
+  ret_t ret = entry != NULL ? segment_cache_map(path, key, entry) : RET_OOM;
+  free(key);
+  if (ret == RET_FAIL) {
+    log_warn("cache: dropping corrupt entry %s\n", path);
+    unlink(path);
+  }
+
+  pthread_mutex_lock(&cache->mutex);
+  if (ret == RET_OK) {
+    cache->stats.hits++;
+    cache->stats.bytes_saved += entry->size;
+    segment_cache_put_locked(cache, hash, entry->length, segment_cache_now());
+  } else {
+    cache->stats.misses++;
+    segment_cache_item_t *item = segment_cache_find_locked(cache, hash);
+    if (item != NULL && ret == RET_FAIL) {
+      segment_cache_remove_locked(cache, item);
+    }
+  }
+  pthread_mutex_unlock(&cache->mutex);
+
+  if (ret != RET_OK) {
+    free(entry);
+    return NULL;
+  }
+  return entry;
+}
+
+ret_t segment_cache_release(segment_cache_entry_t *entry) {
+  return_value_if_fail(entry != NULL, RET_BAD_PARAMS);
+
+  munmap(entry->base, entry->length);
+  free(entry);
+
+  return RET_OK;
+}
+
+static ret_t segment_cache_write_all(int fd, const void *data, size_t size) {
+  const uint8_t *p = (const uint8_t *)data;
+  while (size > 0) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    return_value_if_fail(n > 0, RET_IO);
+    p += n;
+    size -= (size_t)n;
+  }
+  return RET_OK;
+}
+
+ret_t segment_cache_store(segment_cache_t *cache, const char *url, int64_t offset,
+                          int64_t length, const uint8_t *data, size_t size) {
+  char path[MAX_PATH + 1];
+  char tmp[MAX_PATH + 1];
+  segment_cache_header_t header;
+  return_value_if_fail(cache != NULL && url != NULL && data != NULL, RET_BAD_PARAMS);
+
+  char *key = segment_cache_make_key(url, offset, length);
+  return_value_if_fail(key != NULL, RET_OOM);
+  size_t key_size = strlen(key);
+  uint64_t total = sizeof(header) + key_size + size;
+  if (total > cache->max_bytes) {
+    free(key);
+    return RET_FAIL;
+  }
+
+  uint64_t hash = segment_cache_hash(key);
+  pthread_mutex_lock(&cache->mutex);
+  uint32_t counter = cache->tmp_counter++;
+  pthread_mutex_unlock(&cache->mutex);
+  int n = snprintf(tmp, sizeof(tmp), "%s/%016llx" SEGMENT_CACHE_TMP "%d.%u",
+                   cache->dir, (unsigned long long)hash, (int)getpid(), counter);
+  if (segment_cache_path(cache, hash, path) != RET_OK || n < 0 ||
+      n >= (int)sizeof(tmp)) {
+    free(key);
+    return RET_FAIL;
+  }
+
+  memset(&header, 0x00, sizeof(header));
+  header.magic = SEGMENT_CACHE_MAGIC;
+  header.version = SEGMENT_CACHE_VERSION;
+  header.key_size = (uint32_t)key_size;
+  header.data_size = size;
+
+  ret_t ret = RET_IO;
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (fd >= 0) {
+    ret = segment_cache_write_all(fd, &header, sizeof(header));
+    if (ret == RET_OK) {
+      ret = segment_cache_write_all(fd, key, key_size);
+    }
+    if (ret == RET_OK) {
+      ret = segment_cache_write_all(fd, data, size);
+    }
+    // The data must be on disk before the rename makes the entry visible.
+    if (ret == RET_OK && fsync(fd) != 0) {
+      ret = RET_IO;
+    }
+    close(fd);
+    if (ret == RET_OK && rename(tmp, path) != 0) {
+      ret = RET_IO;
+    }
+    if (ret != RET_OK) {
+      unlink(tmp);
+    }
+  }
+  free(key);
+
+  if (ret != RET_OK) {
+    log_warn("cache: could not write %s\n", path);
+    return ret;
+  }
+
+  pthread_mutex_lock(&cache->mutex);
+  ret = segment_cache_put_locked(cache, hash, total, segment_cache_now());
+  segment_cache_evict_locked(cache, hash);
+  pthread_mutex_unlock(&cache->mutex);
+
+  return ret;
+}
+
+ret_t segment_cache_get_stats(segment_cache_t *cache, segment_cache_stats_t *stats) {
+  return_value_if_fail(cache != NULL && stats != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&cache->mutex);
+  *stats = cache->stats;
+  stats->entries = cache->nr_items;
+  stats->bytes_used = cache->bytes_used;
+  stats->max_bytes = cache->max_bytes;
+  pthread_mutex_unlock(&cache->mutex);
+
+  return RET_OK;
+}
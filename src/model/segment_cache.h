@@ -0,0 +1,55 @@
+#ifndef SEGMENT_CACHE_H
+#define SEGMENT_CACHE_H
+
+#include "tkc/types_def.h"
+
+BEGIN_C_DECLS
+
+/*
+ * Persistent cache of media segments in one directory, keyed by URL (and
+ * byte range), with a size budget enforced by evicting the least recently
+ * used entries. Entries are written to a temporary file and renamed into
+ * place, and carry their key and length, so a crash leaves either a whole
+ * entry or none. Hits are memory-mapped rather than read.
+ *
+ * All functions are thread-safe; one cache may serve several sources.
+ */
+typedef struct _segment_cache_t segment_cache_t;
+
+/* A mapped hit; data stays valid until segment_cache_release. */
+typedef struct _segment_cache_entry_t {
+  const uint8_t *data;
+  size_t size;
+
+  void *base;
+  size_t length;
+} segment_cache_entry_t;
+
+typedef struct _segment_cache_stats_t {
+  uint32_t hits;
+  uint32_t misses;
+  /* Bytes served from disk instead of the network */
+  uint64_t bytes_saved;
+  uint32_t entries;
+  uint64_t bytes_used;
+  uint64_t max_bytes;
+  uint32_t evictions;
+} segment_cache_stats_t;
+
+/* Creates dir if needed and indexes the entries already in it. */
+segment_cache_t *segment_cache_create(const char *dir, uint64_t max_bytes);
+ret_t segment_cache_destroy(segment_cache_t *cache);
+
+/* length < 0 means the whole resource, as in m3u8_segment_t. */
+segment_cache_entry_t *segment_cache_lookup(segment_cache_t *cache, const char *url,
+                                            int64_t offset, int64_t length);
+ret_t segment_cache_release(segment_cache_entry_t *entry);
+
+ret_t segment_cache_store(segment_cache_t *cache, const char *url, int64_t offset,
+                          int64_t length, const uint8_t *data, size_t size);
+
+ret_t segment_cache_get_stats(segment_cache_t *cache, segment_cache_stats_t *stats);
+
+END_C_DECLS
+
+#endif /* SEGMENT_CACHE_H */
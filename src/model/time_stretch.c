@@ -0,0 +1,212 @@
+#include "time_stretch.h"
+#include "audio_gain.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Sequence, overlap and search window lengths, in milliseconds */
+#define TIME_STRETCH_SEQUENCE_MS 40
+#define TIME_STRETCH_OVERLAP_MS 10
+#define TIME_STRETCH_SEEK_MS 15
+/* Input held beyond what one sequence at the highest rate needs */
+#define TIME_STRETCH_SLACK_MS 100
+#define TIME_STRETCH_MIN_RATE 0.5
+#define TIME_STRETCH_MAX_RATE 2.0
+/* Coarse search step, refined around the best coarse match */
+#define TIME_STRETCH_SEEK_STEP 4
+
+ret_t time_stretch_init(time_stretch_t *ts, uint32_t channels, uint32_t sample_rate) {
+  return_value_if_fail(ts != NULL && channels > 0 && sample_rate > 0,
+                       RET_BAD_PARAMS);
+
+  memset(ts, 0x00, sizeof(*ts));
+  ts->channels = channels;
+  ts->sample_rate = sample_rate;
+  ts->rate = 1.0;
+  ts->sequence = sample_rate * TIME_STRETCH_SEQUENCE_MS / 1000;
+  ts->overlap = sample_rate * TIME_STRETCH_OVERLAP_MS / 1000;
+  ts->seek = sample_rate * TIME_STRETCH_SEEK_MS / 1000;
+
+  uint32_t step = ts->sequence - ts->overlap;
+  uint32_t need = (uint32_t)(TIME_STRETCH_MAX_RATE * step) + ts->overlap + 1;
+  ts->input_capacity = tk_max(need, ts->sequence) + ts->seek +
+                       sample_rate * TIME_STRETCH_SLACK_MS / 1000;
+
+  ts->input = (int16_t *)malloc(ts->input_capacity * channels * sizeof(int16_t));
+  ts->mid = (int16_t *)malloc(ts->overlap * channels * sizeof(int16_t));
+  ts->fade = (int16_t *)malloc(ts->overlap * channels * sizeof(int16_t));
+  if (ts->input == NULL || ts->mid == NULL || ts->fade == NULL) {
+    time_stretch_deinit(ts);
+    return RET_OOM;
+  }
+
+  for (uint32_t f = 0; f < ts->overlap; f++) {
+    int16_t w = (int16_t)((int64_t)AUDIO_GAIN_UNITY * f / ts->overlap);
+    for (uint32_t c = 0; c < channels; c++) {
+      ts->fade[f * channels + c] = w;
+    }
+  }
+
+  return RET_OK;
+}
+
+ret_t time_stretch_deinit(time_stretch_t *ts) {
+  return_value_if_fail(ts != NULL, RET_BAD_PARAMS);
+
+  free(ts->input);
+  free(ts->mid);
+  free(ts->fade);
+  memset(ts, 0x00, sizeof(*ts));
+
+  return RET_OK;
+}
+
+ret_t time_stretch_reset(time_stretch_t *ts) {
+  return_value_if_fail(ts != NULL, RET_BAD_PARAMS);
+
+  ts->input_frames = 0;
+  ts->has_mid = FALSE;
+  ts->skip_fract = 0;
+
+  return RET_OK;
+}
+
+ret_t time_stretch_set_rate(time_stretch_t *ts, double rate) {
+  return_value_if_fail(ts != NULL, RET_BAD_PARAMS);
+  return_value_if_fail(rate >= TIME_STRETCH_MIN_RATE && rate <= TIME_STRETCH_MAX_RATE,
+                       RET_BAD_PARAMS);
+
+  ts->rate = rate;
+
+  return RET_OK;
+}
+
+uint32_t time_stretch_put(time_stretch_t *ts, const int16_t *in, uint32_t frames) {
+  return_value_if_fail(ts != NULL && ts->input != NULL && in != NULL, 0);
+
+  uint32_t len = tk_min(frames, ts->input_capacity - ts->input_frames);
+  memcpy(ts->input + ts->input_frames * ts->channels, in,
+         len * ts->channels * sizeof(int16_t));
+  ts->input_frames += len;
+
+  return len;
+}
+
+static void time_stretch_consume(time_stretch_t *ts, uint32_t frames) {
+  frames = tk_min(frames, ts->input_frames);
+  ts->input_frames -= frames;
+  memmove(ts->input, ts->input + frames * ts->channels,
+          ts->input_frames * ts->channels * sizeof(int16_t));
+}
+
+/* Normalised cross-correlation of the previous tail with input at offset. */
+static double time_stretch_match(time_stretch_t *ts, uint32_t offset) {
+  const int16_t *a = ts->mid;
+  const int16_t *b = ts->input + offset * ts->channels;
+  uint32_t count = ts->overlap * ts->channels;
+  int64_t corr = 0;
+  int64_t energy = 0;
+
+  for (uint32_t i = 0; i < count; i++) {
+    corr += a[i] * b[i];
+    energy += b[i] * b[i];
+  }
+
+  return corr / sqrt((double)energy + 1);
+}
+
+static uint32_t time_stretch_best_offset(time_stretch_t *ts) {
+  uint32_t best = 0;
+  double best_score = -INFINITY;
+
+  for (uint32_t offset = 0; offset < ts->seek; offset += TIME_STRETCH_SEEK_STEP) {
+    double score = time_stretch_match(ts, offset);
+    if (score > best_score) {
+      best_score = score;
+      best = offset;
+    }
+  }
+
+  uint32_t from = best > TIME_STRETCH_SEEK_STEP ? best - TIME_STRETCH_SEEK_STEP + 1 : 0;
+  uint32_t to = tk_min(best + TIME_STRETCH_SEEK_STEP, ts->seek);
+  for (uint32_t offset = from; offset < to; offset++) {
+    double score = time_stretch_match(ts, offset);
+    if (score > best_score) {
+      best_score = score;
+      best = offset;
+    }
+  }
+
+  return best;
+}
+
+uint32_t time_stretch_get(time_stretch_t *ts, int16_t *out, uint32_t max_frames) {
+  return_value_if_fail(ts != NULL && ts->input != NULL && out != NULL, 0);
+
+  uint32_t ch = ts->channels;
+  uint32_t step = ts->sequence - ts->overlap;
+  uint32_t written = 0;
+
+  for (;;) {
+    uint32_t skip = (uint32_t)(ts->skip_fract + ts->rate * step);
+    uint32_t need = tk_max(skip + ts->overlap, ts->sequence) + ts->seek;
+    if (ts->input_frames < need || max_frames - written < step) {
+      break;
+    }
+
+    int16_t *o = out + written * ch;
+    uint32_t offset = 0;
+    if (ts->has_mid) {
+      offset = time_stretch_best_offset(ts);
+      audio_gain_crossfade(o, ts->mid, ts->input + offset * ch, ts->fade,
+                           ts->overlap * ch);
+    } else {
+      memcpy(o, ts->input, ts->overlap * ch * sizeof(int16_t));
+    }
+
+    const int16_t *seq = ts->input + offset * ch;
+    memcpy(o + ts->overlap * ch, seq + ts->overlap * ch,
+           (ts->sequence - 2 * ts->overlap) * ch * sizeof(int16_t));
+    memcpy(ts->mid, seq + step * ch, ts->overlap * ch * sizeof(int16_t));
+    ts->has_mid = TRUE;
+    written += step;
+
+    ts->skip_fract += ts->rate * step;
+    skip = (uint32_t)ts->skip_fract;
+    ts->skip_fract -= skip;
+    time_stretch_consume(ts, skip);
+  }
+
+  return written;
+}
+
+uint32_t time_stretch_drain(time_stretch_t *ts, int16_t *out, uint32_t max_frames) {
+  return_value_if_fail(ts != NULL && ts->input != NULL && out != NULL, 0);
+
+  uint32_t ch = ts->channels;
+  uint32_t written = 0;
+
+  // Blend the pending tail into the input it continues from.
+  if (ts->has_mid && ts->input_frames >= ts->overlap && max_frames >= ts->overlap) {
+    audio_gain_crossfade(out, ts->mid, ts->input, ts->fade, ts->overlap * ch);
+    time_stretch_consume(ts, ts->overlap);
+    written = ts->overlap;
+  }
+  ts->has_mid = FALSE;
+
+  uint32_t len = tk_min(max_frames - written, ts->input_frames);
+  memcpy(out + written * ch, ts->input, len * ch * sizeof(int16_t));
+  time_stretch_consume(ts, len);
+  written += len;
+  if (ts->input_frames == 0) {
+    ts->skip_fract = 0;
+  }
+
+  return written;
+}
+
+uint32_t time_stretch_get_latency(time_stretch_t *ts) {
+  return_value_if_fail(ts != NULL, 0);
+
+  return ts->input_frames;
+}
@@ -0,0 +1,57 @@
+#ifndef TIME_STRETCH_H
+#define TIME_STRETCH_H
+
+#include "tkc/types_def.h"
+
+BEGIN_C_DECLS
+
+/*
+ * Pitch-preserving tempo change of interleaved S16 audio by WSOLA: the
+ * input is cut into overlapping sequences taken rate times further apart
+ * than they are laid out, each placed where it best matches the tail of
+ * the previous one and crossfaded into it. All buffers are allocated by
+ * init; put/get never allocate.
+ */
+typedef struct _time_stretch_t {
+  uint32_t channels;
+  uint32_t sample_rate;
+  double rate;
+
+  /* In frames */
+  uint32_t sequence;
+  uint32_t overlap;
+  uint32_t seek;
+
+  int16_t *input;
+  uint32_t input_frames;
+  uint32_t input_capacity;
+  /* Tail of the previous sequence, to crossfade the next one into */
+  int16_t *mid;
+  bool_t has_mid;
+  /* Q14 fade-in ramp over the overlap, one entry per sample */
+  int16_t *fade;
+  double skip_fract;
+} time_stretch_t;
+
+ret_t time_stretch_init(time_stretch_t *ts, uint32_t channels, uint32_t sample_rate);
+ret_t time_stretch_deinit(time_stretch_t *ts);
+ret_t time_stretch_reset(time_stretch_t *ts);
+
+/* 0.5 to 2.0; takes effect from the next sequence. */
+ret_t time_stretch_set_rate(time_stretch_t *ts, double rate);
+
+/* Queue input; returns the frames accepted, fewer once the input is full. */
+uint32_t time_stretch_put(time_stretch_t *ts, const int16_t *in, uint32_t frames);
+
+/* Stretch what is queued into out; returns the frames written. */
+uint32_t time_stretch_get(time_stretch_t *ts, int16_t *out, uint32_t max_frames);
+
+/* Hand back what is queued without stretching, leaving the stretcher empty. */
+uint32_t time_stretch_drain(time_stretch_t *ts, int16_t *out, uint32_t max_frames);
+
+/* Input frames queued but not yet in any output. */
+uint32_t time_stretch_get_latency(time_stretch_t *ts);
+
+END_C_DECLS
+
+#endif /* TIME_STRETCH_H */
@@ -0,0 +1,397 @@
+#include "timeshift.h"
+#include "cond_clock.h"
+#include "tkc/log.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Share of max_bytes given to the packet index */
+#define TIMESHIFT_INDEX_SHARE 16
+#define TIMESHIFT_MIN_ENTRIES 64
+#define TIMESHIFT_MIN_BYTES (64 * 1024)
+
+/*
+ * Packet data lives in one logical byte stream: pos grows forever, the
+ * newest bytes are in a memory ring at pos % memory_size and the older ones
+ * in a file ring at pos % spill_size. Entries are indexed by a sequence
+ * number in the same way.
+ */
+typedef struct _timeshift_entry_t {
+  uint64_t pos;
+  uint32_t size;
+  int32_t stream_index;
+  int32_t flags;
+  int64_t pts;
+  int64_t dts;
+  int64_t duration;
+  double time;
+} timeshift_entry_t;
+
+struct _timeshift_t {
+  uint8_t *memory;
+  uint32_t memory_size;
+  timeshift_entry_t *entries;
+  uint32_t nr_entries;
+
+  /* Sequence numbers: oldest entry, one past the newest, next to read */
+  uint64_t head;
+  uint64_t tail;
+  uint64_t cursor;
+  /* Oldest entry still in memory; head..memory_seq are on disk */
+  uint64_t memory_seq;
+  uint64_t write_pos;
+
+  /* Unlinked spill file, -1 when spilling is off */
+  int fd;
+  uint64_t spill_size;
+
+  int key_stream;
+  bool_t eof;
+  bool_t skipped;
+  timeshift_stats_t stats;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+};
+
+static timeshift_entry_t *timeshift_entry(timeshift_t *ts, uint64_t seq) {
+  return &ts->entries[seq % ts->nr_entries];
+}
+
+static bool_t timeshift_is_key(timeshift_t *ts, timeshift_entry_t *e) {
+  return ts->key_stream < 0 ||
+         (e->stream_index == ts->key_stream && (e->flags & AV_PKT_FLAG_KEY));
+}
+
+static uint64_t timeshift_memory_start(timeshift_t *ts) {
+  return ts->memory_seq < ts->tail ? timeshift_entry(ts, ts->memory_seq)->pos
+                                   : ts->write_pos;
+}
+
+static double timeshift_live_time(timeshift_t *ts) {
+  return ts->tail > ts->head ? timeshift_entry(ts, ts->tail - 1)->time : 0;
+}
+
+static void timeshift_memory_copy(timeshift_t *ts, uint64_t pos, uint8_t *data,
+                                  uint32_t size, bool_t in) {
+  uint32_t offset = pos % ts->memory_size;
+  uint32_t first = tk_min(size, ts->memory_size - offset);
+
+  if (in) {
+    memcpy(ts->memory + offset, data, first);
+    memcpy(ts->memory, data + first, size - first);
+  } else {
+    memcpy(data, ts->memory + offset, first);
+    memcpy(data + first, ts->memory, size - first);
+  }
+}
+
+static ret_t timeshift_disk_copy(timeshift_t *ts, uint64_t pos, uint8_t *data,
+                                 uint32_t size, bool_t in) {
+  while (size > 0) {
+    off_t offset = pos % ts->spill_size;
+    size_t len = tk_min((uint64_t)size, ts->spill_size - offset);
+    ssize_t done = in ? pwrite(ts->fd, data, len, offset)
+                      : pread(ts->fd, data, len, offset);
+    if (done <= 0) {
+      if (done < 0 && errno == EINTR) {
+        continue;
+      }
+      return RET_IO;
+    }
+    pos += done;
+    data += done;
+    size -= done;
+  }
+
+  return RET_OK;
+}
+
+static void timeshift_evict_head_locked(timeshift_t *ts) {
+  ts->head++;
+  ts->stats.evicted++;
+  if (ts->memory_seq < ts->head) {
+    ts->memory_seq = ts->head;
+  }
+}
+
+/* The cursor fell off the oldest end: resume at the next keyframe. */
+static void timeshift_resync_locked(timeshift_t *ts) {
+  ts->cursor = ts->head;
+  while (ts->cursor < ts->tail &&
+         !timeshift_is_key(ts, timeshift_entry(ts, ts->cursor))) {
+    ts->cursor++;
+  }
+  ts->skipped = TRUE;
+  ts->stats.skips++;
+  log_debug("timeshift: playback overtaken, skipping ahead\n");
+}
+
+static void timeshift_spill_locked(timeshift_t *ts) {
+  timeshift_entry_t *e = timeshift_entry(ts, ts->memory_seq);
+  uint8_t buffer[16 * 1024];
+
+  // The spill file holds head..memory_seq; make room for one more entry.
+  while (ts->head < ts->memory_seq &&
+         e->pos + e->size - timeshift_entry(ts, ts->head)->pos > ts->spill_size) {
+    timeshift_evict_head_locked(ts);
+  }
+
+  for (uint32_t done = 0; done < e->size;) {
+    uint32_t len = tk_min(e->size - done, (uint32_t)sizeof(buffer));
+    timeshift_memory_copy(ts, e->pos + done, buffer, len, FALSE);
+    if (timeshift_disk_copy(ts, e->pos + done, buffer, len, TRUE) != RET_OK) {
+      log_warn("timeshift: spill failed (%s), keeping memory only\n",
+               strerror(errno));
+      close(ts->fd);
+      ts->fd = -1;
+      while (ts->head <= ts->memory_seq) {
+        timeshift_evict_head_locked(ts);
+      }
+      return;
+    }
+    done += len;
+  }
+  ts->memory_seq++;
+}
+
+static void timeshift_make_room_locked(timeshift_t *ts, uint32_t size) {
+  // The index spans disk and memory, so a full index always drops the oldest.
+  while (ts->tail - ts->head >= ts->nr_entries) {
+    timeshift_evict_head_locked(ts);
+  }
+  while (ts->write_pos + size - timeshift_memory_start(ts) > ts->memory_size) {
+    if (ts->fd >= 0) {
+      timeshift_spill_locked(ts);
+    } else {
+      timeshift_evict_head_locked(ts);
+    }
+  }
+  if (ts->cursor < ts->head) {
+    timeshift_resync_locked(ts);
+  }
+}
+
+timeshift_t *timeshift_create(uint32_t max_bytes, const char *spill_dir,
+                              uint64_t max_spill_bytes, int key_stream) {
+  return_value_if_fail(max_bytes >= TIMESHIFT_MIN_BYTES, NULL);
+
+  timeshift_t *ts = (timeshift_t *)calloc(1, sizeof(timeshift_t));
+  return_value_if_fail(ts != NULL, NULL);
+
+  uint32_t index_bytes = max_bytes / TIMESHIFT_INDEX_SHARE;
+  ts->nr_entries =
+      tk_max(index_bytes / sizeof(timeshift_entry_t), TIMESHIFT_MIN_ENTRIES);
+  ts->memory_size = max_bytes - ts->nr_entries * sizeof(timeshift_entry_t);
+  ts->memory = (uint8_t *)malloc(ts->memory_size);
+  ts->entries =
+      (timeshift_entry_t *)calloc(ts->nr_entries, sizeof(timeshift_entry_t));
+  ts->fd = -1;
+  ts->key_stream = key_stream;
+  ts->stats.max_bytes = max_bytes;
+  if (ts->memory == NULL || ts->entries == NULL) {
+    timeshift_destroy(ts);
+    return NULL;
+  }
+
+  // Spilled packets must fit as a whole, so the file is at least memory sized.
+  if (spill_dir != NULL && *spill_dir && max_spill_bytes > 0) {
+    if (max_spill_bytes < ts->memory_size) {
+      log_warn("timeshift: spill size below memory size, not spilling\n");
+    } else {
+      char path[MAX_PATH + 1];
+      snprintf(path, sizeof(path), "%s/timeshift-XXXXXX", spill_dir);
+      ts->fd = mkstemp(path);
+      if (ts->fd >= 0) {
+        // Nothing outlives the process, even after a crash.
+        unlink(path);
+        ts->spill_size = max_spill_bytes;
+        ts->stats.max_spill_bytes = max_spill_bytes;
+      } else {
+        log_warn("timeshift: cannot create spill file in %s: %s\n", spill_dir,
+                 strerror(errno));
+      }
+    }
+  }
+
+  pthread_mutex_init(&ts->mutex, NULL);
+  cond_clock_init(&ts->cond);
+
+  return ts;
+}
+
+ret_t timeshift_destroy(timeshift_t *ts) {
+  return_value_if_fail(ts != NULL, RET_BAD_PARAMS);
+
+  if (ts->memory != NULL && ts->entries != NULL) {
+    pthread_mutex_destroy(&ts->mutex);
+    pthread_cond_destroy(&ts->cond);
+  }
+  if (ts->fd >= 0) {
+    close(ts->fd);
+  }
+  free(ts->memory);
+  free(ts->entries);
+  free(ts);
+
+  return RET_OK;
+}
+
+ret_t timeshift_write(timeshift_t *ts, AVPacket *pkt, double time) {
+  return_value_if_fail(ts != NULL && pkt != NULL, RET_BAD_PARAMS);
+  if ((uint32_t)pkt->size > ts->memory_size) {
+    log_warn("timeshift: %d byte packet does not fit, dropped\n", pkt->size);
+    return RET_FAIL;
+  }
+
+  pthread_mutex_lock(&ts->mutex);
+  timeshift_make_room_locked(ts, pkt->size);
+
+  timeshift_entry_t *e = timeshift_entry(ts, ts->tail);
+  e->pos = ts->write_pos;
+  e->size = pkt->size;
+  e->stream_index = pkt->stream_index;
+  e->flags = pkt->flags;
+  e->pts = pkt->pts;
+  e->dts = pkt->dts;
+  e->duration = pkt->duration;
+  e->time = time;
+  timeshift_memory_copy(ts, e->pos, pkt->data, e->size, TRUE);
+
+  ts->write_pos += e->size;
+  ts->tail++;
+  pthread_cond_signal(&ts->cond);
+  pthread_mutex_unlock(&ts->mutex);
+
+  return RET_OK;
+}
+
+ret_t timeshift_set_eof(timeshift_t *ts) {
+  return_value_if_fail(ts != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&ts->mutex);
+  ts->eof = TRUE;
+  pthread_cond_broadcast(&ts->cond);
+  pthread_mutex_unlock(&ts->mutex);
+
+  return RET_OK;
+}
+
+static ret_t timeshift_read_locked(timeshift_t *ts, AVPacket *pkt) {
+  timeshift_entry_t *e = timeshift_entry(ts, ts->cursor);
+
+  if (av_new_packet(pkt, e->size) < 0) {
+    return RET_OOM;
+  }
+  if (ts->cursor >= ts->memory_seq) {
+    timeshift_memory_copy(ts, e->pos, pkt->data, e->size, FALSE);
+  } else if (timeshift_disk_copy(ts, e->pos, pkt->data, e->size, FALSE) !=
+             RET_OK) {
+    log_warn("timeshift: spill read failed: %s\n", strerror(errno));
+    av_packet_unref(pkt);
+    ts->cursor++;
+    return RET_IO;
+  }
+  pkt->stream_index = e->stream_index;
+  pkt->flags = e->flags;
+  pkt->pts = e->pts;
+  pkt->dts = e->dts;
+  pkt->duration = e->duration;
+  ts->cursor++;
+
+  return RET_OK;
+}
+
+ret_t timeshift_read(timeshift_t *ts, AVPacket *pkt, uint32_t timeout_ms) {
+  ret_t ret = RET_OK;
+  struct timespec deadline;
+
+  return_value_if_fail(ts != NULL && pkt != NULL, RET_BAD_PARAMS);
+
+  cond_clock_deadline(&deadline, timeout_ms);
+
+  pthread_mutex_lock(&ts->mutex);
+  for (;;) {
+    if (ts->skipped) {
+      ts->skipped = FALSE;
+      ret = RET_SKIP;
+      break;
+    }
+    if (ts->cursor < ts->tail) {
+      ret = timeshift_read_locked(ts, pkt);
+      break;
+    }
+    if (ts->eof) {
+      ret = RET_EOS;
+      break;
+    }
+    if (pthread_cond_timedwait(&ts->cond, &ts->mutex, &deadline) == ETIMEDOUT) {
+      ret = RET_TIMEOUT;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&ts->mutex);
+
+  return ret;
+}
+
+ret_t timeshift_seek(timeshift_t *ts, double delay, double *landed) {
+  ret_t ret = RET_NOT_FOUND;
+  return_value_if_fail(ts != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&ts->mutex);
+  if (ts->tail > ts->head) {
+    double live = timeshift_live_time(ts);
+    double target = live - tk_max(delay, 0);
+    uint64_t found = ts->tail;
+
+    // Newest keyframe not after the target, else the oldest keyframe held;
+    // a delay of 0 lands on the latest keyframe.
+    for (uint64_t seq = ts->tail; seq-- > ts->head;) {
+      timeshift_entry_t *e = timeshift_entry(ts, seq);
+      if (timeshift_is_key(ts, e)) {
+        found = seq;
+        if (e->time <= target + 0.001) {
+          break;
+        }
+      }
+    }
+
+    ts->cursor = found;
+    ts->skipped = FALSE;
+    if (landed != NULL) {
+      *landed = found < ts->tail ? live - timeshift_entry(ts, found)->time : 0;
+    }
+    ret = RET_OK;
+  }
+  pthread_mutex_unlock(&ts->mutex);
+
+  return ret;
+}
+
+ret_t timeshift_get_stats(timeshift_t *ts, timeshift_stats_t *stats) {
+  return_value_if_fail(ts != NULL && stats != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&ts->mutex);
+  *stats = ts->stats;
+  stats->packets = ts->tail - ts->head;
+  stats->window = 0;
+  stats->delay = 0;
+  stats->memory_bytes = ts->write_pos - timeshift_memory_start(ts);
+  stats->disk_bytes = 0;
+  if (ts->tail > ts->head) {
+    double live = timeshift_live_time(ts);
+    stats->window = live - timeshift_entry(ts, ts->head)->time;
+    if (ts->cursor < ts->tail) {
+      stats->delay = live - timeshift_entry(ts, ts->cursor)->time;
+    }
+    stats->disk_bytes =
+        timeshift_memory_start(ts) - timeshift_entry(ts, ts->head)->pos;
+  }
+  pthread_mutex_unlock(&ts->mutex);
+
+  return RET_OK;
+}
@@ -0,0 +1,62 @@
+#ifndef TIMESHIFT_H
+#define TIMESHIFT_H
+
+#include "tkc/types_def.h"
+#include <libavcodec/avcodec.h>
+
+BEGIN_C_DECLS
+
+/*
+ * Timeshift (DVR) buffer for live streams: one writer appends every demuxed
+ * packet while one reader plays from a cursor that may lag behind the live
+ * edge. Memory use is bounded by max_bytes, packet index included. Packets
+ * pushed out of memory spill to a file of at most max_spill_bytes when a
+ * directory is given, and are dropped from the oldest end otherwise.
+ *
+ * A cursor overtaken by eviction moves to the next keyframe of key_stream,
+ * and the reader is told with RET_SKIP.
+ */
+typedef struct _timeshift_t timeshift_t;
+
+typedef struct _timeshift_stats_t {
+  /* Seconds from the oldest packet held to the live edge */
+  double window;
+  /* Seconds the cursor is behind the live edge */
+  double delay;
+  uint32_t packets;
+  uint64_t memory_bytes;
+  uint64_t disk_bytes;
+  uint32_t max_bytes;
+  uint64_t max_spill_bytes;
+  /* Packets evicted for good, and times the cursor was overtaken */
+  uint32_t evicted;
+  uint32_t skips;
+} timeshift_stats_t;
+
+/* spill_dir NULL keeps everything in memory; key_stream < 0 treats all packets as keys. */
+timeshift_t *timeshift_create(uint32_t max_bytes, const char *spill_dir,
+                              uint64_t max_spill_bytes, int key_stream);
+ret_t timeshift_destroy(timeshift_t *ts);
+
+/* Copies the packet; time is its position in seconds on the stream clock. */
+ret_t timeshift_write(timeshift_t *ts, AVPacket *pkt, double time);
+ret_t timeshift_set_eof(timeshift_t *ts);
+
+/*
+ * Copies the packet at the cursor into pkt and advances. Returns RET_EOS at
+ * the live edge after timeshift_set_eof, RET_TIMEOUT if nothing arrived
+ * within timeout_ms, and RET_SKIP once after the cursor was overtaken.
+ */
+ret_t timeshift_read(timeshift_t *ts, AVPacket *pkt, uint32_t timeout_ms);
+
+/*
+ * Move the cursor to the latest keyframe at least delay seconds behind the
+ * live edge, or the oldest one held. landed receives the resulting delay.
+ */
+ret_t timeshift_seek(timeshift_t *ts, double delay, double *landed);
+
+ret_t timeshift_get_stats(timeshift_t *ts, timeshift_stats_t *stats);
+
+END_C_DECLS
+
+#endif /* TIMESHIFT_H */
@@ -0,0 +1,278 @@
+#include "video_scaler.h"
+#include "tkc/log.h"
+#include <libavutil/buffer.h>
+
+/* Slice threading needs the sws_send_slice/sws_receive_slice API. */
+#define VIDEO_SCALER_HAS_SLICES (LIBSWSCALE_VERSION_MAJOR >= 6)
+
+static void video_scaler_free_contexts(video_scaler_t *scaler) {
+  for (uint32_t i = 0; i < VIDEO_SCALER_MAX_SLICES; i++) {
+    if (scaler->ctx[i]) {
+      sws_freeContext(scaler->ctx[i]);
+      scaler->ctx[i] = NULL;
+    }
+  }
+  scaler->nr_slices = 0;
+  scaler->src_w = 0;
+  scaler->src_h = 0;
+  scaler->direct = FALSE;
+}
+
+static bool_t video_scaler_can_convert_direct(video_scaler_t *scaler,
+                                              const AVFrame *src, int dst_w,
+                                              int dst_h, int dst_fmt) {
+  if (!scaler->use_kernel ||
+      (dst_fmt != AV_PIX_FMT_RGBA && dst_fmt != AV_PIX_FMT_BGRA) ||
+      dst_w != src->width || dst_h != src->height) {
+    return FALSE;
+  }
+
+  return src->format == AV_PIX_FMT_YUV420P ||
+         src->format == AV_PIX_FMT_YUVJ420P || src->format == AV_PIX_FMT_NV12;
+}
+
+ret_t video_scaler_init(video_scaler_t *scaler) {
+  return_value_if_fail(scaler != NULL, RET_BAD_PARAMS);
+
+  memset(scaler, 0x00, sizeof(*scaler));
+  scaler->use_kernel = TRUE;
+  scaler->kernel = YUV2RGB_KERNEL_AUTO;
+
+  return RET_OK;
+}
+
+ret_t video_scaler_set_kernel(video_scaler_t *scaler, bool_t enable,
+                              yuv2rgb_kernel_t kernel) {
+  return_value_if_fail(scaler != NULL, RET_BAD_PARAMS);
+  return_value_if_fail(!enable || yuv2rgb_kernel_available(kernel),
+                       RET_NOT_IMPL);
+
+  if (scaler->use_kernel != enable || scaler->kernel != kernel) {
+    scaler->use_kernel = enable;
+    scaler->kernel = kernel;
+    // Forces the next configure to rebuild.
+    video_scaler_free_contexts(scaler);
+  }
+
+  return RET_OK;
+}
+
+ret_t video_scaler_deinit(video_scaler_t *scaler) {
+  return_value_if_fail(scaler != NULL, RET_BAD_PARAMS);
+
+  video_scaler_free_contexts(scaler);
+  for (uint32_t i = 0; i < VIDEO_SCALER_MAX_SLICES; i++) {
+    av_frame_free(&scaler->dst[i]);
+  }
+  av_buffer_unref(&scaler->dst_ref);
+
+  return RET_OK;
+}
+
+ret_t video_scaler_configure(video_scaler_t *scaler, const AVFrame *src,
+                             int dst_w, int dst_h, int dst_fmt, int flags,
+                             uint32_t nr_slices) {
+  return_value_if_fail(scaler != NULL && src != NULL, RET_BAD_PARAMS);
+
+#if !VIDEO_SCALER_HAS_SLICES
+  nr_slices = 1;
+#endif
+  nr_slices = tk_max(1, tk_min(nr_slices, VIDEO_SCALER_MAX_SLICES));
+
+  if (scaler->nr_slices == nr_slices && scaler->src_w == src->width &&
+      scaler->src_h == src->height && scaler->src_fmt == src->format &&
+      scaler->dst_w == dst_w && scaler->dst_h == dst_h &&
+      scaler->dst_fmt == dst_fmt && scaler->flags == flags) {
+    return RET_OK;
+  }
+
+  video_scaler_free_contexts(scaler);
+
+  if (video_scaler_can_convert_direct(scaler, src, dst_w, dst_h, dst_fmt)) {
+    log_debug("scaler: %dx%d %s kernel, %u slices\n", src->width, src->height,
+              yuv2rgb_kernel_name(scaler->kernel), nr_slices);
+    // Rows are independent; even slice heights keep chroma rows unshared.
+    int rows = (dst_h + nr_slices - 1) / nr_slices;
+    scaler->direct = TRUE;
+    scaler->nr_slices = nr_slices;
+    scaler->slice_h = (rows + 1) & ~1;
+    scaler->src_w = src->width;
+    scaler->src_h = src->height;
+    scaler->src_fmt = src->format;
+    scaler->dst_w = dst_w;
+    scaler->dst_h = dst_h;
+    scaler->dst_fmt = dst_fmt;
+    scaler->flags = flags;
+    return RET_OK;
+  }
+
+  log_debug("scaler: %dx%d -> %dx%d, %u slices\n", src->width, src->height,
+            dst_w, dst_h, nr_slices);
+  for (uint32_t i = 0; i < nr_slices; i++) {
+    scaler->ctx[i] = sws_getContext(
+        src->width, src->height, (enum AVPixelFormat)src->format, dst_w, dst_h,
+        (enum AVPixelFormat)dst_fmt, flags, NULL, NULL, NULL);
+    if (scaler->ctx[i] == NULL) {
+      video_scaler_free_contexts(scaler);
+      return RET_FAIL;
+    }
+  }
+
+  scaler->nr_slices = nr_slices;
+  scaler->slice_h = dst_h;
+#if VIDEO_SCALER_HAS_SLICES
+  if (nr_slices > 1) {
+    int align = (int)sws_receive_slice_alignment(scaler->ctx[0]);
+    int rows = (dst_h + nr_slices - 1) / nr_slices;
+    scaler->slice_h = tk_max(align, (rows + align - 1) / align * align);
+  }
+#endif
+  scaler->src_w = src->width;
+  scaler->src_h = src->height;
+  scaler->src_fmt = src->format;
+  scaler->dst_w = dst_w;
+  scaler->dst_h = dst_h;
+  scaler->dst_fmt = dst_fmt;
+  scaler->flags = flags;
+
+  return RET_OK;
+}
+
+static void video_scaler_convert_rows(void *ctx, uint32_t index) {
+  video_scaler_t *scaler = (video_scaler_t *)ctx;
+  int y = index * scaler->slice_h;
+  int h = tk_min(scaler->slice_h, scaler->dst_h - y);
+
+  if (h <= 0) {
+    return;
+  }
+
+  if (yuv2rgb_convert_rows(scaler->kernel, &scaler->yuv, scaler->yuv_dst,
+                           scaler->yuv_dst_stride, y, y + h) != RET_OK) {
+    __atomic_add_fetch(&scaler->errors, 1, __ATOMIC_RELAXED);
+  }
+}
+
+static ret_t video_scaler_convert_direct(video_scaler_t *scaler,
+                                         const AVFrame *src, uint8_t *dst,
+                                         int dst_stride, worker_pool_t *pool) {
+  yuv2rgb_src_t *yuv = &scaler->yuv;
+
+  yuv->format = src->format == AV_PIX_FMT_NV12 ? YUV2RGB_FORMAT_NV12
+                                               : YUV2RGB_FORMAT_YUV420P;
+  for (int p = 0; p < 3; p++) {
+    yuv->data[p] = src->data[p];
+    yuv->stride[p] = src->linesize[p];
+  }
+  yuv->width = src->width;
+  yuv->height = src->height;
+  // Untagged HD streams are BT.709 in practice, SD ones BT.601.
+  if (src->colorspace == AVCOL_SPC_BT709 ||
+      (src->colorspace == AVCOL_SPC_UNSPECIFIED && src->height >= 720)) {
+    yuv->matrix = YUV2RGB_MATRIX_BT709;
+  } else {
+    yuv->matrix = YUV2RGB_MATRIX_BT601;
+  }
+  yuv->full_range = src->format == AV_PIX_FMT_YUVJ420P ||
+                    src->color_range == AVCOL_RANGE_JPEG;
+  yuv->bgra = scaler->dst_fmt == AV_PIX_FMT_BGRA;
+
+  scaler->yuv_dst = dst;
+  scaler->yuv_dst_stride = dst_stride;
+  scaler->errors = 0;
+  if (pool != NULL && scaler->nr_slices > 1) {
+    worker_pool_run(pool, video_scaler_convert_rows, scaler, scaler->nr_slices);
+  } else {
+    for (uint32_t i = 0; i < scaler->nr_slices; i++) {
+      video_scaler_convert_rows(scaler, i);
+    }
+  }
+  scaler->yuv_dst = NULL;
+
+  return scaler->errors == 0 ? RET_OK : RET_FAIL;
+}
+
+#if VIDEO_SCALER_HAS_SLICES
+static void video_scaler_convert_slice(void *ctx, uint32_t index) {
+  video_scaler_t *scaler = (video_scaler_t *)ctx;
+  struct SwsContext *sws = scaler->ctx[index];
+  AVFrame *dst = scaler->dst[index];
+  int y = index * scaler->slice_h;
+  int h = tk_min(scaler->slice_h, scaler->dst_h - y);
+
+  if (h <= 0) {
+    return;
+  }
+
+  // Every slice context reads the whole source and writes only its rows.
+  if (sws_frame_start(sws, dst, scaler->src) < 0) {
+    __atomic_add_fetch(&scaler->errors, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  if (sws_send_slice(sws, 0, scaler->src_h) < 0 ||
+      sws_receive_slice(sws, y, h) < 0) {
+    __atomic_add_fetch(&scaler->errors, 1, __ATOMIC_RELAXED);
+  }
+  sws_frame_end(sws);
+}
+#endif
+
+ret_t video_scaler_convert(video_scaler_t *scaler, const AVFrame *src,
+                           uint8_t *const dst[4], const int dst_linesize[4],
+                           worker_pool_t *pool) {
+  return_value_if_fail(scaler != NULL && src != NULL && dst != NULL,
+                       RET_BAD_PARAMS);
+  return_value_if_fail(scaler->nr_slices > 0, RET_FAIL);
+
+  if (scaler->direct) {
+    return video_scaler_convert_direct(scaler, src, dst[0], dst_linesize[0],
+                                       pool);
+  }
+
+  if (scaler->nr_slices == 1) {
+    sws_scale(scaler->ctx[0], (uint8_t const *const *)src->data, src->linesize,
+              0, src->height, dst, dst_linesize);
+    return RET_OK;
+  }
+
+#if VIDEO_SCALER_HAS_SLICES
+  // sws_frame_start allocates a destination unless it already holds a
+  // buffer; a placeholder reference makes it write to our pointers instead.
+  if (scaler->dst_ref == NULL) {
+    scaler->dst_ref = av_buffer_alloc(1);
+    return_value_if_fail(scaler->dst_ref != NULL, RET_OOM);
+  }
+  for (uint32_t i = 0; i < scaler->nr_slices; i++) {
+    AVFrame *frame = scaler->dst[i];
+    if (frame == NULL) {
+      frame = scaler->dst[i] = av_frame_alloc();
+      return_value_if_fail(frame != NULL, RET_OOM);
+      frame->buf[0] = av_buffer_ref(scaler->dst_ref);
+      return_value_if_fail(frame->buf[0] != NULL, RET_OOM);
+    }
+    for (int p = 0; p < 4; p++) {
+      frame->data[p] = dst[p];
+      frame->linesize[p] = dst_linesize[p];
+    }
+    frame->width = scaler->dst_w;
+    frame->height = scaler->dst_h;
+    frame->format = scaler->dst_fmt;
+  }
+
+  scaler->src = src;
+  scaler->errors = 0;
+  if (pool != NULL) {
+    worker_pool_run(pool, video_scaler_convert_slice, scaler,
+                    scaler->nr_slices);
+  } else {
+    for (uint32_t i = 0; i < scaler->nr_slices; i++) {
+      video_scaler_convert_slice(scaler, i);
+    }
+  }
+  scaler->src = NULL;
+
+  return scaler->errors == 0 ? RET_OK : RET_FAIL;
+#else
+  return RET_NOT_IMPL;
+#endif
+}
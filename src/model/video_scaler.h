@@ -0,0 +1,72 @@
+#ifndef VIDEO_SCALER_H
+#define VIDEO_SCALER_H
+
+#include "tkc/types_def.h"
+#include "worker_pool.h"
+#include "yuv2rgb.h"
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+
+BEGIN_C_DECLS
+
+#define VIDEO_SCALER_MAX_SLICES 16
+
+/*
+ * Colour conversion and scaling of decoded frames. The output is split into
+ * horizontal slices, each with its own SwsContext, so the slices can be
+ * converted in parallel on a worker_pool. Same-size conversions of
+ * yuv420p/yuvj420p/nv12 to RGBA or BGRA bypass swscale for the yuv2rgb
+ * kernels unless that is disabled.
+ */
+typedef struct _video_scaler_t {
+  struct SwsContext *ctx[VIDEO_SCALER_MAX_SLICES];
+  uint32_t nr_slices;
+  int slice_h;
+
+  /* Geometry the contexts were built for */
+  int src_w;
+  int src_h;
+  int src_fmt;
+  int dst_w;
+  int dst_h;
+  int dst_fmt;
+  int flags;
+
+  /* yuv2rgb kernel for same-size conversions; direct when it applies */
+  bool_t use_kernel;
+  yuv2rgb_kernel_t kernel;
+  bool_t direct;
+
+  /* State of the conversion in flight */
+  const AVFrame *src;
+  yuv2rgb_src_t yuv;
+  uint8_t *yuv_dst;
+  int yuv_dst_stride;
+  AVFrame *dst[VIDEO_SCALER_MAX_SLICES];
+  AVBufferRef *dst_ref;
+  int errors;
+} video_scaler_t;
+
+ret_t video_scaler_init(video_scaler_t *scaler);
+ret_t video_scaler_deinit(video_scaler_t *scaler);
+
+/*
+ * Choose between the yuv2rgb kernels (enable, with kernel or
+ * YUV2RGB_KERNEL_AUTO) and swscale for every conversion (!enable).
+ */
+ret_t video_scaler_set_kernel(video_scaler_t *scaler, bool_t enable,
+                              yuv2rgb_kernel_t kernel);
+
+/* Rebuild the contexts only if the geometry, flags or slice count changed. */
+ret_t video_scaler_configure(video_scaler_t *scaler, const AVFrame *src,
+                             int dst_w, int dst_h, int dst_fmt, int flags,
+                             uint32_t nr_slices);
+
+/* Convert src into dst; pool may be NULL to run on the calling thread. */
+ret_t video_scaler_convert(video_scaler_t *scaler, const AVFrame *src,
+                           uint8_t *const dst[4], const int dst_linesize[4],
+                           worker_pool_t *pool);
+
+END_C_DECLS
+
+#endif /* VIDEO_SCALER_H */
@@ -0,0 +1,120 @@
+#include "worker_pool.h"
+#include <stdlib.h>
+
+/* Run job indices until none are left. Called with pool->mutex held. */
+static void worker_pool_drain_locked(worker_pool_t *pool) {
+  while (pool->next_job < pool->nr_jobs) {
+    uint32_t index = pool->next_job++;
+    worker_pool_job_t job = pool->job;
+    void *ctx = pool->ctx;
+
+    pthread_mutex_unlock(&pool->mutex);
+    job(ctx, index);
+    pthread_mutex_lock(&pool->mutex);
+
+    if (--pool->pending == 0) {
+      pthread_cond_broadcast(&pool->done_cond);
+    }
+  }
+}
+
+static void *worker_pool_thread(void *arg) {
+  worker_pool_t *pool = (worker_pool_t *)arg;
+  uint32_t seen = 0;
+
+  pthread_mutex_lock(&pool->mutex);
+  while (!pool->quit) {
+    if (pool->generation == seen) {
+      pthread_cond_wait(&pool->work_cond, &pool->mutex);
+      continue;
+    }
+    seen = pool->generation;
+    worker_pool_drain_locked(pool);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  return NULL;
+}
+
+worker_pool_t *worker_pool_create(uint32_t nr_threads) {
+  worker_pool_t *pool = (worker_pool_t *)calloc(1, sizeof(worker_pool_t));
+  return_value_if_fail(pool != NULL, NULL);
+
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_mutex_init(&pool->run_mutex, NULL);
+  pthread_cond_init(&pool->work_cond, NULL);
+  pthread_cond_init(&pool->done_cond, NULL);
+
+  if (nr_threads > 0) {
+    pool->threads = (pthread_t *)calloc(nr_threads, sizeof(pthread_t));
+    if (pool->threads == NULL) {
+      worker_pool_destroy(pool);
+      return NULL;
+    }
+  }
+
+  for (uint32_t i = 0; i < nr_threads; i++) {
+    if (pthread_create(&pool->threads[i], NULL, worker_pool_thread, pool) != 0) {
+      break;
+    }
+    pool->nr_threads++;
+  }
+
+  return pool;
+}
+
+ret_t worker_pool_destroy(worker_pool_t *pool) {
+  return_value_if_fail(pool != NULL, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->quit = TRUE;
+  pthread_cond_broadcast(&pool->work_cond);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (uint32_t i = 0; i < pool->nr_threads; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  free(pool->threads);
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_mutex_destroy(&pool->run_mutex);
+  pthread_cond_destroy(&pool->work_cond);
+  pthread_cond_destroy(&pool->done_cond);
+  free(pool);
+
+  return RET_OK;
+}
+
+ret_t worker_pool_run(worker_pool_t *pool, worker_pool_job_t job, void *ctx,
+                      uint32_t nr_jobs) {
+  return_value_if_fail(pool != NULL && job != NULL, RET_BAD_PARAMS);
+
+  if (nr_jobs == 0) {
+    return RET_OK;
+  }
+
+  pthread_mutex_lock(&pool->run_mutex);
+  pthread_mutex_lock(&pool->mutex);
+  pool->job = job;
+  pool->ctx = ctx;
+  pool->nr_jobs = nr_jobs;
+  pool->next_job = 0;
+  pool->pending = nr_jobs;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->work_cond);
+
+  worker_pool_drain_locked(pool);
+  while (pool->pending > 0) {
+    pthread_cond_wait(&pool->done_cond, &pool->mutex);
+  }
+  pool->job = NULL;
+  pool->ctx = NULL;
+  pthread_mutex_unlock(&pool->mutex);
+  pthread_mutex_unlock(&pool->run_mutex);
+
+  return RET_OK;
+}
+
+uint32_t worker_pool_concurrency(worker_pool_t *pool) {
+  return pool != NULL ? pool->nr_threads + 1 : 1;
+}
@@ -0,0 +1,47 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include "tkc/types_def.h"
+#include <pthread.h>
+
+BEGIN_C_DECLS
+
+typedef void (*worker_pool_job_t)(void *ctx, uint32_t index);
+
+/*
+ * A fixed set of threads for fork-join work: worker_pool_run splits a job
+ * into nr_jobs indices, runs them on the pool and on the calling thread, and
+ * returns when all of them are done.
+ */
+typedef struct _worker_pool_t {
+  pthread_t *threads;
+  uint32_t nr_threads;
+
+  worker_pool_job_t job;
+  void *ctx;
+  uint32_t nr_jobs;
+  uint32_t next_job;
+  uint32_t pending;
+  uint32_t generation;
+  bool_t quit;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t work_cond;
+  pthread_cond_t done_cond;
+  /* Serialises callers of worker_pool_run */
+  pthread_mutex_t run_mutex;
+} worker_pool_t;
+
+/* nr_threads extra threads; the caller of worker_pool_run is one more. */
+worker_pool_t *worker_pool_create(uint32_t nr_threads);
+ret_t worker_pool_destroy(worker_pool_t *pool);
+
+ret_t worker_pool_run(worker_pool_t *pool, worker_pool_job_t job, void *ctx,
+                      uint32_t nr_jobs);
+
+/* Threads available to a job, counting the caller. */
+uint32_t worker_pool_concurrency(worker_pool_t *pool);
+
+END_C_DECLS
+
+#endif /* WORKER_POOL_H */
@@ -0,0 +1,396 @@
+#include "yuv2rgb.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define YUV2RGB_HAS_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define YUV2RGB_HAS_NEON 1
+#include <arm_neon.h>
+#endif
+
+/*
+ * Q6 fixed point, 16-bit lanes:
+ *   y' = (Y - yoff) * ycoef
+ *   R = (y' + crv * V' + 32) >> 6
+ *   G = (y' - cgu * U' - cgv * V' + 32) >> 6
+ *   B = (y' + cbu * U' + 32) >> 6
+ * with U' = U - 128, V' = V - 128. Sums saturate to int16 and results to
+ * 0..255, exactly as the packed-saturating SIMD instructions do.
+ */
+typedef struct _yuv2rgb_coef_t {
+  int16_t yoff;
+  int16_t ycoef;
+  int16_t crv;
+  int16_t cgu;
+  int16_t cgv;
+  int16_t cbu;
+} yuv2rgb_coef_t;
+
+static const yuv2rgb_coef_t s_coefs[2][2] = {
+    /* limited range */
+    {{16, 75, 102, 25, 52, 129}, {16, 75, 115, 14, 34, 135}},
+    /* full range */
+    {{0, 64, 90, 22, 46, 113}, {0, 64, 101, 12, 30, 119}},
+};
+
+typedef struct _yuv2rgb_row_t {
+  const uint8_t *y;
+  const uint8_t *u; /* interleaved UV for nv12 */
+  const uint8_t *v;
+  uint8_t *dst;
+  int width;
+  bool_t nv12;
+  bool_t bgra;
+} yuv2rgb_row_t;
+
+/* Returns the number of leading pixels converted; the rest go to the scalar kernel. */
+typedef int (*yuv2rgb_row_func_t)(const yuv2rgb_row_t *row, const yuv2rgb_coef_t *c);
+
+static inline int yuv2rgb_sat16(int v) {
+  return v < -32768 ? -32768 : (v > 32767 ? 32767 : v);
+}
+
+static inline uint8_t yuv2rgb_clamp(int v) {
+  v = yuv2rgb_sat16(v + 32) >> 6;
+  return v < 0 ? 0 : (v > 255 ? 255 : (uint8_t)v);
+}
+
+static void yuv2rgb_row_scalar(const yuv2rgb_row_t *row, const yuv2rgb_coef_t *c,
+                               int x) {
+  uint8_t *d = row->dst + x * 4;
+  int ri = row->bgra ? 2 : 0;
+  int bi = 2 - ri;
+
+  for (; x < row->width; x++, d += 4) {
+    int cx = x >> 1;
+    int u = (row->nv12 ? row->u[cx * 2] : row->u[cx]) - 128;
+    int v = (row->nv12 ? row->u[cx * 2 + 1] : row->v[cx]) - 128;
+    int y = (int16_t)((row->y[x] - c->yoff) * c->ycoef);
+    int rv = (int16_t)(v * c->crv);
+    int gv = (int16_t)(u * c->cgu + v * c->cgv);
+    int bv = (int16_t)(u * c->cbu);
+
+    d[ri] = yuv2rgb_clamp(yuv2rgb_sat16(y + rv));
+    d[1] = yuv2rgb_clamp(yuv2rgb_sat16(y - gv));
+    d[bi] = yuv2rgb_clamp(yuv2rgb_sat16(y + bv));
+    d[3] = 0xff;
+  }
+}
+
+static int yuv2rgb_row_none(const yuv2rgb_row_t *row, const yuv2rgb_coef_t *c) {
+  (void)row;
+  (void)c;
+  return 0;
+}
+
+#ifdef YUV2RGB_HAS_X86
+/* 16 pixels per iteration; SSE2 is part of the x86-64 baseline. */
+__attribute__((target("sse2"))) static int
+yuv2rgb_row_sse2(const yuv2rgb_row_t *row, const yuv2rgb_coef_t *c) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i c128 = _mm_set1_epi16(128);
+  const __m128i round = _mm_set1_epi16(32);
+  const __m128i lo8 = _mm_set1_epi16(0x00ff);
+  const __m128i alpha = _mm_set1_epi8((char)0xff);
+  const __m128i yoff = _mm_set1_epi16(c->yoff);
+  const __m128i ycoef = _mm_set1_epi16(c->ycoef);
+  const __m128i crv = _mm_set1_epi16(c->crv);
+  const __m128i cgu = _mm_set1_epi16(c->cgu);
+  const __m128i cgv = _mm_set1_epi16(c->cgv);
+  const __m128i cbu = _mm_set1_epi16(c->cbu);
+  int x = 0;
+
+  for (; x + 16 <= row->width; x += 16) {
+    __m128i u, v;
+    if (row->nv12) {
+      __m128i uv = _mm_loadu_si128((const __m128i *)(row->u + x));
+      u = _mm_and_si128(uv, lo8);
+      v = _mm_srli_epi16(uv, 8);
+    } else {
+      u = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(row->u + x / 2)), zero);
+      v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(row->v + x / 2)), zero);
+    }
+    u = _mm_sub_epi16(u, c128);
+    v = _mm_sub_epi16(v, c128);
+
+    /* Chroma terms for 8 pixel pairs */
+    __m128i rv = _mm_mullo_epi16(v, crv);
+    __m128i gv = _mm_add_epi16(_mm_mullo_epi16(u, cgu), _mm_mullo_epi16(v, cgv));
+    __m128i bv = _mm_mullo_epi16(u, cbu);
+
+    __m128i yy = _mm_loadu_si128((const __m128i *)(row->y + x));
+    __m128i y0 = _mm_mullo_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(yy, zero), yoff), ycoef);
+    __m128i y1 = _mm_mullo_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(yy, zero), yoff), ycoef);
+
+#define YUV2RGB_SSE2_CHANNEL(op, term)                                               \
+  _mm_packus_epi16(                                                                 \
+      _mm_srai_epi16(_mm_adds_epi16(op(y0, _mm_unpacklo_epi16(term, term)), round), \
+                     6),                                                            \
+      _mm_srai_epi16(_mm_adds_epi16(op(y1, _mm_unpackhi_epi16(term, term)), round), \
+                     6))
+    __m128i r = YUV2RGB_SSE2_CHANNEL(_mm_adds_epi16, rv);
+    __m128i g = YUV2RGB_SSE2_CHANNEL(_mm_subs_epi16, gv);
+    __m128i b = YUV2RGB_SSE2_CHANNEL(_mm_adds_epi16, bv);
+#undef YUV2RGB_SSE2_CHANNEL
+    if (row->bgra) {
+      __m128i t = r;
+      r = b;
+      b = t;
+    }
+
+    __m128i rg_lo = _mm_unpacklo_epi8(r, g);
+    __m128i rg_hi = _mm_unpackhi_epi8(r, g);
+    __m128i ba_lo = _mm_unpacklo_epi8(b, alpha);
+    __m128i ba_hi = _mm_unpackhi_epi8(b, alpha);
+    __m128i *d = (__m128i *)(row->dst + x * 4);
+    _mm_storeu_si128(d + 0, _mm_unpacklo_epi16(rg_lo, ba_lo));
+    _mm_storeu_si128(d + 1, _mm_unpackhi_epi16(rg_lo, ba_lo));
+    _mm_storeu_si128(d + 2, _mm_unpacklo_epi16(rg_hi, ba_hi));
+    _mm_storeu_si128(d + 3, _mm_unpackhi_epi16(rg_hi, ba_hi));
+  }
+
+  return x;
+}
+
+/*
+ * 32 pixels per iteration. AVX2 unpack/pack work within 128-bit lanes, so
+ * chroma and packed bytes are permuted back into pixel order.
+ */
+__attribute__((target("avx2"))) static int
+yuv2rgb_row_avx2(const yuv2rgb_row_t *row, const yuv2rgb_coef_t *c) {
+  const __m256i c128 = _mm256_set1_epi16(128);
+  const __m256i round = _mm256_set1_epi16(32);
+  const __m256i lo8 = _mm256_set1_epi16(0x00ff);
+  const __m256i alpha = _mm256_set1_epi8((char)0xff);
+  const __m256i yoff = _mm256_set1_epi16(c->yoff);
+  const __m256i ycoef = _mm256_set1_epi16(c->ycoef);
+  const __m256i crv = _mm256_set1_epi16(c->crv);
+  const __m256i cgu = _mm256_set1_epi16(c->cgu);
+  const __m256i cgv = _mm256_set1_epi16(c->cgv);
+  const __m256i cbu = _mm256_set1_epi16(c->cbu);
+  int x = 0;
+
+  for (; x + 32 <= row->width; x += 32) {
+    __m256i u, v;
+    if (row->nv12) {
+      __m256i uv = _mm256_loadu_si256((const __m256i *)(row->u + x));
+      u = _mm256_and_si256(uv, lo8);
+      v = _mm256_srli_epi16(uv, 8);
+    } else {
+      u = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(row->u + x / 2)));
+      v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(row->v + x / 2)));
+    }
+    u = _mm256_sub_epi16(u, c128);
+    v = _mm256_sub_epi16(v, c128);
+
+    /* Reorder to chroma 0-3,8-11 | 4-7,12-15 so the in-lane unpacks below
+     * yield pixels 0-15 and 16-31. */
+    __m256i rv = _mm256_permute4x64_epi64(_mm256_mullo_epi16(v, crv), 0xd8);
+    __m256i gv = _mm256_permute4x64_epi64(
+        _mm256_add_epi16(_mm256_mullo_epi16(u, cgu), _mm256_mullo_epi16(v, cgv)),
+        0xd8);
+    __m256i bv = _mm256_permute4x64_epi64(_mm256_mullo_epi16(u, cbu), 0xd8);
+
+    __m256i y0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(row->y + x)));
+    __m256i y1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(row->y + x + 16)));
+    y0 = _mm256_mullo_epi16(_mm256_sub_epi16(y0, yoff), ycoef);
+    y1 = _mm256_mullo_epi16(_mm256_sub_epi16(y1, yoff), ycoef);
+
+#define YUV2RGB_AVX2_CHANNEL(op, term)                                                 \
+  _mm256_permute4x64_epi64(                                                           \
+      _mm256_packus_epi16(                                                            \
+          _mm256_srai_epi16(                                                          \
+              _mm256_adds_epi16(op(y0, _mm256_unpacklo_epi16(term, term)), round), 6), \
+          _mm256_srai_epi16(                                                          \
+              _mm256_adds_epi16(op(y1, _mm256_unpackhi_epi16(term, term)), round), 6)), \
+      0xd8)
+    __m256i r = YUV2RGB_AVX2_CHANNEL(_mm256_adds_epi16, rv);
+    __m256i g = YUV2RGB_AVX2_CHANNEL(_mm256_subs_epi16, gv);
+    __m256i b = YUV2RGB_AVX2_CHANNEL(_mm256_adds_epi16, bv);
+#undef YUV2RGB_AVX2_CHANNEL
+    if (row->bgra) {
+      __m256i t = r;
+      r = b;
+      b = t;
+    }
+
+    __m256i rg_lo = _mm256_unpacklo_epi8(r, g);   /* 0-7   | 16-23 */
+    __m256i rg_hi = _mm256_unpackhi_epi8(r, g);   /* 8-15  | 24-31 */
+    __m256i ba_lo = _mm256_unpacklo_epi8(b, alpha);
+    __m256i ba_hi = _mm256_unpackhi_epi8(b, alpha);
+    __m256i p0 = _mm256_unpacklo_epi16(rg_lo, ba_lo); /* 0-3   | 16-19 */
+    __m256i p1 = _mm256_unpackhi_epi16(rg_lo, ba_lo); /* 4-7   | 20-23 */
+    __m256i p2 = _mm256_unpacklo_epi16(rg_hi, ba_hi); /* 8-11  | 24-27 */
+    __m256i p3 = _mm256_unpackhi_epi16(rg_hi, ba_hi); /* 12-15 | 28-31 */
+    __m256i *d = (__m256i *)(row->dst + x * 4);
+    _mm256_storeu_si256(d + 0, _mm256_permute2x128_si256(p0, p1, 0x20));
+    _mm256_storeu_si256(d + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+    _mm256_storeu_si256(d + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+    _mm256_storeu_si256(d + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+  }
+
+  return x;
+}
+#endif /* YUV2RGB_HAS_X86 */
+
+#ifdef YUV2RGB_HAS_NEON
+static inline uint8x8_t yuv2rgb_neon_pack(int16x8_t v) {
+  return vqmovun_s16(vshrq_n_s16(vqaddq_s16(v, vdupq_n_s16(32)), 6));
+}
+
+/* 16 pixels per iteration */
+static int yuv2rgb_row_neon(const yuv2rgb_row_t *row, const yuv2rgb_coef_t *c) {
+  const uint8x8_t c128 = vdup_n_u8(128);
+  const int16x8_t yoff = vdupq_n_s16(c->yoff);
+  int x = 0;
+
+  for (; x + 16 <= row->width; x += 16) {
+    uint8x8_t u8, v8;
+    if (row->nv12) {
+      uint8x8x2_t uv = vld2_u8(row->u + x);
+      u8 = uv.val[0];
+      v8 = uv.val[1];
+    } else {
+      u8 = vld1_u8(row->u + x / 2);
+      v8 = vld1_u8(row->v + x / 2);
+    }
+    /* Widening subtract wraps; reinterpreted as signed it is U - 128. */
+    int16x8_t u = vreinterpretq_s16_u16(vsubl_u8(u8, c128));
+    int16x8_t v = vreinterpretq_s16_u16(vsubl_u8(v8, c128));
+
+    int16x8x2_t rv = vzipq_s16(vmulq_n_s16(v, c->crv), vmulq_n_s16(v, c->crv));
+    int16x8_t g = vmlaq_n_s16(vmulq_n_s16(u, c->cgu), v, c->cgv);
+    int16x8x2_t gv = vzipq_s16(g, g);
+    int16x8x2_t bv = vzipq_s16(vmulq_n_s16(u, c->cbu), vmulq_n_s16(u, c->cbu));
+
+    uint8x16_t yy = vld1q_u8(row->y + x);
+    int16x8_t y0 = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(yy)));
+    int16x8_t y1 = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(yy)));
+    y0 = vmulq_n_s16(vsubq_s16(y0, yoff), c->ycoef);
+    y1 = vmulq_n_s16(vsubq_s16(y1, yoff), c->ycoef);
+
+    uint8x16x4_t out;
+    int ri = row->bgra ? 2 : 0;
+    out.val[ri] = vcombine_u8(yuv2rgb_neon_pack(vqaddq_s16(y0, rv.val[0])),
+                              yuv2rgb_neon_pack(vqaddq_s16(y1, rv.val[1])));
+    out.val[1] = vcombine_u8(yuv2rgb_neon_pack(vqsubq_s16(y0, gv.val[0])),
+                             yuv2rgb_neon_pack(vqsubq_s16(y1, gv.val[1])));
+    out.val[2 - ri] = vcombine_u8(yuv2rgb_neon_pack(vqaddq_s16(y0, bv.val[0])),
+                                  yuv2rgb_neon_pack(vqaddq_s16(y1, bv.val[1])));
+    out.val[3] = vdupq_n_u8(0xff);
+    vst4q_u8(row->dst + x * 4, out);
+  }
+
+  return x;
+}
+#endif /* YUV2RGB_HAS_NEON */
+
+bool_t yuv2rgb_kernel_available(yuv2rgb_kernel_t kernel) {
+  switch (kernel) {
+  case YUV2RGB_KERNEL_AUTO:
+  case YUV2RGB_KERNEL_SCALAR:
+    return TRUE;
+#ifdef YUV2RGB_HAS_X86
+  case YUV2RGB_KERNEL_SSE2:
+    return __builtin_cpu_supports("sse2") ? TRUE : FALSE;
+  case YUV2RGB_KERNEL_AVX2:
+    return __builtin_cpu_supports("avx2") ? TRUE : FALSE;
+#endif
+#ifdef YUV2RGB_HAS_NEON
+  case YUV2RGB_KERNEL_NEON:
+    return TRUE;
+#endif
+  default:
+    return FALSE;
+  }
+}
+
+yuv2rgb_kernel_t yuv2rgb_best_kernel(void) {
+  if (yuv2rgb_kernel_available(YUV2RGB_KERNEL_AVX2)) {
+    return YUV2RGB_KERNEL_AVX2;
+  }
+  if (yuv2rgb_kernel_available(YUV2RGB_KERNEL_SSE2)) {
+    return YUV2RGB_KERNEL_SSE2;
+  }
+  if (yuv2rgb_kernel_available(YUV2RGB_KERNEL_NEON)) {
+    return YUV2RGB_KERNEL_NEON;
+  }
+  return YUV2RGB_KERNEL_SCALAR;
+}
+
+const char *yuv2rgb_kernel_name(yuv2rgb_kernel_t kernel) {
+  switch (kernel) {
+  case YUV2RGB_KERNEL_AUTO:
+    return "auto";
+  case YUV2RGB_KERNEL_SCALAR:
+    return "scalar";
+  case YUV2RGB_KERNEL_SSE2:
+    return "sse2";
+  case YUV2RGB_KERNEL_AVX2:
+    return "avx2";
+  case YUV2RGB_KERNEL_NEON:
+    return "neon";
+  default:
+    return "unknown";
+  }
+}
+
+static yuv2rgb_row_func_t yuv2rgb_row_func(yuv2rgb_kernel_t kernel) {
+  switch (kernel) {
+#ifdef YUV2RGB_HAS_X86
+  case YUV2RGB_KERNEL_SSE2:
+    return yuv2rgb_row_sse2;
+  case YUV2RGB_KERNEL_AVX2:
+    return yuv2rgb_row_avx2;
+#endif
+#ifdef YUV2RGB_HAS_NEON
+  case YUV2RGB_KERNEL_NEON:
+    return yuv2rgb_row_neon;
+#endif
+  default:
+    return yuv2rgb_row_none;
+  }
+}
+
+ret_t yuv2rgb_convert_rows(yuv2rgb_kernel_t kernel, const yuv2rgb_src_t *src,
+                           uint8_t *dst, int dst_stride, int y0, int y1) {
+  return_value_if_fail(src != NULL && dst != NULL, RET_BAD_PARAMS);
+  return_value_if_fail(src->data[0] != NULL && src->data[1] != NULL,
+                       RET_BAD_PARAMS);
+  return_value_if_fail(src->format == YUV2RGB_FORMAT_NV12 || src->data[2] != NULL,
+                       RET_BAD_PARAMS);
+  return_value_if_fail(y0 >= 0 && y1 <= src->height && y0 <= y1, RET_BAD_PARAMS);
+
+  if (kernel == YUV2RGB_KERNEL_AUTO) {
+    kernel = yuv2rgb_best_kernel();
+  }
+  return_value_if_fail(yuv2rgb_kernel_available(kernel), RET_NOT_IMPL);
+
+  yuv2rgb_row_func_t func = yuv2rgb_row_func(kernel);
+  const yuv2rgb_coef_t *c =
+      &s_coefs[src->full_range ? 1 : 0][src->matrix == YUV2RGB_MATRIX_BT709 ? 1 : 0];
+  yuv2rgb_row_t row;
+  row.width = src->width;
+  row.nv12 = src->format == YUV2RGB_FORMAT_NV12;
+  row.bgra = src->bgra;
+
+  for (int y = y0; y < y1; y++) {
+    int cy = y >> 1;
+    row.y = src->data[0] + y * src->stride[0];
+    row.u = src->data[1] + cy * src->stride[1];
+    row.v = row.nv12 ? NULL : src->data[2] + cy * src->stride[2];
+    row.dst = dst + y * dst_stride;
+    yuv2rgb_row_scalar(&row, c, func(&row, c));
+  }
+
+  return RET_OK;
+}
+
+ret_t yuv2rgb_convert(yuv2rgb_kernel_t kernel, const yuv2rgb_src_t *src,
+                      uint8_t *dst, int dst_stride) {
+  return_value_if_fail(src != NULL, RET_BAD_PARAMS);
+
+  return yuv2rgb_convert_rows(kernel, src, dst, dst_stride, 0, src->height);
+}
@@ -0,0 +1,62 @@
+#ifndef YUV2RGB_H
+#define YUV2RGB_H
+
+#include "tkc/types_def.h"
+
+BEGIN_C_DECLS
+
+/*
+ * Same-size YUV -> RGBA8888 (or BGRA8888) conversion for the formats HLS
+ * streams decode to (yuv420p, yuvj420p, nv12), with SIMD kernels and a
+ * scalar reference. All
+ * kernels use the same 16-bit fixed-point arithmetic, so their output is
+ * bit-identical.
+ */
+typedef enum _yuv2rgb_kernel_t {
+  YUV2RGB_KERNEL_AUTO = 0,
+  YUV2RGB_KERNEL_SCALAR,
+  YUV2RGB_KERNEL_SSE2,
+  YUV2RGB_KERNEL_AVX2,
+  YUV2RGB_KERNEL_NEON
+} yuv2rgb_kernel_t;
+
+typedef enum _yuv2rgb_format_t {
+  YUV2RGB_FORMAT_YUV420P = 0,
+  YUV2RGB_FORMAT_NV12
+} yuv2rgb_format_t;
+
+typedef enum _yuv2rgb_matrix_t {
+  YUV2RGB_MATRIX_BT601 = 0,
+  YUV2RGB_MATRIX_BT709
+} yuv2rgb_matrix_t;
+
+typedef struct _yuv2rgb_src_t {
+  yuv2rgb_format_t format;
+  /* Y, U, V planes; for nv12 plane 1 holds interleaved UV */
+  const uint8_t *data[3];
+  int stride[3];
+  int width;
+  int height;
+  yuv2rgb_matrix_t matrix;
+  bool_t full_range;
+  /* Write pixels as B, G, R, A bytes instead of R, G, B, A */
+  bool_t bgra;
+} yuv2rgb_src_t;
+
+bool_t yuv2rgb_kernel_available(yuv2rgb_kernel_t kernel);
+/* The fastest kernel this CPU supports. */
+yuv2rgb_kernel_t yuv2rgb_best_kernel(void);
+const char *yuv2rgb_kernel_name(yuv2rgb_kernel_t kernel);
+
+/*
+ * Convert rows [y0, y1) of src into dst, which points at row 0. Row ranges
+ * are independent, so slices can be converted in parallel.
+ */
+ret_t yuv2rgb_convert_rows(yuv2rgb_kernel_t kernel, const yuv2rgb_src_t *src,
+                           uint8_t *dst, int dst_stride, int y0, int y1);
+ret_t yuv2rgb_convert(yuv2rgb_kernel_t kernel, const yuv2rgb_src_t *src,
+                      uint8_t *dst, int dst_stride);
+
+END_C_DECLS
+
+#endif /* YUV2RGB_H */
@@ -0,0 +1,187 @@
+#include "video_grid.h"
+#include "tkc/utils.h"
+
+/* Gap around each tile, and the outline of the focused one */
+#define VIDEO_GRID_SPACING 2
+#define VIDEO_GRID_FOCUS_COLOR "#00A0FF"
+
+static void video_grid_tile_rect(widget_t* widget, uint32_t index, rect_t* r) {
+  video_grid_t* video_grid = VIDEO_GRID(widget);
+  uint32_t col = index % video_grid->cols;
+  uint32_t row = index / video_grid->cols;
+  xy_t x0 = (xy_t)(col * widget->w / video_grid->cols);
+  xy_t x1 = (xy_t)((col + 1) * widget->w / video_grid->cols);
+  xy_t y0 = (xy_t)(row * widget->h / video_grid->rows);
+  xy_t y1 = (xy_t)((row + 1) * widget->h / video_grid->rows);
+
+  *r = rect_init(x0 + VIDEO_GRID_SPACING / 2, y0 + VIDEO_GRID_SPACING / 2,
+                 tk_max(0, x1 - x0 - VIDEO_GRID_SPACING),
+                 tk_max(0, y1 - y0 - VIDEO_GRID_SPACING));
+}
+
+static ret_t video_grid_notify_int(widget_t* widget, const char* name, int32_t value) {
+  value_t v;
+  prop_change_event_t e;
+
+  value_set_int(&v, value);
+  return widget_dispatch(widget, prop_change_event_init(&e, EVT_PROP_CHANGED, name, &v));
+}
+
+static ret_t video_grid_on_layout_children(widget_t* widget) {
+  video_grid_t* video_grid = VIDEO_GRID(widget);
+  uint32_t nr_tiles = video_grid->rows * video_grid->cols;
+  rect_t r;
+
+  WIDGET_FOR_EACH_CHILD_BEGIN(widget, iter, i)
+  if ((uint32_t)i < nr_tiles) {
+    video_grid_tile_rect(widget, i, &r);
+    widget_move_resize(iter, r.x, r.y, r.w, r.h);
+    widget_set_visible(iter, TRUE);
+  } else {
+    widget_set_visible(iter, FALSE);
+  }
+  WIDGET_FOR_EACH_CHILD_END();
+
+  /* Every tile has the size of the first, give or take a pixel */
+  video_grid_tile_rect(widget, 0, &r);
+  if (r.w != video_grid->tile_w || r.h != video_grid->tile_h) {
+    video_grid->tile_w = r.w;
+    video_grid->tile_h = r.h;
+    video_grid_notify_int(widget, VIDEO_GRID_PROP_TILE_W, r.w);
+    video_grid_notify_int(widget, VIDEO_GRID_PROP_TILE_H, r.h);
+  }
+
+  return RET_OK;
+}
+
+static ret_t video_grid_on_paint_end(widget_t* widget, canvas_t* c) {
+  video_grid_t* video_grid = VIDEO_GRID(widget);
+  rect_t r;
+
+  bitmap_format_t format = lcd_get_desired_bitmap_format(c->lcd);
+  if ((int32_t)format != video_grid->pixel_format) {
+    video_grid->pixel_format = format;
+    video_grid_notify_int(widget, VIDEO_GRID_PROP_PIXEL_FORMAT, format);
+  }
+
+  if (video_grid->focused < 0 ||
+      (uint32_t)video_grid->focused >= video_grid->rows * video_grid->cols) {
+    return RET_OK;
+  }
+
+  video_grid_tile_rect(widget, video_grid->focused, &r);
+  canvas_set_stroke_color_str(c, VIDEO_GRID_FOCUS_COLOR);
+  canvas_stroke_rect(c, r.x, r.y, r.w, r.h);
+
+  return RET_OK;
+}
+
+static ret_t video_grid_on_pointer_up(widget_t* widget, pointer_event_t* e) {
+  video_grid_t* video_grid = VIDEO_GRID(widget);
+  point_t p = {e->x, e->y};
+
+  widget_to_local(widget, &p);
+  if (p.x < 0 || p.y < 0 || p.x >= widget->w || p.y >= widget->h) {
+    return RET_OK;
+  }
+
+  uint32_t col = (uint32_t)p.x * video_grid->cols / widget->w;
+  uint32_t row = (uint32_t)p.y * video_grid->rows / widget->h;
+  int32_t index = (int32_t)(row * video_grid->cols + col);
+  if (index >= (int32_t)widget_count_children(widget)) {
+    return RET_OK;
+  }
+
+  /* Clicking the focused tile again leaves the mosaic unfocused */
+  video_grid_set_focused(widget, index == video_grid->focused ? -1 : index);
+  video_grid_notify_int(widget, VIDEO_GRID_PROP_FOCUSED, video_grid->focused);
+
+  return RET_OK;
+}
+
+static ret_t video_grid_get_prop(widget_t* widget, const char* name, value_t* v) {
+  video_grid_t* video_grid = VIDEO_GRID(widget);
+
+  if (tk_str_eq(name, VIDEO_GRID_PROP_ROWS)) {
+    value_set_uint32(v, video_grid->rows);
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_GRID_PROP_COLS)) {
+    value_set_uint32(v, video_grid->cols);
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_GRID_PROP_FOCUSED)) {
+    value_set_int(v, video_grid->focused);
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_GRID_PROP_TILE_W)) {
+    value_set_int(v, video_grid->tile_w);
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_GRID_PROP_TILE_H)) {
+    value_set_int(v, video_grid->tile_h);
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_GRID_PROP_PIXEL_FORMAT)) {
+    value_set_int(v, video_grid->pixel_format);
+    return RET_OK;
+  }
+
+  return RET_NOT_FOUND;
+}
+
+static ret_t video_grid_set_prop(widget_t* widget, const char* name, const value_t* v) {
+  video_grid_t* video_grid = VIDEO_GRID(widget);
+
+  if (tk_str_eq(name, VIDEO_GRID_PROP_ROWS) || tk_str_eq(name, VIDEO_GRID_PROP_COLS)) {
+    uint32_t n = tk_max(1, value_uint32(v));
+    if (tk_str_eq(name, VIDEO_GRID_PROP_ROWS)) {
+      video_grid->rows = n;
+    } else {
+      video_grid->cols = n;
+    }
+    widget_layout_children(widget);
+    widget_invalidate(widget, NULL);
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_GRID_PROP_FOCUSED)) {
+    return video_grid_set_focused(widget, value_int(v));
+  } else if (tk_str_eq(name, VIDEO_GRID_PROP_TILE_W) ||
+             tk_str_eq(name, VIDEO_GRID_PROP_TILE_H) ||
+             tk_str_eq(name, VIDEO_GRID_PROP_PIXEL_FORMAT)) {
+    /* Read-only: these flow from the widget to the view model */
+    return RET_OK;
+  }
+
+  return RET_NOT_FOUND;
+}
+
+static ret_t video_grid_init(widget_t* widget) {
+  video_grid_t* video_grid = VIDEO_GRID(widget);
+
+  video_grid->rows = 3;
+  video_grid->cols = 3;
+  video_grid->focused = -1;
+
+  return RET_OK;
+}
+
+TK_DECL_VTABLE(video_grid) = {
+    .size = sizeof(video_grid_t),
+    .type = WIDGET_TYPE_VIDEO_GRID,
+    .parent = TK_PARENT_VTABLE(widget),
+    .create = video_grid_create,
+    .init = video_grid_init,
+    .on_layout_children = video_grid_on_layout_children,
+    .on_paint_end = video_grid_on_paint_end,
+    .on_pointer_up = video_grid_on_pointer_up,
+    .get_prop = video_grid_get_prop,
+    .set_prop = video_grid_set_prop};
+
+widget_t* video_grid_create(widget_t* parent, xy_t x, xy_t y, wh_t w, wh_t h) {
+  return widget_create(parent, TK_REF_VTABLE(video_grid), x, y, w, h);
+}
+
+ret_t video_grid_set_focused(widget_t* widget, int32_t focused) {
+  video_grid_t* video_grid = VIDEO_GRID(widget);
+  return_value_if_fail(video_grid != NULL, RET_BAD_PARAMS);
+
+  video_grid->focused = focused < 0 ? -1 : focused;
+  widget_invalidate(widget, NULL);
+
+  return RET_OK;
+}
@@ -0,0 +1,43 @@
+#ifndef VIDEO_GRID_H
+#define VIDEO_GRID_H
+
+#include "awtk.h"
+
+BEGIN_C_DECLS
+
+#define WIDGET_TYPE_VIDEO_GRID "video_grid"
+
+#define VIDEO_GRID_PROP_ROWS "rows"
+#define VIDEO_GRID_PROP_COLS "cols"
+/* Index of the focused tile, -1 for none; a click on a tile toggles it */
+#define VIDEO_GRID_PROP_FOCUSED "focused"
+/* Size of one tile, published so the players can convert straight to it */
+#define VIDEO_GRID_PROP_TILE_W "tile_w"
+#define VIDEO_GRID_PROP_TILE_H "tile_h"
+/* bitmap_format_t the LCD draws without converting, for all the tiles */
+#define VIDEO_GRID_PROP_PIXEL_FORMAT "pixel_format"
+
+/*
+ * Mosaic of video_image children, laid out row by row in rows x cols equal
+ * tiles; children past the last tile are hidden. The focused tile is
+ * outlined.
+ */
+widget_t* video_grid_create(widget_t* parent, xy_t x, xy_t y, wh_t w, wh_t h);
+ret_t video_grid_set_focused(widget_t* widget, int32_t focused);
+
+#define VIDEO_GRID(widget) ((video_grid_t*)(widget))
+
+typedef struct _video_grid_t {
+  widget_t widget;
+  uint32_t rows;
+  uint32_t cols;
+  int32_t focused;
+  /* Last tile size published */
+  wh_t tile_w;
+  wh_t tile_h;
+  int32_t pixel_format;
+} video_grid_t;
+
+END_C_DECLS
+
+#endif /* VIDEO_GRID_H */
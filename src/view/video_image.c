@@ -1,16 +1,102 @@
 #include "video_image.h"
+#include "tkc/time_now.h"
+
+ret_t video_image_draw_frame(canvas_t* c, bitmap_t* image, wh_t w, wh_t h) {
+  return_value_if_fail(c != NULL, RET_BAD_PARAMS);
+
+  canvas_set_fill_color_str(c, "black");
+  canvas_fill_rect(c, 0, 0, w, h);
+  if (image == NULL || image->w <= 0 || image->h <= 0) {
+    return RET_OK;
+  }
+
+  /* Letterbox: the frame already has its display aspect, fit and centre it.
+   * The player converts at the widget size, rounded down to even: within
+   * that rounding the frame is blitted 1:1 rather than resampled again. */
+  wh_t dw = w;
+  wh_t dh = (wh_t)((int64_t)image->h * w / image->w);
+  if (dh > h) {
+    dh = h;
+    dw = (wh_t)((int64_t)image->w * h / image->h);
+  }
+  if (image->w <= w && image->h <= h && dw - image->w <= 1 && dh - image->h <= 1) {
+    dw = image->w;
+    dh = image->h;
+  }
+  rect_t src = rect_init(0, 0, image->w, image->h);
+  rect_t dst = rect_init((w - dw) / 2, (h - dh) / 2, dw, dh);
+
+  return canvas_draw_image(c, image, &src, &dst);
+}
+
+ret_t video_image_notify_view_size(widget_t* widget) {
+  value_t v;
+  prop_change_event_t e;
+  return_value_if_fail(widget != NULL, RET_BAD_PARAMS);
+
+  value_set_int(&v, widget->w);
+  widget_dispatch(widget, prop_change_event_init(&e, EVT_PROP_CHANGED,
+                                                 VIDEO_IMAGE_PROP_VIEW_W, &v));
+  value_set_int(&v, widget->h);
+  widget_dispatch(widget, prop_change_event_init(&e, EVT_PROP_CHANGED,
+                                                 VIDEO_IMAGE_PROP_VIEW_H, &v));
+
+  return RET_OK;
+}
+
+ret_t video_image_notify_paint_time(widget_t* widget, int64_t us) {
+  value_t v;
+  prop_change_event_t e;
+  return_value_if_fail(widget != NULL, RET_BAD_PARAMS);
+
+  value_set_int64(&v, us);
+  widget_dispatch(widget, prop_change_event_init(&e, EVT_PROP_CHANGED,
+                                                 VIDEO_IMAGE_PROP_PAINT_TIME, &v));
+
+  return RET_OK;
+}
+
+ret_t video_image_notify_pixel_format(widget_t* widget, canvas_t* c, int32_t* published) {
+  value_t v;
+  prop_change_event_t e;
+  return_value_if_fail(widget != NULL && c != NULL && published != NULL, RET_BAD_PARAMS);
+
+  int32_t format = (int32_t)lcd_get_desired_bitmap_format(c->lcd);
+  if (format == *published) {
+    return RET_OK;
+  }
+
+  *published = format;
+  value_set_int(&v, format);
+  widget_dispatch(widget, prop_change_event_init(&e, EVT_PROP_CHANGED,
+                                                 VIDEO_IMAGE_PROP_PIXEL_FORMAT, &v));
+
+  return RET_OK;
+}
 
 static ret_t video_image_on_paint_self(widget_t* widget, canvas_t* c) {
   video_image_t* video_image = VIDEO_IMAGE(widget);
+  bitmap_t* image = video_image->image;
+  uint64_t start = time_now_us();
 
-  if (video_image->image) {
-    rect_t dst = rect_init(0, 0, widget->w, widget->h);
-    canvas_draw_image_ex(c, video_image->image, IMAGE_DRAW_SCALE, &dst);
-  } else {
-    canvas_set_fill_color_str(c, "black");
-    canvas_fill_rect(c, 0, 0, widget->w, widget->h);
+  video_image_notify_pixel_format(widget, c, &video_image->pixel_format);
+  ret_t ret = video_image_draw_frame(c, image, widget->w, widget->h);
+  bool_t new_frame = video_image->has_seq
+                         ? video_image->frame_seq != video_image->painted_seq
+                         : image != video_image->painted;
+  if (image != NULL && new_frame) {
+    video_image->painted = image;
+    video_image->painted_seq = video_image->frame_seq;
+    video_image_notify_paint_time(widget, (int64_t)(time_now_us() - start));
   }
 
+  return ret;
+}
+
+static ret_t video_image_on_event(widget_t* widget, event_t* e) {
+  if (e->type == EVT_RESIZE || e->type == EVT_MOVE_RESIZE) {
+    video_image_notify_view_size(widget);
+  }
   return RET_OK;
 }
 
@@ -24,6 +110,21 @@ static ret_t video_image_get_prop(widget_t* widget, const char* name, value_t* v
   if (tk_str_eq(name, "image")) {
     value_set_pointer(v, video_image->image);
     return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_IMAGE_PROP_VIEW_W)) {
+    value_set_int(v, widget->w);
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_IMAGE_PROP_VIEW_H)) {
+    value_set_int(v, widget->h);
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_IMAGE_PROP_PAINT_TIME)) {
+    value_set_int64(v, 0);
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_IMAGE_PROP_FRAME_SEQ)) {
+    value_set_uint32(v, video_image->frame_seq);
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_IMAGE_PROP_PIXEL_FORMAT)) {
+    value_set_int(v, video_image->pixel_format);
+    return RET_OK;
   }
   return RET_NOT_FOUND;
 }
@@ -31,8 +132,27 @@ static ret_t video_image_get_prop(widget_t* widget, const char* name, value_t* v
 static ret_t video_image_set_prop(widget_t* widget, const char* name, const value_t* v) {
   video_image_t* video_image = VIDEO_IMAGE(widget);
   if (tk_str_eq(name, "image")) {
-    video_image->image = (bitmap_t*)value_pointer(v);
-    widget_invalidate(widget, NULL);
+    bitmap_t* image = (bitmap_t*)value_pointer(v);
+    /* Bindings set the image again on every property change; with a
+     * generation bound only a new frame_seq or another bitmap repaints */
+    if (!video_image->has_seq || image != video_image->image) {
+      widget_invalidate(widget, NULL);
+    }
+    video_image->image = image;
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_IMAGE_PROP_FRAME_SEQ)) {
+    uint32_t seq = value_uint32(v);
+    if (!video_image->has_seq || seq != video_image->frame_seq) {
+      widget_invalidate(widget, NULL);
+    }
+    video_image->frame_seq = seq;
+    video_image->has_seq = TRUE;
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_IMAGE_PROP_VIEW_W) ||
+             tk_str_eq(name, VIDEO_IMAGE_PROP_VIEW_H) ||
+             tk_str_eq(name, VIDEO_IMAGE_PROP_PAINT_TIME) ||
+             tk_str_eq(name, VIDEO_IMAGE_PROP_PIXEL_FORMAT)) {
+    /* Read-only: these flow from the widget to the view model */
     return RET_OK;
   }
   return RET_NOT_FOUND;
@@ -46,6 +166,7 @@ TK_DECL_VTABLE(video_image) = {
     .on_paint_self = video_image_on_paint_self,
     .get_prop = video_image_get_prop,
     .set_prop = video_image_set_prop,
+    .on_event = video_image_on_event,
     .on_destroy = video_image_on_destroy};
 
 widget_t* video_image_create(widget_t* parent, xy_t x, xy_t y, wh_t w, wh_t h) {
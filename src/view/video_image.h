@@ -7,14 +7,47 @@ BEGIN_C_DECLS
 
 #define WIDGET_TYPE_VIDEO_IMAGE "video_image"
 
+/* Widget size, published so the player can convert straight to it */
+#define VIDEO_IMAGE_PROP_VIEW_W "view_w"
+#define VIDEO_IMAGE_PROP_VIEW_H "view_h"
+/* Microseconds the last new frame took to paint, published after each one */
+#define VIDEO_IMAGE_PROP_PAINT_TIME "paint_time"
+/*
+ * Generation of image, bumped by the view model for every new frame. Once
+ * bound, setting the same image with the same generation repaints nothing.
+ */
+#define VIDEO_IMAGE_PROP_FRAME_SEQ "frame_seq"
+/*
+ * bitmap_format_t the LCD draws without converting, published on the first
+ * paint and whenever it changes, so frames can be decoded straight into it
+ */
+#define VIDEO_IMAGE_PROP_PIXEL_FORMAT "pixel_format"
+
 widget_t* video_image_create(widget_t* parent, xy_t x, xy_t y, wh_t w, wh_t h);
 ret_t video_image_set_image(widget_t* widget, bitmap_t* image);
 
+/* Paint a frame letterboxed into a w x h area (shared with video_view) */
+ret_t video_image_draw_frame(canvas_t* c, bitmap_t* image, wh_t w, wh_t h);
+/* Dispatch EVT_PROP_CHANGED for view_w/view_h */
+ret_t video_image_notify_view_size(widget_t* widget);
+/* Dispatch EVT_PROP_CHANGED for paint_time */
+ret_t video_image_notify_paint_time(widget_t* widget, int64_t us);
+/* Dispatch EVT_PROP_CHANGED for pixel_format if c's LCD wants another one */
+ret_t video_image_notify_pixel_format(widget_t* widget, canvas_t* c, int32_t* published);
+
 #define VIDEO_IMAGE(widget) ((video_image_t*)(widget))
 
 typedef struct _video_image_t {
   widget_t widget;
   bitmap_t* image;
+  /* Last frame painted, so repaints of the same frame are not timed */
+  bitmap_t* painted;
+  uint32_t frame_seq;
+  uint32_t painted_seq;
+  /* frame_seq is bound; without it every image set is a new frame */
+  bool_t has_seq;
+  /* Last pixel_format published, BITMAP_FMT_NONE before the first paint */
+  int32_t pixel_format;
 } video_image_t;
 
 END_C_DECLS
@@ -1,7 +1,9 @@
 #include "tkc/mem.h"
+#include "tkc/time_now.h"
 #include "tkc/utils.h"
 #include "base/widget_vtable.h"
 #include "video_view.h"
+#include "video_image.h"
 #include "mutable_image/mutable_image.h"
 
 static bitmap_t* video_view_create_image(void* ctx, bitmap_format_t format, bitmap_t* old_image) {
@@ -26,8 +28,16 @@ static bitmap_t* video_view_create_image(void* ctx, bitmap_format_t format, bitm
   return old_image;
 }
 
+/* 绑定了 frame_seq 时，只有新帧才需要重新拷贝 */
+static bool_t video_view_need_redraw(void* ctx) {
+  video_view_t* video_view = VIDEO_VIEW(ctx);
+
+  return !video_view->has_seq || video_view->frame_seq != video_view->copied_seq;
+}
+
 static ret_t video_view_prepare_image(void* ctx, bitmap_t* image) {
   widget_t* widget = WIDGET(ctx);
+  video_view_t* video_view = VIDEO_VIEW(widget);
   value_t v;
 
   return_value_if_fail(image != NULL, RET_BAD_PARAMS);
@@ -41,6 +51,7 @@ static ret_t video_view_prepare_image(void* ctx, bitmap_t* image) {
 
       if (s != NULL && d != NULL) {
         memcpy(d, s, size);
+        video_view->copied_seq = video_view->frame_seq;
       }
 
       bitmap_unlock_buffer(src);
@@ -53,14 +64,117 @@ static ret_t video_view_prepare_image(void* ctx, bitmap_t* image) {
 }
 
 static ret_t video_view_on_event(widget_t* widget, event_t* e) {
+  video_view_t* video_view = VIDEO_VIEW(widget);
+
   if (e->type == EVT_WINDOW_WILL_OPEN) {
     widget_t* mutable_image = widget_lookup(widget, "mutable_image", TRUE);
     if (mutable_image != NULL) {
-      mutable_image_set_create_image(mutable_image, video_view_create_image, widget);
-      mutable_image_set_prepare_image(mutable_image, video_view_prepare_image, widget);
-      mutable_image_invalidate_force(mutable_image);
+      if (video_view->direct) {
+        widget_set_visible(mutable_image, FALSE);
+      } else {
+        mutable_image_set_create_image(mutable_image, video_view_create_image, widget);
+        mutable_image_set_prepare_image(mutable_image, video_view_prepare_image, widget);
+        mutable_image_set_need_redraw(mutable_image, video_view_need_redraw, widget);
+        mutable_image_invalidate_force(mutable_image);
+      }
+    }
+    video_image_notify_view_size(widget);
+  } else if (e->type == EVT_RESIZE || e->type == EVT_MOVE_RESIZE) {
+    video_image_notify_view_size(widget);
+  }
+  return RET_OK;
+}
+
+static ret_t video_view_on_paint_self(widget_t* widget, canvas_t* c) {
+  video_view_t* video_view = VIDEO_VIEW(widget);
+
+  /* 让解码直接输出 LCD 期望的像素格式，绘制时无需再转换 */
+  video_image_notify_pixel_format(widget, c, &video_view->pixel_format);
+
+  /* direct 模式：ViewModel 的位图即解码输出，直接绘制，不做拷贝 */
+  if (video_view->direct && video_view->image != NULL) {
+    uint64_t start = time_now_us();
+    video_image_draw_frame(c, video_view->image, widget->w, widget->h);
+
+    /* 只统计新帧的绘制耗时，同一帧的重绘不计 */
+    bool_t new_frame = video_view->has_seq ? video_view->frame_seq != video_view->painted_seq
+                                           : video_view->image != video_view->painted;
+    if (new_frame) {
+      video_view->painted = video_view->image;
+      video_view->painted_seq = video_view->frame_seq;
+      video_image_notify_paint_time(widget, (int64_t)(time_now_us() - start));
+    }
+  }
+
+  return RET_OK;
+}
+
+static ret_t video_view_get_prop(widget_t* widget, const char* name, value_t* v) {
+  video_view_t* video_view = VIDEO_VIEW(widget);
+
+  if (tk_str_eq(name, "image")) {
+    value_set_pointer(v, video_view->image);
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_VIEW_PROP_DIRECT)) {
+    value_set_bool(v, video_view->direct);
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_IMAGE_PROP_FRAME_SEQ)) {
+    value_set_uint32(v, video_view->frame_seq);
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_IMAGE_PROP_VIEW_W)) {
+    value_set_int(v, widget->w);
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_IMAGE_PROP_VIEW_H)) {
+    value_set_int(v, widget->h);
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_IMAGE_PROP_PAINT_TIME)) {
+    value_set_int64(v, 0);
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_IMAGE_PROP_PIXEL_FORMAT)) {
+    value_set_int(v, video_view->pixel_format);
+    return RET_OK;
+  }
+
+  return RET_NOT_FOUND;
+}
+
+static ret_t video_view_set_prop(widget_t* widget, const char* name, const value_t* v) {
+  video_view_t* video_view = VIDEO_VIEW(widget);
+
+  if (tk_str_eq(name, "image")) {
+    bitmap_t* image = (bitmap_t*)value_pointer(v);
+    /* 绑定在任何属性变化时都会重设 image，同一帧不重绘 */
+    if (video_view->direct && (!video_view->has_seq || image != video_view->image)) {
+      widget_invalidate(widget, NULL);
+    }
+    video_view->image = image;
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_IMAGE_PROP_FRAME_SEQ)) {
+    uint32_t seq = value_uint32(v);
+    if (video_view->direct && (!video_view->has_seq || seq != video_view->frame_seq)) {
+      widget_invalidate(widget, NULL);
     }
+    video_view->frame_seq = seq;
+    video_view->has_seq = TRUE;
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_VIEW_PROP_DIRECT)) {
+    video_view->direct = value_bool(v);
+    return RET_OK;
+  } else if (tk_str_eq(name, VIDEO_IMAGE_PROP_VIEW_W) ||
+             tk_str_eq(name, VIDEO_IMAGE_PROP_VIEW_H) ||
+             tk_str_eq(name, VIDEO_IMAGE_PROP_PAINT_TIME) ||
+             tk_str_eq(name, VIDEO_IMAGE_PROP_PIXEL_FORMAT)) {
+    return RET_OK;
   }
+
+  return RET_NOT_FOUND;
+}
+
+static ret_t video_view_init(widget_t* widget) {
+  video_view_t* video_view = VIDEO_VIEW(widget);
+
+  video_view->direct = TRUE;
+
   return RET_OK;
 }
 
@@ -69,6 +183,10 @@ TK_DECL_VTABLE(video_view) = {
     .type = WIDGET_TYPE_VIDEO_VIEW,
     .get_parent_vt = TK_GET_PARENT_VTABLE(widget),
     .create = video_view_create,
+    .init = video_view_init,
+    .on_paint_self = video_view_on_paint_self,
+    .get_prop = video_view_get_prop,
+    .set_prop = video_view_set_prop,
     .on_event = video_view_on_event
 };
 
@@ -12,9 +12,43 @@ BEGIN_C_DECLS
  * 视频视图控件。
  *
  * 负责管理视频显示的视图，包括初始化 mutable_image 子控件。
+ *
+ * direct 模式下（缺省）直接绘制 image 指向的位图，不再拷贝到 mutable_image。
  */
 typedef struct _video_view_t {
   widget_t widget;
+
+  /**
+   * @property {bitmap_t*} image
+   * @annotation ["set_prop","get_prop"]
+   * 当前视频帧（由 ViewModel 拥有）。
+   */
+  bitmap_t* image;
+
+  /**
+   * @property {bool_t} direct
+   * @annotation ["set_prop","get_prop","design"]
+   * 是否直接绘制 image（零拷贝）。为 FALSE 时经 mutable_image 拷贝后显示。
+   */
+  bool_t direct;
+
+  /**
+   * @property {uint32_t} frame_seq
+   * @annotation ["set_prop","get_prop"]
+   * 当前视频帧的序号（由 ViewModel 每帧递增）。绑定后，序号不变时不重绘也不拷贝。
+   */
+  uint32_t frame_seq;
+
+  /*private*/
+  /* 上一次绘制的帧，用于只统计新帧的绘制耗时 */
+  bitmap_t* painted;
+  uint32_t painted_seq;
+  /* 已拷贝到 mutable_image 的帧序号 */
+  uint32_t copied_seq;
+  /* 是否绑定了 frame_seq，未绑定时每次设置 image 都视为新帧 */
+  bool_t has_seq;
+  /* 已通知 ViewModel 的 LCD 期望像素格式(pixel_format) */
+  int32_t pixel_format;
 } video_view_t;
 
 /**
@@ -43,6 +77,8 @@ video_view_t* video_view_cast(widget_t* widget);
 
 #define WIDGET_TYPE_VIDEO_VIEW "video_view"
 
+#define VIDEO_VIEW_PROP_DIRECT "direct"
+
 #define VIDEO_VIEW(widget) ((video_view_t*)(video_view_cast(WIDGET(widget))))
 
 END_C_DECLS
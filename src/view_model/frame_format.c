@@ -0,0 +1,29 @@
+#include "frame_format.h"
+
+bitmap_format_t frame_format_to_bitmap(hls_player_pixel_format_t format) {
+  switch (format) {
+  case HLS_PLAYER_PIXEL_RGBA:
+    return BITMAP_FMT_RGBA8888;
+  case HLS_PLAYER_PIXEL_BGRA:
+    return BITMAP_FMT_BGRA8888;
+  case HLS_PLAYER_PIXEL_RGB565:
+    return BITMAP_FMT_RGB565;
+  case HLS_PLAYER_PIXEL_BGR565:
+    return BITMAP_FMT_BGR565;
+  default:
+    return BITMAP_FMT_NONE;
+  }
+}
+
+hls_player_pixel_format_t frame_format_from_bitmap(bitmap_format_t format) {
+  switch (format) {
+  case BITMAP_FMT_BGRA8888:
+    return HLS_PLAYER_PIXEL_BGRA;
+  case BITMAP_FMT_RGB565:
+    return HLS_PLAYER_PIXEL_RGB565;
+  case BITMAP_FMT_BGR565:
+    return HLS_PLAYER_PIXEL_BGR565;
+  default:
+    return HLS_PLAYER_PIXEL_RGBA;
+  }
+}
@@ -0,0 +1,22 @@
+#ifndef FRAME_FORMAT_H
+#define FRAME_FORMAT_H
+
+#include "awtk.h"
+#include "../model/hls_player.h"
+
+BEGIN_C_DECLS
+
+/*
+ * Mapping between the player's output formats and AWTK bitmap formats, so
+ * frames are converted once, straight into the layout the LCD draws fastest.
+ */
+
+/* BITMAP_FMT_NONE for formats a bitmap cannot hold (YUV420P). */
+bitmap_format_t frame_format_to_bitmap(hls_player_pixel_format_t format);
+
+/* RGBA for bitmap formats the player cannot produce. */
+hls_player_pixel_format_t frame_format_from_bitmap(bitmap_format_t format);
+
+END_C_DECLS
+
+#endif /* FRAME_FORMAT_H */
@@ -0,0 +1,128 @@
+#include "frame_ring.h"
+
+#define FRAME_RING_FRESH 0x80000000u
+#define FRAME_RING_INDEX_MASK 0x7fffffffu
+
+static void frame_ring_destroy_slots(frame_ring_t *ring) {
+  for (uint32_t i = 0; i < FRAME_RING_SIZE; i++) {
+    BITMAP_DESTROY(ring->slots[i]);
+  }
+  ring->w = 0;
+  ring->h = 0;
+}
+
+ret_t frame_ring_init(frame_ring_t *ring) {
+  return_value_if_fail(ring != NULL, RET_BAD_PARAMS);
+
+  memset(ring, 0x00, sizeof(*ring));
+  ring->back = 0;
+  ring->latest = 1;
+  ring->front = 2;
+  pthread_mutex_init(&ring->mutex, NULL);
+
+  return RET_OK;
+}
+
+ret_t frame_ring_deinit(frame_ring_t *ring) {
+  return_value_if_fail(ring != NULL, RET_BAD_PARAMS);
+
+  frame_ring_destroy_slots(ring);
+  BITMAP_DESTROY(ring->retired);
+  pthread_mutex_destroy(&ring->mutex);
+
+  return RET_OK;
+}
+
+ret_t frame_ring_resize(frame_ring_t *ring, uint32_t w, uint32_t h,
+                        bitmap_format_t format) {
+  ret_t ret = RET_OK;
+  return_value_if_fail(ring != NULL && w > 0 && h > 0, RET_BAD_PARAMS);
+
+  pthread_mutex_lock(&ring->mutex);
+  if (ring->w != w || ring->h != h || ring->format != format) {
+    // Until a new frame is acquired the UI still shows the front bitmap.
+    if (ring->retired == NULL) {
+      ring->retired = ring->slots[ring->front];
+      ring->slots[ring->front] = NULL;
+    }
+    frame_ring_destroy_slots(ring);
+    for (uint32_t i = 0; i < FRAME_RING_SIZE; i++) {
+      ring->slots[i] = bitmap_create_ex(w, h, 0, format);
+      if (ring->slots[i] == NULL) {
+        frame_ring_destroy_slots(ring);
+        ret = RET_OOM;
+        break;
+      }
+    }
+    if (ret == RET_OK) {
+      ring->w = w;
+      ring->h = h;
+      ring->format = format;
+    }
+    ring->back = 0;
+    __atomic_store_n(&ring->latest, 1, __ATOMIC_RELEASE);
+    ring->front = 2;
+  }
+  pthread_mutex_unlock(&ring->mutex);
+
+  return ret;
+}
+
+bitmap_t *frame_ring_begin_write(frame_ring_t *ring, uint32_t w, uint32_t h,
+                                 bitmap_format_t format) {
+  return_value_if_fail(ring != NULL, NULL);
+
+  pthread_mutex_lock(&ring->mutex);
+  if (ring->w != w || ring->h != h || ring->format != format ||
+      ring->slots[ring->back] == NULL) {
+    pthread_mutex_unlock(&ring->mutex);
+    return NULL;
+  }
+
+  return ring->slots[ring->back];
+}
+
+ret_t frame_ring_end_write(frame_ring_t *ring, bool_t publish) {
+  return_value_if_fail(ring != NULL, RET_BAD_PARAMS);
+
+  if (publish) {
+    uint32_t prev = __atomic_exchange_n(&ring->latest,
+                                        ring->back | FRAME_RING_FRESH,
+                                        __ATOMIC_ACQ_REL);
+    // The UI never took the previous frame: it is overwritten, not shown.
+    if (prev & FRAME_RING_FRESH) {
+      __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+    }
+    ring->back = prev & FRAME_RING_INDEX_MASK;
+    __atomic_add_fetch(&ring->produced, 1, __ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&ring->mutex);
+
+  return RET_OK;
+}
+
+bitmap_t *frame_ring_acquire(frame_ring_t *ring) {
+  return_value_if_fail(ring != NULL, NULL);
+
+  if (!(__atomic_load_n(&ring->latest, __ATOMIC_ACQUIRE) & FRAME_RING_FRESH)) {
+    return NULL;
+  }
+
+  uint32_t prev =
+      __atomic_exchange_n(&ring->latest, ring->front, __ATOMIC_ACQ_REL);
+  ring->front = prev & FRAME_RING_INDEX_MASK;
+  __atomic_add_fetch(&ring->presented, 1, __ATOMIC_RELAXED);
+  BITMAP_DESTROY(ring->retired);
+
+  return ring->slots[ring->front];
+}
+
+ret_t frame_ring_get_stats(frame_ring_t *ring, frame_ring_stats_t *stats) {
+  return_value_if_fail(ring != NULL && stats != NULL, RET_BAD_PARAMS);
+
+  stats->produced = __atomic_load_n(&ring->produced, __ATOMIC_RELAXED);
+  stats->presented = __atomic_load_n(&ring->presented, __ATOMIC_RELAXED);
+  stats->dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+
+  return RET_OK;
+}
@@ -0,0 +1,73 @@
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include "awtk.h"
+#include <pthread.h>
+
+BEGIN_C_DECLS
+
+#define FRAME_RING_SIZE 3
+
+/*
+ * Triple-buffered handoff of decoded frames from the decode thread to the
+ * AWTK UI thread. The producer owns one bitmap, the consumer owns another,
+ * and the third is the "latest" slot both sides swap with atomically, so the
+ * UI always picks up the newest frame and the decoder never waits on it.
+ *
+ * The bitmaps are created and destroyed on the UI thread only, and only when
+ * the frame size changes. The bitmap on screen then is kept as "retired"
+ * until a frame of the new size replaces it, so a resolution switch never
+ * shows a blank picture.
+ */
+typedef struct _frame_ring_t {
+  bitmap_t *slots[FRAME_RING_SIZE];
+  bitmap_t *retired;
+  uint32_t w;
+  uint32_t h;
+  bitmap_format_t format;
+
+  uint32_t back;   /* owned by the producer */
+  uint32_t front;  /* owned by the consumer */
+  uint32_t latest; /* slot index | FRAME_RING_FRESH, swapped atomically */
+
+  uint64_t produced;
+  uint64_t presented;
+  uint64_t dropped;
+
+  /* Held by the producer while it writes, and by resize. */
+  pthread_mutex_t mutex;
+} frame_ring_t;
+
+typedef struct _frame_ring_stats_t {
+  uint64_t produced;
+  uint64_t presented;
+  uint64_t dropped;
+} frame_ring_stats_t;
+
+ret_t frame_ring_init(frame_ring_t *ring);
+ret_t frame_ring_deinit(frame_ring_t *ring);
+
+/*
+ * UI thread: (re)allocate the bitmaps for a new frame size. The last frame
+ * acquired stays valid until the next frame_ring_acquire returns a new one.
+ */
+ret_t frame_ring_resize(frame_ring_t *ring, uint32_t w, uint32_t h,
+                        bitmap_format_t format);
+
+/*
+ * Producer: returns the back bitmap if it matches w x h and format, or NULL if
+ * the ring must be resized first. A non-NULL result must be followed by
+ * frame_ring_end_write.
+ */
+bitmap_t *frame_ring_begin_write(frame_ring_t *ring, uint32_t w, uint32_t h,
+                                 bitmap_format_t format);
+ret_t frame_ring_end_write(frame_ring_t *ring, bool_t publish);
+
+/* Consumer: the newest frame if one arrived since the last call, else NULL. */
+bitmap_t *frame_ring_acquire(frame_ring_t *ring);
+
+ret_t frame_ring_get_stats(frame_ring_t *ring, frame_ring_stats_t *stats);
+
+END_C_DECLS
+
+#endif /* FRAME_RING_H */
@@ -0,0 +1,350 @@
+#include "mosaic_view_model.h"
+#include "../model/player_manager.h"
+#include "frame_format.h"
+#include "frame_ring.h"
+#include "tkc/utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Streams shown until urls is set: the demo stream in every tile of 3x3 */
+#define MOSAIC_VIEW_MODEL_TILES 9
+#define MOSAIC_VIEW_MODEL_URL \
+  "http://devimages.apple.com/iphone/samples/bipbop/bipbopall.m3u8"
+#define MOSAIC_VIEW_MODEL_URL_SEPARATORS " \t\r\n,;"
+
+struct _mosaic_view_model_t;
+
+/* One tile: the frame handoff of one player to its video_image */
+typedef struct _mosaic_tile_t {
+  struct _mosaic_view_model_t *vm;
+  frame_ring_t ring;
+  bitmap_t *image;
+  /* Bumped whenever image changes to a new frame */
+  uint32_t frame_seq;
+  bool_t resize_pending;
+  uint32_t frame_w;
+  uint32_t frame_h;
+  bitmap_format_t frame_format;
+} mosaic_tile_t;
+
+typedef struct _mosaic_view_model_t {
+  view_model_t view_model;
+  player_manager_t *manager;
+  mosaic_tile_t tiles[PLAYER_MANAGER_MAX_PLAYERS];
+
+  /* Properties */
+  char *urls;
+  char *state_str;
+  /* Size of one tile of the grid, reported by the view */
+  int32_t tile_w;
+  int32_t tile_h;
+  /* Bitmap format the grid's LCD draws without converting */
+  int32_t pixel_format;
+
+  /* One UI update picks up the new frames of every tile */
+  bool_t update_pending;
+} mosaic_view_model_t;
+
+static ret_t on_resize_ring(const idle_info_t *info) {
+  mosaic_tile_t *tile = (mosaic_tile_t *)(info->ctx);
+
+  frame_ring_resize(&tile->ring, tile->frame_w, tile->frame_h,
+                    tile->frame_format);
+
+  __atomic_store_n(&tile->resize_pending, FALSE, __ATOMIC_RELEASE);
+  return RET_REMOVE;
+}
+
+static ret_t on_update_ui(const idle_info_t *info) {
+  mosaic_view_model_t *vm = (mosaic_view_model_t *)(info->ctx);
+
+  // Clear first: a frame published after this point queues a new update.
+  __atomic_store_n(&vm->update_pending, FALSE, __ATOMIC_RELEASE);
+
+  for (uint32_t i = 0; i < PLAYER_MANAGER_MAX_PLAYERS; i++) {
+    bitmap_t *image = frame_ring_acquire(&vm->tiles[i].ring);
+    if (image != NULL) {
+      image->flags |= BITMAP_FLAG_CHANGED;
+      vm->tiles[i].image = image;
+      vm->tiles[i].frame_seq++;
+    }
+  }
+  view_model_notify_props_changed(VIEW_MODEL(vm));
+
+  return RET_REMOVE;
+}
+
+static ret_t on_acquire_frame(void *ctx, int w, int h, int format,
+                              hls_player_frame_t *frame) {
+  mosaic_tile_t *tile = (mosaic_tile_t *)ctx;
+  bitmap_format_t bitmap_format =
+      frame_format_to_bitmap((hls_player_pixel_format_t)format);
+  if (bitmap_format == BITMAP_FMT_NONE) {
+    return RET_BUSY;
+  }
+
+  bitmap_t *image = frame_ring_begin_write(&tile->ring, w, h, bitmap_format);
+  if (image == NULL) {
+    // New resolution or format: the UI thread owns the bitmaps, so it
+    // reallocates.
+    if (!__atomic_exchange_n(&tile->resize_pending, TRUE, __ATOMIC_ACQ_REL)) {
+      tile->frame_w = w;
+      tile->frame_h = h;
+      tile->frame_format = bitmap_format;
+      idle_queue(on_resize_ring, tile);
+    }
+    return RET_BUSY;
+  }
+
+  uint8_t *data = bitmap_lock_buffer_for_write(image);
+  if (data == NULL) {
+    frame_ring_end_write(&tile->ring, FALSE);
+    return RET_BUSY;
+  }
+
+  frame->data = data;
+  frame->line_length = bitmap_get_line_length(image);
+  frame->width = w;
+  frame->height = h;
+  frame->format = format;
+  frame->handle = image;
+
+  return RET_OK;
+}
+
+static ret_t on_release_frame(void *ctx, hls_player_frame_t *frame,
+                              bool_t publish) {
+  mosaic_tile_t *tile = (mosaic_tile_t *)ctx;
+  mosaic_view_model_t *vm = tile->vm;
+
+  bitmap_unlock_buffer((bitmap_t *)frame->handle);
+  frame_ring_end_write(&tile->ring, publish);
+
+  if (publish &&
+      !__atomic_exchange_n(&vm->update_pending, TRUE, __ATOMIC_ACQ_REL)) {
+    idle_queue(on_update_ui, vm);
+  }
+
+  return RET_OK;
+}
+
+static void mosaic_view_model_set_state(mosaic_view_model_t *vm,
+                                        const char *state) {
+  if (vm->state_str)
+    free(vm->state_str);
+  vm->state_str = tk_strdup(state);
+}
+
+/*
+ * One player per URL in vm->urls, reusing the players there are. Called
+ * with all of them stopped.
+ */
+static void mosaic_view_model_apply_urls(mosaic_view_model_t *vm) {
+  char *urls = tk_strdup(vm->urls != NULL ? vm->urls : "");
+  char *save = NULL;
+  uint32_t n = 0;
+
+  return_if_fail(urls != NULL);
+  for (char *url = strtok_r(urls, MOSAIC_VIEW_MODEL_URL_SEPARATORS, &save);
+       url != NULL && n < PLAYER_MANAGER_MAX_PLAYERS;
+       url = strtok_r(NULL, MOSAIC_VIEW_MODEL_URL_SEPARATORS, &save)) {
+    hls_player_t *player = player_manager_get(vm->manager, n);
+    if (player == NULL) {
+      player = player_manager_add(vm->manager);
+      if (player == NULL) {
+        break;
+      }
+      hls_player_set_frame_sink(player, on_acquire_frame, on_release_frame,
+                                &vm->tiles[n]);
+      hls_player_set_output_format(
+          player, frame_format_from_bitmap((bitmap_format_t)vm->pixel_format));
+      if (vm->tile_w > 0 && vm->tile_h > 0) {
+        player_manager_set_tile_size(vm->manager, n, vm->tile_w, vm->tile_h);
+      }
+    }
+    hls_player_set_url(player, url);
+    n++;
+  }
+  free(urls);
+
+  while (player_manager_count(vm->manager) > n) {
+    uint32_t last = player_manager_count(vm->manager) - 1;
+    player_manager_remove(vm->manager, last);
+    vm->tiles[last].image = NULL;
+  }
+}
+
+/* Tile of a per-tile property such as image3, -1 if name is not prefix<n> */
+static int mosaic_view_model_tile_index(const char *name, const char *prefix) {
+  if (!tk_str_start_with(name, prefix)) {
+    return -1;
+  }
+  int index = tk_atoi(name + strlen(prefix));
+  return index >= 0 && index < PLAYER_MANAGER_MAX_PLAYERS ? index : -1;
+}
+
+static ret_t mosaic_view_model_set_prop(tk_object_t *obj, const char *name,
+                                        const value_t *v) {
+  mosaic_view_model_t *vm = (mosaic_view_model_t *)VIEW_MODEL(obj);
+
+  if (tk_str_eq(name, "urls")) {
+    if (vm->urls)
+      free(vm->urls);
+    vm->urls = tk_strdup(value_str(v));
+    player_manager_stop_all(vm->manager);
+    mosaic_view_model_apply_urls(vm);
+    mosaic_view_model_set_state(vm, "Stopped");
+    return RET_OK;
+  } else if (tk_str_eq(name, "focused")) {
+    return player_manager_set_focus(vm->manager, value_int(v));
+  } else if (tk_str_eq(name, "tile_w") || tk_str_eq(name, "tile_h")) {
+    if (tk_str_eq(name, "tile_w")) {
+      vm->tile_w = value_int(v);
+    } else {
+      vm->tile_h = value_int(v);
+    }
+    if (vm->tile_w > 0 && vm->tile_h > 0) {
+      for (uint32_t i = 0; i < player_manager_count(vm->manager); i++) {
+        player_manager_set_tile_size(vm->manager, i, vm->tile_w, vm->tile_h);
+      }
+    }
+    return RET_OK;
+  } else if (tk_str_eq(name, "pixel_format")) {
+    vm->pixel_format = value_int(v);
+    hls_player_pixel_format_t format =
+        frame_format_from_bitmap((bitmap_format_t)vm->pixel_format);
+    for (uint32_t i = 0; i < player_manager_count(vm->manager); i++) {
+      hls_player_set_output_format(player_manager_get(vm->manager, i), format);
+    }
+    return RET_OK;
+  }
+
+  return RET_NOT_FOUND;
+}
+
+static ret_t mosaic_view_model_get_prop(tk_object_t *obj, const char *name,
+                                        value_t *v) {
+  mosaic_view_model_t *vm = (mosaic_view_model_t *)VIEW_MODEL(obj);
+  int image = mosaic_view_model_tile_index(name, "image");
+  int frame_seq = mosaic_view_model_tile_index(name, "frame_seq");
+
+  if (image >= 0) {
+    value_set_pointer(v, vm->tiles[image].image);
+    return RET_OK;
+  } else if (frame_seq >= 0) {
+    value_set_uint32(v, vm->tiles[frame_seq].frame_seq);
+    return RET_OK;
+  } else if (tk_str_eq(name, "urls")) {
+    value_set_str(v, vm->urls);
+    return RET_OK;
+  } else if (tk_str_eq(name, "state")) {
+    value_set_str(v, vm->state_str);
+    return RET_OK;
+  } else if (tk_str_eq(name, "focused")) {
+    value_set_int(v, player_manager_get_focus(vm->manager));
+    return RET_OK;
+  } else if (tk_str_eq(name, "tile_w")) {
+    value_set_int(v, vm->tile_w);
+    return RET_OK;
+  } else if (tk_str_eq(name, "tile_h")) {
+    value_set_int(v, vm->tile_h);
+    return RET_OK;
+  } else if (tk_str_eq(name, "pixel_format")) {
+    value_set_int(v, vm->pixel_format);
+    return RET_OK;
+  } else if (tk_str_eq(name, "streams")) {
+    value_set_uint32(v, player_manager_count(vm->manager));
+    return RET_OK;
+  } else if (tk_str_eq(name, "saturated")) {
+    value_set_bool(v, player_manager_is_saturated(vm->manager));
+    return RET_OK;
+  }
+
+  return RET_NOT_FOUND;
+}
+
+static bool_t mosaic_view_model_can_exec(tk_object_t *obj, const char *name,
+                                         const char *args) {
+  return TRUE;
+}
+
+static ret_t mosaic_view_model_exec(tk_object_t *obj, const char *name,
+                                    const char *args) {
+  view_model_t *view_model = VIEW_MODEL(obj);
+  mosaic_view_model_t *vm = (mosaic_view_model_t *)view_model;
+
+  if (tk_str_eq(name, "play")) {
+    player_manager_play_all(vm->manager);
+    mosaic_view_model_set_state(vm, "Playing");
+    view_model_notify_props_changed(view_model);
+    return RET_OK;
+  } else if (tk_str_eq(name, "stop")) {
+    player_manager_stop_all(vm->manager);
+    mosaic_view_model_set_state(vm, "Stopped");
+    view_model_notify_props_changed(view_model);
+    return RET_OK;
+  }
+
+  return RET_NOT_FOUND;
+}
+
+static ret_t mosaic_view_model_on_destroy(tk_object_t *obj) {
+  mosaic_view_model_t *vm = (mosaic_view_model_t *)VIEW_MODEL(obj);
+
+  if (vm->manager) {
+    player_manager_destroy(vm->manager);
+    vm->manager = NULL;
+  }
+  for (uint32_t i = 0; i < PLAYER_MANAGER_MAX_PLAYERS; i++) {
+    vm->tiles[i].image = NULL;
+    frame_ring_deinit(&vm->tiles[i].ring);
+  }
+  if (vm->urls) {
+    free(vm->urls);
+    vm->urls = NULL;
+  }
+  if (vm->state_str) {
+    free(vm->state_str);
+    vm->state_str = NULL;
+  }
+
+  return RET_OK;
+}
+
+static const object_vtable_t s_mosaic_view_model_vtable = {
+    .type = "mosaic_view_model",
+    .desc = "mosaic_view_model",
+    .size = sizeof(mosaic_view_model_t),
+    .is_collection = FALSE,
+    .on_destroy = mosaic_view_model_on_destroy,
+    .get_prop = mosaic_view_model_get_prop,
+    .set_prop = mosaic_view_model_set_prop,
+    .can_exec = mosaic_view_model_can_exec,
+    .exec = mosaic_view_model_exec};
+
+view_model_t *mosaic_view_model_create(navigator_request_t *req) {
+  tk_object_t *obj = tk_object_create(&s_mosaic_view_model_vtable);
+  view_model_t *view_model = view_model_init(VIEW_MODEL(obj));
+  mosaic_view_model_t *vm = (mosaic_view_model_t *)view_model;
+  str_t urls;
+
+  for (uint32_t i = 0; i < PLAYER_MANAGER_MAX_PLAYERS; i++) {
+    vm->tiles[i].vm = vm;
+    frame_ring_init(&vm->tiles[i].ring);
+  }
+  vm->manager = player_manager_create(0);
+
+  str_init(&urls, MOSAIC_VIEW_MODEL_TILES * sizeof(MOSAIC_VIEW_MODEL_URL));
+  for (uint32_t i = 0; i < MOSAIC_VIEW_MODEL_TILES; i++) {
+    str_append_format(&urls, sizeof(MOSAIC_VIEW_MODEL_URL) + 1, "%s%s",
+                      i > 0 ? " " : "", MOSAIC_VIEW_MODEL_URL);
+  }
+  vm->urls = tk_strdup(urls.str);
+  str_reset(&urls);
+  if (vm->manager != NULL) {
+    mosaic_view_model_apply_urls(vm);
+  }
+  mosaic_view_model_set_state(vm, "Stopped");
+
+  return view_model;
+}
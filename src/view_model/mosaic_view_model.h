@@ -0,0 +1,12 @@
+#ifndef MOSAIC_VIEW_MODEL_H
+#define MOSAIC_VIEW_MODEL_H
+
+#include "mvvm/mvvm.h"
+
+BEGIN_C_DECLS
+
+view_model_t* mosaic_view_model_create(navigator_request_t* req);
+
+END_C_DECLS
+
+#endif /* MOSAIC_VIEW_MODEL_H */
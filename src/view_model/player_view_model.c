@@ -1,31 +1,69 @@
 #include "player_view_model.h"
 #include "../model/hls_player.h"
+#include "../model/channel_zapper.h"
+#include "../model/decode_ladder.h"
+#include "frame_format.h"
+#include "frame_ring.h"
+#include "tkc/time_now.h"
 #include "tkc/utils.h"
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/* Live streams keep this much demuxed media for pause and rewind */
+#define PLAYER_VIEW_MODEL_TIMESHIFT_BYTES (32 * 1024 * 1024)
+/* Initial volume, in percent as bound to the slider */
+#define PLAYER_VIEW_MODEL_VOLUME 60
+/* The stats overlay is refreshed at most this often */
+#define PLAYER_VIEW_MODEL_STATS_INTERVAL_MS 500
+
 typedef struct _player_view_model_t {
   view_model_t view_model;
+  /* Owns the players; player is the one on screen, refreshed after a zap */
+  channel_zapper_t *zapper;
   hls_player_t *player;
 
   /* Properties */
   char *url;
+  /* Channel expected next, kept warm on the standby player */
+  char *next_url;
   char *state_str;
   bitmap_t *image;
   char position_text[8];
   char duration_text[8];
   double progress;
+
+  /* Decode thread -> UI thread frame handoff */
+  frame_ring_t ring;
+  /* Bumped whenever image changes to a new frame, so views skip the rest */
+  uint32_t frame_seq;
   bool_t update_pending;
+  bool_t resize_pending;
+  uint32_t frame_w;
+  uint32_t frame_h;
+  bitmap_format_t frame_format;
+  /* Let the player convert straight into the ring bitmaps */
+  bool_t zero_copy;
+  /* Size of the video widget, reported by the view */
+  int32_t view_w;
+  int32_t view_h;
+  /* Bitmap format the view's LCD draws without converting */
+  int32_t pixel_format;
+  char *scaler;
+  /* Low-latency live settings, applied on the next play */
+  bool_t low_latency;
+  double target_latency;
+
+  /* time_now_us() of the newest frame published, for the handoff latency */
+  uint64_t publish_us;
+  /* Stats overlay text, rebuilt while shown, and the JSON metrics dump */
+  bool_t show_stats;
+  str_t stats_text;
+  uint64_t stats_updated;
+  str_t metrics_json;
 } player_view_model_t;
 
-typedef struct _frame_info_t {
-  int w;
-  int h;
-  uint8_t *data;
-  player_view_model_t *vm;
-} frame_info_t;
-
 static void format_time(double seconds, char *buffer, size_t size) {
   if (seconds < 0) {
     seconds = 0;
@@ -68,56 +106,220 @@ static void player_view_model_reset_progress(player_view_model_t *vm) {
   vm->progress = 0;
 }
 
-static ret_t on_update_ui(const idle_info_t *info) {
-  frame_info_t *frame = (frame_info_t *)(info->ctx);
-  player_view_model_t *vm = frame->vm;
-
-  if (vm->image == NULL || vm->image->w != frame->w ||
-      vm->image->h != frame->h) {
-    if (vm->image) {
-      bitmap_destroy(vm->image);
+static void player_view_model_update_stats(player_view_model_t *vm) {
+  static const char *const stage_names[HLS_PLAYER_STAGES] = {
+      "network", "demux", "decode", "convert", "handoff", "paint"};
+  hls_player_metrics_t m;
+
+  hls_player_get_metrics(vm->player, &m);
+  str_clear(&vm->stats_text);
+  for (uint32_t i = 0; i < HLS_PLAYER_STAGES; i++) {
+    str_append_format(&vm->stats_text, 128,
+                      "%-8s p50 %6.2f  p95 %6.2f  max %7.2f ms\n", stage_names[i],
+                      m.stages[i].p50, m.stages[i].p95, m.stages[i].max);
+  }
+  str_append_format(&vm->stats_text, 128,
+                    "frames %llu decoded, %llu shown, %llu dropped\n",
+                    (unsigned long long)m.frames_decoded,
+                    (unsigned long long)m.frames_displayed,
+                    (unsigned long long)m.frames_dropped);
+  str_append_format(&vm->stats_text, 128,
+                    "buffer net %.1fs  video %.1fs  audio %.1fs  underruns %u\n",
+                    m.network_buffer, m.video_queue, m.audio_buffer,
+                    m.audio_underruns);
+  str_append_format(&vm->stats_text, 128, "bitrate %.0f kbps  link %.0f kbps",
+                    m.bitrate / 1000, m.throughput / 1000);
+  if (m.live_latency >= 0) {
+    str_append_format(&vm->stats_text, 64, "\nlive %.1fs behind the edge",
+                      m.live_latency);
+  }
+  if (m.connection_reuse >= 0) {
+    str_append_format(&vm->stats_text, 64,
+                      "\nhttp %.0f%% kept-alive  connect %.1f ms",
+                      m.connection_reuse * 100, m.handshake_ms);
+  }
+  if (m.decode_changes > 0) {
+    str_append_format(&vm->stats_text, 96, "\ndecode %s  %u level changes",
+                      decode_level_name((decode_level_t)m.decode_level), m.decode_changes);
+  }
+  if (vm->zapper != NULL) {
+    channel_zapper_stats_t zs;
+    channel_zapper_get_stats(vm->zapper, &zs);
+    if (zs.zaps > 0) {
+      str_append_format(&vm->stats_text, 128,
+                        "\nzap %.0f ms  avg %.0f  max %.0f  standby %u/%u",
+                        zs.last, zs.avg, zs.max, zs.standby_hits, zs.zaps);
     }
-    log_debug("on_update_ui: create bitmap: w=%d, h=%d\n", frame->w, frame->h);
-    vm->image = bitmap_create_ex(frame->w, frame->h, 0, BITMAP_FMT_RGBA8888);
   }
+  vm->stats_updated = time_now_ms();
+}
 
-  if (vm->image) {
-    uint8_t *data = (uint8_t *)bitmap_lock_buffer_for_write(vm->image);
-    if (data) {
-      memcpy(data, frame->data, frame->w * frame->h * 4);
-      bitmap_unlock_buffer(vm->image);
-    }
+static ret_t on_resize_ring(const idle_info_t *info) {
+  player_view_model_t *vm = (player_view_model_t *)(info->ctx);
+
+  log_debug("on_resize_ring: w=%u, h=%u, format=%d\n", vm->frame_w,
+            vm->frame_h, vm->frame_format);
+  // vm->image stays valid (retired by the ring) until the next frame.
+  frame_ring_resize(&vm->ring, vm->frame_w, vm->frame_h, vm->frame_format);
+
+  __atomic_store_n(&vm->resize_pending, FALSE, __ATOMIC_RELEASE);
+  return RET_REMOVE;
+}
+
+static ret_t on_update_ui(const idle_info_t *info) {
+  player_view_model_t *vm = (player_view_model_t *)(info->ctx);
+
+  // Clear first: a frame published after this point queues a new update.
+  __atomic_store_n(&vm->update_pending, FALSE, __ATOMIC_RELEASE);
+
+  bitmap_t *image = frame_ring_acquire(&vm->ring);
+  if (image != NULL) {
+    image->flags |= BITMAP_FLAG_CHANGED;
+    vm->image = image;
+    vm->frame_seq++;
+    hls_player_record_stage(
+        vm->player, HLS_PLAYER_STAGE_HANDOFF,
+        (int64_t)(time_now_us() -
+                  __atomic_load_n(&vm->publish_us, __ATOMIC_ACQUIRE)));
   }
 
   player_view_model_update_progress(vm);
   view_model_notify_props_changed(VIEW_MODEL(vm));
 
-  free(frame->data);
-  free(frame);
-  vm->update_pending = FALSE;
   return RET_REMOVE;
 }
 
+static ret_t on_stopped_ui(const idle_info_t *info) {
+  player_view_model_t *vm = (player_view_model_t *)(info->ctx);
+
+  // Play may have been pressed again while the last run was tearing down.
+  if (hls_player_get_state(vm->player) == PLAYER_STATE_STOPPED) {
+    if (vm->state_str)
+      free(vm->state_str);
+    vm->state_str = tk_strdup("Stopped");
+    view_model_notify_props_changed(VIEW_MODEL(vm));
+  }
+  // Taken by the stop command; may be the last one.
+  tk_object_unref(TK_OBJECT(vm));
+  return RET_REMOVE;
+}
+
+/* Player thread: the asynchronous stop has released everything. */
+static void on_player_stopped(void *ctx, hls_player_t *player) {
+  idle_queue(on_stopped_ui, ctx);
+}
+
+static bitmap_t *player_view_model_begin_frame(player_view_model_t *vm, int w,
+                                               int h, int format) {
+  bitmap_format_t bitmap_format =
+      frame_format_to_bitmap((hls_player_pixel_format_t)format);
+  if (bitmap_format == BITMAP_FMT_NONE) {
+    return NULL;
+  }
+
+  bitmap_t *image = frame_ring_begin_write(&vm->ring, w, h, bitmap_format);
+  if (image == NULL) {
+    // New resolution or format: the UI thread owns the bitmaps, so it
+    // reallocates.
+    if (!__atomic_exchange_n(&vm->resize_pending, TRUE, __ATOMIC_ACQ_REL)) {
+      vm->frame_w = w;
+      vm->frame_h = h;
+      vm->frame_format = bitmap_format;
+      idle_queue(on_resize_ring, vm);
+    }
+  }
+  return image;
+}
+
+static void player_view_model_end_frame(player_view_model_t *vm,
+                                        bool_t written) {
+  frame_ring_end_write(&vm->ring, written);
+  if (written) {
+    __atomic_store_n(&vm->publish_us, time_now_us(), __ATOMIC_RELEASE);
+  }
+
+  if (written &&
+      !__atomic_exchange_n(&vm->update_pending, TRUE, __ATOMIC_ACQ_REL)) {
+    idle_queue(on_update_ui, vm);
+  }
+}
+
+/* Zero-copy path: sws_scale writes into the locked back bitmap. */
+static ret_t on_acquire_frame(void *ctx, int w, int h, int format,
+                              hls_player_frame_t *frame) {
+  player_view_model_t *vm = (player_view_model_t *)ctx;
+
+  bitmap_t *image = player_view_model_begin_frame(vm, w, h, format);
+  if (image == NULL) {
+    return RET_BUSY;
+  }
+
+  uint8_t *data = bitmap_lock_buffer_for_write(image);
+  if (data == NULL) {
+    frame_ring_end_write(&vm->ring, FALSE);
+    return RET_BUSY;
+  }
+
+  frame->data = data;
+  frame->line_length = bitmap_get_line_length(image);
+  frame->width = w;
+  frame->height = h;
+  frame->format = format;
+  frame->handle = image;
+
+  return RET_OK;
+}
+
+static ret_t on_release_frame(void *ctx, hls_player_frame_t *frame,
+                              bool_t publish) {
+  player_view_model_t *vm = (player_view_model_t *)ctx;
+
+  bitmap_unlock_buffer((bitmap_t *)frame->handle);
+  player_view_model_end_frame(vm, publish);
+
+  return RET_OK;
+}
+
 static void on_frame_callback(void *ctx, const void *data, int w, int h,
                               int format) {
   player_view_model_t *vm = (player_view_model_t *)ctx;
 
-  if (vm->update_pending) {
+  bitmap_t *image = player_view_model_begin_frame(vm, w, h, format);
+  if (image == NULL) {
     return;
   }
 
-  uint32_t size = w * h * 4;
-  uint8_t *buffer = (uint8_t *)malloc(size);
-  if (buffer) {
-    memcpy(buffer, data, size);
-    frame_info_t *info = (frame_info_t *)malloc(sizeof(frame_info_t));
-    info->w = w;
-    info->h = h;
-    info->data = buffer;
-    info->vm = vm;
-    vm->update_pending = TRUE;
-    idle_queue(on_update_ui, info);
+  bool_t written = FALSE;
+  uint8_t *dst = bitmap_lock_buffer_for_write(image);
+  if (dst != NULL) {
+    const uint8_t *src = (const uint8_t *)data;
+    uint32_t row = w * bitmap_get_bpp_of_format((bitmap_format_t)image->format);
+    uint32_t line_length = bitmap_get_line_length(image);
+    for (int y = 0; y < h; y++) {
+      memcpy(dst + y * line_length, src + y * row, row);
+    }
+    bitmap_unlock_buffer(image);
+    written = TRUE;
+  }
+  player_view_model_end_frame(vm, written);
+}
+
+static void player_view_model_apply_zero_copy(player_view_model_t *vm) {
+  if (vm->zero_copy) {
+    hls_player_set_frame_sink(vm->player, on_acquire_frame, on_release_frame,
+                              vm);
+  } else {
+    hls_player_set_frame_sink(vm->player, NULL, NULL, NULL);
+  }
+}
+
+static hls_player_scaler_t player_view_model_parse_scaler(const char *name) {
+  if (tk_str_eq(name, "fast_bilinear")) {
+    return HLS_PLAYER_SCALER_FAST_BILINEAR;
+  } else if (tk_str_eq(name, "bicubic")) {
+    return HLS_PLAYER_SCALER_BICUBIC;
   }
+  return HLS_PLAYER_SCALER_BILINEAR;
 }
 
 static ret_t player_view_model_set_prop(tk_object_t *obj, const char *name,
@@ -133,6 +335,82 @@ static ret_t player_view_model_set_prop(tk_object_t *obj, const char *name,
       hls_player_set_url(vm->player, vm->url);
     }
     return RET_OK;
+  } else if (tk_str_eq(name, "next_url")) {
+    const char *url = value_str(v);
+    if (vm->next_url)
+      free(vm->next_url);
+    vm->next_url = (url == NULL || *url == '\0') ? NULL : tk_strdup(url);
+    if (vm->zapper && vm->next_url) {
+      return channel_zapper_prepare(vm->zapper, vm->next_url);
+    }
+    return RET_OK;
+  } else if (tk_str_eq(name, "zero_copy")) {
+    vm->zero_copy = value_bool(v);
+    player_view_model_apply_zero_copy(vm);
+    return RET_OK;
+  } else if (tk_str_eq(name, "view_w") || tk_str_eq(name, "view_h")) {
+    if (tk_str_eq(name, "view_w")) {
+      vm->view_w = value_int(v);
+    } else {
+      vm->view_h = value_int(v);
+    }
+    if (vm->view_w > 0 && vm->view_h > 0) {
+      hls_player_set_output_size(vm->player, vm->view_w, vm->view_h);
+    }
+    return RET_OK;
+  } else if (tk_str_eq(name, "pixel_format")) {
+    vm->pixel_format = value_int(v);
+    return hls_player_set_output_format(
+        vm->player, frame_format_from_bitmap((bitmap_format_t)vm->pixel_format));
+  } else if (tk_str_eq(name, "scaler")) {
+    if (vm->scaler)
+      free(vm->scaler);
+    vm->scaler = tk_strdup(value_str(v));
+    hls_player_set_scaler(vm->player,
+                          player_view_model_parse_scaler(vm->scaler));
+    return RET_OK;
+  } else if (tk_str_eq(name, "selected_variant")) {
+    return hls_player_select_variant(vm->player, value_int(v));
+  } else if (tk_str_eq(name, "fast_start")) {
+    return hls_player_set_fast_start(vm->player, value_bool(v));
+  } else if (tk_str_eq(name, "progress")) {
+    double percent = value_double(v);
+    double duration = hls_player_get_duration(vm->player);
+    // The two-way binding writes back what update_progress just set.
+    if (duration <= 0 || fabs(percent - vm->progress) < 0.5) {
+      return RET_OK;
+    }
+    ret_t ret = hls_player_seek(vm->player, percent / 100.0 * duration);
+    if (ret == RET_OK) {
+      vm->progress = percent;
+    }
+    return ret;
+  } else if (tk_str_eq(name, "low_latency") ||
+             tk_str_eq(name, "target_latency")) {
+    if (tk_str_eq(name, "low_latency")) {
+      vm->low_latency = value_bool(v);
+    } else {
+      vm->target_latency = tk_max(0, value_double(v));
+    }
+    return hls_player_set_low_latency(vm->player, vm->low_latency,
+                                      vm->target_latency);
+  } else if (tk_str_eq(name, "timeshift_delay")) {
+    return hls_player_timeshift_seek(vm->player, value_double(v));
+  } else if (tk_str_eq(name, "audio_latency")) {
+    return hls_player_set_audio_latency(vm->player, value_double(v));
+  } else if (tk_str_eq(name, "volume")) {
+    return hls_player_set_volume(vm->player, value_double(v) / 100.0);
+  } else if (tk_str_eq(name, "mute")) {
+    return hls_player_set_mute(vm->player, value_bool(v));
+  } else if (tk_str_eq(name, "playback_rate")) {
+    return hls_player_set_playback_rate(vm->player, value_double(v));
+  } else if (tk_str_eq(name, "paint_time")) {
+    return hls_player_record_stage(vm->player, HLS_PLAYER_STAGE_PAINT,
+                                   value_int64(v));
+  } else if (tk_str_eq(name, "show_stats")) {
+    vm->show_stats = value_bool(v);
+    vm->stats_updated = 0;
+    return RET_OK;
   }
 
   return RET_NOT_FOUND;
@@ -152,6 +430,9 @@ static ret_t player_view_model_get_prop(tk_object_t *obj, const char *name,
   } else if (tk_str_eq(name, "image")) {
     value_set_pointer(v, vm->image);
     return RET_OK;
+  } else if (tk_str_eq(name, "frame_seq")) {
+    value_set_uint32(v, vm->frame_seq);
+    return RET_OK;
   } else if (tk_str_eq(name, "position_text")) {
     value_set_str(v, vm->position_text);
     return RET_OK;
@@ -161,6 +442,156 @@ static ret_t player_view_model_get_prop(tk_object_t *obj, const char *name,
   } else if (tk_str_eq(name, "progress")) {
     value_set_double(v, vm->progress);
     return RET_OK;
+  } else if (tk_str_eq(name, "zero_copy")) {
+    value_set_bool(v, vm->zero_copy);
+    return RET_OK;
+  } else if (tk_str_eq(name, "pixel_format")) {
+    value_set_int(v, vm->pixel_format);
+    return RET_OK;
+  } else if (tk_str_eq(name, "view_w")) {
+    value_set_int(v, vm->view_w);
+    return RET_OK;
+  } else if (tk_str_eq(name, "view_h")) {
+    value_set_int(v, vm->view_h);
+    return RET_OK;
+  } else if (tk_str_eq(name, "scaler")) {
+    value_set_str(v, vm->scaler);
+    return RET_OK;
+  } else if (tk_str_eq(name, "selected_variant")) {
+    value_set_int(v, hls_player_get_selected_variant(vm->player));
+    return RET_OK;
+  } else if (tk_str_eq(name, "fast_start")) {
+    value_set_bool(v, hls_player_get_fast_start(vm->player));
+    return RET_OK;
+  } else if (tk_str_eq(name, "first_frame_ms")) {
+    hls_player_startup_times_t times;
+    hls_player_get_startup_times(vm->player, &times);
+    value_set_double(v, times.first_frame);
+    return RET_OK;
+  } else if (tk_str_eq(name, "seek_ttff_ms")) {
+    hls_player_seek_stats_t stats;
+    hls_player_get_seek_stats(vm->player, &stats);
+    value_set_double(v, stats.last_ttff);
+    return RET_OK;
+  } else if (tk_str_eq(name, "timeshift_delay")) {
+    hls_player_timeshift_stats_t stats;
+    hls_player_get_timeshift_stats(vm->player, &stats);
+    value_set_double(v, stats.delay);
+    return RET_OK;
+  } else if (tk_str_eq(name, "timeshift_window")) {
+    hls_player_timeshift_stats_t stats;
+    hls_player_get_timeshift_stats(vm->player, &stats);
+    value_set_double(v, stats.window);
+    return RET_OK;
+  } else if (tk_str_eq(name, "low_latency")) {
+    value_set_bool(v, vm->low_latency);
+    return RET_OK;
+  } else if (tk_str_eq(name, "target_latency")) {
+    value_set_double(v, vm->target_latency);
+    return RET_OK;
+  } else if (tk_str_eq(name, "live_latency")) {
+    value_set_double(v, hls_player_get_live_latency(vm->player));
+    return RET_OK;
+  } else if (tk_str_eq(name, "next_url")) {
+    value_set_str(v, vm->next_url);
+    return RET_OK;
+  } else if (tk_str_eq(name, "standby_ready")) {
+    value_set_bool(v, vm->zapper != NULL && vm->zapper->standby != NULL &&
+                          vm->zapper->standby_url != NULL &&
+                          hls_player_is_prerolled(vm->zapper->standby));
+    return RET_OK;
+  } else if (tk_str_eq(name, "zap_ms")) {
+    channel_zapper_stats_t stats;
+    channel_zapper_get_stats(vm->zapper, &stats);
+    value_set_double(v, stats.last);
+    return RET_OK;
+  } else if (tk_str_eq(name, "stop_ms")) {
+    hls_player_stop_stats_t stats;
+    hls_player_get_stop_stats(vm->player, &stats);
+    value_set_double(v, stats.last_latency);
+    return RET_OK;
+  } else if (tk_str_eq(name, "audio_latency")) {
+    value_set_double(v, hls_player_get_audio_latency(vm->player));
+    return RET_OK;
+  } else if (tk_str_eq(name, "audio_underruns")) {
+    hls_player_audio_stats_t stats;
+    hls_player_get_audio_stats(vm->player, &stats);
+    value_set_uint32(v, stats.underruns);
+    return RET_OK;
+  } else if (tk_str_eq(name, "volume")) {
+    value_set_double(v, hls_player_get_volume(vm->player) * 100);
+    return RET_OK;
+  } else if (tk_str_eq(name, "mute")) {
+    value_set_bool(v, hls_player_get_mute(vm->player));
+    return RET_OK;
+  } else if (tk_str_eq(name, "playback_rate")) {
+    value_set_double(v, hls_player_get_playback_rate(vm->player));
+    return RET_OK;
+  } else if (tk_str_eq(name, "variant")) {
+    hls_player_abr_stats_t stats;
+    hls_player_get_abr_stats(vm->player, &stats);
+    value_set_int(v, stats.variant);
+    return RET_OK;
+  } else if (tk_str_eq(name, "bandwidth")) {
+    hls_player_abr_stats_t stats;
+    hls_player_get_abr_stats(vm->player, &stats);
+    value_set_double(v, stats.bandwidth);
+    return RET_OK;
+  } else if (tk_str_eq(name, "buffer_level")) {
+    hls_player_abr_stats_t stats;
+    hls_player_get_abr_stats(vm->player, &stats);
+    value_set_double(v, stats.buffer_level);
+    return RET_OK;
+  } else if (tk_str_eq(name, "switch_count")) {
+    hls_player_abr_stats_t stats;
+    hls_player_get_abr_stats(vm->player, &stats);
+    value_set_uint32(v, stats.switches);
+    return RET_OK;
+  } else if (tk_str_eq(name, "frames_produced")) {
+    frame_ring_stats_t stats;
+    frame_ring_get_stats(&vm->ring, &stats);
+    value_set_uint64(v, stats.produced);
+    return RET_OK;
+  } else if (tk_str_eq(name, "frames_presented")) {
+    frame_ring_stats_t stats;
+    frame_ring_get_stats(&vm->ring, &stats);
+    value_set_uint64(v, stats.presented);
+    return RET_OK;
+  } else if (tk_str_eq(name, "frames_dropped")) {
+    frame_ring_stats_t stats;
+    frame_ring_get_stats(&vm->ring, &stats);
+    value_set_uint64(v, stats.dropped);
+    return RET_OK;
+  } else if (tk_str_eq(name, "frames_decoded")) {
+    hls_player_metrics_t m;
+    hls_player_get_metrics(vm->player, &m);
+    value_set_uint64(v, m.frames_decoded);
+    return RET_OK;
+  } else if (tk_str_eq(name, "bitrate")) {
+    hls_player_metrics_t m;
+    hls_player_get_metrics(vm->player, &m);
+    value_set_double(v, m.bitrate);
+    return RET_OK;
+  } else if (tk_str_eq(name, "paint_time")) {
+    hls_player_metrics_t m;
+    hls_player_get_metrics(vm->player, &m);
+    value_set_int64(v, (int64_t)(m.stages[HLS_PLAYER_STAGE_PAINT].p50 * 1000));
+    return RET_OK;
+  } else if (tk_str_eq(name, "show_stats")) {
+    value_set_bool(v, vm->show_stats);
+    return RET_OK;
+  } else if (tk_str_eq(name, "stats_text")) {
+    if (vm->show_stats &&
+        time_now_ms() - vm->stats_updated >= PLAYER_VIEW_MODEL_STATS_INTERVAL_MS) {
+      player_view_model_update_stats(vm);
+    }
+    value_set_str(v, vm->show_stats ? vm->stats_text.str : "");
+    return RET_OK;
+  } else if (tk_str_eq(name, "metrics_json")) {
+    str_clear(&vm->metrics_json);
+    hls_player_dump_metrics(vm->player, &vm->metrics_json);
+    value_set_str(v, vm->metrics_json.str);
+    return RET_OK;
   }
 
   return RET_NOT_FOUND;
@@ -189,6 +620,20 @@ static ret_t player_view_model_exec(tk_object_t *obj, const char *name,
       view_model_notify_props_changed(view_model);
     }
     return RET_OK;
+  } else if (tk_str_eq(name, "zap")) {
+    // Switch to url in place, or to the standby if it was warmed up on it.
+    if (vm->zapper && vm->url) {
+      log_debug("exec zap url: %s\n", vm->url);
+      channel_zapper_zap(vm->zapper, vm->url);
+      vm->player = channel_zapper_get_player(vm->zapper);
+
+      if (vm->state_str)
+        free(vm->state_str);
+      vm->state_str = tk_strdup("Playing");
+      player_view_model_reset_progress(vm);
+      view_model_notify_props_changed(view_model);
+    }
+    return RET_OK;
   } else if (tk_str_eq(name, "pause")) {
     if (vm->player) {
       hls_player_pause(vm->player);
@@ -200,13 +645,30 @@ static ret_t player_view_model_exec(tk_object_t *obj, const char *name,
       view_model_notify_props_changed(view_model);
     }
     return RET_OK;
-  } else if (tk_str_eq(name, "stop")) {
+  } else if (tk_str_eq(name, "dump_metrics")) {
     if (vm->player) {
-      hls_player_stop(vm->player);
-
+      str_clear(&vm->metrics_json);
+      hls_player_dump_metrics(vm->player, &vm->metrics_json);
+      log_info("metrics: %s\n", vm->metrics_json.str);
+    }
+    return RET_OK;
+  } else if (tk_str_eq(name, "go_live")) {
+    if (vm->player) {
+      return hls_player_go_live(vm->player);
+    }
+    return RET_OK;
+  } else if (tk_str_eq(name, "stop")) {
+    if (vm->player && hls_player_get_state(vm->player) != PLAYER_STATE_STOPPED) {
+      // Never wait on the network here: the UI learns when the stop is done.
+      // The view model must outlive the completion, which comes as an idle
+      // on the UI thread: it is kept until then. A stop already on its way
+      // is left alone, so each reference has exactly one completion.
       if (vm->state_str)
         free(vm->state_str);
-      vm->state_str = tk_strdup("Stopped");
+      vm->state_str = tk_strdup("Stopping");
+      tk_object_ref(TK_OBJECT(vm));
+      hls_player_stop_async(vm->player, on_player_stopped, vm);
+
       player_view_model_reset_progress(vm);
       view_model_notify_props_changed(view_model);
     }
@@ -220,22 +682,31 @@ static ret_t player_view_model_on_destroy(tk_object_t *obj) {
   view_model_t *view_model = VIEW_MODEL(obj);
   player_view_model_t *vm = (player_view_model_t *)view_model;
 
-  if (vm->player) {
-    hls_player_destroy(vm->player);
+  if (vm->zapper) {
+    channel_zapper_destroy(vm->zapper);
+    vm->zapper = NULL;
     vm->player = NULL;
   }
   if (vm->url) {
     free(vm->url);
     vm->url = NULL;
   }
+  if (vm->next_url) {
+    free(vm->next_url);
+    vm->next_url = NULL;
+  }
   if (vm->state_str) {
     free(vm->state_str);
     vm->state_str = NULL;
   }
-  if (vm->image) {
-    bitmap_destroy(vm->image);
-    vm->image = NULL;
+  if (vm->scaler) {
+    free(vm->scaler);
+    vm->scaler = NULL;
   }
+  vm->image = NULL;
+  frame_ring_deinit(&vm->ring);
+  str_reset(&vm->stats_text);
+  str_reset(&vm->metrics_json);
 
   return RET_OK;
 }
@@ -256,8 +727,19 @@ view_model_t *player_view_model_create(navigator_request_t *req) {
   view_model_t *view_model = view_model_init(VIEW_MODEL(obj));
   player_view_model_t *vm = (player_view_model_t *)view_model;
 
+  frame_ring_init(&vm->ring);
+  str_init(&vm->stats_text, 512);
+  str_init(&vm->metrics_json, 1024);
   vm->player = hls_player_create();
+  vm->zapper = channel_zapper_create(vm->player, idle_queue);
   hls_player_set_on_frame(vm->player, on_frame_callback, vm);
+  vm->zero_copy = TRUE;
+  player_view_model_apply_zero_copy(vm);
+  hls_player_set_fast_start(vm->player, TRUE);
+  hls_player_set_timeshift(vm->player, PLAYER_VIEW_MODEL_TIMESHIFT_BYTES, NULL,
+                           0);
+  hls_player_set_volume(vm->player, PLAYER_VIEW_MODEL_VOLUME / 100.0);
+  vm->scaler = tk_strdup("bilinear");
   vm->url = tk_strdup(
       "http://devimages.apple.com/iphone/samples/bipbop/bipbopall.m3u8");
   hls_player_set_url(vm->player, vm->url);
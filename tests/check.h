@@ -0,0 +1,55 @@
+#ifndef TESTS_CHECK_H
+#define TESTS_CHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Minimal assertions for the unit tests: a failed check prints where it
+ * failed and the test carries on, and CHECK_RESULT() is the exit status.
+ */
+static int s_check_failures = 0;
+
+#define CHECK(cond)                                                           \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      s_check_failures++;                                                     \
+    }                                                                         \
+  } while (0)
+
+#define CHECK_STR_EQ(actual, expected)                                        \
+  do {                                                                        \
+    const char *a_ = (actual);                                                \
+    const char *e_ = (expected);                                              \
+    if (a_ == NULL || strcmp(a_, e_) != 0) {                                  \
+      fprintf(stderr, "%s:%d: %s is \"%s\", expected \"%s\"\n", __FILE__,     \
+              __LINE__, #actual, a_ != NULL ? a_ : "(null)", e_);             \
+      s_check_failures++;                                                     \
+    }                                                                         \
+  } while (0)
+
+#define CHECK_RESULT()                                                        \
+  (s_check_failures == 0 ? 0 : (fprintf(stderr, "%d checks failed\n",        \
+                                        s_check_failures), 1))
+
+/* The whole of a fixture file, NUL-terminated; free() it */
+static inline char *check_read_file(const char *path) {
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return NULL;
+  }
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  char *text = size >= 0 ? (char *)malloc(size + 1) : NULL;
+  if (text != NULL) {
+    text[fread(text, 1, size, fp)] = '\0';
+  }
+  fclose(fp);
+  return text;
+}
+
+#endif /* TESTS_CHECK_H */
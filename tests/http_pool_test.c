@@ -0,0 +1,173 @@
+/*
+ * Test of the keep-alive HTTP client against a local server: connection
+ * reuse, chunked bodies, redirects, a server that ignores Range, and a kept
+ * connection the server has closed meanwhile. Needs the responses of
+ * scripts/serve_hls.sh --test, which tests/http_pool_test.sh starts.
+ *
+ * usage: http_pool_test [base_url]   (http://127.0.0.1:8000 by default)
+ */
+#include "model/http_pool.h"
+#include "check.h"
+#include "tkc/platform.h"
+
+#define BODY_SIZE 256
+
+/*
+ * GET base + path from offset (length bytes when >= 0) through pool, into
+ * body as a string; size gets the size the response announced.
+ */
+static ret_t fetch(http_pool_t *pool, const char *base, const char *path,
+                   int64_t offset, int64_t length, char *body, int64_t *size) {
+  char url[256];
+  http_request_t *request = NULL;
+  int used = 0;
+
+  snprintf(url, sizeof(url), "%s%s", base, path);
+  body[0] = '\0';
+  ret_t ret = http_pool_open(pool, url, offset, length, NULL, &request);
+  if (ret != RET_OK) {
+    return ret;
+  }
+  if (size != NULL) {
+    *size = http_request_get_size(request);
+  }
+
+  for (;;) {
+    int n = http_request_read(request, (uint8_t *)body + used, BODY_SIZE - 1 - used);
+    if (n <= 0) {
+      ret = n == 0 ? RET_OK : RET_FAIL;
+      break;
+    }
+    used += n;
+    if (used == BODY_SIZE - 1) {
+      ret = RET_FAIL;
+      break;
+    }
+  }
+  body[used] = '\0';
+  http_request_close(request);
+
+  return ret;
+}
+
+static void test_keep_alive(const char *base) {
+  char body[BODY_SIZE];
+  int64_t size = 0;
+  http_pool_stats_t stats;
+  http_pool_t *pool = http_pool_create(0, 0, 0);
+
+  CHECK(fetch(pool, base, "/test/hello", 0, -1, body, &size) == RET_OK);
+  CHECK_STR_EQ(body, "hello world");
+  CHECK(size == 11);
+  CHECK(fetch(pool, base, "/test/hello", 0, -1, body, NULL) == RET_OK);
+  CHECK_STR_EQ(body, "hello world");
+
+  // The second request went out on the first one's connection.
+  http_pool_get_stats(pool, &stats);
+  CHECK(stats.requests == 2 && stats.reused == 1 && stats.connects == 1);
+  CHECK(stats.stale == 0 && stats.idle == 1);
+  CHECK(stats.handshake_avg >= 0);
+  http_pool_destroy(pool);
+}
+
+static void test_chunked(const char *base) {
+  char body[BODY_SIZE];
+  int64_t size = 0;
+  http_pool_stats_t stats;
+  http_pool_t *pool = http_pool_create(0, 0, 0);
+
+  CHECK(fetch(pool, base, "/test/chunked", 0, -1, body, &size) == RET_OK);
+  CHECK_STR_EQ(body, "hello chunked world");
+  CHECK(size == -1);
+
+  // Read to its last chunk and trailer, the connection can be kept.
+  CHECK(fetch(pool, base, "/test/hello", 0, -1, body, NULL) == RET_OK);
+  CHECK_STR_EQ(body, "hello world");
+  http_pool_get_stats(pool, &stats);
+  CHECK(stats.requests == 2 && stats.reused == 1 && stats.connects == 1);
+  http_pool_destroy(pool);
+}
+
+static void test_redirect(const char *base) {
+  char body[BODY_SIZE];
+  http_pool_stats_t stats;
+  http_pool_t *pool = http_pool_create(0, 0, 0);
+
+  CHECK(fetch(pool, base, "/test/redirect", 0, -1, body, NULL) == RET_OK);
+  CHECK_STR_EQ(body, "hello world");
+
+  // The redirect's body was read out so the target could use its connection.
+  http_pool_get_stats(pool, &stats);
+  CHECK(stats.requests == 2 && stats.reused == 1 && stats.connects == 1);
+  http_pool_destroy(pool);
+}
+
+/*
+ * The whole resource comes back: the bytes before the range are dropped and
+ * reading stops at its end.
+ */
+static void test_range_ignored(const char *base) {
+  char body[BODY_SIZE];
+  int64_t size = 0;
+  http_pool_stats_t stats;
+  http_pool_t *pool = http_pool_create(0, 0, 0);
+
+  CHECK(fetch(pool, base, "/test/hello", 6, 5, body, NULL) == RET_OK);
+  CHECK_STR_EQ(body, "world");
+  CHECK(fetch(pool, base, "/test/hello", 6, -1, body, NULL) == RET_OK);
+  CHECK_STR_EQ(body, "world");
+  CHECK(fetch(pool, base, "/test/hello", 2, 3, body, &size) == RET_OK);
+  CHECK_STR_EQ(body, "llo");
+  CHECK(size == 3);
+  CHECK(fetch(pool, base, "/test/hello", 0, 5, body, NULL) == RET_OK);
+  CHECK_STR_EQ(body, "hello");
+
+  // A connection left with the rest of a body on it is not kept.
+  http_pool_get_stats(pool, &stats);
+  CHECK(stats.requests == 4 && stats.reused == 2 && stats.connects == 2);
+  CHECK(stats.idle == 0);
+  http_pool_destroy(pool);
+}
+
+static void test_stale(const char *base) {
+  char body[BODY_SIZE];
+  http_pool_stats_t stats;
+  http_pool_t *pool = http_pool_create(0, 0, 0);
+
+  CHECK(fetch(pool, base, "/test/drop", 0, -1, body, NULL) == RET_OK);
+  CHECK_STR_EQ(body, "dropped");
+  http_pool_get_stats(pool, &stats);
+  CHECK(stats.idle == 1);
+
+  // Give the server's close time to arrive; the next request starts over.
+  sleep_ms(200);
+  CHECK(fetch(pool, base, "/test/hello", 0, -1, body, NULL) == RET_OK);
+  CHECK_STR_EQ(body, "hello world");
+  http_pool_get_stats(pool, &stats);
+  CHECK(stats.requests == 2 && stats.reused == 0);
+  CHECK(stats.stale == 1 && stats.connects == 2);
+  http_pool_destroy(pool);
+}
+
+static void test_not_found(const char *base) {
+  char body[BODY_SIZE];
+  http_pool_t *pool = http_pool_create(0, 0, 0);
+
+  CHECK(fetch(pool, base, "/test/missing", 0, -1, body, NULL) == RET_FAIL);
+  CHECK(http_pool_supports("http://127.0.0.1/"));
+  CHECK(!http_pool_supports("https://127.0.0.1/"));
+  http_pool_destroy(pool);
+}
+
+int main(int argc, char *argv[]) {
+  const char *base = argc > 1 ? argv[1] : "http://127.0.0.1:8000";
+
+  test_keep_alive(base);
+  test_chunked(base);
+  test_redirect(base);
+  test_range_ignored(base);
+  test_stale(base);
+  test_not_found(base);
+
+  return CHECK_RESULT();
+}
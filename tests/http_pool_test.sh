@@ -0,0 +1,23 @@
+#!/bin/bash
+
+# Runs the HTTP pool test against scripts/serve_hls.sh --test.
+#
+#   tests/http_pool_test.sh [TEST_BINARY] [PORT]
+#
+# TEST_BINARY is bin/http_pool_test by default, PORT 8089.
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+TEST=${1:-bin/http_pool_test}
+PORT=${2:-8089}
+
+"$ROOT/scripts/serve_hls.sh" --test --port "$PORT" > /dev/null 2>&1 &
+SERVER_PID=$!
+# The server is python under the script: stop both.
+trap 'pkill -P $SERVER_PID; kill $SERVER_PID 2>/dev/null' EXIT
+
+for i in $(seq 50); do
+  (exec 3<> "/dev/tcp/127.0.0.1/$PORT") 2>/dev/null && break
+  sleep 0.1
+done
+
+"$TEST" "http://127.0.0.1:$PORT"
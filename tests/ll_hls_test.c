@@ -0,0 +1,151 @@
+/*
+ * Unit test of the LL-HLS side of the playlist parser: parts, preload hints,
+ * server control and the blocking reload request, over two successive
+ * reloads of a live playlist in tests/fixtures.
+ *
+ * usage: ll_hls_test [fixtures_dir]   (tests/fixtures by default)
+ */
+#include "model/m3u8.h"
+#include "check.h"
+#include <limits.h>
+
+#define BASE_URL "http://live.example/ll/index.m3u8"
+
+static bool_t load(const char *dir, const char *name, m3u8_playlist_t *pl) {
+  char path[PATH_MAX];
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  char *text = check_read_file(path);
+  m3u8_playlist_init(pl);
+  ret_t ret = text != NULL ? m3u8_playlist_parse(pl, text, BASE_URL) : RET_FAIL;
+  free(text);
+  CHECK(ret == RET_OK);
+
+  return ret == RET_OK;
+}
+
+/* Segment 102 is being written: two parts out and a hint for the third */
+static void test_parts_in_progress(const char *dir) {
+  m3u8_playlist_t pl;
+  uint32_t nr_parts = 0;
+  bool_t complete = TRUE;
+
+  if (!load(dir, "ll_live_1.m3u8", &pl)) {
+    return;
+  }
+  CHECK(pl.part_target == 1.0);
+  CHECK(pl.can_block_reload);
+  CHECK(pl.part_hold_back == 3.0);
+  CHECK(pl.hold_back == 12.0);
+  CHECK(!pl.endlist);
+  CHECK(pl.media_sequence == 100 && pl.nr_segments == 2);
+
+  // Parts of a finished segment stay attached to it.
+  const m3u8_part_t *parts = m3u8_playlist_get_parts(&pl, 101, &nr_parts, &complete);
+  CHECK(parts != NULL && nr_parts == 4 && complete);
+  if (parts != NULL && nr_parts == 4) {
+    CHECK_STR_EQ(parts[0].uri, "http://live.example/ll/seg101.part0.m4s");
+    CHECK(parts[0].independent && !parts[1].independent && parts[2].independent);
+    CHECK(parts[3].duration == 1.0);
+    CHECK(parts[3].length == -1);
+  }
+  parts = m3u8_playlist_get_parts(&pl, 100, &nr_parts, &complete);
+  CHECK(nr_parts == 0 && complete);
+
+  parts = m3u8_playlist_get_parts(&pl, 102, &nr_parts, &complete);
+  CHECK(parts == pl.parts && nr_parts == 2 && !complete);
+  if (nr_parts == 2) {
+    CHECK_STR_EQ(parts[1].uri, "http://live.example/ll/seg102.part1.m4s");
+  }
+  CHECK_STR_EQ(pl.preload_hint.uri, "http://live.example/ll/seg102.part2.m4s");
+  CHECK(pl.preload_hint.offset == 0 && pl.preload_hint.length == -1);
+
+  // Nothing is known past the segment in progress.
+  CHECK(m3u8_playlist_get_parts(&pl, 103, &nr_parts, &complete) == NULL);
+  CHECK(nr_parts == 0 && !complete);
+  m3u8_playlist_deinit(&pl);
+}
+
+/*
+ * The reload that blocked for part 2 of segment 102: the segment is now
+ * complete and the new one is published as byte ranges of a single file.
+ */
+static void test_parts_after_blocking_reload(const char *dir) {
+  m3u8_playlist_t pl;
+  uint32_t nr_parts = 0;
+  bool_t complete = FALSE;
+
+  if (!load(dir, "ll_live_2.m3u8", &pl)) {
+    return;
+  }
+  CHECK(pl.hold_back == 0);
+  CHECK(pl.media_sequence == 101 && pl.nr_segments == 2);
+
+  const m3u8_part_t *parts = m3u8_playlist_get_parts(&pl, 102, &nr_parts, &complete);
+  CHECK(nr_parts == 3 && complete);
+  if (parts != NULL && nr_parts == 3) {
+    CHECK_STR_EQ(parts[2].uri, "http://live.example/ll/seg102.m4s");
+    CHECK(parts[0].offset == 0 && parts[0].length == 1000);
+    // A part byte range without an offset follows on from the previous part.
+    CHECK(parts[1].offset == 1000 && parts[1].length == 1200);
+    CHECK(parts[2].offset == 2200 && parts[2].length == 900);
+  }
+
+  parts = m3u8_playlist_get_parts(&pl, 103, &nr_parts, &complete);
+  CHECK(nr_parts == 1 && !complete);
+  if (parts != NULL && nr_parts == 1) {
+    // Byte ranges start over with each segment.
+    CHECK(parts[0].offset == 0 && parts[0].length == 800);
+  }
+  CHECK_STR_EQ(pl.preload_hint.uri, "http://live.example/ll/seg103.m4s");
+  CHECK(pl.preload_hint.offset == 800 && pl.preload_hint.length == -1);
+  m3u8_playlist_deinit(&pl);
+}
+
+static void test_blocking_reload_url(void) {
+  char *url = m3u8_blocking_reload_url(BASE_URL, 102, 2);
+  CHECK_STR_EQ(url, BASE_URL "?_HLS_msn=102&_HLS_part=2");
+  free(url);
+
+  url = m3u8_blocking_reload_url(BASE_URL "?token=abc", 7, 0);
+  CHECK_STR_EQ(url, BASE_URL "?token=abc&_HLS_msn=7&_HLS_part=0");
+  free(url);
+}
+
+/* Part and hint URIs are not cut short however long they are */
+static void test_long_part_uris(void) {
+  char uri[301];
+  char text[1024];
+  char expected[512];
+  m3u8_playlist_t pl;
+
+  memset(uri, 'p', sizeof(uri) - 1);
+  memcpy(uri, "part.m4s?sig=", strlen("part.m4s?sig="));
+  uri[sizeof(uri) - 1] = '\0';
+  snprintf(text, sizeof(text),
+           "#EXTM3U\n#EXT-X-TARGETDURATION:4\n#EXT-X-MEDIA-SEQUENCE:1\n"
+           "#EXT-X-PART:DURATION=1.0,URI=\"%s\"\n"
+           "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"%s\"\n",
+           uri, uri);
+  snprintf(expected, sizeof(expected), "http://live.example/ll/%s", uri);
+
+  m3u8_playlist_init(&pl);
+  CHECK(m3u8_playlist_parse(&pl, text, BASE_URL) == RET_OK);
+  CHECK(pl.nr_parts == 1);
+  if (pl.nr_parts == 1) {
+    CHECK_STR_EQ(pl.parts[0].uri, expected);
+  }
+  CHECK_STR_EQ(pl.preload_hint.uri, expected);
+  m3u8_playlist_deinit(&pl);
+}
+
+int main(int argc, char *argv[]) {
+  const char *dir = argc > 1 ? argv[1] : "tests/fixtures";
+
+  test_parts_in_progress(dir);
+  test_parts_after_blocking_reload(dir);
+  test_blocking_reload_url();
+  test_long_part_uris();
+
+  return CHECK_RESULT();
+}
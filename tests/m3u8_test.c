@@ -0,0 +1,162 @@
+/*
+ * Unit test of the playlist parser and URL resolution.
+ *
+ * usage: m3u8_test [fixtures_dir]   (tests/fixtures by default)
+ */
+#include "model/m3u8.h"
+#include "check.h"
+#include <limits.h>
+
+static void test_resolve_url(void) {
+  static const struct {
+    const char *base;
+    const char *ref;
+    const char *expected;
+  } cases[] = {
+      {"http://cdn.example/live/index.m3u8", "seg1.ts",
+       "http://cdn.example/live/seg1.ts"},
+      {"http://cdn.example/live/v1/index.m3u8", "../v2/seg1.ts",
+       "http://cdn.example/live/v1/../v2/seg1.ts"},
+      {"http://cdn.example/live/index.m3u8", "/vod/seg1.ts",
+       "http://cdn.example/vod/seg1.ts"},
+      {"http://cdn.example:8080/live/index.m3u8", "/vod/seg1.ts",
+       "http://cdn.example:8080/vod/seg1.ts"},
+      {"http://cdn.example/live/index.m3u8", "https://other.example/seg1.ts",
+       "https://other.example/seg1.ts"},
+      {"https://cdn.example/live/index.m3u8", "//edge.example/seg1.ts",
+       "https://edge.example/seg1.ts"},
+      {"http://cdn.example", "index.m3u8", "http://cdn.example/index.m3u8"},
+      // The base's query goes; the reference keeps its own.
+      {"http://cdn.example/live/index.m3u8?token=abc", "seg1.ts?sig=x",
+       "http://cdn.example/live/seg1.ts?sig=x"},
+      {"http://cdn.example/live/index.m3u8?next=/a/b", "seg1.ts",
+       "http://cdn.example/live/seg1.ts"},
+      {"http://cdn.example/live/index.m3u8?token=abc", "/vod/seg1.ts",
+       "http://cdn.example/vod/seg1.ts"},
+      // A URL in the query does not make the reference absolute.
+      {"http://cdn.example/live/index.m3u8", "seg1.ts?from=http://x/y",
+       "http://cdn.example/live/seg1.ts?from=http://x/y"},
+      {"file:///srv/hls/master.m3u8", "v1/index.m3u8",
+       "file:///srv/hls/v1/index.m3u8"},
+      {"/srv/hls/master.m3u8", "v1/index.m3u8", "/srv/hls/v1/index.m3u8"},
+  };
+
+  for (size_t i = 0; i < ARRAY_SIZE(cases); i++) {
+    char *url = m3u8_resolve_url(cases[i].base, cases[i].ref);
+    CHECK_STR_EQ(url, cases[i].expected);
+    free(url);
+  }
+}
+
+/* URIs are not cut short however long they are, as signed CDN URLs can be */
+static void test_long_uris(void) {
+  const char *base = "http://cdn.example/live/index.m3u8";
+  char uri[301];
+  char text[1024];
+  char expected[512];
+  m3u8_playlist_t pl;
+
+  memset(uri, 'a', sizeof(uri) - 1);
+  memcpy(uri, "init.mp4?sig=", strlen("init.mp4?sig="));
+  uri[sizeof(uri) - 1] = '\0';
+  snprintf(text, sizeof(text),
+           "#EXTM3U\n#EXT-X-TARGETDURATION:4\n#EXT-X-MAP:URI=\"%s\"\n"
+           "#EXTINF:4.0,\n%s\n#EXT-X-ENDLIST\n",
+           uri, uri);
+  snprintf(expected, sizeof(expected), "http://cdn.example/live/%s", uri);
+
+  m3u8_playlist_init(&pl);
+  CHECK(m3u8_playlist_parse(&pl, text, base) == RET_OK);
+  CHECK_STR_EQ(pl.map_uri, expected);
+  CHECK(pl.map_uri != NULL && strlen(pl.map_uri) == strlen(expected));
+  CHECK(pl.nr_segments == 1);
+  if (pl.nr_segments == 1) {
+    CHECK_STR_EQ(pl.segments[0].uri, expected);
+  }
+  m3u8_playlist_deinit(&pl);
+}
+
+static void test_master(const char *dir) {
+  char path[PATH_MAX];
+  m3u8_playlist_t pl;
+
+  snprintf(path, sizeof(path), "%s/master.m3u8", dir);
+  char *text = check_read_file(path);
+  CHECK(text != NULL);
+  if (text == NULL) {
+    return;
+  }
+
+  m3u8_playlist_init(&pl);
+  CHECK(m3u8_playlist_parse(&pl, text, "file:///fixtures/master.m3u8") == RET_OK);
+  CHECK(pl.is_master);
+  CHECK(pl.nr_variants == 2);
+  if (pl.nr_variants == 2) {
+    CHECK_STR_EQ(pl.variants[0].uri, "file:///fixtures/v360/index.m3u8");
+    CHECK(pl.variants[0].bandwidth == 800000);
+    CHECK(pl.variants[0].width == 640 && pl.variants[0].height == 360);
+    CHECK_STR_EQ(pl.variants[0].codecs, "avc1.4d401e,mp4a.40.2");
+    CHECK_STR_EQ(pl.variants[1].uri, "file:///hls/v720/index.m3u8?token=abc");
+    CHECK(pl.variants[1].bandwidth == 2800000);
+  }
+  m3u8_playlist_deinit(&pl);
+  free(text);
+}
+
+static void test_media(const char *dir) {
+  char path[PATH_MAX];
+  m3u8_playlist_t pl;
+
+  snprintf(path, sizeof(path), "%s/vod.m3u8", dir);
+  char *text = check_read_file(path);
+  CHECK(text != NULL);
+  if (text == NULL) {
+    return;
+  }
+
+  m3u8_playlist_init(&pl);
+  CHECK(m3u8_playlist_parse(&pl, text, "file:///fixtures/vod.m3u8") == RET_OK);
+  CHECK(!pl.is_master);
+  CHECK(pl.endlist);
+  CHECK(pl.media_sequence == 10);
+  CHECK(pl.target_duration == 4.0);
+  CHECK_STR_EQ(pl.map_uri, "file:///fixtures/init.mp4");
+  CHECK(pl.map_offset == 0 && pl.map_length == 720);
+  CHECK(pl.nr_segments == 4);
+  if (pl.nr_segments == 4) {
+    CHECK_STR_EQ(pl.segments[0].uri, "file:///fixtures/seg10.m4s");
+    CHECK(pl.segments[0].length == -1);
+    CHECK(pl.segments[1].offset == 720 && pl.segments[1].length == 1000);
+    // A byte range without an offset follows on from the previous one.
+    CHECK(pl.segments[2].offset == 1720 && pl.segments[2].length == 2000);
+    CHECK(pl.segments[2].duration == 2.5);
+    CHECK(pl.segments[3].discontinuity);
+    CHECK_STR_EQ(pl.segments[3].uri, "http://other.example/seg13.ts");
+  }
+  CHECK(m3u8_playlist_get_duration(&pl) == 14.5);
+  CHECK(m3u8_playlist_find(&pl, 12) == &pl.segments[2]);
+  CHECK(m3u8_playlist_find(&pl, 14) == NULL);
+  m3u8_playlist_deinit(&pl);
+  free(text);
+}
+
+static void test_bad_header(void) {
+  m3u8_playlist_t pl;
+
+  m3u8_playlist_init(&pl);
+  CHECK(m3u8_playlist_parse(&pl, "#EXTINF:4.0,\nseg.ts\n", "http://h/i.m3u8") ==
+        RET_FAIL);
+  m3u8_playlist_deinit(&pl);
+}
+
+int main(int argc, char *argv[]) {
+  const char *dir = argc > 1 ? argv[1] : "tests/fixtures";
+
+  test_resolve_url();
+  test_long_uris();
+  test_master(dir);
+  test_media(dir);
+  test_bad_header();
+
+  return CHECK_RESULT();
+}